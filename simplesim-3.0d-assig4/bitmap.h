@@ -120,6 +120,15 @@ typedef unsigned int *BITMAP_PTR_TYPE;
 #define BITMAP_CLEAR_P(BMAP, SZ, BIT)				\
   (!BMAP_SET_P((BMAP), (SZ), (BIT)))
 
+/* return the index of the lowest bit set in bitmap word W, which must be
+   non-zero */
+#ifdef __GNUC__
+#define BITMAP_WORD_FFS(W)	(__builtin_ctz(W))
+#else /* !__GNUC__ */
+#include <strings.h>
+#define BITMAP_WORD_FFS(W)	(ffs(W) - 1)
+#endif /* __GNUC__ */
+
 /* count the number of bits set in BMAP */
 #define BITMAP_COUNT_ONES(BMAP, SZ)				\
 ({								\
@@ -51,7 +51,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define CACHE_SSE2_TAGS
+#endif /* __SSE2__ && __GNUC__ */
 
 #include "host.h"
 #include "misc.h"
@@ -140,8 +145,6 @@
 #define BOUND_POS(N)    ((int)(MIN(MAX(0, (N)), 2147483647)))
 
 
-int indexA = 0;
-
 int getIndex(int pc){
   int temp = log_base2(sizeof(md_inst_t));
   return (pc & (1023 << temp)) >> temp;
@@ -273,6 +276,246 @@ update_way_list(struct cache_set_t *set,  /* set contained way chain */
     panic("bogus WHERE designator");
 }
 
+/* way index of block BLK within set SET */
+#define CACHE_WAY(cp, set, blk)						\
+  ((int)(((char *)(blk) - (char *)(cp)->sets[set].blks)		\
+	 / (sizeof(struct cache_blk_t)					\
+	    + ((cp)->balloc ? (cp)->bsize*sizeof(byte_t) : 0))))
+
+/* return the way among the N tags at TAGS equal to TAG, or -1 if none is */
+static int
+cache_tag_match(md_addr_t *tags, int n, md_addr_t tag)
+{
+  int i = 0;
+
+#ifdef CACHE_SSE2_TAGS
+  /* four 32-bit tags per compare, the branch folds at compile time */
+  if (sizeof(md_addr_t) == 4)
+    {
+      __m128i key = _mm_set1_epi32((int)tag);
+
+      for (; i + 4 <= n; i += 4)
+	{
+	  __m128i eq =
+	    _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(tags + i)), key);
+	  int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+
+	  if (mask)
+	    return i + __builtin_ctz(mask);
+	}
+    }
+#endif /* CACHE_SSE2_TAGS */
+
+  for (; i < n; i++)
+    {
+      if (tags[i] == tag)
+	return i;
+    }
+  return -1;
+}
+
+/* replacement policy interface for the policies that keep compact per-set
+   state in SET->REPL rather than ordering the way list: HIT is called on
+   every hit to WAY, VICTIM picks the way to replace when no way in the set
+   is invalid, FILL is called once a miss has been placed in WAY, and EVICT
+   (optional) just before a valid block in WAY is replaced */
+struct cache_repl_t {
+  void (*hit)(struct cache_t *cp, int set, int way);
+  int (*victim)(struct cache_t *cp, int set);
+  void (*fill)(struct cache_t *cp, int set, int way);
+  void (*evict)(struct cache_t *cp, int set, int way);
+};
+
+/* NRU: one reference bit per way, cleared in all other ways once every
+   way has been referenced */
+static void
+nru_hit(struct cache_t *cp, int set, int way)
+{
+  byte_t *ref = cp->sets[set].repl;
+  int i;
+
+  ref[way] = 1;
+  for (i=0; i < cp->assoc; i++)
+    {
+      if (!ref[i])
+	return;
+    }
+  for (i=0; i < cp->assoc; i++)
+    ref[i] = (i == way);
+}
+
+static int
+nru_victim(struct cache_t *cp, int set)
+{
+  byte_t *ref = cp->sets[set].repl;
+  int i;
+
+  for (i=0; i < cp->assoc; i++)
+    {
+      if (!ref[i])
+	return i;
+    }
+  panic("NRU set with all reference bits set");
+  return 0;
+}
+
+/* tree PLRU: node N (1 .. assoc-1, root 1) has children 2N and 2N+1, its
+   bit points toward the less recently used half of its subtree, leaf
+   N >= assoc is way N - assoc */
+static void
+plru_hit(struct cache_t *cp, int set, int way)
+{
+  byte_t *tree = cp->sets[set].repl;
+  int node = way + cp->assoc;
+
+  while (node > 1)
+    {
+      /* point the parent away from this subtree */
+      tree[node >> 1] = !(node & 1);
+      node >>= 1;
+    }
+}
+
+static int
+plru_victim(struct cache_t *cp, int set)
+{
+  byte_t *tree = cp->sets[set].repl;
+  int node = 1;
+
+  while (node < cp->assoc)
+    node = (node << 1) | tree[node];
+  return node - cp->assoc;
+}
+
+/* RRIP: a 2-bit re-reference prediction value per way, hits predict a
+   near re-reference, victims are ways predicted distant, ageing the whole
+   set until one is */
+static void
+rrip_hit(struct cache_t *cp, int set, int way)
+{
+  cp->sets[set].repl[way] = 0;
+}
+
+static int
+rrip_victim(struct cache_t *cp, int set)
+{
+  byte_t *rrpv = cp->sets[set].repl;
+  int i;
+
+  for (;;)
+    {
+      for (i=0; i < cp->assoc; i++)
+	{
+	  if (rrpv[i] == RRPV_MAX)
+	    return i;
+	}
+      for (i=0; i < cp->assoc; i++)
+	rrpv[i]++;
+    }
+}
+
+static void
+srrip_fill(struct cache_t *cp, int set, int way)
+{
+  cp->sets[set].repl[way] = RRPV_LONG;
+}
+
+static void
+brrip_fill(struct cache_t *cp, int set, int way)
+{
+  /* random rather than every Nth fill, which would alias with the set
+     index on sequential misses */
+  cp->sets[set].repl[way] =
+    (myrand() & (BRRIP_EPSILON-1)) == 0 ? RRPV_LONG : RRPV_MAX;
+}
+
+/* DRRIP leader sets, SRRIP where the low five set index bits equal the
+   next five, BRRIP where they equal their complement */
+#define DRRIP_SRRIP_LEADER(set)	(((set) & 31) == (((set) >> 5) & 31))
+#define DRRIP_BRRIP_LEADER(set)	(((set) & 31) == (~((set) >> 5) & 31))
+
+static void
+drrip_fill(struct cache_t *cp, int set, int way)
+{
+  int psel_max = (1 << DRRIP_PSEL_BITS) - 1;
+
+  /* fills are misses, leader set misses vote against their policy */
+  if (DRRIP_SRRIP_LEADER(set))
+    {
+      cp->drrip_psel = MIN(cp->drrip_psel + 1, psel_max);
+      srrip_fill(cp, set, way);
+    }
+  else if (DRRIP_BRRIP_LEADER(set))
+    {
+      cp->drrip_psel = MAX(cp->drrip_psel - 1, 0);
+      brrip_fill(cp, set, way);
+    }
+  else if (cp->drrip_psel > (psel_max >> 1))
+    brrip_fill(cp, set, way);
+  else
+    srrip_fill(cp, set, way);
+}
+
+/* SHiP: RRIP insertion predicted from the history of the PC signature
+   that brought the block in, blocks evicted without re-reference train
+   their signature towards distant insertion */
+extern md_addr_t get_PC();
+
+#define SHIP_SIG(pc)							\
+  ((half_t)((((pc) >> 3) ^ ((pc) >> 17)) & (SHIP_SHCT_SIZE-1)))
+
+static void
+ship_hit(struct cache_t *cp, int set, int way)
+{
+  half_t *sig = &cp->ship_sig[set * cp->assoc + way];
+
+  if (!(*sig & SHIP_REUSED))
+    {
+      *sig |= SHIP_REUSED;
+      if (cp->ship_shct[*sig & ~SHIP_REUSED] < SHIP_SHCT_MAX)
+	cp->ship_shct[*sig & ~SHIP_REUSED]++;
+    }
+  rrip_hit(cp, set, way);
+}
+
+static void
+ship_fill(struct cache_t *cp, int set, int way)
+{
+  half_t sig = SHIP_SIG(get_PC());
+
+  cp->ship_sig[set * cp->assoc + way] = sig;
+  if (cp->ship_shct[sig] == 0)
+    {
+      /* predicted dead, insert like BRRIP so that a signature whose
+	 blocks all got evicted can still show re-references */
+      brrip_fill(cp, set, way);
+    }
+  else
+    cp->sets[set].repl[way] = RRPV_LONG;
+}
+
+static void
+ship_evict(struct cache_t *cp, int set, int way)
+{
+  half_t sig = cp->ship_sig[set * cp->assoc + way];
+
+  if (!(sig & SHIP_REUSED) && cp->ship_shct[sig] > 0)
+    cp->ship_shct[sig]--;
+}
+
+static const struct cache_repl_t nru_repl =
+  { nru_hit, nru_victim, nru_hit, NULL };
+static const struct cache_repl_t plru_repl =
+  { plru_hit, plru_victim, plru_hit, NULL };
+static const struct cache_repl_t srrip_repl =
+  { rrip_hit, rrip_victim, srrip_fill, NULL };
+static const struct cache_repl_t brrip_repl =
+  { rrip_hit, rrip_victim, brrip_fill, NULL };
+static const struct cache_repl_t drrip_repl =
+  { rrip_hit, rrip_victim, drrip_fill, NULL };
+static const struct cache_repl_t ship_repl =
+  { ship_hit, rrip_victim, ship_fill, ship_evict };
+
 /* create and initialize a general cache structure */
 struct cache_t *      /* pointer to cache created */
 cache_create(char *name,    /* name of the cache */
@@ -288,7 +531,11 @@ cache_create(char *name,    /* name of the cache */
              struct cache_blk_t *blk,
              tick_t now, int prefetch),
        unsigned int hit_latency,  /* latency in cycles for a hit */
-       int prefetch_type)    /* prefetcher type */
+       int prefetch_type,    /* prefetcher type */
+       int prefetch_degree,  /* stride prefetcher degree */
+       int prefetch_distance, /* stride prefetcher look-ahead distance */
+       int nmshr,	    /* MSHRs, 0 for unlimited untimed misses */
+       int pfq_size)	    /* prefetch queue entries, used with MSHRs */
 {
   struct cache_t *cp;
   struct cache_blk_t *blk;
@@ -314,6 +561,16 @@ cache_create(char *name,    /* name of the cache */
     fatal("must specify miss/replacement functions");
   if (prefetch_type < 0)
     fatal("prefetcher type `%d'must be a positive number", prefetch_type);
+  if (prefetch_degree <= 0)
+    fatal("prefetch degree `%d' must be non-zero and positive",
+	  prefetch_degree);
+  if (prefetch_distance <= 0)
+    fatal("prefetch distance `%d' must be non-zero and positive",
+	  prefetch_distance);
+  if (nmshr < 0)
+    fatal("number of MSHRs `%d' must be a positive value", nmshr);
+  if (nmshr && pfq_size <= 0)
+    fatal("prefetch queue size `%d' must be non-zero and positive", pfq_size);
 
   /* allocate the cache structure */
   cp = (struct cache_t *)
@@ -331,12 +588,17 @@ cache_create(char *name,    /* name of the cache */
   cp->policy = policy;
   cp->hit_latency = hit_latency;
   cp->prefetch_type = prefetch_type;
-  //cp->q = NULL;
+  cp->prefetch_degree = prefetch_degree;
+  cp->prefetch_distance = prefetch_distance;
+  cp->pf_degree = prefetch_degree;
+  cp->nmshr = nmshr;
+  cp->pfq_size = pfq_size;
   /* miss/replacement functions */
   cp->blk_access_fn = blk_access_fn;
 
   /* compute derived parameters */
-  cp->hsize = CACHE_HIGHLY_ASSOC(cp) ? (assoc >> 2) : 0;
+  cp->hsize = (CACHE_HIGHLY_ASSOC(cp) && assoc > CACHE_TAGS_MAX_ASSOC
+	       ? (assoc >> 2) : 0);
   cp->blk_mask = bsize-1;
   cp->set_shift = log_base2(bsize);
   cp->set_mask = nsets-1;
@@ -376,7 +638,70 @@ cache_create(char *name,    /* name of the cache */
   if (!cp->data)
     fatal("out of virtual memory");
 
+  /* contiguous per-set tags, all ways invalid */
+  if (assoc <= CACHE_TAGS_MAX_ASSOC)
+    {
+      cp->tag_array = (md_addr_t *)malloc(nsets * assoc * sizeof(md_addr_t));
+      if (!cp->tag_array)
+	fatal("out of virtual memory");
+      for (i=0; i < nsets * assoc; i++)
+	cp->tag_array[i] = CACHE_TAG_INVALID;
+    }
+
+  /* policies with per-set state get one byte per way */
+  switch (policy)
+    {
+    case NRU: cp->repl_ops = &nru_repl; break;
+    case PLRU: cp->repl_ops = &plru_repl; break;
+    case SRRIP: cp->repl_ops = &srrip_repl; break;
+    case BRRIP: cp->repl_ops = &brrip_repl; break;
+    case DRRIP: cp->repl_ops = &drrip_repl; break;
+    case SHiP: cp->repl_ops = &ship_repl; break;
+    default: cp->repl_ops = NULL; break;
+    }
+  if (cp->repl_ops)
+    {
+      cp->repl_state = (byte_t *)calloc(nsets * assoc, sizeof(byte_t));
+      if (!cp->repl_state)
+	fatal("out of virtual memory");
+      if (policy >= SRRIP)
+	memset(cp->repl_state, RRPV_MAX, nsets * assoc);
+      cp->drrip_psel = 1 << (DRRIP_PSEL_BITS - 1);
+    }
+  if (policy == SHiP)
+    {
+      cp->ship_sig = (half_t *)calloc(nsets * assoc, sizeof(half_t));
+      cp->ship_shct = (byte_t *)malloc(SHIP_SHCT_SIZE);
+      if (!cp->ship_sig || !cp->ship_shct)
+	fatal("out of virtual memory");
+      /* start out weakly predicting re-reference */
+      memset(cp->ship_shct, 1, SHIP_SHCT_SIZE);
+    }
+
   /* ECE552 Assignment 4 - BEGIN CODE */
+
+  // MSHR file, plus a prefetch queue if this cache prefetches
+  if (nmshr)
+    {
+      cp->mshr = (struct cache_mshr_t *)
+	calloc(nmshr, sizeof(struct cache_mshr_t));
+      if (!cp->mshr)
+	fatal("out of virtual memory");
+      if (prefetch_type != 0)
+	{
+	  cp->pfq = (md_addr_t *)calloc(pfq_size, sizeof(md_addr_t));
+	  if (!cp->pfq)
+	    fatal("out of virtual memory");
+	}
+    }
+
+  // shadow tags for prefetch pollution detection
+  if (prefetch_type != 0)
+    {
+      cp->pf_shadow = (md_addr_t *)calloc(PF_SHADOW_ENTRIES, sizeof(md_addr_t));
+      if (!cp->pf_shadow)
+	fatal("out of virtual memory");
+    }
   
   // initialize RPT
   
@@ -389,6 +714,8 @@ cache_create(char *name,    /* name of the cache */
     rpt_table[i].prev_addr = 0;
     rpt_table[i].stride = 0;
     rpt_table[i].state = INITIAL_STATE;
+    rpt_table[i].last_now = 0;
+    rpt_table[i].interval = 0.0;
    }
    cp->rpt = rpt_table;
    
@@ -402,10 +729,17 @@ cache_create(char *name,    /* name of the cache */
     rpt_table[i].prev_addr = 0;
     rpt_table[i].stride = 0;
     rpt_table[i].state = INITIAL_STATE;
+    rpt_table[i].last_now = 0;
+    rpt_table[i].interval = 0.0;
     
    }
    cp->rpt = rpt_table;
-   
+
+   /* miss-correlation table, filled in by demand misses */
+   cp->corr = (struct corr_entry *)calloc(CORR_ENTRIES, sizeof(struct corr_entry));
+   if (!cp->corr)
+     fatal("out of virtual memory");
+   cp->corr_last = 0;
   }
     
     /* ECE552 Assignment 4 - END CODE */
@@ -429,6 +763,8 @@ cache_create(char *name,    /* name of the cache */
    otherwise, block accesses through SET->BLKS will fail (used
    during random replacement selection) */
       cp->sets[i].blks = CACHE_BINDEX(cp, cp->data, bindex);
+      cp->sets[i].repl = cp->repl_state ? cp->repl_state + i*assoc : NULL;
+      cp->sets[i].tags = cp->tag_array ? cp->tag_array + i*assoc : NULL;
       
       /* link the data blocks into ordered way chain and hash table bucket
          chains, if hash table exists */
@@ -471,6 +807,12 @@ cache_char2policy(char c)    /* replacement policy as a char */
   case 'l': return LRU;
   case 'r': return Random;
   case 'f': return FIFO;
+  case 'n': return NRU;
+  case 'p': return PLRU;
+  case 's': return SRRIP;
+  case 'b': return BRRIP;
+  case 'd': return DRRIP;
+  case 'h': return SHiP;
   default: fatal("bogus replacement policy, `%c'", c);
   }
 }
@@ -489,8 +831,25 @@ cache_config(struct cache_t *cp,  /* cache instance */
     cp->policy == LRU ? "LRU"
     : cp->policy == Random ? "Random"
     : cp->policy == FIFO ? "FIFO"
+    : cp->policy == NRU ? "NRU"
+    : cp->policy == PLRU ? "PLRU"
+    : cp->policy == SRRIP ? "SRRIP"
+    : cp->policy == BRRIP ? "BRRIP"
+    : cp->policy == DRRIP ? "DRRIP"
+    : cp->policy == SHiP ? "SHiP"
     : (abort(), ""),
     cp->prefetch_type);
+  if (cp->nmshr)
+    fprintf(stream,
+	    "cache: %s: %d MSHRs, %d entry prefetch queue\n",
+	    cp->name, cp->nmshr, cp->pfq ? cp->pfq_size : 0);
+  if (cp->prefetch_type > 2)
+    fprintf(stream,
+	    "cache: %s: stride prefetch degree %d, distance %d\n",
+	    cp->name, cp->prefetch_degree, cp->prefetch_distance);
+  if (cp->inclusion != NINE)
+    fprintf(stream, "cache: %s: %s of the level(s) above\n", cp->name,
+	    cp->inclusion == Inclusive ? "inclusive" : "exclusive");
 }
 
 /* register cache stats */
@@ -553,48 +912,225 @@ cache_reg_stats(struct cache_t *cp,  /* cache instance */
   stat_reg_counter(sdb, buf, "total number of prefetch hits", &cp->prefetch_hits, 0, NULL);
   sprintf(buf, "%s.prefetch_misses", name);
   stat_reg_counter(sdb, buf, "total number of prefetch misses", &cp->prefetch_misses, 0, NULL);
+  sprintf(buf, "%s.prefetch_useful", name);
+  stat_reg_counter(sdb, buf, "prefetched blocks later hit by a demand access", &cp->prefetch_useful, 0, NULL);
+  sprintf(buf, "%s.prefetch_late", name);
+  stat_reg_counter(sdb, buf, "useful prefetches that arrived after the demand access", &cp->prefetch_late, 0, NULL);
+  sprintf(buf, "%s.prefetch_unused", name);
+  stat_reg_counter(sdb, buf, "prefetched blocks evicted before any demand access", &cp->prefetch_unused, 0, NULL);
+  sprintf(buf, "%s.prefetch_pollution", name);
+  stat_reg_counter(sdb, buf, "demand misses to blocks evicted by a prefetch", &cp->prefetch_pollution, 0, NULL);
+  if (cp->nmshr)
+    {
+      sprintf(buf, "%s.mshr_stalls", name);
+      stat_reg_counter(sdb, buf, "demand misses that waited for a free MSHR", &cp->mshr_stalls, 0, NULL);
+    }
+  if (cp->pfq)
+    {
+      sprintf(buf, "%s.pfq_drops", name);
+      stat_reg_counter(sdb, buf, "prefetches dropped on a full prefetch queue", &cp->pfq_drops, 0, NULL);
+      sprintf(buf, "%s.pfq_merges", name);
+      stat_reg_counter(sdb, buf, "queued prefetches taken over by a demand miss", &cp->pfq_merges, 0, NULL);
+    }
+  sprintf(buf, "%s.prefetch_accuracy", name);
+  sprintf(buf1, "%s.prefetch_useful / %s.prefetch_misses", name, name);
+  stat_reg_formula(sdb, buf, "fraction of issued prefetches that were useful", buf1, NULL);
+  sprintf(buf, "%s.prefetch_coverage", name);
+  sprintf(buf1, "%s.prefetch_useful / (%s.prefetch_useful + %s.misses)", name, name, name);
+  stat_reg_formula(sdb, buf, "fraction of would-be misses removed by prefetching", buf1, NULL);
+  sprintf(buf, "%s.prefetch_lateness", name);
+  sprintf(buf1, "%s.prefetch_late / %s.prefetch_useful", name, name);
+  stat_reg_formula(sdb, buf, "fraction of useful prefetches that were late", buf1, NULL);
+  sprintf(buf, "%s.prefetch_pollution_rate", name);
+  sprintf(buf1, "%s.prefetch_pollution / %s.misses", name, name);
+  stat_reg_formula(sdb, buf, "fraction of demand misses caused by prefetch pollution", buf1, NULL);
 
 
 }
 
 /* ECE552 Assignment 4 - BEGIN CODE */
 
-md_addr_t nextQ (struct cache_t *cp, md_addr_t addr) {
-  int i;
-  for (i = 0; i < MAX_Q; ++i) {
-    if (cp->q[i] == addr) {
-      int idx = (i+1)%MAX_Q;
-      return cp->q[idx];
+/* prefetch shadow tag slot for block address BADDR */
+#define PF_SHADOW(cp, baddr)						\
+  (&(cp)->pf_shadow[((baddr) >> (cp)->set_shift) & (PF_SHADOW_ENTRIES-1)])
+
+/* miss-correlation table entry for block address BADDR */
+#define CORR_ENTRY(cp, baddr)						\
+  (&(cp)->corr[(((baddr) >> (cp)->set_shift)				\
+		^ ((baddr) >> ((cp)->set_shift + 12))) & (CORR_ENTRIES-1)])
+
+/* record a demand miss to block BADDR as a successor of the previous one */
+static void
+corr_miss(struct cache_t *cp, md_addr_t baddr)
+{
+  struct corr_entry *ent;
+  int i, victim = 0;
+
+  if (cp->corr_last != 0 && cp->corr_last != baddr)
+    {
+      ent = CORR_ENTRY(cp, cp->corr_last);
+      if (ent->tag != cp->corr_last)
+	{
+	  /* claim the entry, dropping whatever block aliased into it */
+	  memset(ent, 0, sizeof(*ent));
+	  ent->tag = cp->corr_last;
+	}
+
+      /* strengthen BADDR and age the other successors, else replace the
+	 weakest successor with it */
+      for (i=0; i < CORR_SUCCS; i++)
+	{
+	  if (ent->succ[i] == baddr && ent->conf[i] > 0)
+	    break;
+	  if (ent->conf[i] < ent->conf[victim])
+	    victim = i;
+	}
+      if (i < CORR_SUCCS)
+	{
+	  int j;
+
+	  for (j=0; j < CORR_SUCCS; j++)
+	    {
+	      if (j == i)
+		ent->conf[j] = MIN(ent->conf[j] + 1, CORR_CONF_MAX);
+	      else if (ent->conf[j] > 1)
+		ent->conf[j]--;
+	    }
+	}
+      else
+	{
+	  ent->succ[victim] = baddr;
+	  ent->conf[victim] = 1;
+	}
     }
-  }
-  return 0;
+  cp->corr_last = baddr;
+}
+
+/* fill CAND with the blocks predicted to miss after block BADDR, strongest
+   first, returns the number of candidates */
+static int
+corr_predict(struct cache_t *cp, md_addr_t baddr, md_addr_t cand[CORR_SUCCS])
+{
+  struct corr_entry *ent = CORR_ENTRY(cp, baddr);
+  int i, n = 0, best = 0;
+
+  if (ent->tag != baddr)
+    return 0;
+
+  for (i=1; i < CORR_SUCCS; i++)
+    {
+      if (ent->conf[i] > ent->conf[best])
+	best = i;
+    }
+  if (ent->conf[best] == 0)
+    return 0;
+  cand[n++] = ent->succ[best];
+
+  for (i=0; i < CORR_SUCCS; i++)
+    {
+      if (i != best && ent->conf[i] >= CORR_CONF_PREFETCH)
+	cand[n++] = ent->succ[i];
+    }
+  return n;
 }
 
 /* ECE552 Assignment 4 - END CODE */
 
+/* return the MSHR of CP that frees up first, and in *NFREE (if non-NULL)
+   the number of MSHRs free at time NOW */
+static struct cache_mshr_t *
+mshr_earliest(struct cache_t *cp, tick_t now, int *nfree)
+{
+  struct cache_mshr_t *mshr = &cp->mshr[0];
+  int i, n = 0;
+
+  for (i=0; i < cp->nmshr; i++)
+    {
+      if (cp->mshr[i].ready <= now)
+	n++;
+      if (cp->mshr[i].ready < mshr->ready)
+	mshr = &cp->mshr[i];
+    }
+  if (nfree)
+    *nfree = n;
+  return mshr;
+}
+
+/* issue queued prefetches, oldest first, while the bus to the next level
+   and an MSHR (other than the last one, kept for demand misses) are free */
+static void
+pfq_drain(struct cache_t *cp, tick_t now)
+{
+  md_addr_t baddr;
+  int nfree;
+
+  while (cp->pfq_num > 0)
+    {
+      baddr = cp->pfq[cp->pfq_head];
+      if (baddr != 0)
+	{
+	  mshr_earliest(cp, now, &nfree);
+	  if (nfree <= (cp->nmshr > 1) || cp->bus_free > now)
+	    break;
+	  if (!cache_probe(cp, baddr))
+	    cache_access(cp, Read, baddr, NULL, cp->bsize, now,
+			 NULL, NULL, CACHE_PF_OWN);
+	}
+      cp->pfq_head = (cp->pfq_head + 1) % cp->pfq_size;
+      cp->pfq_num--;
+    }
+}
+
+/* request a prefetch of the block containing ADDR into cache CP, issued at
+   once without MSHRs, else queued until an MSHR and the bus are free */
+void
+cache_prefetch(struct cache_t *cp, md_addr_t addr, tick_t now)
+{
+  md_addr_t baddr = CACHE_BADDR(cp, addr);
+  int i;
+
+  if (cache_probe(cp, baddr))
+    return;
+
+  if (!cp->pfq)
+    {
+      cache_access(cp, Read, baddr, NULL, cp->bsize, now, NULL, NULL,
+		   CACHE_PF_OWN);
+      return;
+    }
+
+  for (i=0; i < cp->pfq_num; i++)
+    {
+      if (cp->pfq[(cp->pfq_head + i) % cp->pfq_size] == baddr)
+	return;
+    }
+  if (cp->pfq_num == cp->pfq_size)
+    {
+      cp->pfq_drops++;
+      return;
+    }
+  cp->pfq[(cp->pfq_head + cp->pfq_num) % cp->pfq_size] = baddr;
+  cp->pfq_num++;
+}
+
 /* Next Line Prefetcher */
-void next_line_prefetcher(struct cache_t *cp, md_addr_t addr) {
+void next_line_prefetcher(struct cache_t *cp, md_addr_t addr, tick_t now) {
   /* ECE552 Assignment 4 - BEGIN CODE */
-  md_addr_t nextAddr = addr + cp->bsize;
-  md_addr_t nextTagSet = CACHE_TAGSET(cp, nextAddr);
-  
-  bool_t probe = cache_probe(cp, nextTagSet);
-  
-  if (!probe){
-    cache_access(cp, Read, nextTagSet, NULL, cp->bsize, NULL, NULL, NULL, 1);
-  }
+  cache_prefetch(cp, addr + cp->bsize, now);
   /* ECE552 Assignment 4 - END CODE */
 }
 int counter = 0;
 /* Open Ended Prefetcher */
-void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
+void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr, tick_t now) {
   int pc = get_PC();
   int rpt_index = getIndex(pc);//RPT_INDEX(pc,cp);
   md_addr_t tag = getTag(pc);//RPT_TAG(pc,cp);
   struct rpt_entry * this_rpt_entry = &(cp->rpt[rpt_index]);
   int new_state;
   int new_stride;
-  md_addr_t addr_next = 0;
+  int use_corr = FALSE;
+  md_addr_t cand[CORR_SUCCS];
+  int i, ncand = 0;
 
   // Scenario 1: if no corresponding entry in RPT
   
@@ -603,7 +1139,9 @@ void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
     this_rpt_entry->prev_addr = addr;
     this_rpt_entry->stride = 0;
     this_rpt_entry->state = INITIAL_STATE;
-    addr_next = nextQ(cp, addr);
+    new_stride = 0;
+    new_state = INITIAL_STATE;
+    use_corr = TRUE;
   }
   else { // Scenario 2: Tag found
     // calculate stride
@@ -627,29 +1165,29 @@ void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
       } else if(this_rpt_entry->state == NO_PREDICTION_STATE){
         new_state = TRANSIENT_STATE;
         new_stride = this_rpt_entry->stride;
-        addr_next = nextQ(cp, addr);
+        use_corr = TRUE;
       }
     }
     else { // stride mismatch
       if(this_rpt_entry->state == STEADY_STATE){
         new_state = INITIAL_STATE;
         new_stride = this_rpt_entry->stride;
-        addr_next = nextQ(cp, addr);
+        use_corr = TRUE;
       }
       else if(this_rpt_entry->state == INITIAL_STATE){
         new_state = TRANSIENT_STATE;
         new_stride = temp_stride;
-        addr_next = nextQ(cp, addr);
+        use_corr = TRUE;
       }
       else if(this_rpt_entry->state == TRANSIENT_STATE){
         new_state = NO_PREDICTION_STATE;
         new_stride = temp_stride;
-        addr_next = nextQ(cp, addr);
+        use_corr = TRUE;
       }
       else if(this_rpt_entry->state == NO_PREDICTION_STATE){
         new_state = NO_PREDICTION_STATE;
         new_stride = temp_stride;
-        addr_next = nextQ(cp, addr);
+        use_corr = TRUE;
       }
     }
   }
@@ -657,14 +1195,14 @@ void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
   this_rpt_entry->stride = new_stride;
   this_rpt_entry->state = new_state;
 
-  if (addr_next == 0){
-    addr_next = addr + this_rpt_entry->stride;
-  }
+  /* prefer the correlated successors, fall back to the stride */
+  if (use_corr)
+    ncand = corr_predict(cp, CACHE_TAGSET(cp, addr), cand);
+  if (ncand == 0)
+    cand[ncand++] = addr + this_rpt_entry->stride;
 
-  md_addr_t nextTagSet = CACHE_TAGSET(cp, addr_next);
-  if (!cache_probe(cp, nextTagSet)){
-    cache_access(cp, Read, nextTagSet, NULL, cp->bsize, NULL, NULL, NULL, 1);
-  }
+  for (i=0; i < ncand; i++)
+    cache_prefetch(cp, cand[i], now);
 }
 
 int get_rpt_index(int addr, struct cache_t *cp){
@@ -673,8 +1211,33 @@ int get_rpt_index(int addr, struct cache_t *cp){
   return index;
 }
 
+/* adjust the stride prefetch degree to the accuracy of the prefetches
+   issued since the last adjustment */
+static void
+stride_throttle(struct cache_t *cp)
+{
+  counter_t issued = cp->prefetch_misses - cp->pf_win_misses;
+  counter_t useful = cp->prefetch_useful - cp->pf_win_useful;
+
+  if (issued < PF_THROTTLE_WINDOW)
+    return;
+
+  if (useful * 100 >= issued * PF_ACC_HIGH)
+    {
+      if (cp->pf_degree < cp->prefetch_degree)
+	cp->pf_degree++;
+    }
+  else if (useful * 100 < issued * PF_ACC_LOW)
+    {
+      if (cp->pf_degree > 1)
+	cp->pf_degree--;
+    }
+  cp->pf_win_misses = cp->prefetch_misses;
+  cp->pf_win_useful = cp->prefetch_useful;
+}
+
 /* Stride Prefetcher */
-void stride_prefetcher(struct cache_t *cp, md_addr_t addr) {
+void stride_prefetcher(struct cache_t *cp, md_addr_t addr, tick_t now) {
   /* ECE552 Assignment 4 - BEGIN CODE*/
 
   
@@ -693,6 +1256,8 @@ void stride_prefetcher(struct cache_t *cp, md_addr_t addr) {
     this_rpt_entry->prev_addr = addr;
     this_rpt_entry->stride = 0;
     this_rpt_entry->state = INITIAL_STATE;
+    this_rpt_entry->last_now = now;
+    this_rpt_entry->interval = 0.0;
     
   } else { // Scenario 2: Tag found
     
@@ -744,14 +1309,31 @@ void stride_prefetcher(struct cache_t *cp, md_addr_t addr) {
     this_rpt_entry->prev_addr = addr;
     this_rpt_entry->stride = new_stride;
     this_rpt_entry->state = new_state;
+    if (now >= this_rpt_entry->last_now)
+      this_rpt_entry->interval = (3.0 * this_rpt_entry->interval
+				  + (double)(now - this_rpt_entry->last_now)) / 4.0;
+    this_rpt_entry->last_now = now;
     
-    // prefetch
-    md_addr_t nextTagSet = CACHE_TAGSET(cp, addr + this_rpt_entry->stride);
-
-    if(this_rpt_entry->state != NO_PREDICTION_STATE){
-      if(!cache_probe(cp, nextTagSet)){
-        cache_access(cp, Read, CACHE_BADDR(cp, (addr + this_rpt_entry->stride)), NULL, cp->bsize, NULL, NULL, NULL, 1);
+    // prefetch: one block ahead while the stride is still being confirmed,
+    // once steady, up to pf_degree blocks starting far enough ahead to hide
+    // the average miss latency
+    if(this_rpt_entry->state != NO_PREDICTION_STATE && this_rpt_entry->stride != 0){
+      int distance = 1, degree = 1, k;
+
+      if (this_rpt_entry->state == STEADY_STATE) {
+        distance = cp->prefetch_distance;
+        if (this_rpt_entry->interval > 0.0) {
+          double ahead = cp->miss_lat / this_rpt_entry->interval;
+
+          if (ahead < (double)distance)
+            distance = MAX(1, (int)ahead + ((double)(int)ahead < ahead));
+        }
+        degree = cp->pf_degree;
       }
+
+      for (k = 0; k < degree; k++)
+        cache_prefetch(cp, addr + (distance + k) * this_rpt_entry->stride, now);
+      stride_throttle(cp);
     }
   }
   
@@ -761,7 +1343,7 @@ void stride_prefetcher(struct cache_t *cp, md_addr_t addr) {
 
 
 /* cache x might generate a prefetch after a regular cache access to address addr */
-void generate_prefetch(struct cache_t *cp, md_addr_t addr) {
+void generate_prefetch(struct cache_t *cp, md_addr_t addr, tick_t now) {
 
   switch(cp->prefetch_type) {
     case 0:
@@ -770,17 +1352,20 @@ void generate_prefetch(struct cache_t *cp, md_addr_t addr) {
        break;
     case 1:
        // Next Line Prefetcher
-       next_line_prefetcher(cp, addr);
+       next_line_prefetcher(cp, addr, now);
        break;
     case 2:
        // Open Ended Prefetcher
-       open_ended_prefetcher(cp, addr);
+       open_ended_prefetcher(cp, addr, now);
        break;
     default:
        // Stride Prefetcher with cp->prefetch_type number of entries in the Reference Prediction Table (RPT)
-       stride_prefetcher(cp, addr);
+       stride_prefetcher(cp, addr, now);
   }
 
+  /* send what the prefetcher asked for, as far as resources allow */
+  if (cp->pfq)
+    pfq_drain(cp, now);
 }
 
 //md_addr_t get_PC();
@@ -803,6 +1388,103 @@ cache_stats(struct cache_t *cp,    /* cache instance */
     (double)cp->invalidations/sum);
 }
 
+/* select the way of set SET to replace, for the way list policies the
+   block is moved to the head of the list */
+static int
+cache_victim(struct cache_t *cp,	/* cache to replace a block of */
+	     md_addr_t set)		/* set to replace a block of */
+{
+  struct cache_blk_t *repl;
+  int way;
+
+  switch (cp->policy) {
+  case LRU:
+  case FIFO:
+    repl = cp->sets[set].way_tail;
+    update_way_list(&cp->sets[set], repl, Head);
+    return CACHE_WAY(cp, set, repl);
+  case Random:
+    return myrand() & (cp->assoc - 1);
+  default:
+    if (!cp->repl_ops)
+      panic("bogus replacement policy");
+
+    /* fill invalid ways first, else ask the policy */
+    for (way=0; way < cp->assoc; way++)
+      {
+	if (!(CACHE_BINDEX(cp, cp->sets[set].blks, way)->status
+	      & CACHE_BLK_VALID))
+	  return way;
+      }
+    return cp->repl_ops->victim(cp, set);
+  }
+}
+
+/* evict block REPL, way WAY of set SET, to make room for a fill at NOW,
+   the eviction hook gets it first, then it is written back if dirty,
+   returns the latency until the fill may start */
+static unsigned int
+cache_evict(struct cache_t *cp,		/* cache to evict from */
+	    md_addr_t set,		/* set of the block */
+	    int way,			/* way of the block */
+	    struct cache_blk_t *repl,	/* block to evict */
+	    md_addr_t *repl_addr,	/* for address of replaced block */
+	    int prefetch,		/* fill is a prefetch? */
+	    tick_t now)			/* time of the fill */
+{
+  md_addr_t baddr;
+  int dirty, lat = 0;
+
+  /* remove this block from the hash bucket chain, if hash exists */
+  if (cp->hsize)
+    unlink_htab_ent(cp, &cp->sets[set], repl);
+
+  /* blow away the last block to hit */
+  cp->last_tagset = 0;
+  cp->last_blk = NULL;
+
+  if (!(repl->status & CACHE_BLK_VALID))
+    return 0;
+
+  baddr = CACHE_MK_BADDR(cp, repl->tag, set);
+  cp->replacements++;
+  if (repl_addr)
+    *repl_addr = baddr;
+
+  if (repl->status & CACHE_BLK_PREFETCHED)
+    cp->prefetch_unused++;
+  if (cp->repl_ops && cp->repl_ops->evict)
+    cp->repl_ops->evict(cp, set, way);
+  if (prefetch && cp->pf_shadow)
+    *PF_SHADOW(cp, baddr) = baddr;
+
+  /* don't replace the block until outstanding misses are satisfied */
+  lat += BOUND_POS(repl->ready - now);
+
+  /* stall until the bus to next level of memory is available */
+  lat += BOUND_POS(cp->bus_free - (now + lat));
+
+  /* track bus resource usage */
+  cp->bus_free = MAX(cp->bus_free, (now + lat)) + 1;
+
+  /* the block is gone before the hook or the write back run, so nothing
+     they set off finds it here */
+  dirty = (repl->status & CACHE_BLK_DIRTY) != 0;
+  repl->status &= ~(CACHE_BLK_VALID|CACHE_BLK_DIRTY|CACHE_BLK_PREFETCHED);
+  if (cp->tag_array)
+    cp->sets[set].tags[way] = CACHE_TAG_INVALID;
+
+  if (cp->evict_fn)
+    dirty = cp->evict_fn(cp, baddr, dirty, now+lat);
+  if (dirty)
+    {
+      /* write back the cache block */
+      cp->writebacks++;
+      lat += cp->blk_access_fn(Write, baddr, cp->bsize, repl, now+lat, 0);
+    }
+  return lat;
+}
+
 /* access a cache, perform a CMD operation on cache CP at address ADDR,
    places NBYTES of data at *P, returns latency of operation if initiated
    at NOW, places pointer to block user data in *UDATA, *P is untouched if
@@ -824,7 +1506,8 @@ cache_access(struct cache_t *cp,  /* cache to access */
   md_addr_t set = CACHE_SET(cp, addr);
   md_addr_t bofs = CACHE_BLK(cp, addr);
   struct cache_blk_t *blk, *repl;
-  int lat = 0;
+  struct cache_mshr_t *mshr = NULL;
+  int lat = 0, way = 0;
 
   /* default replacement address */
   if (repl_addr)
@@ -842,6 +1525,10 @@ cache_access(struct cache_t *cp,  /* cache to access */
 
   /* permissions are checked on cache misses */
 
+  /* queued prefetches go out as MSHRs and the bus free up */
+  if (cp->pfq && prefetch == 0)
+    pfq_drain(cp, now);
+
   /* check for a fast hit: access to same block */
   if (CACHE_TAGSET(cp, addr) == cp->last_tagset)
     {
@@ -850,7 +1537,18 @@ cache_access(struct cache_t *cp,  /* cache to access */
       goto cache_fast_hit;
     }
     
-  if (cp->hsize)
+  if (cp->tag_array)
+    {
+      /* search the set's tag array */
+      int hway = cache_tag_match(cp->sets[set].tags, cp->assoc, tag);
+
+      if (hway >= 0)
+  {
+    blk = CACHE_BINDEX(cp, cp->sets[set].blks, hway);
+    goto cache_hit;
+  }
+    }
+  else if (cp->hsize)
     {
       /* higly-associativity cache, access through the per-set hash tables */
       int hindex = CACHE_HASH(cp, tag);
@@ -886,75 +1584,95 @@ cache_access(struct cache_t *cp,  /* cache to access */
   cp->read_misses++;
      }
      if (cp->prefetch_type == 2) {
-      cp->q[indexA] = addr;
-      indexA = (indexA + 1)%MAX_Q;
+      corr_miss(cp, CACHE_TAGSET(cp, addr));
      }
   }
   else {
      cp->prefetch_misses++;
   }
 
+  /* a demand miss takes over a prefetch of the same block still queued */
+  if (cp->pfq && prefetch == 0) {
+     int i;
 
-  /* select the appropriate block to replace, and re-link this entry to
-     the appropriate place in the way list */
-  switch (cp->policy) {
-  case LRU:
-  case FIFO:
-    repl = cp->sets[set].way_tail;
-    update_way_list(&cp->sets[set], repl, Head);
-    break;
-  case Random:
-    {
-      int bindex = myrand() & (cp->assoc - 1);
-      repl = CACHE_BINDEX(cp, cp->sets[set].blks, bindex);
-    }
-    break;
-  default:
-    panic("bogus replacement policy");
-  }
+     for (i=0; i < cp->pfq_num; i++) {
+       md_addr_t *qent = &cp->pfq[(cp->pfq_head + i) % cp->pfq_size];
 
-  /* remove this block from the hash bucket chain, if hash exists */
-  if (cp->hsize)
-    unlink_htab_ent(cp, &cp->sets[set], repl);
+       if (*qent == CACHE_BADDR(cp, addr)) {
+         *qent = 0;
+         cp->pfq_merges++;
+         break;
+       }
+     }
+  }
 
-  /* blow away the last block to hit */
-  cp->last_tagset = 0;
-  cp->last_blk = NULL;
+  /* a miss on a block a prefetch pushed out is a pollution miss, either
+     way the block is coming back in */
+  if (cp->pf_shadow) {
+     md_addr_t *shadow = PF_SHADOW(cp, CACHE_TAGSET(cp, addr));
 
-  /* write back replaced block data */
-  if (repl->status & CACHE_BLK_VALID)
-    {
-      cp->replacements++;
+     if (*shadow == CACHE_TAGSET(cp, addr)) {
+       if (prefetch == 0)
+         cp->prefetch_pollution++;
+       *shadow = 0;
+     }
+  }
 
-      if (repl_addr)
-  *repl_addr = CACHE_MK_BADDR(cp, repl->tag, set);
- 
-      /* don't replace the block until outstanding misses are satisfied */
-      lat += BOUND_POS(repl->ready - now);
- 
-      /* stall until the bus to next level of memory is available */
-      lat += BOUND_POS(cp->bus_free - (now + lat));
- 
-      /* track bus resource usage */
-      cp->bus_free = MAX(cp->bus_free, (now + lat)) + 1;
 
-      if (repl->status & CACHE_BLK_DIRTY)
-  {
-    /* write back the cache block */
-    cp->writebacks++;
-    lat += cp->blk_access_fn(Write,
-           CACHE_MK_BADDR(cp, repl->tag, set),
-           cp->bsize, repl, now+lat, 0);
-  }
+  /* an Exclusive cache does not fill on reads from the level above, the
+     block moves up there and only comes back here once evicted */
+  if (cp->inclusion == Exclusive && cmd == Read && prefetch != CACHE_PF_OWN)
+    {
+      lat = cp->blk_access_fn(Read, CACHE_BADDR(cp, addr), cp->bsize,
+			      NULL, now, prefetch != 0);
+      if (prefetch == 0)
+	{
+	  cp->miss_lat = (7.0 * cp->miss_lat + (double)lat) / 8.0;
+	  generate_prefetch(cp, addr, now);
+	}
+      return lat;
     }
 
+  /* select the appropriate block to replace, and write it back */
+  way = cache_victim(cp, set);
+  repl = CACHE_BINDEX(cp, cp->sets[set].blks, way);
+  lat += cache_evict(cp, set, way, repl, repl_addr, prefetch, now);
+
   /* update block tags */
   repl->tag = tag;
   repl->status = CACHE_BLK_VALID;  /* dirty bit set on update */
+  if (cp->tag_array)
+    cp->sets[set].tags[way] = tag;
+  if (prefetch)
+    repl->status |= CACHE_BLK_PREFETCHED;
+  if (cp->repl_ops)
+    cp->repl_ops->fill(cp, set, way);
+
+  /* the fill needs an MSHR, wait for the first to free up if all are
+     busy, then the request takes a cycle on the bus to the next level */
+  if (cp->nmshr)
+    {
+      mshr = mshr_earliest(cp, now+lat, NULL);
+      if (mshr->ready > now+lat)
+  {
+    if (prefetch == 0)
+      cp->mshr_stalls++;
+    lat = mshr->ready - now;
+  }
+      lat += BOUND_POS(cp->bus_free - (now + lat));
+      cp->bus_free = MAX(cp->bus_free, (now + lat)) + 1;
+    }
 
   /* read data block */
   lat += cp->blk_access_fn(Read, CACHE_BADDR(cp, addr), cp->bsize,
-         repl, now+lat, prefetch);
+         repl, now+lat, prefetch != 0);
+
+  /* the MSHR is held until the fill completes */
+  if (mshr)
+    {
+      mshr->baddr = CACHE_BADDR(cp, addr);
+      mshr->ready = now+lat;
+    }
 
   /* copy data out of cache block */
   if (cp->balloc)
@@ -978,7 +1696,8 @@ cache_access(struct cache_t *cp,  /* cache to access */
     link_htab_ent(cp, &cp->sets[set], repl);
 
   if (prefetch == 0) {  /* only regular cache accesses can generate a prefetch */
-    generate_prefetch(cp, addr);
+    cp->miss_lat = (7.0 * cp->miss_lat + (double)lat) / 8.0;
+    generate_prefetch(cp, addr, now);
   }
 
   /* return latency of the operation */
@@ -995,6 +1714,13 @@ cache_access(struct cache_t *cp,  /* cache to access */
      if (cmd == Read) {  
      cp->read_hits++;
      }
+     if (blk->status & CACHE_BLK_PREFETCHED) {
+       blk->status &= ~CACHE_BLK_PREFETCHED;
+       cp->prefetch_useful++;
+       /* untimed simulators (e.g., sim-cache) access at NOW = 0 */
+       if (now != 0 && blk->ready > now)
+         cp->prefetch_late++;
+     }
   }
   else {
      cp->prefetch_hits++;
@@ -1017,6 +1743,8 @@ cache_access(struct cache_t *cp,  /* cache to access */
       /* move this block to head of the way (MRU) list */
       update_way_list(&cp->sets[set], blk, Head);
     }
+  else if (cp->repl_ops)
+    cp->repl_ops->hit(cp, set, CACHE_WAY(cp, set, blk));
 
   /* tag is unchanged, so hash links (if they exist) are still valid */
 
@@ -1029,7 +1757,7 @@ cache_access(struct cache_t *cp,  /* cache to access */
     *udata = blk->user_data;
 
   if (prefetch == 0) {  /* only regular cache accesses can generate a prefetch */
-  generate_prefetch(cp, addr);
+  generate_prefetch(cp, addr, now);
   }
 
 
@@ -1046,6 +1774,13 @@ cache_access(struct cache_t *cp,  /* cache to access */
      if (cmd == Read) {  
         cp->read_hits++;
      }
+     if (blk->status & CACHE_BLK_PREFETCHED) {
+       blk->status &= ~CACHE_BLK_PREFETCHED;
+       cp->prefetch_useful++;
+       /* untimed simulators (e.g., sim-cache) access at NOW = 0 */
+       if (now != 0 && blk->ready > now)
+         cp->prefetch_late++;
+     }
   }
   else {
      cp->prefetch_hits++;
@@ -1062,7 +1797,8 @@ cache_access(struct cache_t *cp,  /* cache to access */
   if (cmd == Write)
     blk->status |= CACHE_BLK_DIRTY;
 
-  /* this block hit last, no change in the way list */
+  /* this block hit last, no change in the way list, nor in per-set
+     replacement state as any miss in between clears the last block */
 
   /* tag is unchanged, so hash links (if they exist) are still valid */
 
@@ -1075,7 +1811,7 @@ cache_access(struct cache_t *cp,  /* cache to access */
   cp->last_blk = blk;
 
   if (prefetch == 0) {  /* only regular cache accesses can generate a prefetch */
-     generate_prefetch(cp, addr);
+     generate_prefetch(cp, addr, now);
   }
 
   /* return first cycle data is available to access */
@@ -1095,7 +1831,9 @@ cache_probe(struct cache_t *cp,    /* cache instance to probe */
 
   /* permissions are checked on cache misses */
 
-  if (cp->hsize)
+  if (cp->tag_array)
+    return cache_tag_match(cp->sets[set].tags, cp->assoc, tag) >= 0;
+  else if (cp->hsize)
   {
     /* higly-associativity cache, access through the per-set hash tables */
     int hindex = CACHE_HASH(cp, tag);
@@ -1137,6 +1875,11 @@ cache_flush(struct cache_t *cp,    /* cache instance to flush */
   cp->last_blk = NULL;
 
   /* no way list updates required because all blocks are being invalidated */
+  if (cp->tag_array)
+    {
+      for (i=0; i < cp->nsets * cp->assoc; i++)
+	cp->tag_array[i] = CACHE_TAG_INVALID;
+    }
   for (i=0; i<cp->nsets; i++)
     {
 
@@ -1145,7 +1888,9 @@ cache_flush(struct cache_t *cp,    /* cache instance to flush */
     if (blk->status & CACHE_BLK_VALID)
       {
         cp->invalidations++;
-        blk->status &= ~CACHE_BLK_VALID;
+        if (blk->status & CACHE_BLK_PREFETCHED)
+          cp->prefetch_unused++;
+        blk->status &= ~(CACHE_BLK_VALID|CACHE_BLK_PREFETCHED);
 
         if (blk->status & CACHE_BLK_DIRTY)
     {
@@ -1175,7 +1920,19 @@ cache_flush_addr(struct cache_t *cp,  /* cache instance to flush */
   struct cache_blk_t *blk;
   int lat = cp->hit_latency; /* min latency to probe cache */
 
-  if (cp->hsize)
+  if (cp->tag_array)
+    {
+      /* search the set's tag array, invalidating the way found */
+      int way = cache_tag_match(cp->sets[set].tags, cp->assoc, tag);
+
+      blk = NULL;
+      if (way >= 0)
+  {
+    blk = CACHE_BINDEX(cp, cp->sets[set].blks, way);
+    cp->sets[set].tags[way] = CACHE_TAG_INVALID;
+  }
+    }
+  else if (cp->hsize)
     {
       /* higly-associativity cache, access through the per-set hash tables */
       int hindex = CACHE_HASH(cp, tag);
@@ -1203,7 +1960,9 @@ cache_flush_addr(struct cache_t *cp,  /* cache instance to flush */
   if (blk)
     {
       cp->invalidations++;
-      blk->status &= ~CACHE_BLK_VALID;
+      if (blk->status & CACHE_BLK_PREFETCHED)
+        cp->prefetch_unused++;
+      blk->status &= ~(CACHE_BLK_VALID|CACHE_BLK_PREFETCHED);
 
       /* blow away the last block to hit */
       cp->last_tagset = 0;
@@ -1225,3 +1984,285 @@ cache_flush_addr(struct cache_t *cp,  /* cache instance to flush */
   return lat;
 }
 
+
+/* return the valid block of set SET with tag TAG in cache CP, else NULL */
+static struct cache_blk_t *
+cache_find_blk(struct cache_t *cp,	/* cache to search */
+	       md_addr_t set,		/* set to search */
+	       md_addr_t tag)		/* tag to search for */
+{
+  struct cache_blk_t *blk;
+
+  if (cp->tag_array)
+    {
+      int way = cache_tag_match(cp->sets[set].tags, cp->assoc, tag);
+
+      return way >= 0 ? CACHE_BINDEX(cp, cp->sets[set].blks, way) : NULL;
+    }
+  else if (cp->hsize)
+    {
+      for (blk=cp->sets[set].hash[CACHE_HASH(cp, tag)];
+	   blk;
+	   blk=blk->hash_next)
+	{
+	  if (blk->tag == tag && (blk->status & CACHE_BLK_VALID))
+	    return blk;
+	}
+    }
+  else
+    {
+      for (blk=cp->sets[set].way_head; blk; blk=blk->way_next)
+	{
+	  if (blk->tag == tag && (blk->status & CACHE_BLK_VALID))
+	    return blk;
+	}
+    }
+  return NULL;
+}
+
+/* place the block containing ADDR into cache CP without accessing the next
+   level, e.g., a block evicted by the level above into a victim or
+   Exclusive cache, marked dirty if DIRTY, a block already present is only
+   marked dirty, returns the latency of the replacement made */
+unsigned int				/* latency of the fill */
+cache_fill(struct cache_t *cp,		/* cache instance to fill */
+	   md_addr_t addr,		/* address of block to place */
+	   int dirty,			/* block is dirty? */
+	   tick_t now)			/* time of the fill */
+{
+  md_addr_t tag = CACHE_TAG(cp, addr);
+  md_addr_t set = CACHE_SET(cp, addr);
+  struct cache_blk_t *repl;
+  int way, lat;
+
+  repl = cache_find_blk(cp, set, tag);
+  if (repl)
+    {
+      if (dirty)
+	repl->status |= CACHE_BLK_DIRTY;
+      return 0;
+    }
+
+  way = cache_victim(cp, set);
+  repl = CACHE_BINDEX(cp, cp->sets[set].blks, way);
+  lat = cache_evict(cp, set, way, repl, NULL, FALSE, now);
+
+  repl->tag = tag;
+  repl->status = CACHE_BLK_VALID | (dirty ? CACHE_BLK_DIRTY : 0);
+  repl->ready = now+lat;
+  if (cp->tag_array)
+    cp->sets[set].tags[way] = tag;
+  if (cp->repl_ops)
+    cp->repl_ops->fill(cp, set, way);
+  if (cp->hsize)
+    link_htab_ent(cp, &cp->sets[set], repl);
+
+  return lat;
+}
+
+/* remove the block containing ADDR from cache CP without writing it back,
+   counted as an invalidation if INVAL, else the block is moving to another
+   level, returns -1 if the block is not present, else non-zero if it was
+   dirty */
+int					/* -1, or block was dirty? */
+cache_remove_addr(struct cache_t *cp,	/* cache instance */
+		  md_addr_t addr,	/* address of block to remove */
+		  int inval)		/* count an invalidation? */
+{
+  md_addr_t set = CACHE_SET(cp, addr);
+  struct cache_blk_t *blk;
+  int dirty;
+
+  blk = cache_find_blk(cp, set, CACHE_TAG(cp, addr));
+  if (!blk)
+    return -1;
+
+  if (inval)
+    {
+      cp->invalidations++;
+      if (blk->status & CACHE_BLK_PREFETCHED)
+	cp->prefetch_unused++;
+    }
+  dirty = (blk->status & CACHE_BLK_DIRTY) != 0;
+  blk->status &= ~(CACHE_BLK_VALID|CACHE_BLK_DIRTY|CACHE_BLK_PREFETCHED);
+  if (cp->tag_array)
+    cp->sets[set].tags[CACHE_WAY(cp, set, blk)] = CACHE_TAG_INVALID;
+
+  /* blow away the last block to hit */
+  cp->last_tagset = 0;
+  cp->last_blk = NULL;
+
+  /* move this block to tail of the way (LRU) list */
+  update_way_list(&cp->sets[set], blk, Tail);
+
+  return dirty;
+}
+
+/* mark the block containing ADDR in cache CP shared with other caches if
+   SHARED, a dirty block becomes clean and the caller writes it back, else
+   mark it owned by CP alone, returns -1 if the block is not present, else
+   its status before the change */
+int					/* -1, or old block status */
+cache_mark_shared(struct cache_t *cp,	/* cache instance */
+		  md_addr_t addr,	/* address of block to mark */
+		  int shared)		/* shared with other caches? */
+{
+  struct cache_blk_t *blk;
+  int status;
+
+  blk = cache_find_blk(cp, CACHE_SET(cp, addr), CACHE_TAG(cp, addr));
+  if (!blk)
+    return -1;
+
+  status = blk->status;
+  if (shared)
+    blk->status = (blk->status & ~CACHE_BLK_DIRTY) | CACHE_BLK_SHARED;
+  else
+    blk->status &= ~CACHE_BLK_SHARED;
+  return status;
+}
+
+/* create a stack-distance engine for BSIZE-byte blocks, tracking every
+   power-of-two set count from MIN_SETS to MAX_SETS and associativity up
+   to MAX_ASSOC */
+struct cache_sdist_t *
+cache_sdist_create(char *name,		/* name of the engine */
+		   int bsize,		/* block size in bytes */
+		   int min_sets,	/* smallest set count */
+		   int max_sets,	/* largest set count */
+		   int max_assoc)	/* largest associativity */
+{
+  struct cache_sdist_t *sd;
+  int l, i;
+
+  if (bsize <= 0 || (bsize & (bsize-1)) != 0)
+    fatal("stack distance block size `%d' must be a positive power of two",
+	  bsize);
+  if (min_sets <= 0 || (min_sets & (min_sets-1)) != 0
+      || max_sets < min_sets || (max_sets & (max_sets-1)) != 0)
+    fatal("stack distance set counts `%d:%d' must be powers of two, "
+	  "smallest first", min_sets, max_sets);
+  if (max_assoc <= 0 || (max_assoc & (max_assoc-1)) != 0)
+    fatal("stack distance associativity `%d' must be a positive power "
+	  "of two", max_assoc);
+
+  sd = (struct cache_sdist_t *)calloc(1, sizeof(struct cache_sdist_t));
+  if (!sd)
+    fatal("out of virtual memory");
+
+  sd->name = mystrdup(name);
+  sd->bsize = bsize;
+  sd->bshift = log_base2(bsize);
+  sd->min_sets = min_sets;
+  sd->max_sets = max_sets;
+  sd->max_assoc = max_assoc;
+  sd->nlevels = log_base2(max_sets) - log_base2(min_sets) + 1;
+  sd->nassocs = log_base2(max_assoc) + 1;
+
+  sd->stacks = (md_addr_t **)calloc(sd->nlevels, sizeof(md_addr_t *));
+  sd->misses = (counter_t *)calloc(sd->nlevels * sd->nassocs,
+				   sizeof(counter_t));
+  if (!sd->stacks || !sd->misses)
+    fatal("out of virtual memory");
+
+  for (l=0; l < sd->nlevels; l++)
+    {
+      int n = (min_sets << l) * max_assoc;
+
+      sd->stacks[l] = (md_addr_t *)malloc(n * sizeof(md_addr_t));
+      if (!sd->stacks[l])
+	fatal("out of virtual memory");
+      for (i=0; i < n; i++)
+	sd->stacks[l][i] = CACHE_TAG_INVALID;
+    }
+
+  return sd;
+}
+
+/* print stack-distance engine configuration */
+void
+cache_sdist_config(struct cache_sdist_t *sd,	/* engine instance */
+		   FILE *stream)		/* output stream */
+{
+  fprintf(stream,
+	  "stack distance: %s: %d-byte blocks, %d to %d sets, "
+	  "1 to %d ways, LRU\n",
+	  sd->name, sd->bsize, sd->min_sets, sd->max_sets, sd->max_assoc);
+}
+
+/* register stack-distance engine stats, the misses and miss rate of
+   every tracked configuration */
+void
+cache_sdist_reg_stats(struct cache_sdist_t *sd,	/* engine instance */
+		      struct stat_sdb_t *sdb)	/* stats database */
+{
+  char buf[512], buf1[512], buf2[512];
+  int l, k;
+
+  sprintf(buf, "%s.refs", sd->name);
+  stat_reg_counter(sdb, buf, "total number of references", &sd->refs, 0,
+		   NULL);
+
+  for (l=0; l < sd->nlevels; l++)
+    {
+      int nsets = sd->min_sets << l;
+
+      for (k=0; k < sd->nassocs; k++)
+	{
+	  int assoc = 1 << k;
+
+	  sprintf(buf, "%s.%dx%d.misses", sd->name, nsets, assoc);
+	  sprintf(buf1, "misses, %d sets x %d ways (%d bytes)",
+		  nsets, assoc, nsets * assoc * sd->bsize);
+	  stat_reg_counter(sdb, buf, buf1,
+			   &sd->misses[l * sd->nassocs + k], 0, NULL);
+	  sprintf(buf, "%s.%dx%d.miss_rate", sd->name, nsets, assoc);
+	  sprintf(buf2, "%s.%dx%d.misses / %s.refs",
+		  sd->name, nsets, assoc, sd->name);
+	  stat_reg_formula(sdb, buf, "miss rate (i.e., misses/ref)", buf2,
+			   NULL);
+	}
+    }
+}
+
+/* account a reference to ADDR in every tracked configuration */
+void
+cache_sdist_access(struct cache_sdist_t *sd,	/* engine instance */
+		   md_addr_t addr)		/* address of access */
+{
+  md_addr_t baddr = addr >> sd->bshift;
+  int l, k, depth;
+
+  sd->refs++;
+
+  for (l=0; l < sd->nlevels; l++)
+    {
+      md_addr_t *stack = sd->stacks[l]
+	+ (baddr & ((md_addr_t)(sd->min_sets << l) - 1)) * sd->max_assoc;
+      counter_t *misses = sd->misses + l * sd->nassocs;
+
+      depth = cache_tag_match(stack, sd->max_assoc, baddr);
+
+      /* the block is MRU here, so it is MRU at every larger set count */
+      if (depth == 0)
+	break;
+
+      if (depth < 0)
+	{
+	  /* deeper than any tracked associativity, drop the LRU block */
+	  for (k=0; k < sd->nassocs; k++)
+	    misses[k]++;
+	  depth = sd->max_assoc - 1;
+	}
+      else
+	{
+	  /* caches of DEPTH ways or fewer miss */
+	  for (k=0; (1 << k) <= depth; k++)
+	    misses[k]++;
+	}
+
+      /* move the block to the top of the stack */
+      memmove(stack + 1, stack, depth * sizeof(md_addr_t));
+      stack[0] = baddr;
+    }
+}
@@ -98,12 +98,47 @@
    speed block access, this macro decides if a cache is "highly associative" */
 #define CACHE_HIGHLY_ASSOC(cp)  ((cp)->assoc > 4)
 
+/* caches of up to CACHE_TAGS_MAX_ASSOC ways instead keep each set's tags in
+   a contiguous array, searched with vector compares where the host has
+   them, invalid ways hold CACHE_TAG_INVALID, which no real tag can equal
+   as blocks are at least 8 bytes */
+#define CACHE_TAGS_MAX_ASSOC  64
+#define CACHE_TAG_INVALID  (~(md_addr_t)0)
+
 /* ECE552 Assignment 4 - BEGIN CODE*/
 #define STEADY_STATE 3
 #define INITIAL_STATE 2
 #define TRANSIENT_STATE 1
 #define NO_PREDICTION_STATE 0
-#define MAX_Q 8192
+
+/* open-ended prefetcher miss-correlation (Markov) table: CORR_ENTRIES
+   direct-mapped entries indexed by a hash of the miss block address, each
+   remembering up to CORR_SUCCS blocks that missed next, with a saturating
+   confidence counter per successor */
+#define CORR_ENTRIES 4096      /* must be a power of two */
+#define CORR_SUCCS 4
+#define CORR_CONF_MAX 3
+#define CORR_CONF_PREFETCH 2  /* confidence needed to prefetch a successor
+				 other than the strongest one */
+
+/* stride prefetcher throttling: every PF_THROTTLE_WINDOW prefetches sent to
+   the next level, the prefetch degree is raised if at least PF_ACC_HIGH
+   percent of them were used by demand accesses, and lowered if fewer than
+   PF_ACC_LOW percent were */
+#define PF_THROTTLE_WINDOW 256
+#define PF_ACC_HIGH 75
+#define PF_ACC_LOW 40
+
+/* prefetch pollution detection: blocks evicted by prefetch fills are
+   remembered in a direct-mapped shadow tag array of PF_SHADOW_ENTRIES
+   block addresses, a later demand miss on one of them is a pollution miss */
+#define PF_SHADOW_ENTRIES 1024	/* must be a power of two */
+
+/* miss status holding register, tracks one outstanding block fill */
+struct cache_mshr_t {
+  md_addr_t baddr;	/* block being filled */
+  tick_t ready;		/* time the fill completes, MSHR is free after */
+};
 
 struct rpt_entry {
 
@@ -111,22 +146,75 @@ struct rpt_entry {
   md_addr_t prev_addr;
   int stride;
   int state;
+  tick_t last_now;	/* time of the last access by this PC */
+  double interval;	/* average time between accesses by this PC */
 
 };
+
+struct corr_entry {
+  md_addr_t tag;		/* miss block address, 0 if entry unused */
+  md_addr_t succ[CORR_SUCCS];	/* block addresses that missed next */
+  int conf[CORR_SUCCS];		/* confidence of each successor, 0 = empty */
+};
   
 /* ECE552 Assignment 4 - END CODE*/
 
-/* cache replacement policy */
+/* cache replacement policy, LRU, Random and FIFO order the way list, the
+   others keep compact per-set state, see struct cache_repl_t in cache.c */
 enum cache_policy {
   LRU,    /* replace least recently used block (perfect LRU) */
   Random,  /* replace a random block */
-  FIFO    /* replace the oldest block in the set */
+  FIFO,    /* replace the oldest block in the set */
+  NRU,    /* replace a block not recently used (one bit per block) */
+  PLRU,    /* tree pseudo-LRU (assoc-1 bits per set) */
+  SRRIP,  /* static re-reference interval prediction (2 bits per block) */
+  BRRIP,  /* bimodal RRIP, inserts mostly at distant re-reference */
+  DRRIP,  /* set-dueling between SRRIP and BRRIP */
+  SHiP    /* SRRIP with insertion predicted by the accessing PC */
 };
 
+/* re-reference prediction values, RRIP policies */
+#define RRPV_MAX    3    /* distant re-reference, replace first */
+#define RRPV_LONG    2    /* SRRIP insertion value */
+
+/* BRRIP inserts at RRPV_LONG with probability 1/BRRIP_EPSILON */
+#define BRRIP_EPSILON    32    /* must be a power of two */
+
+/* DRRIP set dueling: leader sets per policy are picked by the low five
+   set index bits, PSEL is a DRRIP_PSEL_BITS bit saturating counter */
+#define DRRIP_PSEL_BITS    10
+
+/* SHiP signature history counter table, SHIP_SHCT_SIZE 3-bit counters
+   indexed by a hash of the PC that brought the block in */
+#define SHIP_SHCT_SIZE    16384  /* must be a power of two */
+#define SHIP_SHCT_MAX    7
+#define SHIP_REUSED    0x8000  /* signature flag, block was re-referenced */
+
+
+/* inclusion policy of a cache towards the level(s) above it: NINE (neither
+   inclusive nor exclusive) caches fill on every miss from above, Inclusive
+   caches additionally have their user's evict_fn back-invalidate evicted
+   blocks above, Exclusive caches hold only blocks the level above evicted
+   into them with cache_fill(), reads from above pass through a miss and
+   take the block out on a hit (see cache_remove_addr()) */
+enum cache_inclusion {
+  NINE,			/* non-inclusive non-exclusive */
+  Inclusive,		/* contents above are a subset */
+  Exclusive		/* contents above and here are disjoint */
+};
+
+/* cache_access() PREFETCH value of a cache's own prefetches, which fill
+   even an Exclusive cache, prefetches from the level above pass 1 */
+#define CACHE_PF_OWN	2
 
 /* block status values */
 #define CACHE_BLK_VALID    0x00000001  /* block in valid, in use */
 #define CACHE_BLK_DIRTY    0x00000002  /* dirty block */
+#define CACHE_BLK_PREFETCHED 0x00000004 /* filled by a prefetch, not yet
+					   touched by a demand access */
+#define CACHE_BLK_SHARED   0x00000008  /* other caches may hold the block,
+					  kept by coherent users, see
+					  cache_mark_shared() */
 
 /* cache block (or line) definition */
 struct cache_blk_t
@@ -162,8 +250,14 @@ struct cache_set_t
   struct cache_blk_t *blks;  /* cache blocks, allocated sequentially, so
            this pointer can also be used for random
            access to cache blocks */
+  byte_t *repl;      /* per-way replacement state (NRU bit, RRPV or
+           PLRU tree node), NULL for way list policies */
+  md_addr_t *tags;    /* per-way tags, see CACHE_TAGS_MAX_ASSOC */
 };
 
+/* replacement policy operations, defined in cache.c */
+struct cache_repl_t;
+
 /* cache definition */
 struct cache_t
 {
@@ -183,6 +277,12 @@ struct cache_t
   enum cache_policy policy;  /* cache replacement policy */
   unsigned int hit_latency;  /* cache hit latency */
   int prefetch_type;    /* prefetcher type */
+  const struct cache_repl_t *repl_ops; /* per-set state replacement policy,
+           NULL for LRU, Random and FIFO */
+  int prefetch_degree;    /* max stride prefetches issued per access */
+  int prefetch_distance;  /* max stride prefetch look-ahead, in strides */
+  enum cache_inclusion inclusion; /* policy towards the level above, NINE
+				     unless set after cache_create() */
 
   /* miss/replacement handler, read/write BSIZE bytes starting at BADDR
      from/into cache block BLK, returns the latency of the operation
@@ -201,6 +301,17 @@ struct cache_t
          tick_t now,    /* when fetch was initiated */
          int prefetch);    /* 1 if the access is a prefetch, 0 if it is not */
 
+  /* eviction hook, NULL unless set after cache_create(), called for every
+     valid block BADDR replaced by a miss or cache_fill() with DIRTY set if
+     the block is dirty, returns non-zero if the block must still be
+     written back with BLK_ACCESS_FN, zero if the hook took care of it
+     (e.g., moved it into a victim or exclusive cache) */
+  int
+    (*evict_fn)(struct cache_t *cp,	/* cache evicting the block */
+		md_addr_t baddr,	/* address of the evicted block */
+		int dirty,		/* block is dirty? */
+		tick_t now);		/* time of the eviction */
+
   /* derived data, for fast decoding */
   int hsize;      /* cache set hash table size */
   md_addr_t blk_mask;
@@ -233,6 +344,16 @@ struct cache_t
 
   counter_t prefetch_hits;  /* total number of prefetch accesses that are hits */ 
   counter_t prefetch_misses;  /* total number of prefetch accesses that miss in this cache */
+  counter_t prefetch_useful;  /* prefetched blocks later hit by a demand access */
+  counter_t prefetch_late;  /* useful prefetches whose fill was still in flight */
+  counter_t prefetch_unused;  /* prefetched blocks evicted before any use */
+  counter_t prefetch_pollution;  /* demand misses on blocks evicted by prefetches */
+
+  /* stride prefetcher feedback */
+  int pf_degree;		/* current degree, after accuracy throttling */
+  counter_t pf_win_misses;	/* prefetch_misses at start of throttle window */
+  counter_t pf_win_useful;	/* prefetch_useful at start of throttle window */
+  double miss_lat;		/* average demand miss latency */
 
 
 
@@ -241,9 +362,35 @@ struct cache_t
   struct cache_blk_t *last_blk;  /* cache block last accessed */
 
   /* ECE552 Assignment 4 - BEGIN CODE */
-  md_addr_t q[MAX_Q];
+  struct corr_entry *corr;	/* miss-correlation table, prefetch_type 2
+				   only, else NULL */
+  md_addr_t corr_last;		/* block address of the last demand miss */
+  md_addr_t *pf_shadow;		/* blocks evicted by prefetch fills, NULL
+				   if this cache does not prefetch */
+
+  /* miss status holding registers and prefetch request queue, if NMSHR is
+     zero outstanding misses are unlimited and prefetches issue at once */
+  int nmshr;			/* number of MSHRs */
+  struct cache_mshr_t *mshr;	/* MSHR file */
+  int pfq_size;			/* prefetch queue capacity */
+  int pfq_head, pfq_num;	/* oldest queued prefetch, queue occupancy */
+  md_addr_t *pfq;		/* queued prefetch block addresses, 0 if
+				   claimed by a demand miss */
+  counter_t mshr_stalls;	/* demand misses that waited for an MSHR */
+  counter_t pfq_drops;		/* prefetches dropped, queue was full */
+  counter_t pfq_merges;		/* queued prefetches taken by demand misses */
   /* ECE552 Assignment 4 - END CODE */
 
+  /* tags of all sets, see set->tags, NULL if the cache is too associative
+     and looks blocks up through the way list or hash tables */
+  md_addr_t *tag_array;
+
+  /* replacement policy state */
+  byte_t *repl_state;    /* per-way state of all sets, see set->repl */
+  half_t *ship_sig;    /* SHiP per-way signature and SHIP_REUSED flag */
+  byte_t *ship_shct;    /* SHiP signature history counters */
+  int drrip_psel;    /* DRRIP policy selector, high favours BRRIP */
+
   /* data blocks */
   byte_t *data;      /* pointer to data blocks allocation */
 
@@ -267,7 +414,11 @@ cache_create(char *name,    /* name of the cache */
              struct cache_blk_t *blk,
              tick_t now, int prefetch),
        unsigned int hit_latency,/* latency in cycles for a hit */
-       int prefetch_type);      /* the type of the prefetcher for this cache */  
+       int prefetch_type,      /* the type of the prefetcher for this cache */
+       int prefetch_degree,    /* stride prefetcher degree */
+       int prefetch_distance,  /* stride prefetcher look-ahead distance */
+       int nmshr,	      /* MSHRs, 0 for unlimited untimed misses */
+       int pfq_size);	      /* prefetch queue entries, used with MSHRs */
 
 /* parse policy */
 enum cache_policy      /* replacement policy enum */
@@ -294,16 +445,20 @@ void cache_stats(struct cache_t *cp, FILE *stream);
 /* figure out what type of prefetcher is used by this cache and
    call the appropriate function to generate the prefetch (e.g., next_line_prefetcher) */
 
-void generate_prefetch(struct cache_t *cp, md_addr_t addr);
+void generate_prefetch(struct cache_t *cp, md_addr_t addr, tick_t now);
 
 /* Next Line Prefetcher */
-void next_line_prefetcher(struct cache_t *cp, md_addr_t addr);
+void next_line_prefetcher(struct cache_t *cp, md_addr_t addr, tick_t now);
 
 /* Stride Prefetcher */
-void stride_prefetcher(struct cache_t *cp, md_addr_t addr);
+void stride_prefetcher(struct cache_t *cp, md_addr_t addr, tick_t now);
 
 /* Opend Ended Prefetcher */
-void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr);
+void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr, tick_t now);
+
+/* request a prefetch of the block containing ADDR into cache CP, issued at
+   once without MSHRs, else queued until an MSHR and the bus are free */
+void cache_prefetch(struct cache_t *cp, md_addr_t addr, tick_t now);
 
 /* access a cache, perform a CMD operation on cache CP at address ADDR,
    places NBYTES of data at *P, returns latency of operation if initiated
@@ -355,5 +510,81 @@ cache_flush_addr(struct cache_t *cp,  /* cache instance to flush */
      md_addr_t addr,  /* address of block to flush */
      tick_t now);    /* time of cache flush */
 
+/* place the block containing ADDR into cache CP without accessing the next
+   level, e.g., a block evicted by the level above into a victim or
+   Exclusive cache, marked dirty if DIRTY, a block already present is only
+   marked dirty, returns the latency of the replacement made */
+unsigned int				/* latency of the fill */
+cache_fill(struct cache_t *cp,		/* cache instance to fill */
+	   md_addr_t addr,		/* address of block to place */
+	   int dirty,			/* block is dirty? */
+	   tick_t now);			/* time of the fill */
+
+/* remove the block containing ADDR from cache CP without writing it back,
+   counted as an invalidation if INVAL, else the block is moving to another
+   level, returns -1 if the block is not present, else non-zero if it was
+   dirty */
+int					/* -1, or block was dirty? */
+cache_remove_addr(struct cache_t *cp,	/* cache instance */
+		  md_addr_t addr,	/* address of block to remove */
+		  int inval);		/* count an invalidation? */
+
+/* mark the block containing ADDR in cache CP shared with other caches if
+   SHARED, a dirty block becomes clean and the caller writes it back, else
+   mark it owned by CP alone, returns -1 if the block is not present, else
+   its status before the change */
+int					/* -1, or old block status */
+cache_mark_shared(struct cache_t *cp,	/* cache instance */
+		  md_addr_t addr,	/* address of block to mark */
+		  int shared);		/* shared with other caches? */
+
+/* single-pass LRU stack-distance simulation (Mattson et al.): one LRU
+   stack of MAX_ASSOC block addresses per set for every power-of-two set
+   count from MIN_SETS to MAX_SETS, a reference at stack depth D hits in
+   every cache of that set count with more than D ways, so one pass over
+   the reference stream gives the misses of all these configurations */
+struct cache_sdist_t
+{
+  char *name;			/* stack-distance engine name */
+  int bsize;			/* block size in bytes */
+  int bshift;			/* log2(bsize) */
+  int min_sets, max_sets;	/* range of set counts, powers of two */
+  int max_assoc;		/* deepest stack tracked, a power of two */
+  int nlevels;			/* number of set counts tracked */
+  int nassocs;			/* associativities tracked, 1..MAX_ASSOC */
+  md_addr_t **stacks;		/* per set count, MAX_ASSOC block addresses
+				   per set with the MRU block first, unused
+				   entries are CACHE_TAG_INVALID */
+  counter_t refs;		/* references seen */
+  counter_t *misses;		/* misses of NSETS x ASSOC caches, indexed
+				   [level * nassocs + log2(assoc)] */
+};
+
+/* create a stack-distance engine for BSIZE-byte blocks, tracking every
+   power-of-two set count from MIN_SETS to MAX_SETS and associativity up
+   to MAX_ASSOC */
+struct cache_sdist_t *
+cache_sdist_create(char *name,		/* name of the engine */
+		   int bsize,		/* block size in bytes */
+		   int min_sets,	/* smallest set count */
+		   int max_sets,	/* largest set count */
+		   int max_assoc);	/* largest associativity */
+
+/* print stack-distance engine configuration */
+void
+cache_sdist_config(struct cache_sdist_t *sd,	/* engine instance */
+		   FILE *stream);		/* output stream */
+
+/* register stack-distance engine stats, the misses and miss rate of
+   every tracked configuration */
+void
+cache_sdist_reg_stats(struct cache_sdist_t *sd,	/* engine instance */
+		      struct stat_sdb_t *sdb);	/* stats database */
+
+/* account a reference to ADDR in every tracked configuration */
+void
+cache_sdist_access(struct cache_sdist_t *sd,	/* engine instance */
+		   md_addr_t addr);		/* address of access */
+
 #endif /* CACHE_H */
 
@@ -0,0 +1,407 @@
+/* dram.c - main memory (DRAM) model routines */
+
+/* SimpleScalar(TM) Tool Suite
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ * All Rights Reserved. 
+ * 
+ * THIS IS A LEGAL DOCUMENT, BY USING SIMPLESCALAR,
+ * YOU ARE AGREEING TO THESE TERMS AND CONDITIONS.
+ * 
+ * No portion of this work may be used by any commercial entity, or for any
+ * commercial purpose, without the prior, written permission of SimpleScalar,
+ * LLC (info@simplescalar.com). Nonprofit and noncommercial use is permitted
+ * as described below.
+ * 
+ * 1. SimpleScalar is provided AS IS, with no warranty of any kind, express
+ * or implied. The user of the program accepts full responsibility for the
+ * application of the program and the use of any results.
+ * 
+ * 2. Nonprofit and noncommercial use is encouraged. SimpleScalar may be
+ * downloaded, compiled, executed, copied, and modified solely for nonprofit,
+ * educational, noncommercial research, and noncommercial scholarship
+ * purposes provided that this notice in its entirety accompanies all copies.
+ * Copies of the modified software can be delivered to persons who use it
+ * solely for nonprofit, educational, noncommercial research, and
+ * noncommercial scholarship purposes provided that this notice in its
+ * entirety accompanies all copies.
+ * 
+ * 3. ALL COMMERCIAL USE, AND ALL USE BY FOR PROFIT ENTITIES, IS EXPRESSLY
+ * PROHIBITED WITHOUT A LICENSE FROM SIMPLESCALAR, LLC (info@simplescalar.com).
+ * 
+ * 4. No nonprofit user may place any restrictions on the use of this software,
+ * including as modified by the user, by any other authorized user.
+ * 
+ * 5. Noncommercial and nonprofit users may distribute copies of SimpleScalar
+ * in compiled or executable form as set forth in Section 2, provided that
+ * either: (A) it is accompanied by the corresponding machine-readable source
+ * code, or (B) it is accompanied by a written offer, with no time limit, to
+ * give anyone a machine-readable copy of the corresponding source code in
+ * return for reimbursement of the cost of distribution. This written offer
+ * must permit verbatim duplication by anyone, or (C) it is distributed by
+ * someone who received only the executable form, and is accompanied by a
+ * copy of the written offer of source code.
+ * 
+ * 6. SimpleScalar was developed by Todd M. Austin, Ph.D. The tool suite is
+ * currently maintained by SimpleScalar LLC (info@simplescalar.com). US Mail:
+ * 2395 Timbercrest Court, Ann Arbor, MI 48105.
+ * 
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "memory.h"
+#include "stats.h"
+#include "dram.h"
+
+/* decode a block address into channel, bank and row */
+#define DRAM_CHAN(DP, ADDR)						\
+  (((ADDR) >> (DP)->col_shift) & ((DP)->nchan - 1))
+#define DRAM_BANK(DP, ADDR)						\
+  (((ADDR) >> ((DP)->col_shift + (DP)->chan_shift)) & ((DP)->nbanks - 1))
+#define DRAM_ROW(DP, ADDR)						\
+  ((ADDR) >> ((DP)->col_shift + (DP)->chan_shift + (DP)->bank_shift))
+
+/* bus cycles to transfer NBYTES */
+#define DRAM_XFER(DP, NBYTES)						\
+  ((((NBYTES) + (DP)->bus_width - 1) / (DP)->bus_width) * (DP)->xfer_lat)
+
+/* create a DRAM main memory */
+struct dram_t *				/* DRAM instance */
+dram_create(char *name,			/* memory name */
+	    int nchan,			/* number of channels */
+	    int nbanks,			/* banks per channel */
+	    int row_size,		/* row buffer size, in bytes */
+	    int bus_width,		/* data bus width, in bytes */
+	    int xfer_lat,		/* bus cycles per bus width */
+	    int t_rcd,			/* activate to column access */
+	    int t_cas,			/* column access to data */
+	    int t_rp,			/* precharge to activate */
+	    int t_ras,			/* activate to precharge */
+	    enum dram_page_policy page,	/* row buffer policy */
+	    enum dram_sched_policy sched,/* scheduling policy */
+	    int rq_size,		/* read queue entries per channel */
+	    int wq_size)		/* write queue entries per channel */
+{
+  struct dram_t *dp;
+  int i;
+
+  /* check all parameters */
+  if (nchan <= 0 || (nchan & (nchan-1)) != 0)
+    fatal("DRAM channels `%d' must be non-zero and a power of two", nchan);
+  if (nbanks <= 0 || (nbanks & (nbanks-1)) != 0)
+    fatal("DRAM banks `%d' must be non-zero and a power of two", nbanks);
+  if (row_size <= 0 || (row_size & (row_size-1)) != 0)
+    fatal("DRAM row size `%d' must be non-zero and a power of two",
+	  row_size);
+  if (bus_width <= 0 || xfer_lat <= 0)
+    fatal("DRAM bus width and transfer latency must be non-zero and "
+	  "positive");
+  if (t_rcd <= 0 || t_cas <= 0 || t_rp <= 0 || t_ras <= 0)
+    fatal("DRAM timings must be non-zero and positive");
+  if (rq_size <= 0 || wq_size <= 0)
+    fatal("DRAM read and write queue sizes must be non-zero and positive");
+
+  dp = (struct dram_t *)calloc(1, sizeof(struct dram_t));
+  if (!dp)
+    fatal("out of virtual memory");
+
+  dp->name = mystrdup(name);
+  dp->nchan = nchan;
+  dp->nbanks = nbanks;
+  dp->row_size = row_size;
+  dp->bus_width = bus_width;
+  dp->xfer_lat = xfer_lat;
+  dp->t_rcd = t_rcd;
+  dp->t_cas = t_cas;
+  dp->t_rp = t_rp;
+  dp->t_ras = t_ras;
+  dp->page = page;
+  dp->sched = sched;
+  dp->rq_size = rq_size;
+  dp->wq_size = wq_size;
+
+  dp->col_shift = log_base2(row_size);
+  dp->chan_shift = log_base2(nchan);
+  dp->bank_shift = log_base2(nbanks);
+
+  /* allocate the channels, all banks start out precharged */
+  dp->chans = (struct dram_chan_t *)calloc(nchan, sizeof(struct dram_chan_t));
+  if (!dp->chans)
+    fatal("out of virtual memory");
+  for (i=0; i < nchan; i++)
+    {
+      dp->chans[i].banks =
+	(struct dram_bank_t *)calloc(nbanks, sizeof(struct dram_bank_t));
+      dp->chans[i].rq = (tick_t *)calloc(rq_size, sizeof(tick_t));
+      dp->chans[i].wq =
+	(struct dram_write_t *)calloc(wq_size, sizeof(struct dram_write_t));
+      if (!dp->chans[i].banks || !dp->chans[i].rq || !dp->chans[i].wq)
+	fatal("out of virtual memory");
+    }
+
+  return dp;
+}
+
+/* print DRAM configuration */
+void
+dram_config(struct dram_t *dp,		/* DRAM instance */
+	    FILE *stream)		/* output stream */
+{
+  fprintf(stream,
+	  "dram: %s: %d channel(s), %d banks/channel, %d byte rows, "
+	  "%d byte bus\n",
+	  dp->name, dp->nchan, dp->nbanks, dp->row_size, dp->bus_width);
+  fprintf(stream,
+	  "dram: %s: tRCD %d, tCAS %d, tRP %d, tRAS %d, %d cycles/transfer\n",
+	  dp->name, dp->t_rcd, dp->t_cas, dp->t_rp, dp->t_ras, dp->xfer_lat);
+  fprintf(stream,
+	  "dram: %s: %s page, %s, %d entry read queue, %d entry write queue\n",
+	  dp->name, dp->page == dram_open_page ? "open" : "close",
+	  dp->sched == dram_frfcfs ? "FR-FCFS" : "FCFS",
+	  dp->rq_size, dp->wq_size);
+}
+
+/* register DRAM stats */
+void
+dram_reg_stats(struct dram_t *dp,	/* DRAM instance */
+	       struct stat_sdb_t *sdb)	/* stats database */
+{
+  char buf[512], buf1[512], *name;
+
+  /* get a name for this memory */
+  if (!dp->name || !dp->name[0])
+    name = "mem";
+  else
+    name = dp->name;
+
+  sprintf(buf, "%s.reads", name);
+  stat_reg_counter(sdb, buf, "total number of reads", &dp->reads, 0, NULL);
+  sprintf(buf, "%s.writes", name);
+  stat_reg_counter(sdb, buf, "total number of writes", &dp->writes, 0, NULL);
+  sprintf(buf, "%s.row_hits", name);
+  stat_reg_counter(sdb, buf, "total number of accesses to an open row",
+		   &dp->row_hits, 0, NULL);
+  sprintf(buf, "%s.row_misses", name);
+  stat_reg_counter(sdb, buf, "total number of accesses to a closed bank",
+		   &dp->row_misses, 0, NULL);
+  sprintf(buf, "%s.row_conflicts", name);
+  stat_reg_counter(sdb, buf, "total number of accesses to another open row",
+		   &dp->row_conflicts, 0, NULL);
+  sprintf(buf, "%s.row_hit_rate", name);
+  sprintf(buf1, "%s.row_hits / (%s.reads + %s.writes)", name, name, name);
+  stat_reg_formula(sdb, buf, "row buffer hit rate (i.e., hits/access)",
+		   buf1, NULL);
+  if (dp->sched == dram_frfcfs)
+    {
+      sprintf(buf, "%s.bypasses", name);
+      stat_reg_counter(sdb, buf, "row hits served ahead of older requests",
+		       &dp->bypasses, 0, NULL);
+    }
+  sprintf(buf, "%s.rq_stalls", name);
+  stat_reg_counter(sdb, buf, "reads that waited for read queue space",
+		   &dp->rq_stalls, 0, NULL);
+  sprintf(buf, "%s.wq_drains", name);
+  stat_reg_counter(sdb, buf, "write queue drains on a full write queue",
+		   &dp->wq_drains, 0, NULL);
+  sprintf(buf, "%s.read_lat", name);
+  stat_reg_counter(sdb, buf, "total read latency (in cycles)",
+		   &dp->read_lat, 0, NULL);
+  sprintf(buf, "%s.avg_read_lat", name);
+  sprintf(buf1, "%s.read_lat / %s.reads", name, name);
+  stat_reg_formula(sdb, buf, "average read latency (in cycles)", buf1, NULL);
+  sprintf(buf, "%s.bus_busy", name);
+  stat_reg_counter(sdb, buf, "total data bus busy cycles, all channels",
+		   &dp->bus_busy, 0, NULL);
+}
+
+/* time the first command of an access to ROW of bank BP, arriving at time
+   NOW, could be issued */
+static tick_t
+dram_first_cmd(struct dram_t *dp, struct dram_bank_t *bp, md_addr_t row,
+	       tick_t now)
+{
+  if (bp->open && bp->row != row)
+    return MAX(now, MAX(bp->ready, bp->act + dp->t_ras));
+  else
+    return MAX(now, bp->ready);
+}
+
+/* serve an access of NBYTES to ROW of bank BANK in channel CH, arriving at
+   time NOW, returns the time its data transfer completes */
+static tick_t
+dram_service(struct dram_t *dp, struct dram_chan_t *ch, int bank,
+	     md_addr_t row, int nbytes, tick_t now)
+{
+  struct dram_bank_t *bp = &ch->banks[bank];
+  tick_t xfer = DRAM_XFER(dp, nbytes), col, pre, shift;
+
+  if (bp->open && bp->row == row)
+    {
+      /* row hit */
+      dp->row_hits++;
+      col = MAX(now, bp->ready);
+    }
+  else if (dp->sched == dram_frfcfs
+	   && bp->pre > now && bp->prev_row == row
+	   && bp->bypass < DRAM_BYPASS_MAX)
+    {
+      /* row hit to the row being closed, serve it ahead of the pending
+	 activate, pushing back the bank's later commands and the bus */
+      dp->row_hits++;
+      dp->bypasses++;
+      bp->bypass++;
+      col = MAX(now, bp->prev_ready);
+      bp->prev_ready = col + xfer;
+      shift = MAX(0, bp->prev_ready - bp->pre);
+      bp->pre += shift;
+      bp->act += shift;
+      bp->ready += shift;
+      ch->bus_free += xfer;
+      dp->bus_busy += xfer;
+      return col + dp->t_cas + xfer;
+    }
+  else
+    {
+      if (bp->open)
+	{
+	  /* row conflict, precharge the open row first */
+	  dp->row_conflicts++;
+	  pre = MAX(now, MAX(bp->ready, bp->act + dp->t_ras));
+	  bp->prev_row = bp->row;
+	  bp->prev_ready = bp->ready;
+	  bp->pre = pre;
+	  bp->bypass = 0;
+	  bp->act = pre + dp->t_rp;
+	}
+      else
+	{
+	  /* closed bank */
+	  dp->row_misses++;
+	  bp->act = MAX(now, bp->ready);
+	}
+      bp->open = TRUE;
+      bp->row = row;
+      col = bp->act + dp->t_rcd;
+    }
+
+  /* hold the column access until the bus is free for its data */
+  col = MAX(col, ch->bus_free - dp->t_cas);
+  ch->bus_free = col + dp->t_cas + xfer;
+  dp->bus_busy += xfer;
+  bp->ready = col + xfer;
+
+  /* close page, precharge right after the access */
+  if (dp->page == dram_close_page)
+    {
+      bp->open = FALSE;
+      bp->ready = MAX(bp->ready, bp->act + dp->t_ras) + dp->t_rp;
+    }
+
+  return ch->bus_free;
+}
+
+/* issue writes from the write queue of channel CH until LEFT remain, with
+   FORCE at time NOW, else only the writes the channel could have started
+   before time NOW */
+static void
+dram_drain(struct dram_t *dp, struct dram_chan_t *ch, int left, int force,
+	   tick_t now)
+{
+  struct dram_write_t *wp;
+  int i;
+
+  while (ch->wq_num > left)
+    {
+      /* FR-FCFS takes the oldest write to an open row, if any */
+      wp = &ch->wq[0];
+      if (dp->sched == dram_frfcfs)
+	{
+	  for (i=0; i < ch->wq_num; i++)
+	    if (ch->banks[ch->wq[i].bank].open
+		&& ch->banks[ch->wq[i].bank].row == ch->wq[i].row)
+	      {
+		wp = &ch->wq[i];
+		break;
+	      }
+	}
+
+      if (force)
+	dram_service(dp, ch, wp->bank, wp->row, wp->nbytes, now);
+      else if (dram_first_cmd(dp, &ch->banks[wp->bank], wp->row,
+			      wp->when) < now)
+	dram_service(dp, ch, wp->bank, wp->row, wp->nbytes, wp->when);
+      else
+	break;
+
+      /* remove it from the queue */
+      ch->wq_num--;
+      memmove(wp, wp + 1, (ch->wq_num - (wp - ch->wq)) * sizeof(*wp));
+    }
+}
+
+/* access NBYTES at block address ADDR of DRAM DP at time NOW, returns the
+   latency of a Read, Writes are buffered and return zero */
+unsigned int				/* latency of access in cycles */
+dram_access(struct dram_t *dp,		/* DRAM to access */
+	    enum mem_cmd cmd,		/* access type, Read or Write */
+	    md_addr_t addr,		/* block address of access */
+	    int nbytes,			/* number of bytes to access */
+	    tick_t now)			/* time of access */
+{
+  struct dram_chan_t *ch = &dp->chans[DRAM_CHAN(dp, addr)];
+  struct dram_write_t *wp;
+  tick_t start, done;
+  int i, slot;
+
+  /* the channel first issues the writes it could have while idle */
+  dram_drain(dp, ch, 0, FALSE, now);
+
+  if (cmd == Write)
+    {
+      dp->writes++;
+
+      /* a full write queue is drained down to half */
+      if (ch->wq_num == dp->wq_size)
+	{
+	  dp->wq_drains++;
+	  dram_drain(dp, ch, dp->wq_size / 2, TRUE, now);
+	}
+
+      wp = &ch->wq[ch->wq_num++];
+      wp->bank = DRAM_BANK(dp, addr);
+      wp->row = DRAM_ROW(dp, addr);
+      wp->nbytes = nbytes;
+      wp->when = now;
+
+      /* buffered */
+      return 0;
+    }
+
+  dp->reads++;
+
+  /* the read takes the read queue entry that frees up first, waiting for
+     it if all are taken */
+  slot = 0;
+  for (i=1; i < dp->rq_size; i++)
+    if (ch->rq[i] < ch->rq[slot])
+      slot = i;
+  start = now;
+  if (ch->rq[slot] > now)
+    {
+      dp->rq_stalls++;
+      start = ch->rq[slot];
+    }
+
+  done = dram_service(dp, ch, DRAM_BANK(dp, addr), DRAM_ROW(dp, addr),
+		      nbytes, start);
+  ch->rq[slot] = done;
+
+  dp->read_lat += done - now;
+  return (unsigned int)(done - now);
+}
@@ -0,0 +1,225 @@
+/* dram.h - main memory (DRAM) model interfaces */
+
+/* SimpleScalar(TM) Tool Suite
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ * All Rights Reserved. 
+ * 
+ * THIS IS A LEGAL DOCUMENT, BY USING SIMPLESCALAR,
+ * YOU ARE AGREEING TO THESE TERMS AND CONDITIONS.
+ * 
+ * No portion of this work may be used by any commercial entity, or for any
+ * commercial purpose, without the prior, written permission of SimpleScalar,
+ * LLC (info@simplescalar.com). Nonprofit and noncommercial use is permitted
+ * as described below.
+ * 
+ * 1. SimpleScalar is provided AS IS, with no warranty of any kind, express
+ * or implied. The user of the program accepts full responsibility for the
+ * application of the program and the use of any results.
+ * 
+ * 2. Nonprofit and noncommercial use is encouraged. SimpleScalar may be
+ * downloaded, compiled, executed, copied, and modified solely for nonprofit,
+ * educational, noncommercial research, and noncommercial scholarship
+ * purposes provided that this notice in its entirety accompanies all copies.
+ * Copies of the modified software can be delivered to persons who use it
+ * solely for nonprofit, educational, noncommercial research, and
+ * noncommercial scholarship purposes provided that this notice in its
+ * entirety accompanies all copies.
+ * 
+ * 3. ALL COMMERCIAL USE, AND ALL USE BY FOR PROFIT ENTITIES, IS EXPRESSLY
+ * PROHIBITED WITHOUT A LICENSE FROM SIMPLESCALAR, LLC (info@simplescalar.com).
+ * 
+ * 4. No nonprofit user may place any restrictions on the use of this software,
+ * including as modified by the user, by any other authorized user.
+ * 
+ * 5. Noncommercial and nonprofit users may distribute copies of SimpleScalar
+ * in compiled or executable form as set forth in Section 2, provided that
+ * either: (A) it is accompanied by the corresponding machine-readable source
+ * code, or (B) it is accompanied by a written offer, with no time limit, to
+ * give anyone a machine-readable copy of the corresponding source code in
+ * return for reimbursement of the cost of distribution. This written offer
+ * must permit verbatim duplication by anyone, or (C) it is distributed by
+ * someone who received only the executable form, and is accompanied by a
+ * copy of the written offer of source code.
+ * 
+ * 6. SimpleScalar was developed by Todd M. Austin, Ph.D. The tool suite is
+ * currently maintained by SimpleScalar LLC (info@simplescalar.com). US Mail:
+ * 2395 Timbercrest Court, Ann Arbor, MI 48105.
+ * 
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ */
+
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <stdio.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "memory.h"
+#include "stats.h"
+
+/*
+ * This module models main memory as a set of independent channels, each
+ * with its own data bus and banks, in place of a fixed access latency.  A
+ * block address is split, from high to low bits, into row, bank, channel
+ * and column, so a channel holds whole rows and consecutive rows go to
+ * different channels, then to different banks.
+ *
+ * Each bank has a row buffer.  With the open page policy a row stays open
+ * after an access, so the next access to it (a row hit) needs only a
+ * column access (tCAS), an access to a closed bank first activates the
+ * row (tRCD), and an access to another row (a row conflict) first
+ * precharges the open one (tRP, no sooner than tRAS after it was
+ * activated).  With the close page policy a bank is precharged right
+ * after every access.  The data transfer then takes the channel's bus for
+ * one transfer time per bus width of the block.
+ *
+ * Latencies are returned at the time of the access, as the caches need
+ * them, so a read is scheduled when it arrives, behind the requests
+ * already queued at its channel.  A channel holds at most a read queue's
+ * worth of outstanding reads, further reads wait for the first of them to
+ * complete.  Writes (write-backs) are buffered in a per-channel write
+ * queue and cost their writer nothing, they are drained while the channel
+ * would otherwise be idle before the next read, or all at once down to
+ * half the queue when the queue fills.
+ *
+ * The FR-FCFS scheduler prefers row hits: draining writes, it takes writes
+ * to open rows before older ones, and a read that hits the row a bank had
+ * open before its last activate, arriving before that row's precharge was
+ * issued, is served from it ahead of the activate (at most DRAM_BYPASS_MAX
+ * times in a row, so older requests are not starved).  The requests it
+ * overtakes keep the latency they were already given, the time the hit
+ * takes is charged to the bank and bus, so to later requests.  The FCFS
+ * scheduler serves everything in arrival order.
+ */
+
+/* row hits served ahead of a pending activate before FR-FCFS gives in */
+#define DRAM_BYPASS_MAX		4
+
+/* row buffer management policies */
+enum dram_page_policy {
+  dram_open_page,			/* leave rows open after an access */
+  dram_close_page			/* precharge after every access */
+};
+
+/* request scheduling policies */
+enum dram_sched_policy {
+  dram_fcfs,				/* first-come, first-served */
+  dram_frfcfs				/* row hits first, then oldest first */
+};
+
+/* a DRAM bank */
+struct dram_bank_t
+{
+  int open;				/* is a row open (or being opened)? */
+  md_addr_t row;			/* the open row */
+  tick_t act;				/* time ROW was activated */
+  tick_t ready;				/* time of the next column access to
+					   ROW, or of the next activate if
+					   the bank is closed */
+
+  /* the row open before the last activate, valid until it is precharged
+     at time PRE, row hits to it can still be served until then */
+  md_addr_t prev_row;			/* the previously open row */
+  tick_t prev_ready;			/* next column access to PREV_ROW */
+  tick_t pre;				/* precharge of PREV_ROW */
+  int bypass;				/* row hits served ahead of the
+					   activate of ROW */
+};
+
+/* a buffered write */
+struct dram_write_t
+{
+  int bank;				/* bank written */
+  md_addr_t row;			/* row written */
+  int nbytes;				/* bytes written */
+  tick_t when;				/* time of the write */
+};
+
+/* a DRAM channel */
+struct dram_chan_t
+{
+  struct dram_bank_t *banks;		/* banks of the channel */
+  tick_t bus_free;			/* data bus is free after this time */
+  tick_t *rq;				/* completion times of the reads
+					   in the read queue */
+  struct dram_write_t *wq;		/* write queue, oldest first */
+  int wq_num;				/* writes in the write queue */
+};
+
+/* a DRAM main memory */
+struct dram_t
+{
+  /* parameters */
+  char *name;				/* memory name, prefixes its stats */
+  int nchan;				/* number of channels */
+  int nbanks;				/* banks per channel */
+  int row_size;				/* row buffer size, in bytes */
+  int bus_width;			/* data bus width, in bytes */
+  int xfer_lat;				/* bus cycles per bus width */
+  int t_rcd, t_cas, t_rp, t_ras;	/* DRAM timing, in cycles */
+  enum dram_page_policy page;		/* row buffer policy */
+  enum dram_sched_policy sched;		/* scheduling policy */
+  int rq_size;				/* read queue entries per channel */
+  int wq_size;				/* write queue entries per channel */
+
+  /* derived data, for fast decoding */
+  int col_shift;			/* log2(row_size) */
+  int chan_shift;			/* log2(nchan) */
+  int bank_shift;			/* log2(nbanks) */
+
+  struct dram_chan_t *chans;		/* channels */
+
+  /* stats */
+  counter_t reads;			/* reads served */
+  counter_t writes;			/* writes served */
+  counter_t row_hits;			/* accesses to an open row */
+  counter_t row_misses;			/* accesses to a closed bank */
+  counter_t row_conflicts;		/* accesses to another row */
+  counter_t bypasses;			/* row hits served ahead of older
+					   requests (FR-FCFS) */
+  counter_t rq_stalls;			/* reads that waited for read queue
+					   space */
+  counter_t wq_drains;			/* write queue full drains */
+  counter_t read_lat;			/* total cycles of all reads */
+  counter_t bus_busy;			/* total data bus busy cycles */
+};
+
+/* create a DRAM main memory */
+struct dram_t *				/* DRAM instance */
+dram_create(char *name,			/* memory name */
+	    int nchan,			/* number of channels */
+	    int nbanks,			/* banks per channel */
+	    int row_size,		/* row buffer size, in bytes */
+	    int bus_width,		/* data bus width, in bytes */
+	    int xfer_lat,		/* bus cycles per bus width */
+	    int t_rcd,			/* activate to column access */
+	    int t_cas,			/* column access to data */
+	    int t_rp,			/* precharge to activate */
+	    int t_ras,			/* activate to precharge */
+	    enum dram_page_policy page,	/* row buffer policy */
+	    enum dram_sched_policy sched,/* scheduling policy */
+	    int rq_size,		/* read queue entries per channel */
+	    int wq_size);		/* write queue entries per channel */
+
+/* print DRAM configuration */
+void
+dram_config(struct dram_t *dp,		/* DRAM instance */
+	    FILE *stream);		/* output stream */
+
+/* register DRAM stats */
+void
+dram_reg_stats(struct dram_t *dp,	/* DRAM instance */
+	       struct stat_sdb_t *sdb);	/* stats database */
+
+/* access NBYTES at block address ADDR of DRAM DP at time NOW, returns the
+   latency of a Read, Writes are buffered and return zero */
+unsigned int				/* latency of access in cycles */
+dram_access(struct dram_t *dp,		/* DRAM to access */
+	    enum mem_cmd cmd,		/* access type, Read or Write */
+	    md_addr_t addr,		/* block address of access */
+	    int nbytes,			/* number of bytes to access */
+	    tick_t now);		/* time of access */
+
+#endif /* DRAM_H */
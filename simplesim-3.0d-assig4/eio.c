@@ -51,6 +51,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #ifdef _MSC_VER
 #include <io.h>
 #else /* !_MSC_VER */
@@ -93,6 +96,18 @@
 /* EIO transaction count, i.e., number of last transaction completed */
 static counter_t eio_trans_icnt = -1;
 
+/* binary EIO trace streams, see below */
+struct eio_bin_t;
+static struct eio_bin_t *eio_bin_stream(FILE *fd);
+static int eio_bin_trace_valid(char *fname);
+static FILE *eio_bin_open(char *fname);
+static void eio_bin_close(struct eio_bin_t *bs);
+static void eio_bin_put_trace_chkpt(struct eio_bin_t *bs, struct regs_t *regs,
+				    struct mem_t *mem, counter_t num_insn);
+static counter_t eio_bin_get_trace_chkpt(struct eio_bin_t *bs,
+					 struct regs_t *regs,
+					 struct mem_t *mem);
+
 FILE *
 eio_create(char *fname)
 {
@@ -131,6 +146,10 @@ eio_open(char *fname)
 
   target_big_endian = (endian_host_byte_order() == endian_big);
 
+  /* binary EIO traces have their own reader */
+  if (eio_bin_trace_valid(fname))
+    return eio_bin_open(fname);
+
   fd = gzopen(fname, "r");
   if (!fd)
     fatal("unable to open EIO file `%s'", fname);
@@ -186,13 +205,13 @@ eio_valid(char *fname)
   /* read and check EIO file header */
   fgets(buf, 512, fd);
 
-  /* check the header */
-  if (strcmp(buf, EIO_FILE_HEADER))
-    return FALSE;
-
   /* all done, close up file */
   gzclose(fd);
 
+  /* check the header */
+  if (strcmp(buf, EIO_FILE_HEADER))
+    return eio_bin_trace_valid(fname);
+
   /* else, has a valid header, go with it... */
   return TRUE;
 }
@@ -200,6 +219,10 @@ eio_valid(char *fname)
 void
 eio_close(FILE *fd)
 {
+  struct eio_bin_t *bs = eio_bin_stream(fd);
+
+  if (bs != NULL)
+    eio_bin_close(bs);
   gzclose(fd);
 }
 
@@ -213,6 +236,14 @@ eio_write_chkpt(struct regs_t *regs,		/* regs to dump */
   int i;
   struct exo_term_t *exo;
   struct mem_pte_t *pte;
+  struct eio_bin_t *bs = eio_bin_stream(fd);
+
+  /* binary EIO traces hold binary checkpoints */
+  if (bs != NULL)
+    {
+      eio_bin_put_trace_chkpt(bs, regs, mem, sim_num_insn);
+      return eio_trans_icnt;
+    }
 
   myfprintf(fd, "/* ** start checkpoint @ %n... */\n\n", eio_trans_icnt);
 
@@ -312,6 +343,11 @@ eio_read_chkpt(struct regs_t *regs,		/* regs to dump */
   int i, page_count;
   counter_t trans_icnt;
   struct exo_term_t *exo, *elt;
+  struct eio_bin_t *bs = eio_bin_stream(fd);
+
+  /* binary EIO traces hold binary checkpoints */
+  if (bs != NULL)
+    return eio_bin_get_trace_chkpt(bs, regs, mem);
 
   /* read the EIO file pointer */
   exo = exo_read(fd);
@@ -429,7 +465,6 @@ eio_read_chkpt(struct regs_t *regs,		/* regs to dump */
 
   for (i=0; i < page_count; i++)
     {
-      int j;
       md_addr_t page_addr;
       struct exo_term_t *blob;
 
@@ -447,21 +482,946 @@ eio_read_chkpt(struct regs_t *regs,		/* regs to dump */
       blob = exo->as_list.head->next;
 
       /* write data to simulator memory */
-      for (j=0; j < blob->as_blob.size; j++)
+      mem_bulk_copy(mem, Write, page_addr,
+		    blob->as_blob.data, blob->as_blob.size);
+      exo_delete(exo);
+    }
+
+  return trans_icnt;
+}
+
+/*
+ * binary EIO files: binary checkpoints and binary EIO traces are built from
+ * fixed-layout records written in host byte order and type sizes, so they
+ * are only portable between like hosts, but they are read and written
+ * without any parsing; a binary checkpoint is a fixed header, the raw
+ * register file, a page index sorted by address, then the non-zero page
+ * images, each aligned to a target page boundary in the file so checkpoints
+ * in uncompressed files can be mapped straight into simulator memory,
+ * all-zero pages are recorded in the index only
+ */
+
+/* binary checkpoint magic */
+#define EIO_BIN_MAGIC			"SSBCHKPT"
+
+/* binary checkpoint version */
+#define EIO_BIN_VERSION			2
+
+/* binary checkpoint header */
+struct eio_bin_hdr_t {
+  char magic[8];			/* EIO_BIN_MAGIC */
+  word_t file_format;			/* MD_EIO_FILE_FORMAT */
+  word_t file_version;			/* EIO_BIN_VERSION */
+  word_t big_endian;			/* host/target byte order */
+  word_t page_size;			/* MD_PAGE_SIZE */
+  word_t regs_size;			/* sizeof(struct regs_t) */
+  word_t page_count;			/* entries in the page index */
+  sqword_t trans_icnt;			/* EIO file pointer */
+  sqword_t num_insn;			/* instruction count */
+  qword_t brk_point, stack_min;		/* memory config */
+  qword_t text_base, text_size;		/* text segment specifiers */
+  qword_t data_base, data_size;		/* data segment specifiers */
+  qword_t stack_base, stack_size;	/* stack segment specifiers */
+  qword_t end;				/* file offset just past checkpoint */
+};
+
+/* binary checkpoint page index entry */
+struct eio_bin_page_t {
+  qword_t addr;				/* target page address */
+  qword_t offset;			/* file offset of image, 0 if all-zero */
+};
+
+/* page to write, used to sort the page index */
+struct eio_bin_src_t {
+  md_addr_t addr;
+  byte_t *page;
+};
+
+static int
+eio_bin_src_cmp(const void *a, const void *b)
+{
+  md_addr_t addr_a = ((const struct eio_bin_src_t *)a)->addr;
+  md_addr_t addr_b = ((const struct eio_bin_src_t *)b)->addr;
+
+  return (addr_a < addr_b) ? -1 : (addr_a > addr_b);
+}
+
+/* returns non-zero if the target page at P is all zeros */
+static int
+eio_bin_zero_page(byte_t *p)
+{
+  word_t *wp = (word_t *)p;
+  int i;
+
+  for (i=0; i < MD_PAGE_SIZE/sizeof(word_t); i++)
+    if (wp[i] != 0)
+      return FALSE;
+  return TRUE;
+}
+
+/* write NBYTES from BUF to stream FD, which is at file offset *POS */
+static void
+eio_bin_put(FILE *fd, long *pos, void *buf, long nbytes)
+{
+  if (nbytes > 0 && fwrite(buf, nbytes, 1, fd) != 1)
+    fatal("could not write binary EIO file");
+  *pos += nbytes;
+}
+
+/* read NBYTES into BUF from stream FD, which is at file offset *POS */
+static void
+eio_bin_get(FILE *fd, long *pos, void *buf, long nbytes)
+{
+  if (nbytes > 0 && fread(buf, nbytes, 1, fd) != 1)
+    fatal("could not read binary EIO file");
+  *pos += nbytes;
+}
+
+/* write zeros to stream FD out to file offset TO */
+static void
+eio_bin_pad(FILE *fd, long *pos, long to)
+{
+  static byte_t zeros[256];
+
+  while (*pos < to)
+    eio_bin_put(fd, pos, zeros, MIN(to - *pos, (long)sizeof(zeros)));
+}
+
+/* move stream FD to file offset TO, streams that cannot seek (pipes from
+   the decompressor) are read through and only move forward */
+static void
+eio_bin_skip(FILE *fd, long *pos, long to, int seekable)
+{
+  byte_t buf[1024];
+
+  if (seekable)
+    {
+      if (fseek(fd, to, SEEK_SET) != 0)
+	fatal("could not seek binary EIO file");
+      *pos = to;
+      return;
+    }
+
+  if (to < *pos)
+    panic("binary EIO stream cannot move backward");
+  while (*pos < to)
+    eio_bin_get(fd, pos, buf, MIN(to - *pos, (long)sizeof(buf)));
+}
+
+/* returns non-zero if stream FD is a regular file, which may be seeked and
+   mapped, compressed files are read through a pipe */
+static int
+eio_bin_seekable(FILE *fd)
+{
+  struct stat sbuf;
+
+  return (fstat(fileno(fd), &sbuf) == 0 && S_ISREG(sbuf.st_mode));
+}
+
+/* write a binary checkpoint of REGS and MEM to stream FD at file offset
+   *POS, recording EIO file pointer TRANS_ICNT and instruction count NUM_INSN */
+static void
+eio_bin_put_chkpt(struct regs_t *regs,		/* regs to dump */
+		  struct mem_t *mem,		/* memory to dump */
+		  FILE *fd,			/* stream to write to */
+		  long *pos,			/* current file offset */
+		  counter_t trans_icnt,		/* EIO file pointer */
+		  counter_t num_insn)		/* instruction count */
+{
+  int i, n;
+  long data;
+  struct mem_pte_t *pte;
+  struct eio_bin_hdr_t hdr;
+  struct eio_bin_page_t *index;
+  struct eio_bin_src_t *src;
+
+  /* collect all active memory pages, in address order */
+  src = calloc(mem->page_count + 1, sizeof(struct eio_bin_src_t));
+  index = calloc(mem->page_count + 1, sizeof(struct eio_bin_page_t));
+  if (!src || !index)
+    fatal("out of virtual memory");
+  n = 0;
+  MEM_FORALL(mem, i, pte)
+    {
+      src[n].addr = MEM_PTE_ADDR(pte, i);
+      src[n].page = pte->page;
+      n++;
+    }
+  qsort(src, n, sizeof(struct eio_bin_src_t), eio_bin_src_cmp);
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, EIO_BIN_MAGIC, sizeof(hdr.magic));
+  hdr.file_format = MD_EIO_FILE_FORMAT;
+  hdr.file_version = EIO_BIN_VERSION;
+  hdr.big_endian = (endian_host_byte_order() == endian_big);
+  hdr.page_size = MD_PAGE_SIZE;
+  hdr.regs_size = sizeof(struct regs_t);
+  hdr.page_count = n;
+  hdr.trans_icnt = trans_icnt;
+  hdr.num_insn = num_insn;
+  hdr.brk_point = ld_brk_point;
+  hdr.stack_min = ld_stack_min;
+  hdr.text_base = ld_text_base;
+  hdr.text_size = ld_text_size;
+  hdr.data_base = ld_data_base;
+  hdr.data_size = ld_data_size;
+  hdr.stack_base = ld_stack_base;
+  hdr.stack_size = ld_stack_size;
+
+  /* lay out the page images, skipping all-zero pages */
+  hdr.end = *pos + sizeof(hdr) + sizeof(struct regs_t)
+    + n * sizeof(struct eio_bin_page_t);
+  data = ROUND_UP((long)hdr.end, MD_PAGE_SIZE);
+  for (i=0; i < n; i++)
+    {
+      index[i].addr = src[i].addr;
+      if (eio_bin_zero_page(src[i].page))
+	index[i].offset = 0;
+      else
 	{
-	  byte_t val;
+	  index[i].offset = data;
+	  data += MD_PAGE_SIZE;
+	  hdr.end = data;
+	}
+    }
+
+  eio_bin_put(fd, pos, &hdr, sizeof(hdr));
+  eio_bin_put(fd, pos, regs, sizeof(struct regs_t));
+  eio_bin_put(fd, pos, index, n * sizeof(struct eio_bin_page_t));
+  for (i=0; i < n; i++)
+    {
+      if (index[i].offset == 0)
+	continue;
+
+      eio_bin_pad(fd, pos, (long)index[i].offset);
+      eio_bin_put(fd, pos, src[i].page, MD_PAGE_SIZE);
+    }
+
+  free(index);
+  free(src);
+}
+
+/* read a binary checkpoint from stream FD at file offset *POS into REGS
+   and MEM, returns EIO transaction count (an EIO file pointer); the page
+   images of SEEKABLE streams are mapped copy-on-write into MEM, so they
+   are only read from the file when the simulator first touches them */
+static counter_t
+eio_bin_get_chkpt(struct regs_t *regs,		/* regs to load */
+		  struct mem_t *mem,		/* memory to load */
+		  FILE *fd,			/* stream to read */
+		  long *pos,			/* current file offset */
+		  int seekable)			/* stream is a regular file? */
+{
+  int i, j;
+  byte_t *buf;
+  struct eio_bin_hdr_t hdr;
+  struct eio_bin_page_t *index;
+
+  eio_bin_get(fd, pos, &hdr, sizeof(hdr));
+  if (memcmp(hdr.magic, EIO_BIN_MAGIC, sizeof(hdr.magic)))
+    fatal("could not read binary checkpoint header");
+  if (hdr.file_format != MD_EIO_FILE_FORMAT)
+    fatal("binary checkpoint has incompatible format");
+  if (hdr.file_version != EIO_BIN_VERSION)
+    fatal("binary checkpoint has incompatible version");
+  if (!!hdr.big_endian != (endian_host_byte_order() == endian_big)
+      || hdr.page_size != MD_PAGE_SIZE
+      || hdr.regs_size != sizeof(struct regs_t))
+    fatal("binary checkpoint was written by an incompatible host");
+
+  eio_bin_get(fd, pos, regs, sizeof(struct regs_t));
+
+  index = calloc(hdr.page_count + 1, sizeof(struct eio_bin_page_t));
+  buf = malloc(MD_PAGE_SIZE);
+  if (!index || !buf)
+    fatal("out of virtual memory");
+  eio_bin_get(fd, pos, index, hdr.page_count * sizeof(struct eio_bin_page_t));
+
+  sim_num_insn = hdr.num_insn;
+  ld_brk_point = (md_addr_t)hdr.brk_point;
+  ld_stack_min = (md_addr_t)hdr.stack_min;
+  ld_text_base = (md_addr_t)hdr.text_base;
+  ld_text_size = (unsigned int)hdr.text_size;
+  ld_data_base = (md_addr_t)hdr.data_base;
+  ld_data_size = (unsigned int)hdr.data_size;
+  ld_stack_base = (md_addr_t)hdr.stack_base;
+  ld_stack_size = (unsigned int)hdr.stack_size;
+
+  for (i=0; i < hdr.page_count; i=j)
+    {
+      md_addr_t page_addr = (md_addr_t)index[i].addr;
 
-	  val = blob->as_blob.data[j];
-	  /* unchecked access... */
-	  MEM_WRITE_BYTE(mem, page_addr, val);
-	  page_addr++;
+      if (index[i].offset == 0)
+	{
+	  mem_bulk_zero(mem, page_addr, MD_PAGE_SIZE);
+	  j = i + 1;
+	  continue;
+	}
+
+      /* find the run of pages contiguous in both target memory and file */
+      for (j=i+1; j < hdr.page_count; j++)
+	if (index[j].offset != index[j-1].offset + MD_PAGE_SIZE
+	    || index[j].addr != index[j-1].addr + MD_PAGE_SIZE)
+	  break;
+
+      if (seekable
+	  && mem_map_file(mem, page_addr, fileno(fd),
+			  (long)index[i].offset, j - i, /* shared */FALSE))
+	continue;
+
+      /* else, copy the run in */
+      for (; i < j; i++)
+	{
+	  eio_bin_skip(fd, pos, (long)index[i].offset, seekable);
+	  eio_bin_get(fd, pos, buf, MD_PAGE_SIZE);
+	  mem_bulk_copy(mem, Write, (md_addr_t)index[i].addr,
+			buf, MD_PAGE_SIZE);
 	}
-      exo_delete(exo);
     }
 
+  /* leave the stream just past the checkpoint */
+  eio_bin_skip(fd, pos, (long)hdr.end, seekable);
+
+  free(buf);
+  free(index);
+
+  return hdr.trans_icnt;
+}
+
+/* returns non-zero if file FNAME is a binary checkpoint file */
+int
+eio_bin_valid(char *fname)
+{
+  FILE *fd;
+  char magic[sizeof(EIO_BIN_MAGIC)-1];
+  int valid;
+
+  fd = gzopen(fname, "r");
+  if (!fd)
+    return FALSE;
+
+  valid = (fread(magic, sizeof(magic), 1, fd) == 1
+	   && !memcmp(magic, EIO_BIN_MAGIC, sizeof(magic)));
+  gzclose(fd);
+
+  return valid;
+}
+
+/* write a binary check point of the current architected state to file
+   FNAME, compressed if FNAME names a compressed file, returns EIO
+   transaction count (an EIO file pointer) */
+counter_t
+eio_write_bin_chkpt(struct regs_t *regs,	/* regs to dump */
+		    struct mem_t *mem,		/* memory to dump */
+		    char *fname)		/* file to create */
+{
+  FILE *fd;
+  long pos = 0;
+
+  fd = gzopen(fname, "w");
+  if (!fd)
+    fatal("unable to create binary checkpoint file `%s'", fname);
+
+  eio_bin_put_chkpt(regs, mem, fd, &pos, eio_trans_icnt, sim_num_insn);
+
+  gzclose(fd);
+
+  return eio_trans_icnt;
+}
+
+/* read a binary check point of architected state from file FNAME, returns
+   EIO transaction count (an EIO file pointer); uncompressed checkpoints
+   are mapped copy-on-write into MEM, so page images are only read from
+   the file when the simulator first touches them */
+counter_t
+eio_read_bin_chkpt(struct regs_t *regs,		/* regs to load */
+		   struct mem_t *mem,		/* memory to load */
+		   char *fname)			/* file to read */
+{
+  FILE *fd;
+  long pos = 0;
+  counter_t trans_icnt;
+
+  fd = gzopen(fname, "r");
+  if (!fd)
+    fatal("unable to open binary checkpoint file `%s'", fname);
+
+  trans_icnt = eio_bin_get_chkpt(regs, mem, fd, &pos, eio_bin_seekable(fd));
+
+  gzclose(fd);
+
   return trans_icnt;
 }
 
+/*
+ * binary EIO traces: a file header followed by fixed-layout records, each
+ * a record header and its data; transactions hold the same inputs and
+ * outputs as EXO transactions, checkpoints of the architected state may be
+ * interleaved with them every so many instructions, and a seek index keyed
+ * by instruction count closes the file, followed by a trailer that locates
+ * it; the index lets eio_fast_forward() seek straight to a transaction and
+ * eio_seek_chkpt() restore the state at any checkpoint, so many simulators
+ * can replay different regions of one trace at the same time
+ */
+
+/* binary EIO trace magic */
+#define EIO_BIN_TRACE_MAGIC		"SSBINEIO"
+
+/* binary EIO trace version */
+#define EIO_BIN_TRACE_VERSION		1
+
+/* binary EIO trace record kinds */
+#define EIO_BIN_TRANS			1	/* syscall transaction */
+#define EIO_BIN_CHKPT			2	/* interleaved checkpoint */
+#define EIO_BIN_INDEX			3	/* seek index, last record */
+
+/* every EIO_BIN_INDEX_STRIDE'th transaction gets a seek index entry,
+   every checkpoint gets one */
+#define EIO_BIN_INDEX_STRIDE		64
+
+/* binary EIO trace file header */
+struct eio_bin_file_t {
+  char magic[8];			/* EIO_BIN_TRACE_MAGIC */
+  word_t file_format;			/* MD_EIO_FILE_FORMAT */
+  word_t file_version;			/* EIO_BIN_TRACE_VERSION */
+  word_t big_endian;			/* host/target byte order */
+  word_t regs_size;			/* sizeof(struct regs_t) */
+};
+
+/* binary EIO trace record header */
+struct eio_bin_rec_t {
+  word_t kind;				/* EIO_BIN_TRANS, _CHKPT or _INDEX */
+  word_t size;				/* bytes of data, 0 for checkpoints */
+  sqword_t icnt;			/* instruction count of record */
+};
+
+/* binary EIO transaction record, followed by the memory inputs then
+   the memory outputs */
+struct eio_bin_trans_t {
+  qword_t pc;				/* syscall PC */
+  qword_t brk_point;			/* memory breakpoint after syscall */
+  qword_t in_regs[MD_LAST_IN_REG - MD_FIRST_IN_REG + 1];
+  qword_t out_regs[MD_LAST_OUT_REG - MD_FIRST_OUT_REG + 1];
+  word_t n_in;				/* number of memory inputs */
+  word_t n_out;				/* number of memory outputs */
+};
+
+/* binary EIO transaction memory block, followed by its data padded out
+   to a multiple of 8 bytes */
+struct eio_bin_mem_t {
+  qword_t addr;				/* target address */
+  word_t size;				/* bytes of data */
+  word_t pad;
+};
+
+/* binary EIO trace seek index entry */
+struct eio_bin_idx_t {
+  sqword_t icnt;			/* instruction count of record */
+  qword_t offset;			/* file offset of record */
+  word_t kind;				/* EIO_BIN_TRANS or EIO_BIN_CHKPT */
+  word_t pad;
+};
+
+/* binary EIO trace file trailer */
+struct eio_bin_tail_t {
+  qword_t index_offset;			/* file offset of seek index record */
+  char magic[8];			/* EIO_BIN_TRACE_MAGIC */
+};
+
+/* binary EIO trace stream state */
+struct eio_bin_t {
+  FILE *fd;				/* stream, NULL if slot unused */
+  int writing;				/* stream is being written? */
+  int seekable;				/* stream is a regular file? */
+  long pos;				/* current file offset */
+  counter_t chkpt_interval;		/* insts between checkpoints, 0=none */
+  counter_t next_chkpt;			/* next checkpoint inst count */
+  counter_t ntrans;			/* transactions written */
+  int nidx, maxidx;			/* seek index size and capacity */
+  struct eio_bin_idx_t *idx;		/* seek index */
+  int bufsize;				/* record buffer capacity */
+  byte_t *buf;				/* record buffer */
+};
+
+/* open binary EIO trace streams, EXO streams are not in here */
+#define EIO_BIN_MAX_STREAMS		8
+static struct eio_bin_t eio_bin_streams[EIO_BIN_MAX_STREAMS];
+
+/* returns the binary EIO trace state of stream FD, NULL if FD is an EXO
+   format stream */
+static struct eio_bin_t *
+eio_bin_stream(FILE *fd)
+{
+  int i;
+
+  for (i=0; i < EIO_BIN_MAX_STREAMS; i++)
+    if (fd != NULL && eio_bin_streams[i].fd == fd)
+      return &eio_bin_streams[i];
+  return NULL;
+}
+
+/* allocate binary EIO trace state for stream FD */
+static struct eio_bin_t *
+eio_bin_new_stream(FILE *fd, int writing)
+{
+  struct eio_bin_t *bs;
+
+  for (bs = eio_bin_streams; bs < eio_bin_streams + EIO_BIN_MAX_STREAMS; bs++)
+    if (bs->fd == NULL)
+      break;
+  if (bs == eio_bin_streams + EIO_BIN_MAX_STREAMS)
+    fatal("too many binary EIO traces open");
+
+  memset(bs, 0, sizeof(*bs));
+  bs->fd = fd;
+  bs->writing = writing;
+  bs->seekable = eio_bin_seekable(fd);
+
+  return bs;
+}
+
+/* make sure the record buffer of BS holds at least SIZE bytes */
+static void
+eio_bin_grow(struct eio_bin_t *bs, int size)
+{
+  if (size <= bs->bufsize)
+    return;
+
+  bs->bufsize = MAX(size, 2 * bs->bufsize);
+  bs->buf = realloc(bs->buf, bs->bufsize);
+  if (!bs->buf)
+    fatal("out of virtual memory");
+}
+
+/* add a seek index entry for a record of KIND at the current offset */
+static void
+eio_bin_add_idx(struct eio_bin_t *bs, int kind, counter_t icnt)
+{
+  if (bs->nidx == bs->maxidx)
+    {
+      bs->maxidx = MAX(1024, 2 * bs->maxidx);
+      bs->idx = realloc(bs->idx, bs->maxidx * sizeof(struct eio_bin_idx_t));
+      if (!bs->idx)
+	fatal("out of virtual memory");
+    }
+  bs->idx[bs->nidx].icnt = icnt;
+  bs->idx[bs->nidx].offset = bs->pos;
+  bs->idx[bs->nidx].kind = kind;
+  bs->idx[bs->nidx].pad = 0;
+  bs->nidx++;
+}
+
+/* returns the last seek index entry of KIND at or before ICNT, NULL if none */
+static struct eio_bin_idx_t *
+eio_bin_find_idx(struct eio_bin_t *bs, int kind, counter_t icnt)
+{
+  int lo = 0, hi = bs->nidx - 1, mid;
+  struct eio_bin_idx_t *best = NULL;
+
+  /* entries are in trace order, so in instruction count order */
+  while (lo <= hi)
+    {
+      mid = (lo + hi) / 2;
+      if (bs->idx[mid].icnt <= icnt)
+	lo = mid + 1;
+      else
+	hi = mid - 1;
+    }
+  for (; hi >= 0; hi--)
+    if (bs->idx[hi].kind == kind)
+      {
+	best = &bs->idx[hi];
+	break;
+      }
+  return best;
+}
+
+/* read the next transaction record header from binary EIO trace BS into
+   REC, skipping over interleaved checkpoints, returns zero at the end of
+   the trace */
+static int
+eio_bin_next_trans(struct eio_bin_t *bs, struct eio_bin_rec_t *rec)
+{
+  struct eio_bin_hdr_t hdr;
+
+  for (;;)
+    {
+      if (fread(rec, sizeof(*rec), 1, bs->fd) != 1)
+	return FALSE;
+      bs->pos += sizeof(*rec);
+
+      if (rec->kind == EIO_BIN_TRANS)
+	return TRUE;
+      else if (rec->kind == EIO_BIN_CHKPT)
+	{
+	  eio_bin_get(bs->fd, &bs->pos, &hdr, sizeof(hdr));
+	  eio_bin_skip(bs->fd, &bs->pos, (long)hdr.end, bs->seekable);
+	}
+      else if (rec->kind == EIO_BIN_INDEX)
+	return FALSE;
+      else
+	fatal("cannot read binary EIO record");
+    }
+}
+
+/* write an interleaved checkpoint record to binary EIO trace BS */
+static void
+eio_bin_put_trace_chkpt(struct eio_bin_t *bs,	/* trace to write */
+			struct regs_t *regs,	/* regs to dump */
+			struct mem_t *mem,	/* memory to dump */
+			counter_t num_insn)	/* instruction count */
+{
+  struct eio_bin_rec_t rec;
+
+  eio_bin_add_idx(bs, EIO_BIN_CHKPT, num_insn);
+
+  rec.kind = EIO_BIN_CHKPT;
+  rec.size = 0;
+  rec.icnt = num_insn;
+  eio_bin_put(bs->fd, &bs->pos, &rec, sizeof(rec));
+  eio_bin_put_chkpt(regs, mem, bs->fd, &bs->pos, eio_trans_icnt, num_insn);
+}
+
+/* read the checkpoint record at the head of binary EIO trace BS into REGS
+   and MEM, returns EIO transaction count (an EIO file pointer) */
+static counter_t
+eio_bin_get_trace_chkpt(struct eio_bin_t *bs,	/* trace to read */
+			struct regs_t *regs,	/* regs to load */
+			struct mem_t *mem)	/* memory to load */
+{
+  struct eio_bin_rec_t rec;
+
+  eio_bin_get(bs->fd, &bs->pos, &rec, sizeof(rec));
+  if (rec.kind != EIO_BIN_CHKPT)
+    fatal("could not read EIO checkpoint");
+
+  return eio_bin_get_chkpt(regs, mem, bs->fd, &bs->pos, bs->seekable);
+}
+
+/* append memory blocks of EXO list MEM_LIST to the record buffer of BS at
+   offset *LEN, returns the number of blocks */
+static int
+eio_bin_put_mem(struct eio_bin_t *bs, int *len, struct exo_term_t *mem_list)
+{
+  int n = 0, size;
+  struct exo_term_t *memrec, *blob;
+  struct eio_bin_mem_t bmem;
+
+  for (memrec=mem_list->as_list.head; memrec != NULL; memrec=memrec->next)
+    {
+      blob = memrec->as_list.head->next;
+      size = ROUND_UP(blob->as_blob.size, 8);
+      eio_bin_grow(bs, *len + sizeof(bmem) + size);
+
+      bmem.addr = (qword_t)memrec->as_list.head->as_address.val;
+      bmem.size = blob->as_blob.size;
+      bmem.pad = 0;
+      memcpy(bs->buf + *len, &bmem, sizeof(bmem));
+      memcpy(bs->buf + *len + sizeof(bmem), blob->as_blob.data, bmem.size);
+      memset(bs->buf + *len + sizeof(bmem) + bmem.size, 0, size - bmem.size);
+      *len += sizeof(bmem) + size;
+      n++;
+    }
+  return n;
+}
+
+/* write a transaction record to binary EIO trace BS from its EXO form */
+static void
+eio_bin_put_trans(struct eio_bin_t *bs,		/* trace to write */
+		  counter_t icnt,		/* instruction count */
+		  struct exo_term_t *exo)	/* EXO transaction */
+{
+  int i, len;
+  struct exo_term_t *elt;
+  struct exo_term_t *exo_pc, *exo_inregs, *exo_inmem, *exo_outregs, *exo_outmem;
+  struct eio_bin_trans_t trans;
+  struct eio_bin_rec_t rec;
+
+  exo_pc = exo->as_list.head->next;
+  exo_inregs = exo_pc->next;
+  exo_inmem = exo_inregs->next;
+  exo_outregs = exo_inmem->next;
+  exo_outmem = exo_outregs->next;
+
+  memset(&trans, 0, sizeof(trans));
+  trans.pc = (qword_t)exo_pc->as_address.val;
+  for (i=0, elt=exo_inregs->as_list.head; elt != NULL; i++, elt=elt->next)
+    trans.in_regs[i] = (qword_t)elt->as_address.val;
+  elt = exo_outregs->as_list.head;
+  trans.brk_point = (qword_t)elt->as_address.val;
+  for (i=0, elt=elt->next; elt != NULL; i++, elt=elt->next)
+    trans.out_regs[i] = (qword_t)elt->as_address.val;
+
+  len = sizeof(trans);
+  eio_bin_grow(bs, len);
+  trans.n_in = eio_bin_put_mem(bs, &len, exo_inmem);
+  trans.n_out = eio_bin_put_mem(bs, &len, exo_outmem);
+  memcpy(bs->buf, &trans, sizeof(trans));
+
+  if ((bs->ntrans++ % EIO_BIN_INDEX_STRIDE) == 0)
+    eio_bin_add_idx(bs, EIO_BIN_TRANS, icnt);
+
+  rec.kind = EIO_BIN_TRANS;
+  rec.size = len;
+  rec.icnt = icnt;
+  eio_bin_put(bs->fd, &bs->pos, &rec, sizeof(rec));
+  eio_bin_put(bs->fd, &bs->pos, bs->buf, len);
+}
+
+/* syscall proxy handler from binary EIO trace BS, see eio_read_trace() */
+static void
+eio_bin_get_trans(struct eio_bin_t *bs,		/* trace to read */
+		  counter_t icnt,		/* instruction count */
+		  struct regs_t *regs,		/* registers to update */
+		  mem_access_fn mem_fn,		/* generic memory accessor */
+		  struct mem_t *mem)		/* memory to update */
+{
+  int i, n;
+  byte_t *p, *data;
+  struct eio_bin_rec_t rec;
+  struct eio_bin_trans_t trans;
+  struct eio_bin_mem_t bmem;
+  static byte_t *inbuf = NULL;
+  static int inbuf_size = 0;
+
+  if (!eio_bin_next_trans(bs, &rec))
+    fatal("cannot read EIO transaction");
+  eio_bin_grow(bs, rec.size);
+  eio_bin_get(bs->fd, &bs->pos, bs->buf, rec.size);
+  memcpy(&trans, bs->buf, sizeof(trans));
+  p = bs->buf + sizeof(trans);
+
+  /* one more transaction processed */
+  eio_trans_icnt = icnt;
+
+  /*
+   * check the system call inputs
+   */
+
+  if (icnt != (counter_t)rec.icnt)
+    fatal("EIO trace inconsistency: ICNT mismatch");
+
+  if (regs->regs_PC != (md_addr_t)trans.pc)
+    fatal("EIO trace inconsistency: PC mismatch");
+
+  for (i=MD_FIRST_IN_REG; i <= MD_LAST_IN_REG; i++)
+    if ((qword_t)regs->regs_R[i] != trans.in_regs[i - MD_FIRST_IN_REG])
+      fatal("EIO trace inconsistency: R[%d] input mismatch", i);
+
+  for (n=0; n < trans.n_in; n++)
+    {
+      memcpy(&bmem, p, sizeof(bmem));
+      data = p + sizeof(bmem);
+      p = data + ROUND_UP(bmem.size, 8);
+
+      if (bmem.size > inbuf_size)
+	{
+	  inbuf_size = bmem.size;
+	  inbuf = realloc(inbuf, inbuf_size);
+	  if (!inbuf)
+	    fatal("out of virtual memory");
+	}
+      mem_bcopy(mem_fn, mem, Read, (md_addr_t)bmem.addr, inbuf, bmem.size);
+      if (memcmp(inbuf, data, bmem.size))
+	{
+	  for (i=0; inbuf[i] == data[i]; i++)
+	    /* nada */;
+	  fatal("EIO trace inconsistency: addr 0x%08p input mismatch",
+		(md_addr_t)bmem.addr + i);
+	}
+
+      /* simulate view'able I/O */
+      if (MD_OUTPUT_SYSCALL(regs))
+	{
+	  if (sim_progfd)
+	    {
+	      /* redirect program output to file */
+	      fwrite(data, 1, bmem.size, sim_progfd);
+	    }
+	  else
+	    {
+	      /* write the output to stdout/stderr */
+	      write(MD_STREAM_FILENO(regs), data, bmem.size);
+	    }
+	}
+    }
+
+  /*
+   * write system call outputs
+   */
+
+  ld_brk_point = (md_addr_t)trans.brk_point;
+
+  for (i=MD_FIRST_OUT_REG; i <= MD_LAST_OUT_REG; i++)
+    regs->regs_R[i] = trans.out_regs[i - MD_FIRST_OUT_REG];
+
+  for (n=0; n < trans.n_out; n++)
+    {
+      memcpy(&bmem, p, sizeof(bmem));
+      data = p + sizeof(bmem);
+      p = data + ROUND_UP(bmem.size, 8);
+
+      mem_bcopy(mem_fn, mem, Write, (md_addr_t)bmem.addr, data, bmem.size);
+    }
+}
+
+/* returns non-zero if file FNAME is a binary EIO trace */
+static int
+eio_bin_trace_valid(char *fname)
+{
+  FILE *fd;
+  char magic[sizeof(EIO_BIN_TRACE_MAGIC)-1];
+  int valid;
+
+  fd = gzopen(fname, "r");
+  if (!fd)
+    return FALSE;
+
+  valid = (fread(magic, sizeof(magic), 1, fd) == 1
+	   && !memcmp(magic, EIO_BIN_TRACE_MAGIC, sizeof(magic)));
+  gzclose(fd);
+
+  return valid;
+}
+
+/* create binary EIO trace file FNAME, compressed if FNAME names a
+   compressed file, a checkpoint is interleaved with the transactions
+   every CHKPT_INTERVAL instructions (0 for none besides the initial one) */
+FILE *
+eio_bin_create(char *fname, counter_t chkpt_interval)
+{
+  FILE *fd;
+  struct eio_bin_t *bs;
+  struct eio_bin_file_t fhdr;
+
+  fd = gzopen(fname, "w");
+  if (!fd)
+    fatal("unable to create EIO file `%s'", fname);
+
+  bs = eio_bin_new_stream(fd, /* writing */TRUE);
+  bs->chkpt_interval = chkpt_interval;
+  bs->next_chkpt = chkpt_interval;
+
+  memset(&fhdr, 0, sizeof(fhdr));
+  memcpy(fhdr.magic, EIO_BIN_TRACE_MAGIC, sizeof(fhdr.magic));
+  fhdr.file_format = MD_EIO_FILE_FORMAT;
+  fhdr.file_version = EIO_BIN_TRACE_VERSION;
+  fhdr.big_endian = (endian_host_byte_order() == endian_big);
+  fhdr.regs_size = sizeof(struct regs_t);
+  eio_bin_put(fd, &bs->pos, &fhdr, sizeof(fhdr));
+
+  return fd;
+}
+
+/* open binary EIO trace file FNAME, loading its seek index if it can be
+   seeked */
+static FILE *
+eio_bin_open(char *fname)
+{
+  FILE *fd;
+  struct eio_bin_t *bs;
+  struct eio_bin_file_t fhdr;
+  struct eio_bin_tail_t tail;
+  struct eio_bin_rec_t rec;
+
+  fd = gzopen(fname, "r");
+  if (!fd)
+    fatal("unable to open EIO file `%s'", fname);
+
+  bs = eio_bin_new_stream(fd, /* !writing */FALSE);
+  eio_bin_get(fd, &bs->pos, &fhdr, sizeof(fhdr));
+
+  if (fhdr.file_format != MD_EIO_FILE_FORMAT)
+    fatal("EIO file `%s' has incompatible format", fname);
+  if (fhdr.file_version != EIO_BIN_TRACE_VERSION)
+    fatal("EIO file `%s' has incompatible version", fname);
+  if (!!fhdr.big_endian != (endian_host_byte_order() == endian_big)
+      || fhdr.regs_size != sizeof(struct regs_t))
+    fatal("EIO file `%s' was written by an incompatible host", fname);
+
+  /* load the seek index, traces cut short have none and are read through */
+  if (bs->seekable
+      && fseek(fd, -(long)sizeof(tail), SEEK_END) == 0
+      && fread(&tail, sizeof(tail), 1, fd) == 1
+      && !memcmp(tail.magic, EIO_BIN_TRACE_MAGIC, sizeof(tail.magic))
+      && fseek(fd, (long)tail.index_offset, SEEK_SET) == 0
+      && fread(&rec, sizeof(rec), 1, fd) == 1
+      && rec.kind == EIO_BIN_INDEX)
+    {
+      bs->nidx = bs->maxidx = rec.size / sizeof(struct eio_bin_idx_t);
+      bs->idx = calloc(bs->nidx + 1, sizeof(struct eio_bin_idx_t));
+      if (!bs->idx)
+	fatal("out of virtual memory");
+      if (bs->nidx > 0
+	  && fread(bs->idx, sizeof(struct eio_bin_idx_t), bs->nidx, fd)
+	     != bs->nidx)
+	fatal("could not read EIO file `%s' seek index", fname);
+    }
+  if (bs->seekable)
+    eio_bin_skip(fd, &bs->pos, (long)sizeof(fhdr), bs->seekable);
+
+  return fd;
+}
+
+/* close binary EIO trace BS, writing its seek index if it is an output */
+static void
+eio_bin_close(struct eio_bin_t *bs)
+{
+  struct eio_bin_rec_t rec;
+  struct eio_bin_tail_t tail;
+
+  if (bs->writing)
+    {
+      tail.index_offset = bs->pos;
+      memcpy(tail.magic, EIO_BIN_TRACE_MAGIC, sizeof(tail.magic));
+
+      rec.kind = EIO_BIN_INDEX;
+      rec.size = bs->nidx * sizeof(struct eio_bin_idx_t);
+      rec.icnt = -1;
+      eio_bin_put(bs->fd, &bs->pos, &rec, sizeof(rec));
+      eio_bin_put(bs->fd, &bs->pos, bs->idx, rec.size);
+      eio_bin_put(bs->fd, &bs->pos, &tail, sizeof(tail));
+    }
+
+  if (bs->idx)
+    free(bs->idx);
+  if (bs->buf)
+    free(bs->buf);
+  memset(bs, 0, sizeof(*bs));
+}
+
+/* restore REGS and MEM from the last checkpoint interleaved into binary EIO
+   trace EIO_FD at or before instruction ICNT, the trace is left positioned
+   just after it, returns the instruction count of the checkpoint */
+counter_t
+eio_seek_chkpt(FILE *eio_fd,			/* EIO stream file desc */
+	       counter_t icnt,			/* instruction count */
+	       struct regs_t *regs,		/* regs to load */
+	       struct mem_t *mem)		/* memory to load */
+{
+  struct eio_bin_t *bs = eio_bin_stream(eio_fd);
+  struct eio_bin_idx_t *idx;
+  struct eio_bin_rec_t rec;
+
+  if (!bs || !bs->idx)
+    fatal("EIO trace has no checkpoint index (use an uncompressed "
+	  "binary EIO trace)");
+
+  idx = eio_bin_find_idx(bs, EIO_BIN_CHKPT, icnt);
+  if (!idx)
+    fatal("EIO trace has no checkpoint at or before instruction %d",
+	  (int)icnt);
+
+  eio_bin_skip(bs->fd, &bs->pos, (long)idx->offset, bs->seekable);
+  eio_bin_get(bs->fd, &bs->pos, &rec, sizeof(rec));
+  if (rec.kind != EIO_BIN_CHKPT)
+    fatal("EIO trace seek index is corrupt");
+
+  eio_trans_icnt = eio_bin_get_chkpt(regs, mem, bs->fd, &bs->pos, bs->seekable);
+
+  return sim_num_insn;
+}
+
 struct mem_rec_t {
   md_addr_t addr;
   unsigned size, maxsize;
@@ -577,6 +1537,16 @@ eio_write_trace(FILE *eio_fd,			/* EIO stream file desc */
 {
   int i;
   struct exo_term_t *exo;
+  struct eio_bin_t *bs = eio_bin_stream(eio_fd);
+
+  /* interleave a checkpoint of the state just before this syscall */
+  if (bs != NULL
+      && bs->chkpt_interval != 0
+      && icnt >= bs->next_chkpt)
+    {
+      eio_bin_put_trace_chkpt(bs, regs, mem, icnt - 1);
+      bs->next_chkpt = icnt + bs->chkpt_interval;
+    }
 
   /* write syscall register inputs ($r2..$r7) */
   input_regs = exo_new(ec_list, NULL);
@@ -619,8 +1589,13 @@ eio_write_trace(FILE *eio_fd,			/* EIO stream file desc */
 		input_regs, input_mem,
 		output_regs, output_mem,
 		NULL);
-  exo_print(exo, eio_fd);
-  fprintf(eio_fd, "\n\n");
+  if (bs != NULL)
+    eio_bin_put_trans(bs, icnt, exo);
+  else
+    {
+      exo_print(exo, eio_fd);
+      fprintf(eio_fd, "\n\n");
+    }
 
   /* release input storage */
   exo_delete(exo);
@@ -644,6 +1619,7 @@ eio_read_trace(FILE *eio_fd,			/* EIO stream file desc */
   struct exo_term_t *exo, *exo_icnt, *exo_pc;
   struct exo_term_t *exo_inregs, *exo_inmem, *exo_outregs, *exo_outmem;
   struct exo_term_t *brkrec, *regrec, *memrec;
+  struct eio_bin_t *bs;
 
   /* exit() system calls get executed for real... */
   if (MD_EXIT_SYSCALL(regs))
@@ -652,6 +1628,13 @@ eio_read_trace(FILE *eio_fd,			/* EIO stream file desc */
       panic("returned from exit() system call");
     }
 
+  /* binary EIO traces have their own reader */
+  if ((bs = eio_bin_stream(eio_fd)) != NULL)
+    {
+      eio_bin_get_trans(bs, icnt, regs, mem_fn, mem);
+      return;
+    }
+
   /* else, read the external I/O (EIO) transaction */
   exo = exo_read(eio_fd);
 
@@ -815,6 +1798,38 @@ void
 eio_fast_forward(FILE *eio_fd, counter_t icnt)
 {
   struct exo_term_t *exo, *exo_icnt;
+  struct eio_bin_t *bs = eio_bin_stream(eio_fd);
+
+  if (bs != NULL)
+    {
+      struct eio_bin_idx_t *idx;
+      struct eio_bin_rec_t rec;
+
+      /* nothing to skip before the first transaction */
+      if (icnt < 0)
+	return;
+
+      /* seek to the last indexed transaction before the target */
+      idx = bs->idx ? eio_bin_find_idx(bs, EIO_BIN_TRANS, icnt) : NULL;
+      if (idx != NULL && (long)idx->offset > bs->pos)
+	eio_bin_skip(bs->fd, &bs->pos, (long)idx->offset, bs->seekable);
+
+      /* then step over whole records */
+      do
+	{
+	  if (!eio_bin_next_trans(bs, &rec))
+	    fatal("could not fast forward to EIO checkpoint");
+	  eio_bin_skip(bs->fd, &bs->pos, bs->pos + rec.size, bs->seekable);
+	}
+      while ((counter_t)rec.icnt < icnt);
+
+      if ((counter_t)rec.icnt != icnt)
+	fatal("could not fast forward to EIO checkpoint");
+
+      /* one more transaction processed */
+      eio_trans_icnt = icnt;
+      return;
+    }
 
   do
     {
@@ -65,6 +65,12 @@ FILE *eio_create(char *fname);
 
 FILE *eio_open(char *fname);
 
+/* create binary EIO trace file FNAME, compressed if FNAME names a
+   compressed file, a checkpoint is interleaved with the transactions
+   every CHKPT_INTERVAL instructions (0 for none besides the initial one),
+   eio_open() recognizes both trace formats */
+FILE *eio_bin_create(char *fname, counter_t chkpt_interval);
+
 /* returns non-zero if file FNAME has a valid EIO header */
 int eio_valid(char *fname);
 
@@ -84,6 +90,26 @@ eio_read_chkpt(struct regs_t *regs,		/* regs to dump */
 		struct mem_t *mem,		/* memory to dump */
 		FILE *fd);			/* stream to read */
 
+/* returns non-zero if file FNAME is a binary checkpoint file */
+int eio_bin_valid(char *fname);
+
+/* write a binary check point of the current architected state to file
+   FNAME, compressed if FNAME names a compressed file, returns EIO
+   transaction count (an EIO file pointer) */
+counter_t
+eio_write_bin_chkpt(struct regs_t *regs,	/* regs to dump */
+		    struct mem_t *mem,		/* memory to dump */
+		    char *fname);		/* file to create */
+
+/* read a binary check point of architected state from file FNAME, returns
+   EIO transaction count (an EIO file pointer); uncompressed checkpoints
+   are mapped copy-on-write into MEM, so page images are only read from
+   the file when the simulator first touches them */
+counter_t
+eio_read_bin_chkpt(struct regs_t *regs,		/* regs to load */
+		   struct mem_t *mem,		/* memory to load */
+		   char *fname);		/* file to read */
+
 /* syscall proxy handler, with EIO tracing support, architect registers
    and memory are assumed to be precise when this function is called,
    register and memory are updated with the results of the sustem call */
@@ -109,4 +135,13 @@ eio_read_trace(FILE *eio_fd,			/* EIO stream file desc */
 /* fast forward EIO trace EIO_FD to the transaction just after ICNT */
 void eio_fast_forward(FILE *eio_fd, counter_t icnt);
 
+/* restore REGS and MEM from the last checkpoint interleaved into binary EIO
+   trace EIO_FD at or before instruction ICNT, the trace is left positioned
+   just after it, returns the instruction count of the checkpoint */
+counter_t
+eio_seek_chkpt(FILE *eio_fd,			/* EIO stream file desc */
+	       counter_t icnt,			/* instruction count */
+	       struct regs_t *regs,		/* regs to load */
+	       struct mem_t *mem);		/* memory to load */
+
 #endif /* EIO_H */
@@ -65,6 +65,15 @@
 #define INLINE
 #endif
 
+/* storage class of state private to each host thread, for simulators that
+   run parts of a simulation on several threads, MSVC builds have no such
+   simulator threads and keep the state global */
+#ifndef _MSC_VER
+#define HOST_TLS	__thread
+#else /* _MSC_VER */
+#define HOST_TLS
+#endif /* _MSC_VER */
+
 /* bind together two symbols, at preprocess time */
 #ifdef __GNUC__
 /* this works on all GNU GCC targets (that I've seen...) */
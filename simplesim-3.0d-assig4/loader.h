@@ -94,41 +94,43 @@
  */
 
 /*
- * program segment ranges, valid after calling ld_load_prog()
+ * program segment ranges, valid after calling ld_load_prog(), they are
+ * kept per host thread (see HOST_TLS), so each core of a multi-core
+ * simulator loads its own program
  */
 
 /* program text (code) segment base */
-extern md_addr_t ld_text_base;
+extern HOST_TLS md_addr_t ld_text_base;
 
 /* program text (code) size in bytes */
-extern unsigned int ld_text_size;
+extern HOST_TLS unsigned int ld_text_size;
 
 /* program initialized data segment base */
-extern md_addr_t ld_data_base;
+extern HOST_TLS md_addr_t ld_data_base;
 
 /* program initialized ".data" and uninitialized ".bss" size in bytes */
-extern unsigned int ld_data_size;
+extern HOST_TLS unsigned int ld_data_size;
 
 /* top of the data segment */
-extern md_addr_t ld_brk_point;
+extern HOST_TLS md_addr_t ld_brk_point;
 
 /* program stack segment base (highest address in stack) */
-extern md_addr_t ld_stack_base;
+extern HOST_TLS md_addr_t ld_stack_base;
 
 /* program initial stack size */
-extern unsigned int ld_stack_size;
+extern HOST_TLS unsigned int ld_stack_size;
 
 /* lowest address accessed on the stack */
-extern md_addr_t ld_stack_min;
+extern HOST_TLS md_addr_t ld_stack_min;
 
 /* program file name */
-extern char *ld_prog_fname;
+extern HOST_TLS char *ld_prog_fname;
 
 /* program entry point (initial PC) */
-extern md_addr_t ld_prog_entry;
+extern HOST_TLS md_addr_t ld_prog_entry;
 
 /* program environment base address address */
-extern md_addr_t ld_environ_base;
+extern HOST_TLS md_addr_t ld_environ_base;
 
 /* target executable endian-ness, non-zero if big endian */
 extern int ld_target_big_endian;
@@ -58,7 +58,11 @@
 #include <sys/types.h>
 #ifndef _MSC_VER
 #include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #endif
 #ifdef BFD_LOADER
 #include <bfd.h>
@@ -115,6 +119,10 @@ jmp_buf sim_exit_buf;
 /* set to non-zero when simulator should dump statistics */
 int sim_dump_stats = FALSE;
 
+/* non-zero in a simulator that forked -snapshot children, it only waited
+   for them and must not write to the files they have taken over */
+int sim_snapshot_parent = FALSE;
+
 /* options database */
 struct opt_odb_t *sim_odb;
 
@@ -134,6 +142,16 @@ FILE *sim_progfd = NULL;
 /* track first argument orphan, this is the program to execute */
 static int exec_index = -1;
 
+/* simulator command line, kept for snapshot children */
+static int sim_argc;
+static char **sim_argv;
+
+/* fork()-based snapshot configurations and output file prefix */
+#define MAX_SNAPSHOTS			64
+static int snapshot_nelt = 0;
+static char *snapshot_cfgs[MAX_SNAPSHOTS];
+static char *snapshot_prefix;
+
 /* dump help information */
 static int help_me;
 
@@ -184,6 +202,17 @@ usage(FILE *fd, int argc, char **argv)
 
 static int running = FALSE;
 
+/* called before the stats are printed, see sim_stats_hook() */
+static void (*stats_hook_fn)(void) = NULL;
+
+/* register FN to be called by sim_print_stats() before the stats are
+   printed, e.g., to bring stats kept by other threads up to date */
+void
+sim_stats_hook(void (*fn)(void))	/* stats hook function */
+{
+  stats_hook_fn = fn;
+}
+
 /* print all simulator stats */
 void
 sim_print_stats(FILE *fd)		/* output stream */
@@ -195,6 +224,9 @@ sim_print_stats(FILE *fd)		/* output stream */
   if (!running)
     return;
 
+  if (stats_hook_fn)
+    stats_hook_fn();
+
   /* get stats time */
   sim_end_time = time((time_t *)NULL);
   sim_elapsed_time = MAX(sim_end_time - sim_start_time, 1);
@@ -225,6 +257,155 @@ exit_now(int exit_code)
   exit(exit_code);
 }
 
+/* give this process private copies of all regular files it has open,
+   standard input included, so file offsets are no longer shared with the
+   processes it was forked from */
+void
+sim_private_files(void)
+{
+#ifndef _MSC_VER
+  DIR *dir;
+  struct dirent *ent;
+  struct stat sbuf;
+  char path[64], fname[1024];
+  int fd, newfd, flags, len;
+  off_t offset;
+
+  dir = opendir("/proc/self/fd");
+  if (!dir)
+    {
+      warn("cannot reopen files after fork, open files are shared");
+      return;
+    }
+
+  while ((ent = readdir(dir)) != NULL)
+    {
+      fd = atoi(ent->d_name);
+      if (ent->d_name[0] == '.' || fd == 1 || fd == 2 || fd == dirfd(dir))
+	continue;
+
+      if (fstat(fd, &sbuf) < 0)
+	continue;
+      if (!S_ISREG(sbuf.st_mode))
+	{
+	  if (S_ISFIFO(sbuf.st_mode))
+	    warn("forked simulator shares pipe on descriptor %d, "
+		 "use uncompressed files", fd);
+	  continue;
+	}
+
+      sprintf(path, "/proc/self/fd/%d", fd);
+      len = readlink(path, fname, sizeof(fname)-1);
+      if (len < 0)
+	continue;
+      fname[len] = '\0';
+
+      flags = fcntl(fd, F_GETFL) & ~(O_CREAT|O_TRUNC|O_EXCL);
+      offset = lseek(fd, 0, SEEK_CUR);
+      newfd = open(fname, flags);
+      if (newfd < 0)
+	fatal("forked simulator could not reopen `%s'", fname);
+      if (lseek(newfd, offset, SEEK_SET) != offset
+	  || dup2(newfd, fd) < 0)
+	fatal("forked simulator could not reopen `%s'", fname);
+      close(newfd);
+    }
+  closedir(dir);
+#endif /* !_MSC_VER */
+}
+
+/* fork one child simulator per -snapshot configuration file from the
+   current architected state, called by a simulator once it has fast
+   forwarded to the point of interest; each child re-reads its -config
+   file on top of the original options, re-runs sim_check_options() and
+   sim_reg_stats(), redirects its output to <prefix>.<n>.simout/progout,
+   and returns the (zero-based) snapshot number to continue simulating;
+   the parent waits for all children and exits, returns -1 if no
+   snapshots were requested */
+int
+sim_snapshot(void)
+{
+#ifdef _MSC_VER
+  return -1;
+#else /* !_MSC_VER */
+  int i, status, failed = 0;
+  pid_t pid;
+  char fname[1024], *args[3];
+
+  if (snapshot_nelt == 0)
+    return -1;
+
+  myfprintf(stderr, "sim: ** forking %d snapshots @ inst %n **\n",
+	    snapshot_nelt, sim_num_insn);
+
+  /* don't let children inherit unwritten output */
+  fflush(NULL);
+
+  for (i=0; i < snapshot_nelt; i++)
+    {
+      pid = fork();
+      if (pid < 0)
+	fatal("could not fork snapshot %d", i);
+      if (pid != 0)
+	continue;
+
+      /* child: private output and files */
+      sprintf(fname, "%s.%d.simout", snapshot_prefix, i);
+      if (!freopen(fname, "w", stderr))
+	fatal("unable to redirect snapshot output to file `%s'", fname);
+      sprintf(fname, "%s.%d.progout", snapshot_prefix, i);
+      sim_progfd = fopen(fname, "w");
+      if (!sim_progfd)
+	fatal("unable to redirect program output to file `%s'", fname);
+      sim_private_files();
+
+      /* apply this snapshot's configuration, then rebuild the simulator
+         configuration and statistics from it */
+      args[0] = sim_argv[0];
+      args[1] = "-config";
+      args[2] = mystrdup(snapshot_cfgs[i]);
+      opt_process_options(sim_odb, 3, args);
+      sim_check_options(sim_odb, sim_argc, sim_argv);
+
+      sim_sdb = stat_new();
+      sim_reg_stats(sim_sdb);
+
+      banner(stderr, sim_argc, sim_argv);
+      myfprintf(stderr, "sim: snapshot %d @ inst %n, config `%s', "
+		"options follow:\n", i, sim_num_insn, snapshot_cfgs[i]);
+      opt_print_options(sim_odb, stderr, /* short */TRUE, /* notes */TRUE);
+      sim_aux_config(stderr);
+      fprintf(stderr, "\n");
+
+      /* snapshot rate stats start now */
+      sim_start_time = time((time_t *)NULL);
+
+      return i;
+    }
+
+  /* parent: wait for all snapshots to finish */
+  for (i=0; i < snapshot_nelt; i++)
+    {
+      pid = wait(&status);
+      if (pid < 0)
+	break;
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+	  warn("snapshot process %d failed", (int)pid);
+	  failed++;
+	}
+    }
+  fprintf(stderr, "sim: ** %d of %d snapshots completed **\n",
+	  snapshot_nelt - failed, snapshot_nelt);
+  sim_snapshot_parent = TRUE;
+
+  /* exit jumps to the target set in main() */
+  longjmp(sim_exit_buf, /* exitcode + fudge */(failed != 0)+1);
+
+  return -1;
+#endif /* _MSC_VER */
+}
+
 int
 main(int argc, char **argv, char **envp)
 {
@@ -266,7 +447,9 @@ main(int argc, char **argv, char **envp)
 	      &rand_seed, /* default */1, /* print */TRUE, NULL);
   opt_reg_flag(sim_odb, "-q", "initialize and terminate immediately",
 	       &init_quit, /* default */FALSE, /* !print */FALSE, NULL);
-  opt_reg_string(sim_odb, "-chkpt", "restore EIO trace execution from <fname>",
+  opt_reg_string(sim_odb, "-chkpt",
+		 "restore EIO trace execution from <fname>, or from the "
+		 "binary EIO trace's own checkpoint nearest before #<icnt>",
 		 &sim_chkpt_fname, /* default */NULL, /* !print */FALSE, NULL);
 
   /* stdio redirection options */
@@ -278,6 +461,19 @@ main(int argc, char **argv, char **envp)
 		 "redirect simulated program output to file",
 		 &sim_progout, /* default */NULL, /* !print */FALSE, NULL);
 
+#ifndef _MSC_VER
+  /* fork()-based snapshot options */
+  opt_reg_string_list(sim_odb, "-snapshot",
+		      "after fast forward, fork a simulator per config file",
+		      snapshot_cfgs, MAX_SNAPSHOTS, &snapshot_nelt,
+		      /* default */NULL, /* !print */FALSE, /* format */NULL,
+		      /* !accrue */FALSE);
+  opt_reg_string(sim_odb, "-snapshot:prefix",
+		 "snapshot output file prefix, <prefix>.<n>.{simout,progout}",
+		 &snapshot_prefix, /* default */"snapshot",
+		 /* !print */FALSE, NULL);
+#endif
+
 #ifndef _MSC_VER
   /* scheduling priority option */
   opt_reg_int(sim_odb, "-nice",
@@ -352,6 +548,8 @@ main(int argc, char **argv, char **envp)
   /* else, exec_index points to simulated program arguments */
 
   /* check simulator-specific options */
+  sim_argc = argc;
+  sim_argv = argv;
   sim_check_options(sim_odb, argc, argv);
 
 #ifndef _MSC_VER
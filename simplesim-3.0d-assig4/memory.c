@@ -51,6 +51,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "host.h"
 #include "misc.h"
@@ -59,6 +60,32 @@
 #include "stats.h"
 #include "memory.h"
 
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#endif /* !_MSC_VER */
+
+#ifndef MEM_FLAT
+/* reads of unallocated pages through the read TLB are served from here */
+static byte_t mem_zero_page[MD_PAGE_SIZE];
+
+/* invalidate all software TLB entries of memory space MEM */
+static void
+mem_tlb_flush(struct mem_t *mem)	/* memory space to flush */
+{
+  int i;
+
+  for (i=0; i < MEM_TLB_SIZE; i++)
+    {
+      mem->rtlb[i].tag = MEM_TLB_INVALID;
+      mem->rtlb[i].page = NULL;
+      mem->wtlb[i].tag = MEM_TLB_INVALID;
+      mem->wtlb[i].page = NULL;
+    }
+}
+#endif /* !MEM_FLAT */
+
 
 /* create a flat memory space */
 struct mem_t *
@@ -71,6 +98,25 @@ mem_create(char *name)			/* name of the memory space */
     fatal("out of virtual memory");
 
   mem->name = mystrdup(name);
+
+#ifdef MEM_FLAT
+  /* reserve the entire target address space, host pages are committed by
+     the host OS only when first touched, so untouched target pages cost
+     nothing and read back as zero */
+  mem->flat = mmap(NULL, (size_t)MEM_FLAT_PAGES * MD_PAGE_SIZE,
+		   PROT_READ|PROT_WRITE,
+		   MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+  if (mem->flat == (byte_t *)MAP_FAILED)
+    fatal("could not reserve flat memory space `%s', "
+	  "rebuild with -DMEM_NO_FLAT", name);
+
+  mem->flat_valid = calloc(MEM_FLAT_PAGES / 32, sizeof(word_t));
+  if (!mem->flat_valid)
+    fatal("out of virtual memory");
+#else /* !MEM_FLAT */
+  mem_tlb_flush(mem);
+#endif /* MEM_FLAT */
+
   return mem;
 }
 
@@ -79,6 +125,10 @@ byte_t *
 mem_translate(struct mem_t *mem,	/* memory space to access */
 	      md_addr_t addr)		/* virtual address to translate */
 {
+#ifdef MEM_FLAT
+  /* flat memory spaces never miss, the page table is bookkeeping only */
+  return MEM_PAGE(mem, addr);
+#else /* !MEM_FLAT */
   struct mem_pte_t *pte, *prev;
 
   /* got here via a first level miss in the page tables */
@@ -104,7 +154,45 @@ mem_translate(struct mem_t *mem,	/* memory space to access */
 
   /* no translation found, return NULL */
   return NULL;
+#endif /* MEM_FLAT */
+}
+
+#ifndef MEM_FLAT
+/* service a software TLB miss for a CMD access to ADDR, returns the host page
+   and installs it in the read or write TLB, reads of unallocated pages return
+   a shared zero page, writes allocate the page */
+byte_t *
+mem_tlb_fill(struct mem_t *mem,		/* memory space to access */
+	     enum mem_cmd cmd,		/* Read or Write */
+	     md_addr_t addr)		/* virtual address to translate */
+{
+  byte_t *page;
+  struct mem_tlb_t *tlb;
+
+  mem->tlb_misses++;
+
+  page = MEM_PAGE(mem, addr);
+  if (cmd == Read)
+    {
+      tlb = &mem->rtlb[MEM_TLB_SET(addr)];
+      if (!page)
+	page = mem_zero_page;
+    }
+  else
+    {
+      tlb = &mem->wtlb[MEM_TLB_SET(addr)];
+      if (!page)
+	{
+	  mem_newpage(mem, addr);
+	  page = MEM_PAGE(mem, addr);
+	}
+    }
+
+  tlb->tag = MEM_TLB_TAG(addr);
+  tlb->page = page;
+  return page;
 }
+#endif /* !MEM_FLAT */
 
 /* allocate a memory page */
 void
@@ -114,10 +202,17 @@ mem_newpage(struct mem_t *mem,		/* memory space to allocate in */
   byte_t *page;
   struct mem_pte_t *pte;
 
+#ifdef MEM_FLAT
+  /* the page is already reserved in the flat mapping, just mark it live */
+  page = mem->flat + ((word_t)addr & ~(MD_PAGE_SIZE - 1));
+  mem->flat_valid[(word_t)addr >> (MD_LOG_PAGE_SIZE + 5)] |=
+    (1U << (((word_t)addr >> MD_LOG_PAGE_SIZE) & 31));
+#else /* !MEM_FLAT */
   /* see misc.c for details on the getcore() function */
   page = getcore(MD_PAGE_SIZE);
   if (!page)
     fatal("out of virtual memory");
+#endif /* MEM_FLAT */
 
   /* generate a new PTE */
   pte = calloc(1, sizeof(struct mem_pte_t));
@@ -130,6 +225,12 @@ mem_newpage(struct mem_t *mem,		/* memory space to allocate in */
   pte->next = mem->ptab[MEM_PTAB_SET(addr)];
   mem->ptab[MEM_PTAB_SET(addr)] = pte;
 
+#ifndef MEM_FLAT
+  /* the read TLB may still map this page to the zero page, drop it */
+  if (mem->rtlb[MEM_TLB_SET(addr)].tag == MEM_TLB_TAG(addr))
+    mem->rtlb[MEM_TLB_SET(addr)].tag = MEM_TLB_INVALID;
+#endif /* !MEM_FLAT */
+
   /* one more page allocated */
   mem->page_count++;
 }
@@ -154,27 +255,12 @@ mem_access(struct mem_t *mem,		/* memory space to access */
   if (/* check natural alignment */(addr & (nbytes-1)) != 0)
     return md_fault_alignment;
 
-  /* perform the copy */
-  {
-    if (cmd == Read)
-      {
-	while (nbytes-- > 0)
-	  {
-	    *((byte_t *)p) = MEM_READ_BYTE(mem, addr);
-	    p += sizeof(byte_t);
-	    addr += sizeof(byte_t);
-	  }
-      }
-    else
-      {
-	while (nbytes-- > 0)
-	  {
-	    MEM_WRITE_BYTE(mem, addr, *((byte_t *)p));
-	    p += sizeof(byte_t);
-	    addr += sizeof(byte_t);
-	  }
-      }
-  }
+  /* perform the copy, a naturally aligned access never spans pages, so a
+     single translation covers the whole transfer */
+  if (cmd == Read)
+    memcpy(p, MEM_RPAGE(mem, addr) + MEM_OFFSET(addr), nbytes);
+  else
+    memcpy(MEM_WPAGE(mem, addr) + MEM_OFFSET(addr), p, nbytes);
 
 #if 0
   switch (nbytes)
@@ -234,6 +320,9 @@ mem_reg_stats(struct mem_t *mem,	/* memory space to declare */
   stat_reg_formula(sdb, buf, "total size of memory pages allocated",
 		   buf1, "%11.0fk");
 
+#ifndef MEM_FLAT
+  /* page table stats only apply when loads and stores are translated
+     through the page table, flat memory spaces never consult it */
   sprintf(buf, "%s.ptab_misses", mem->name);
   stat_reg_counter(sdb, buf, "total first level page table misses",
 		   &mem->ptab_misses, mem->ptab_misses, NULL);
@@ -245,6 +334,19 @@ mem_reg_stats(struct mem_t *mem,	/* memory space to declare */
   sprintf(buf, "%s.ptab_miss_rate", mem->name);
   sprintf(buf1, "%s.ptab_misses / %s.ptab_accesses", mem->name, mem->name);
   stat_reg_formula(sdb, buf, "first level page table miss rate", buf1, NULL);
+
+  sprintf(buf, "%s.tlb_accesses", mem->name);
+  stat_reg_counter(sdb, buf, "total software TLB accesses",
+		   &mem->tlb_accesses, mem->tlb_accesses, NULL);
+
+  sprintf(buf, "%s.tlb_misses", mem->name);
+  stat_reg_counter(sdb, buf, "total software TLB misses",
+		   &mem->tlb_misses, mem->tlb_misses, NULL);
+
+  sprintf(buf, "%s.tlb_hit_rate", mem->name);
+  sprintf(buf1, "1 - %s.tlb_misses / %s.tlb_accesses", mem->name, mem->name);
+  stat_reg_formula(sdb, buf, "software TLB hit rate", buf1, NULL);
+#endif /* !MEM_FLAT */
 }
 
 /* initialize memory system, call before loader.c */
@@ -260,6 +362,12 @@ mem_init(struct mem_t *mem)	/* memory space to initialize */
   mem->page_count = 0;
   mem->ptab_misses = 0;
   mem->ptab_accesses = 0;
+  mem->tlb_accesses = 0;
+  mem->tlb_misses = 0;
+
+#ifndef MEM_FLAT
+  mem_tlb_flush(mem);
+#endif /* !MEM_FLAT */
 }
 
 /* dump a block of memory, returns any faults encountered */
@@ -291,6 +399,150 @@ mem_dump(struct mem_t *mem,		/* memory space to display */
   return md_fault_none;
 }
 
+/* copy NBYTES to/from simulated memory space a page span at a time, host
+   buffer VP is copied directly to/from the target pages without going
+   through an access callback, pages written are allocated as needed */
+void
+mem_bulk_copy(struct mem_t *mem,	/* memory space to access */
+	      enum mem_cmd cmd,		/* Read (from sim mem) or Write */
+	      md_addr_t addr,		/* target address to access */
+	      void *vp,			/* host memory address to access */
+	      int nbytes)		/* number of bytes to access */
+{
+  byte_t *p = vp;
+  int span;
+
+  while (nbytes > 0)
+    {
+      /* copy up to the end of the current target page */
+      span = MD_PAGE_SIZE - MEM_OFFSET(addr);
+      if (span > nbytes)
+	span = nbytes;
+
+      if (cmd == Read)
+	memcpy(p, MEM_RPAGE(mem, addr) + MEM_OFFSET(addr), span);
+      else
+	memcpy(MEM_WPAGE(mem, addr) + MEM_OFFSET(addr), p, span);
+
+      addr += span;
+      p += span;
+      nbytes -= span;
+    }
+}
+
+/* zero out NBYTES of simulated memory a page span at a time */
+void
+mem_bulk_zero(struct mem_t *mem,	/* memory space to access */
+	      md_addr_t addr,		/* target address to access */
+	      int nbytes)		/* number of bytes to clear */
+{
+  int span;
+
+  while (nbytes > 0)
+    {
+      span = MD_PAGE_SIZE - MEM_OFFSET(addr);
+      if (span > nbytes)
+	span = nbytes;
+
+      memset(MEM_WPAGE(mem, addr) + MEM_OFFSET(addr), 0, span);
+
+      addr += span;
+      nbytes -= span;
+    }
+}
+
+/* map NPAGES page images from host file descriptor FD, starting at file
+   offset OFFSET, copy-on-write (or, if SHARED, writing through to the file)
+   into memory space MEM at page-aligned target address ADDR; the host
+   faults the images in on first touch, so unused pages are never read,
+   returns non-zero on success or zero if the host cannot map the file here
+   (the caller must then copy the pages in) */
+int
+mem_map_file(struct mem_t *mem,		/* memory space to map into */
+	     md_addr_t addr,		/* page-aligned target address */
+	     int fd,			/* host file descriptor to map */
+	     long offset,		/* file offset of first page image */
+	     int npages,		/* number of pages to map */
+	     int shared)		/* share the pages with other mappings? */
+{
+#ifdef _MSC_VER
+  return FALSE;
+#else /* !_MSC_VER */
+  int i;
+  long host_page_size = sysconf(_SC_PAGESIZE);
+  size_t len = (size_t)npages * MD_PAGE_SIZE;
+  byte_t *p;
+#ifndef MEM_FLAT
+  struct mem_pte_t *pte;
+#endif /* !MEM_FLAT */
+
+  /* target pages must be made of whole host pages */
+  if (host_page_size <= 0
+      || (MD_PAGE_SIZE % host_page_size) != 0
+      || (offset % host_page_size) != 0
+      || MEM_OFFSET(addr) != 0)
+    return FALSE;
+
+#ifdef MEM_FLAT
+  /* overlay the file onto the flat reservation, replacing whatever pages
+     were there before */
+  p = mmap(mem->flat + (word_t)addr, len, PROT_READ|PROT_WRITE,
+	   (shared ? MAP_SHARED : MAP_PRIVATE)|MAP_FIXED, fd, (off_t)offset);
+  if (p == (byte_t *)MAP_FAILED)
+    {
+      /* a failed fixed mapping may have dropped the reservation there,
+	 put it back so the caller can copy the pages in instead */
+      p = mmap(mem->flat + (word_t)addr, len, PROT_READ|PROT_WRITE,
+	       MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_FIXED, -1, 0);
+      if (p == (byte_t *)MAP_FAILED)
+	fatal("could not restore memory space `%s'", mem->name);
+      return FALSE;
+    }
+
+  for (i=0; i < npages; i++)
+    {
+      md_addr_t page_addr = addr + i * MD_PAGE_SIZE;
+
+      if (!MEM_FLAT_VALID(mem, page_addr))
+	mem_newpage(mem, page_addr);
+    }
+#else /* !MEM_FLAT */
+  p = mmap(NULL, len, PROT_READ|PROT_WRITE,
+	   shared ? MAP_SHARED : MAP_PRIVATE, fd, (off_t)offset);
+  if (p == (byte_t *)MAP_FAILED)
+    return FALSE;
+
+  /* point the PTEs at the mapped images, the pages they replace were
+     allocated with getcore() and cannot be released */
+  for (i=0; i < npages; i++)
+    {
+      md_addr_t page_addr = addr + i * MD_PAGE_SIZE;
+
+      for (pte = mem->ptab[MEM_PTAB_SET(page_addr)]; pte; pte = pte->next)
+	if (pte->tag == MEM_PTAB_TAG(page_addr))
+	  break;
+
+      if (!pte)
+	{
+	  pte = calloc(1, sizeof(struct mem_pte_t));
+	  if (!pte)
+	    fatal("out of virtual memory");
+	  pte->tag = MEM_PTAB_TAG(page_addr);
+	  pte->next = mem->ptab[MEM_PTAB_SET(page_addr)];
+	  mem->ptab[MEM_PTAB_SET(page_addr)] = pte;
+	  mem->page_count++;
+	}
+      pte->page = p + i * MD_PAGE_SIZE;
+    }
+
+  /* cached translations may point at the replaced pages */
+  mem_tlb_flush(mem);
+#endif /* MEM_FLAT */
+
+  return TRUE;
+#endif /* _MSC_VER */
+}
+
 /* copy a '\0' terminated string to/from simulated memory space, returns
    the number of bytes copied, returns any fault encountered */
 enum md_fault_type
@@ -304,6 +556,40 @@ mem_strcpy(mem_access_fn mem_fn,	/* user-specified memory accessor */
   char c;
   enum md_fault_type fault;
 
+  /* direct accesses need no per-byte callback, copy whole page spans */
+  if (mem_fn == mem_access)
+    {
+      byte_t *page, *term;
+      int span;
+
+      switch (cmd)
+	{
+	case Read:
+	  /* scan each page span for the string terminator */
+	  do {
+	    page = MEM_RPAGE(mem, addr) + MEM_OFFSET(addr);
+	    span = MD_PAGE_SIZE - MEM_OFFSET(addr);
+	    term = memchr(page, '\0', span);
+	    if (term)
+	      span = term - page + 1;
+	    memcpy(s, page, span);
+	    s += span;
+	    addr += span;
+	  } while (!term);
+	  break;
+
+	case Write:
+	  mem_bulk_copy(mem, Write, addr, s, strlen(s) + 1);
+	  break;
+
+	default:
+	  return md_fault_internal;
+	}
+
+      /* no faults... */
+      return md_fault_none;
+    }
+
   switch (cmd)
     {
     case Read:
@@ -348,6 +634,13 @@ mem_bcopy(mem_access_fn mem_fn,		/* user-specified memory accessor */
   byte_t *p = vp;
   enum md_fault_type fault;
 
+  /* direct accesses need no per-byte callback, copy whole page spans */
+  if (mem_fn == mem_access)
+    {
+      mem_bulk_copy(mem, cmd, addr, vp, nbytes);
+      return md_fault_none;
+    }
+
   /* copy NBYTES bytes to/from simulator memory */
   while (nbytes-- > 0)
     {
@@ -375,6 +668,16 @@ mem_bcopy4(mem_access_fn mem_fn,	/* user-specified memory accessor */
   int words = nbytes >> 2;		/* note: nbytes % 2 == 0 is assumed */
   enum md_fault_type fault;
 
+  /* direct accesses need no per-word callback, copy whole page spans,
+     an unaligned ADDR faults on the first word as mem_access() would */
+  if (mem_fn == mem_access)
+    {
+      if (words > 0 && (addr & (sizeof(word_t)-1)) != 0)
+	return md_fault_alignment;
+      mem_bulk_copy(mem, cmd, addr, vp, words << 2);
+      return md_fault_none;
+    }
+
   while (words-- > 0)
     {
       fault = mem_fn(mem, cmd, addr, p, sizeof(word_t));
@@ -399,6 +702,13 @@ mem_bzero(mem_access_fn mem_fn,		/* user-specified memory accessor */
   byte_t c = 0;
   enum md_fault_type fault;
 
+  /* direct accesses need no per-byte callback, clear whole page spans */
+  if (mem_fn == mem_access)
+    {
+      mem_bulk_zero(mem, addr, nbytes);
+      return md_fault_none;
+    }
+
   /* zero out NBYTES of simulator memory */
   while (nbytes-- > 0)
     {
@@ -64,6 +64,34 @@
 #define MEM_PTAB_SIZE		(32*1024)
 #define MEM_LOG_PTAB_SIZE	15
 
+/* targets with 32-bit addresses running on a host with 64-bit pointers back
+   the entire target address space with one lazily-committed host mapping,
+   so virtual to host translation is a single add; the inverted page table is
+   still maintained for page bookkeeping (MEM_FORALL(), page counts), but it
+   is no longer consulted on loads and stores, targets with sparse 64-bit
+   address spaces (Alpha) always use the page table, define MEM_NO_FLAT at
+   build time to force the page table version for all targets */
+#if !defined(MD_QWORD_ADDRS) && !defined(MEM_NO_FLAT)			\
+    && (defined(__LP64__) || defined(_LP64)) && !defined(_MSC_VER)
+#define MEM_FLAT
+#endif
+
+#ifdef MEM_FLAT
+/* number of target pages in the flat memory space */
+#define MEM_FLAT_PAGES		(1 << (32 - MD_LOG_PAGE_SIZE))
+#else /* !MEM_FLAT */
+/* number of entries in the host-side software TLBs that sit in front of the
+   page table, one each for reads and writes (must be power-of-two) */
+#define MEM_TLB_SIZE		1024
+#define MEM_LOG_TLB_SIZE	10
+
+/* software TLB entry, maps a virtual page to its host page */
+struct mem_tlb_t {
+  md_addr_t tag;		/* virtual page address, MEM_TLB_INVALID if none */
+  byte_t *page;			/* host page pointer */
+};
+#endif /* MEM_FLAT */
+
 /* page table entry */
 struct mem_pte_t {
   struct mem_pte_t *next;	/* next translation in this bucket */
@@ -76,11 +104,20 @@ struct mem_t {
   /* memory object state */
   char *name;				/* name of this memory space */
   struct mem_pte_t *ptab[MEM_PTAB_SIZE];/* inverted page table */
+#ifdef MEM_FLAT
+  byte_t *flat;				/* host base of flat target space */
+  word_t *flat_valid;			/* bitmap of allocated target pages */
+#else /* !MEM_FLAT */
+  struct mem_tlb_t rtlb[MEM_TLB_SIZE];	/* read translations */
+  struct mem_tlb_t wtlb[MEM_TLB_SIZE];	/* write translations */
+#endif /* MEM_FLAT */
 
   /* memory object stats */
   counter_t page_count;			/* total number of pages allocated */
   counter_t ptab_misses;		/* total first level page tbl misses */
   counter_t ptab_accesses;		/* total page table accesses */
+  counter_t tlb_accesses;		/* total software TLB accesses */
+  counter_t tlb_misses;			/* total software TLB misses */
 };
 
 /* memory access command */
@@ -115,6 +152,33 @@ typedef enum md_fault_type
   (((PTE)->tag << (MD_LOG_PAGE_SIZE + MEM_LOG_PTAB_SIZE))		\
    | ((IDX) << MD_LOG_PAGE_SIZE))
 
+#ifdef MEM_FLAT
+
+/* non-zero if the target page containing ADDR has been allocated */
+#define MEM_FLAT_VALID(MEM, ADDR)					\
+  ((MEM)->flat_valid[(word_t)(ADDR) >> (MD_LOG_PAGE_SIZE + 5)]		\
+   & (1U << (((word_t)(ADDR) >> MD_LOG_PAGE_SIZE) & 31)))
+
+/* locate host page for virtual address ADDR, returns NULL if unallocated */
+#define MEM_PAGE(MEM, ADDR)						\
+  (MEM_FLAT_VALID(MEM, ADDR)						\
+   ? (MEM)->flat + ((word_t)(ADDR) & ~(MD_PAGE_SIZE - 1))		\
+   : NULL)
+
+/* compute host address of target address ADDR, unallocated pages of the
+   flat mapping read as zero, so no validity check is needed for reads */
+#define MEM_FLAT_ADDR(MEM, ADDR)	((MEM)->flat + (word_t)(ADDR))
+
+/* locate host page for a read of ADDR, unallocated pages read as zero */
+#define MEM_RPAGE(MEM, ADDR)						\
+  ((MEM)->flat + ((word_t)(ADDR) & ~(MD_PAGE_SIZE - 1)))
+
+/* locate host page for a write of ADDR, allocating it if needed */
+#define MEM_WPAGE(MEM, ADDR)						\
+  (MEM_TICKLE(MEM, ADDR), MEM_RPAGE(MEM, ADDR))
+
+#else /* !MEM_FLAT */
+
 /* locate host page for virtual address ADDR, returns NULL if unallocated */
 #define MEM_PAGE(MEM, ADDR)						\
   (/* first attempt to hit in first entry, otherwise call xlation fn */	\
@@ -126,15 +190,54 @@ typedef enum md_fault_type
    : (/* first level miss - call the translation helper function */	\
       mem_translate((MEM), (ADDR))))
 
+/* invalid software TLB tag, never page aligned so it never matches */
+#define MEM_TLB_INVALID		((md_addr_t)1)
+
+/* compute software TLB set, the upper page number bits are folded in so the
+   text, data and stack segment bases do not all land in the same set */
+#define MEM_TLB_SET(ADDR)						\
+  ((((ADDR) >> MD_LOG_PAGE_SIZE)					\
+    ^ ((ADDR) >> (MD_LOG_PAGE_SIZE + MEM_LOG_TLB_SIZE)))		\
+   & (MEM_TLB_SIZE - 1))
+
+/* compute software TLB tag */
+#define MEM_TLB_TAG(ADDR)	((ADDR) & ~(md_addr_t)(MD_PAGE_SIZE - 1))
+
+/* locate host page for a read of ADDR through the read TLB, never returns
+   NULL, unallocated pages map to a shared page of zeroes */
+#define MEM_RPAGE(MEM, ADDR)						\
+  ((MEM)->tlb_accesses++,						\
+   (MEM)->rtlb[MEM_TLB_SET(ADDR)].tag == MEM_TLB_TAG(ADDR)		\
+   ? (MEM)->rtlb[MEM_TLB_SET(ADDR)].page				\
+   : mem_tlb_fill((MEM), Read, (ADDR)))
+
+/* locate host page for a write of ADDR through the write TLB, the page is
+   allocated if it does not yet exist */
+#define MEM_WPAGE(MEM, ADDR)						\
+  ((MEM)->tlb_accesses++,						\
+   (MEM)->wtlb[MEM_TLB_SET(ADDR)].tag == MEM_TLB_TAG(ADDR)		\
+   ? (MEM)->wtlb[MEM_TLB_SET(ADDR)].page				\
+   : mem_tlb_fill((MEM), Write, (ADDR)))
+
+#endif /* MEM_FLAT */
+
 /* compute address of access within a host page */
 #define MEM_OFFSET(ADDR)	((ADDR) & (MD_PAGE_SIZE - 1))
 
 /* memory tickle function, allocates pages when they are first written */
+#ifdef MEM_FLAT
+#define MEM_TICKLE(MEM, ADDR)						\
+  (!MEM_FLAT_VALID(MEM, ADDR)						\
+   ? (/* allocate page at address ADDR */				\
+      mem_newpage(MEM, ADDR))						\
+   : (/* nada... */ (void)0))
+#else /* !MEM_FLAT */
 #define MEM_TICKLE(MEM, ADDR)						\
   (!MEM_PAGE(MEM, ADDR)							\
    ? (/* allocate page at address ADDR */				\
       mem_newpage(MEM, ADDR))						\
    : (/* nada... */ (void)0))
+#endif /* MEM_FLAT */
 
 /* memory page iterator */
 #define MEM_FORALL(MEM, ITER, PTE)					\
@@ -146,26 +249,45 @@ typedef enum md_fault_type
  * memory accessors macros, fast but difficult to debug...
  */
 
+#ifdef MEM_FLAT
+
 /* safe version, works only with scalar types */
-/* FIXME: write a more efficient GNU C expression for this... */
 #define MEM_READ(MEM, ADDR, TYPE)					\
-  (MEM_PAGE(MEM, (md_addr_t)(ADDR))					\
-   ? *((TYPE *)(MEM_PAGE(MEM, (md_addr_t)(ADDR)) + MEM_OFFSET(ADDR)))	\
-   : /* page not yet allocated, return zero value */ 0)
+  (*((TYPE *)MEM_FLAT_ADDR(MEM, ADDR)))
 
 /* unsafe version, works with any type */
 #define __UNCHK_MEM_READ(MEM, ADDR, TYPE)				\
-  (*((TYPE *)(MEM_PAGE(MEM, (md_addr_t)(ADDR)) + MEM_OFFSET(ADDR))))
+  (*((TYPE *)MEM_FLAT_ADDR(MEM, ADDR)))
 
 /* safe version, works only with scalar types */
-/* FIXME: write a more efficient GNU C expression for this... */
 #define MEM_WRITE(MEM, ADDR, TYPE, VAL)					\
   (MEM_TICKLE(MEM, (md_addr_t)(ADDR)),					\
-   *((TYPE *)(MEM_PAGE(MEM, (md_addr_t)(ADDR)) + MEM_OFFSET(ADDR))) = (VAL))
+   *((TYPE *)MEM_FLAT_ADDR(MEM, ADDR)) = (VAL))
+
+/* unsafe version, works with any type */
+#define __UNCHK_MEM_WRITE(MEM, ADDR, TYPE, VAL)				\
+  (MEM_TICKLE(MEM, (md_addr_t)(ADDR)),					\
+   *((TYPE *)MEM_FLAT_ADDR(MEM, ADDR)) = (VAL))
+
+#else /* !MEM_FLAT */
+
+/* safe version, works only with scalar types */
+#define MEM_READ(MEM, ADDR, TYPE)					\
+  (*((TYPE *)(MEM_RPAGE(MEM, (md_addr_t)(ADDR)) + MEM_OFFSET(ADDR))))
+
+/* unsafe version, works with any type */
+#define __UNCHK_MEM_READ(MEM, ADDR, TYPE)				\
+  (*((TYPE *)(MEM_RPAGE(MEM, (md_addr_t)(ADDR)) + MEM_OFFSET(ADDR))))
+
+/* safe version, works only with scalar types */
+#define MEM_WRITE(MEM, ADDR, TYPE, VAL)					\
+  (*((TYPE *)(MEM_WPAGE(MEM, (md_addr_t)(ADDR)) + MEM_OFFSET(ADDR))) = (VAL))
       
 /* unsafe version, works with any type */
 #define __UNCHK_MEM_WRITE(MEM, ADDR, TYPE, VAL)				\
-  (*((TYPE *)(MEM_PAGE(MEM, (md_addr_t)(ADDR)) + MEM_OFFSET(ADDR))) = (VAL))
+  (*((TYPE *)(MEM_WPAGE(MEM, (md_addr_t)(ADDR)) + MEM_OFFSET(ADDR))) = (VAL))
+
+#endif /* MEM_FLAT */
 
 
 /* fast memory accessor macros, typed versions */
@@ -213,6 +335,16 @@ byte_t *
 mem_translate(struct mem_t *mem,	/* memory space to access */
 	      md_addr_t addr);		/* virtual address to translate */
 
+#ifndef MEM_FLAT
+/* service a software TLB miss for a CMD access to ADDR, returns the host page
+   and installs it in the read or write TLB, reads of unallocated pages return
+   a shared zero page, writes allocate the page */
+byte_t *
+mem_tlb_fill(struct mem_t *mem,		/* memory space to access */
+	     enum mem_cmd cmd,		/* Read or Write */
+	     md_addr_t addr);		/* virtual address to translate */
+#endif /* !MEM_FLAT */
+
 /* allocate a memory page */
 void
 mem_newpage(struct mem_t *mem,		/* memory space to allocate in */
@@ -244,13 +376,44 @@ mem_dump(struct mem_t *mem,		/* memory space to display */
 	 int len,			/* number bytes to dump */
 	 FILE *stream);			/* output stream */
 
+/* copy NBYTES to/from simulated memory space a page span at a time, host
+   buffer VP is copied directly to/from the target pages without going
+   through an access callback, pages written are allocated as needed */
+void
+mem_bulk_copy(struct mem_t *mem,	/* memory space to access */
+	      enum mem_cmd cmd,		/* Read (from sim mem) or Write */
+	      md_addr_t addr,		/* target address to access */
+	      void *vp,			/* host memory address to access */
+	      int nbytes);		/* number of bytes to access */
+
+/* zero out NBYTES of simulated memory a page span at a time */
+void
+mem_bulk_zero(struct mem_t *mem,	/* memory space to access */
+	      md_addr_t addr,		/* target address to access */
+	      int nbytes);		/* number of bytes to clear */
+
+/* map NPAGES page images from host file descriptor FD, starting at file
+   offset OFFSET, copy-on-write (or, if SHARED, writing through to the file)
+   into memory space MEM at page-aligned target address ADDR; the host
+   faults the images in on first touch, so unused pages are never read,
+   returns non-zero on success or zero if the host cannot map the file here
+   (the caller must then copy the pages in) */
+int
+mem_map_file(struct mem_t *mem,		/* memory space to map into */
+	     md_addr_t addr,		/* page-aligned target address */
+	     int fd,			/* host file descriptor to map */
+	     long offset,		/* file offset of first page image */
+	     int npages,		/* number of pages to map */
+	     int shared);		/* share the pages with other mappings? */
+
 
 /*
  * memory accessor routines, these routines require a memory access function
  * definition to access memory, the memory access function provides a "hook"
  * for programs to instrument memory accesses, this is used by various
  * simulators for various reasons; for the default operation - direct access
- * to the memory system, pass mem_access() as the memory access function
+ * to the memory system, pass mem_access() as the memory access function,
+ * in which case the copies bypass the hook and move whole page spans
  */
 
 /* copy a '\0' terminated string to/from simulated memory space, returns
@@ -0,0 +1,432 @@
+/* mtrace.c - memory reference trace routines */
+
+/* SimpleScalar(TM) Tool Suite
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ * All Rights Reserved. 
+ * 
+ * THIS IS A LEGAL DOCUMENT, BY USING SIMPLESCALAR,
+ * YOU ARE AGREEING TO THESE TERMS AND CONDITIONS.
+ * 
+ * No portion of this work may be used by any commercial entity, or for any
+ * commercial purpose, without the prior, written permission of SimpleScalar,
+ * LLC (info@simplescalar.com). Nonprofit and noncommercial use is permitted
+ * as described below.
+ * 
+ * 1. SimpleScalar is provided AS IS, with no warranty of any kind, express
+ * or implied. The user of the program accepts full responsibility for the
+ * application of the program and the use of any results.
+ * 
+ * 2. Nonprofit and noncommercial use is encouraged. SimpleScalar may be
+ * downloaded, compiled, executed, copied, and modified solely for nonprofit,
+ * educational, noncommercial research, and noncommercial scholarship
+ * purposes provided that this notice in its entirety accompanies all copies.
+ * Copies of the modified software can be delivered to persons who use it
+ * solely for nonprofit, educational, noncommercial research, and
+ * noncommercial scholarship purposes provided that this notice in its
+ * entirety accompanies all copies.
+ * 
+ * 3. ALL COMMERCIAL USE, AND ALL USE BY FOR PROFIT ENTITIES, IS EXPRESSLY
+ * PROHIBITED WITHOUT A LICENSE FROM SIMPLESCALAR, LLC (info@simplescalar.com).
+ * 
+ * 4. No nonprofit user may place any restrictions on the use of this software,
+ * including as modified by the user, by any other authorized user.
+ * 
+ * 5. Noncommercial and nonprofit users may distribute copies of SimpleScalar
+ * in compiled or executable form as set forth in Section 2, provided that
+ * either: (A) it is accompanied by the corresponding machine-readable source
+ * code, or (B) it is accompanied by a written offer, with no time limit, to
+ * give anyone a machine-readable copy of the corresponding source code in
+ * return for reimbursement of the cost of distribution. This written offer
+ * must permit verbatim duplication by anyone, or (C) it is distributed by
+ * someone who received only the executable form, and is accompanied by a
+ * copy of the written offer of source code.
+ * 
+ * 6. SimpleScalar was developed by Todd M. Austin, Ph.D. The tool suite is
+ * currently maintained by SimpleScalar LLC (info@simplescalar.com). US Mail:
+ * 2395 Timbercrest Court, Ann Arbor, MI 48105.
+ * 
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "memory.h"
+#include "mtrace.h"
+
+/* trace file magic, followed by the version, sizeof(md_addr_t),
+   sizeof(md_inst_t) and the text segment base and size */
+#define MTRACE_MAGIC		"SSMTRACE"
+#define MTRACE_MAGIC_LEN	8
+
+/* write V to MT as an unsigned LEB128 value */
+static void
+put_uleb(struct mtrace_t *mt, qword_t v)
+{
+  while (v >= 0x80)
+    {
+      putc((int)(v & 0x7f) | 0x80, mt->fd);
+      v >>= 7;
+    }
+  putc((int)v, mt->fd);
+}
+
+/* read an unsigned LEB128 value from MT */
+static qword_t
+get_uleb(struct mtrace_t *mt)
+{
+  qword_t v = 0;
+  int c, shift = 0;
+
+  do {
+    if ((c = getc(mt->fd)) == EOF)
+      fatal("memory reference trace `%s' is truncated", mt->fname);
+    if (shift < 64)
+      v |= (qword_t)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+
+  return v;
+}
+
+/* allocate an empty trace for FNAME on stream FD */
+static struct mtrace_t *
+mtrace_alloc(char *fname, FILE *fd, int writing)
+{
+  struct mtrace_t *mt;
+
+  mt = (struct mtrace_t *)calloc(1, sizeof(struct mtrace_t));
+  if (!mt)
+    fatal("out of virtual memory");
+  mt->fd = fd;
+  mt->fname = mystrdup(fname);
+  mt->writing = writing;
+
+  mt->dict_size = 1024;
+  mt->dict = (md_addr_t *)calloc(mt->dict_size, sizeof(md_addr_t));
+  if (!mt->dict)
+    fatal("out of virtual memory");
+  if (writing)
+    {
+      mt->hash_size = 2 * mt->dict_size;
+      mt->hash = (unsigned int *)calloc(mt->hash_size, sizeof(unsigned int));
+      if (!mt->hash)
+	fatal("out of virtual memory");
+    }
+  return mt;
+}
+
+/* append PC to the dictionary of MT, returns its index */
+static unsigned int
+dict_add(struct mtrace_t *mt, md_addr_t pc)
+{
+  if (mt->ndict == mt->dict_size)
+    {
+      mt->dict_size *= 2;
+      mt->dict = (md_addr_t *)
+	realloc(mt->dict, mt->dict_size * sizeof(md_addr_t));
+      if (!mt->dict)
+	fatal("out of virtual memory");
+    }
+  mt->dict[mt->ndict] = pc;
+  return mt->ndict++;
+}
+
+/* hash bucket of PC in a table of SIZE buckets */
+#define DICT_HASH(PC, SIZE)						\
+  ((((unsigned int)((PC) >> 2)) * 2654435761U) & ((SIZE) - 1))
+
+/* writer: find PC in the dictionary of MT, adding it if not present,
+   sets *ISNEW if it was added, returns its index */
+static unsigned int
+dict_lookup(struct mtrace_t *mt, md_addr_t pc, int *isnew)
+{
+  unsigned int h, i, idx;
+
+  for (h = DICT_HASH(pc, mt->hash_size);
+       mt->hash[h] != 0;
+       h = (h + 1) & (mt->hash_size - 1))
+    {
+      if (mt->dict[mt->hash[h] - 1] == pc)
+	{
+	  *isnew = FALSE;
+	  return mt->hash[h] - 1;
+	}
+    }
+
+  /* not found, add it and keep the table at most half full */
+  idx = dict_add(mt, pc);
+  mt->hash[h] = idx + 1;
+  *isnew = TRUE;
+
+  if (2 * mt->ndict > mt->hash_size)
+    {
+      free(mt->hash);
+      mt->hash_size *= 2;
+      mt->hash = (unsigned int *)calloc(mt->hash_size, sizeof(unsigned int));
+      if (!mt->hash)
+	fatal("out of virtual memory");
+      for (i = 0; i < mt->ndict; i++)
+	{
+	  for (h = DICT_HASH(mt->dict[i], mt->hash_size);
+	       mt->hash[h] != 0;
+	       h = (h + 1) & (mt->hash_size - 1))
+	    /* nada */;
+	  mt->hash[h] = i + 1;
+	}
+    }
+  return idx;
+}
+
+/* writer: emit the pending fetch run of MT */
+static void
+flush_run(struct mtrace_t *mt)
+{
+  unsigned int idx;
+  int isnew;
+
+  if (!mt->run)
+    return;
+
+  if (!mt->run_jump)
+    put_uleb(mt, ((qword_t)mt->run << 2) | MTRACE_RUN);
+  else
+    {
+      put_uleb(mt, ((qword_t)mt->run << 2) | MTRACE_JUMP);
+      idx = dict_lookup(mt, mt->run_pc, &isnew);
+      put_uleb(mt, idx);
+      if (isnew)
+	put_uleb(mt, mt->run_pc);
+    }
+  mt->run = 0;
+}
+
+/* create memory reference trace file FNAME for a program with text segment
+   TEXT_BASE and TEXT_SIZE */
+struct mtrace_t *
+mtrace_create(char *fname, md_addr_t text_base, unsigned int text_size)
+{
+  FILE *fd;
+  struct mtrace_t *mt;
+
+  fd = fopen(fname, "wb");
+  if (!fd)
+    fatal("could not create memory reference trace `%s'", fname);
+  mt = mtrace_alloc(fname, fd, TRUE);
+
+  fwrite(MTRACE_MAGIC, 1, MTRACE_MAGIC_LEN, fd);
+  put_uleb(mt, MTRACE_VERSION);
+  put_uleb(mt, sizeof(md_addr_t));
+  put_uleb(mt, sizeof(md_inst_t));
+  put_uleb(mt, text_base);
+  put_uleb(mt, text_size);
+  mt->text_base = text_base;
+  mt->text_size = text_size;
+
+  return mt;
+}
+
+/* returns non-zero if file FNAME is a memory reference trace */
+int
+mtrace_valid(char *fname)
+{
+  FILE *fd;
+  char magic[MTRACE_MAGIC_LEN];
+  int valid;
+
+  fd = fopen(fname, "rb");
+  if (!fd)
+    return FALSE;
+  valid = (fread(magic, 1, MTRACE_MAGIC_LEN, fd) == MTRACE_MAGIC_LEN
+	   && !memcmp(magic, MTRACE_MAGIC, MTRACE_MAGIC_LEN));
+  fclose(fd);
+
+  return valid;
+}
+
+/* open memory reference trace file FNAME for reading */
+struct mtrace_t *
+mtrace_open(char *fname)
+{
+  FILE *fd;
+  struct mtrace_t *mt;
+  char magic[MTRACE_MAGIC_LEN];
+
+  fd = fopen(fname, "rb");
+  if (!fd)
+    fatal("could not open memory reference trace `%s'", fname);
+  mt = mtrace_alloc(fname, fd, FALSE);
+
+  if (fread(magic, 1, MTRACE_MAGIC_LEN, fd) != MTRACE_MAGIC_LEN
+      || memcmp(magic, MTRACE_MAGIC, MTRACE_MAGIC_LEN))
+    fatal("`%s' is not a memory reference trace", fname);
+  if (get_uleb(mt) != MTRACE_VERSION)
+    fatal("memory reference trace `%s' has an unsupported version", fname);
+  if (get_uleb(mt) != sizeof(md_addr_t) || get_uleb(mt) != sizeof(md_inst_t))
+    fatal("memory reference trace `%s' is for a different target", fname);
+  mt->text_base = (md_addr_t)get_uleb(mt);
+  mt->text_size = (unsigned int)get_uleb(mt);
+
+  return mt;
+}
+
+/* trace the fetch of the instruction at PC */
+void
+mtrace_inst(struct mtrace_t *mt, md_addr_t pc)
+{
+  if (mt->run && pc == mt->pc + sizeof(md_inst_t))
+    mt->run++;
+  else
+    {
+      flush_run(mt);
+      mt->run = 1;
+      mt->run_pc = pc;
+      mt->run_jump = (pc != mt->pc + sizeof(md_inst_t));
+    }
+  mt->pc = pc;
+  mt->ninsn++;
+}
+
+/* trace a data reference by the last instruction fetched, SYS is non-zero
+   for accesses made by a system call */
+void
+mtrace_data(struct mtrace_t *mt, enum mem_cmd cmd, md_addr_t addr,
+	    int nbytes, int sys)
+{
+  sqword_t delta;
+  int lg;
+
+  switch (nbytes)
+    {
+    case 1: lg = 0; break;
+    case 2: lg = 1; break;
+    case 4: lg = 2; break;
+    case 8: lg = 3; break;
+    default:
+      panic("bogus trace reference size: %d", nbytes);
+    }
+
+  flush_run(mt);
+
+  /* zig-zag encode the (wrapping) address difference */
+  if (sizeof(md_addr_t) == sizeof(word_t))
+    delta = (sword_t)(addr - mt->addr);
+  else
+    delta = (sqword_t)(addr - mt->addr);
+  mt->addr = addr;
+
+  put_uleb(mt, ((cmd == Write) << 5) | ((sys != 0) << 4) | (lg << 2)
+	   | MTRACE_DATA);
+  put_uleb(mt, ((qword_t)delta << 1) ^ (qword_t)(delta >> 63));
+  mt->nrefs++;
+}
+
+/* trace the start of a system call */
+void
+mtrace_syscall(struct mtrace_t *mt)
+{
+  flush_run(mt);
+  put_uleb(mt, (MTRACE_OP_SYSCALL << 2) | MTRACE_CTRL);
+}
+
+/* read the next event from trace MT into REF, returns REF->EVENT, which
+   is mtrace_ev_end at the end of the trace */
+enum mtrace_event_t
+mtrace_next(struct mtrace_t *mt, struct mtrace_ref_t *ref)
+{
+  qword_t v, zz;
+  unsigned int idx;
+
+  for (;;)
+    {
+      /* expand the current fetch run one instruction at a time */
+      if (mt->run)
+	{
+	  mt->run--;
+	  mt->pc += sizeof(md_inst_t);
+	  mt->ninsn++;
+	  ref->event = mtrace_ev_inst;
+	  ref->pc = mt->pc;
+	  return ref->event;
+	}
+
+      v = get_uleb(mt);
+      switch ((int)(v & 3))
+	{
+	case MTRACE_RUN:
+	  mt->run = (unsigned int)(v >> 2);
+	  break;
+
+	case MTRACE_JUMP:
+	  mt->run = (unsigned int)(v >> 2);
+	  idx = (unsigned int)get_uleb(mt);
+	  if (idx == mt->ndict)
+	    dict_add(mt, (md_addr_t)get_uleb(mt));
+	  else if (idx > mt->ndict)
+	    fatal("memory reference trace `%s' is corrupt", mt->fname);
+	  /* the run starts at the dictionary PC */
+	  mt->pc = mt->dict[idx] - sizeof(md_inst_t);
+	  break;
+
+	case MTRACE_DATA:
+	  zz = get_uleb(mt);
+	  mt->addr += (md_addr_t)((zz >> 1) ^ (~(zz & 1) + 1));
+	  mt->nrefs++;
+	  ref->event = mtrace_ev_data;
+	  ref->pc = mt->pc;
+	  ref->addr = mt->addr;
+	  ref->cmd = ((v >> 5) & 1) ? Write : Read;
+	  ref->sys = (int)((v >> 4) & 1);
+	  ref->nbytes = 1 << (int)((v >> 2) & 3);
+	  return ref->event;
+
+	case MTRACE_CTRL:
+	  ref->pc = mt->pc;
+	  switch ((int)(v >> 2))
+	    {
+	    case MTRACE_OP_SYSCALL:
+	      ref->event = mtrace_ev_syscall;
+	      return ref->event;
+	    case MTRACE_OP_END:
+	      ref->event = mtrace_ev_end;
+	      return ref->event;
+	    default:
+	      fatal("memory reference trace `%s' is corrupt", mt->fname);
+	    }
+	}
+    }
+}
+
+/* close trace MT without writing anything more to it, for a process that
+   handed the trace over to another (e.g., a forked snapshot) */
+void
+mtrace_discard(struct mtrace_t *mt)
+{
+  mt->writing = FALSE;
+  mt->run = 0;
+  mtrace_close(mt);
+}
+
+/* finish (if writing) and close trace MT */
+void
+mtrace_close(struct mtrace_t *mt)
+{
+  if (mt->writing)
+    {
+      flush_run(mt);
+      put_uleb(mt, (MTRACE_OP_END << 2) | MTRACE_CTRL);
+      if (fflush(mt->fd))
+	fatal("could not write memory reference trace `%s'", mt->fname);
+    }
+  fclose(mt->fd);
+
+  free(mt->hash);
+  free(mt->dict);
+  free(mt->fname);
+  free(mt);
+}
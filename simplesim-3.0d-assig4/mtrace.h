@@ -0,0 +1,180 @@
+/* mtrace.h - memory reference trace interfaces */
+
+/* SimpleScalar(TM) Tool Suite
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ * All Rights Reserved. 
+ * 
+ * THIS IS A LEGAL DOCUMENT, BY USING SIMPLESCALAR,
+ * YOU ARE AGREEING TO THESE TERMS AND CONDITIONS.
+ * 
+ * No portion of this work may be used by any commercial entity, or for any
+ * commercial purpose, without the prior, written permission of SimpleScalar,
+ * LLC (info@simplescalar.com). Nonprofit and noncommercial use is permitted
+ * as described below.
+ * 
+ * 1. SimpleScalar is provided AS IS, with no warranty of any kind, express
+ * or implied. The user of the program accepts full responsibility for the
+ * application of the program and the use of any results.
+ * 
+ * 2. Nonprofit and noncommercial use is encouraged. SimpleScalar may be
+ * downloaded, compiled, executed, copied, and modified solely for nonprofit,
+ * educational, noncommercial research, and noncommercial scholarship
+ * purposes provided that this notice in its entirety accompanies all copies.
+ * Copies of the modified software can be delivered to persons who use it
+ * solely for nonprofit, educational, noncommercial research, and
+ * noncommercial scholarship purposes provided that this notice in its
+ * entirety accompanies all copies.
+ * 
+ * 3. ALL COMMERCIAL USE, AND ALL USE BY FOR PROFIT ENTITIES, IS EXPRESSLY
+ * PROHIBITED WITHOUT A LICENSE FROM SIMPLESCALAR, LLC (info@simplescalar.com).
+ * 
+ * 4. No nonprofit user may place any restrictions on the use of this software,
+ * including as modified by the user, by any other authorized user.
+ * 
+ * 5. Noncommercial and nonprofit users may distribute copies of SimpleScalar
+ * in compiled or executable form as set forth in Section 2, provided that
+ * either: (A) it is accompanied by the corresponding machine-readable source
+ * code, or (B) it is accompanied by a written offer, with no time limit, to
+ * give anyone a machine-readable copy of the corresponding source code in
+ * return for reimbursement of the cost of distribution. This written offer
+ * must permit verbatim duplication by anyone, or (C) it is distributed by
+ * someone who received only the executable form, and is accompanied by a
+ * copy of the written offer of source code.
+ * 
+ * 6. SimpleScalar was developed by Todd M. Austin, Ph.D. The tool suite is
+ * currently maintained by SimpleScalar LLC (info@simplescalar.com). US Mail:
+ * 2395 Timbercrest Court, Ann Arbor, MI 48105.
+ * 
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ */
+
+#ifndef MTRACE_H
+#define MTRACE_H
+
+#include <stdio.h>
+
+#include "host.h"
+#include "machine.h"
+#include "memory.h"
+
+/*
+ * A memory reference trace holds the instruction fetch and data reference
+ * stream of a program run, enough to drive caches and TLBs (and the
+ * prefetchers' get_PC()) without re-executing the program.  After a short
+ * header, which also records the program's text segment, the trace is a
+ * sequence of variable-length (LEB128) records, the low two bits of a
+ * record's first value give its type:
+ *
+ *   RUN        N << 2 | 0			N instructions fetched
+ *						sequentially after the last
+ *   JUMP       N << 2 | 1, IDX [, PC]		N instructions fetched
+ *						sequentially from dictionary
+ *						PC IDX, IDX equal to the
+ *						dictionary size adds PC
+ *   DATA       CMD << 5 | SYS << 4 | LOG2(NBYTES) << 2 | 2, DELTA
+ *						a data reference, CMD is 1 for
+ *						writes, SYS is 1 for system
+ *						call accesses, DELTA is the
+ *						zig-zag encoded difference to
+ *						the last data address
+ *   CTRL       OP << 2 | 3			SYSCALL (0) or END (1)
+ *
+ * Data references belong to the last instruction fetched, which gives
+ * their PC and instruction count.  A SYSCALL record marks the start of a
+ * system call, the system call's own accesses follow it with SYS set, so
+ * a replay can either flush the caches there or simulate the accesses.
+ */
+
+/* trace record types */
+#define MTRACE_RUN		0
+#define MTRACE_JUMP		1
+#define MTRACE_DATA		2
+#define MTRACE_CTRL		3
+
+/* MTRACE_CTRL operations */
+#define MTRACE_OP_SYSCALL	0
+#define MTRACE_OP_END		1
+
+/* trace file version */
+#define MTRACE_VERSION		1
+
+/* events returned by mtrace_next() */
+enum mtrace_event_t {
+  mtrace_ev_end,			/* end of trace */
+  mtrace_ev_inst,			/* instruction fetch of PC */
+  mtrace_ev_data,			/* data reference */
+  mtrace_ev_syscall			/* start of a system call */
+};
+
+/* an event read from a trace */
+struct mtrace_ref_t
+{
+  enum mtrace_event_t event;		/* event type */
+  md_addr_t pc;				/* PC of the (last) instruction */
+  md_addr_t addr;			/* data address, for data events */
+  enum mem_cmd cmd;			/* Read or Write, for data events */
+  int nbytes;				/* bytes accessed, for data events */
+  int sys;				/* system call access? */
+};
+
+/* an open trace, being written or read */
+struct mtrace_t
+{
+  FILE *fd;				/* trace stream */
+  char *fname;				/* trace file name */
+  int writing;				/* created by mtrace_create()? */
+  md_addr_t text_base;			/* program text segment base */
+  unsigned int text_size;		/* program text segment size */
+  md_addr_t pc;				/* last instruction fetched */
+  md_addr_t addr;			/* last data address */
+  unsigned int run;			/* instructions left in (reader) or
+					   pending in (writer) the current
+					   fetch run */
+  md_addr_t run_pc;			/* first PC of the pending run */
+  int run_jump;				/* pending run is not sequential? */
+
+  /* PC dictionary, reader: index -> PC, writer: open hash of PCs */
+  md_addr_t *dict;			/* PCs by index */
+  unsigned int *hash;			/* writer: dict index + 1, or 0 */
+  unsigned int ndict, dict_size;	/* entries used, allocated */
+  unsigned int hash_size;		/* writer: hash buckets, power of 2 */
+
+  /* stats */
+  counter_t ninsn;			/* instructions traced */
+  counter_t nrefs;			/* data references traced */
+};
+
+/* create memory reference trace file FNAME for a program with text segment
+   TEXT_BASE and TEXT_SIZE */
+struct mtrace_t *mtrace_create(char *fname, md_addr_t text_base,
+			       unsigned int text_size);
+
+/* open memory reference trace file FNAME for reading */
+struct mtrace_t *mtrace_open(char *fname);
+
+/* returns non-zero if file FNAME is a memory reference trace */
+int mtrace_valid(char *fname);
+
+/* trace the fetch of the instruction at PC */
+void mtrace_inst(struct mtrace_t *mt, md_addr_t pc);
+
+/* trace a data reference by the last instruction fetched, SYS is non-zero
+   for accesses made by a system call */
+void mtrace_data(struct mtrace_t *mt, enum mem_cmd cmd, md_addr_t addr,
+		 int nbytes, int sys);
+
+/* trace the start of a system call */
+void mtrace_syscall(struct mtrace_t *mt);
+
+/* read the next event from trace MT into REF, returns REF->EVENT, which
+   is mtrace_ev_end at the end of the trace */
+enum mtrace_event_t mtrace_next(struct mtrace_t *mt, struct mtrace_ref_t *ref);
+
+/* finish (if writing) and close trace MT */
+void mtrace_close(struct mtrace_t *mt);
+
+/* close trace MT without writing anything more to it, for a process that
+   handed the trace over to another (e.g., a forked snapshot) */
+void mtrace_discard(struct mtrace_t *mt);
+
+#endif /* MTRACE_H */
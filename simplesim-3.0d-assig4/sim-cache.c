@@ -54,6 +54,9 @@
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#ifndef _MSC_VER
+#include <pthread.h>
+#endif /* !_MSC_VER */
 
 #include "host.h"
 #include "misc.h"
@@ -64,6 +67,7 @@
 #include "loader.h"
 #include "syscall.h"
 #include "dlite.h"
+#include "mtrace.h"
 #include "sim.h"
 
 /*
@@ -72,6 +76,13 @@
  * up to two levels of instruction and data cache (with any levels unified),
  * and one level of instruction and data TLBs.  No timing information is
  * generated (hence the distinction, "functional" simulator).
+ *
+ * With -sweep, further cache hierarchies are simulated from the same
+ * functional execution.  References are collected in batches in a ring
+ * buffer, and a worker thread per hierarchy simulates each batch, reading
+ * the ring through its own cursor.  The cache pointers below are
+ * thread-local, so the miss handlers of a worker reach the next level of
+ * its own hierarchy.
  */
 
 /* simulated registers */
@@ -86,23 +97,122 @@ static counter_t sim_num_refs = 0;
 /* maximum number of inst's to execute */
 static unsigned int max_insts;
 
+/* number of insts skipped before cache simulation starts */
+static int fastfwd_count;
+
+/* fast forwarding?  the caches and the trace see no references until
+   FASTFWD_COUNT insts have executed */
+static int fastfwd_on = FALSE;
+
 /* level 1 instruction cache, entry level instruction cache */
-static struct cache_t *cache_il1 = NULL;
+static HOST_TLS struct cache_t *cache_il1 = NULL;
 
 /* level 1 instruction cache */
-static struct cache_t *cache_il2 = NULL;
+static HOST_TLS struct cache_t *cache_il2 = NULL;
 
 /* level 1 data cache, entry level data cache */
-static struct cache_t *cache_dl1 = NULL;
+static HOST_TLS struct cache_t *cache_dl1 = NULL;
 
 /* level 2 data cache */
-static struct cache_t *cache_dl2 = NULL;
+static HOST_TLS struct cache_t *cache_dl2 = NULL;
+
+/* level 1 data victim cache, between the level 1 and 2 data caches */
+static HOST_TLS struct cache_t *cache_vc = NULL;
+
+/* level 3 cache, below the level 2 data and instruction caches */
+static HOST_TLS struct cache_t *cache_dl3 = NULL;
 
 /* instruction TLB */
-static struct cache_t *itlb = NULL;
+static HOST_TLS struct cache_t *itlb = NULL;
 
 /* data TLB */
-static struct cache_t *dtlb = NULL;
+static HOST_TLS struct cache_t *dtlb = NULL;
+
+/* memory reference trace being written (-trace:out), and the trace being
+   replayed in place of a program, else NULL */
+static char *mtrace_fname /* = NULL */;
+static struct mtrace_t *mtrace_out = NULL;
+static struct mtrace_t *mtrace_in = NULL;
+
+/* single-pass stack-distance engine, and the reference streams fed to it
+   (SDIST_IL and/or SDIST_DL point at it, else NULL) */
+static struct cache_sdist_t *sdist = NULL;
+static struct cache_sdist_t *sdist_il = NULL;
+static struct cache_sdist_t *sdist_dl = NULL;
+
+/* MSHRs and prefetch queue entries per cache, memory latency */
+static int cache_mshrs /* = 0 */;
+static int cache_pfq_size /* = 16 */;
+static int mem_lat /* = 100 */;
+
+/* cache access time, with MSHRs the caches are timed at one instruction per
+   cycle, else all accesses happen at time 0 */
+#define CACHE_NOW		((tick_t)(cache_mshrs ? sim_num_insn : 0))
+
+/* latency of a main memory block access, only used with MSHRs */
+#define MEM_LATENCY		(cache_mshrs ? mem_lat : 1)
+
+/* cache hierarchies simulated alongside the one above, from -sweep */
+#define MAX_SWEEPS		16
+
+/* references per batch, and batches in the ring buffer */
+#define SWEEP_BATCH		4096
+#define SWEEP_RING		8
+
+/* kinds of references passed to the sweep workers */
+enum sweep_kind_t { sweep_inst, sweep_data, sweep_flush };
+
+/* a reference, as seen by the L1 caches and TLBs */
+struct sweep_ref_t
+{
+  tick_t now;			/* time of access */
+  md_addr_t addr;		/* address of access */
+  md_addr_t pc;			/* PC of the accessing instruction */
+  unsigned char kind;		/* enum sweep_kind_t */
+  unsigned char cmd;		/* enum mem_cmd */
+  unsigned char nbytes;		/* bytes accessed */
+};
+
+/* a batch of references, in program order */
+struct sweep_batch_t
+{
+  int nrefs;
+  struct sweep_ref_t refs[SWEEP_BATCH];
+};
+
+/* a cache hierarchy simulated by a worker thread */
+struct sweep_t
+{
+  char *cfg;			/* config file it was built from */
+  char name[16];		/* stat name prefix, sw<n> */
+  struct cache_t *il1, *il2, *dl1, *dl2, *vc, *dl3, *itlb, *dtlb;
+  md_addr_t pc;			/* PC of the reference being simulated */
+#ifndef _MSC_VER
+  unsigned int tail;		/* batches simulated */
+  pthread_t thread;
+#endif /* !_MSC_VER */
+};
+
+static int sweep_nelt = 0;
+static char *sweep_cfgs[MAX_SWEEPS];
+static struct sweep_t sweeps[MAX_SWEEPS];
+
+/* whether the workers run */
+static int sweep_on = FALSE;
+
+#ifndef _MSC_VER
+/* ring of SWEEP_RING batches, the batch at HEAD is being collected, a
+   batch is reused once every worker's TAIL has passed it */
+static struct sweep_batch_t *sweep_ring = NULL;
+static unsigned int sweep_head;
+static int sweep_done;			/* no more batches will be published */
+static pthread_mutex_t sweep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sweep_more = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sweep_room = PTHREAD_COND_INITIALIZER;
+#endif /* !_MSC_VER */
+
+/* hierarchy simulated by this thread, NULL in the main thread */
+static HOST_TLS struct sweep_t *sweep_cur = NULL;
 
 /* text-based stat profiles */
 #define MAX_PCSTAT_VARS 8
@@ -111,7 +221,7 @@ static counter_t pcstat_lastvals[MAX_PCSTAT_VARS];
 static struct stat_stat_t *pcstat_sdists[MAX_PCSTAT_VARS];
 
 md_addr_t get_PC() {	// return the current program counter (PC)
-   return regs.regs_PC;
+   return sweep_cur ? sweep_cur->pc : regs.regs_PC;
 }
 
 /* wedge all stat values into a counter_t */
@@ -124,6 +234,56 @@ md_addr_t get_PC() {	// return the current program counter (PC)
 	 ? *((STAT)->variant.for_counter.var)				\
 	 : (panic("bad stat class"), 0))))
 
+/* set by a miss handler whose level does not fill (an Exclusive cache
+   passing a read through) when the block it got is dirty, see hier_fetch() */
+static HOST_TLS int hier_dirty = FALSE;
+
+/* access block BADDR for a miss (or a write back) of the level above in
+   NEXT, the next level down, or in main memory if NULL, a read of an
+   Exclusive level moves the block up, dirty status and all, into BLK, or
+   if the level above does not fill either (BLK is NULL), on up through
+   HIER_DIRTY */
+static unsigned int			/* latency of block access */
+hier_fetch(struct cache_t *next,	/* next level, NULL for memory */
+	   enum mem_cmd cmd,		/* access cmd, Read or Write */
+	   md_addr_t baddr,		/* block address to access */
+	   int bsize,			/* size of block to access */
+	   struct cache_blk_t *blk,	/* block filled above, or NULL */
+	   tick_t now,			/* time of access */
+	   int prefetch)		/* access is a prefetch? */
+{
+  unsigned int lat;
+  int save_dirty;
+
+  if (!next)
+    {
+      /* access main memory, which is always done in the main simulator loop */
+      return /* access latency */MEM_LATENCY;
+    }
+
+  if (next->inclusion != Exclusive || cmd != Read)
+    {
+      /* access next level of the cache hierarchy */
+      return cache_access(next, cmd, baddr, NULL, bsize,
+			  /* now */now, /* pudata */NULL, /* repl addr */NULL,
+			  prefetch);
+    }
+
+  save_dirty = hier_dirty;
+  hier_dirty = FALSE;
+  lat = cache_access(next, Read, baddr, NULL, bsize, now, NULL, NULL,
+		     prefetch);
+  if (cache_remove_addr(next, baddr, /* !inval */FALSE) > 0)
+    hier_dirty = TRUE;
+  if (blk)
+    {
+      if (hier_dirty)
+	blk->status |= CACHE_BLK_DIRTY;
+      hier_dirty = save_dirty;
+    }
+  return lat;
+}
+
 /* l1 data cache l1 block miss handler function */
 static unsigned int			/* latency of block access */
 dl1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
@@ -133,17 +293,21 @@ dl1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      tick_t now,		/* time of access */
 	      int prefetch)		/* if 1 the access is a prefetch, if 0 it is a regular cache access */
 {
-  if (cache_dl2)
-    {
-      /* access next level of data cache hierarchy */
-      return cache_access(cache_dl2, cmd, baddr, NULL, bsize, 
-			  /* now */now, /* pudata */NULL, /* repl addr */NULL, prefetch);
-    }
-  else
-    {
-      /* access main memory, which is always done in the main simulator loop */
-      return /* access latency, ignored */1;
-    }
+  /* the victim cache, if any, sits between the l1 and l2 data caches */
+  return hier_fetch(cache_vc ? cache_vc : cache_dl2, cmd, baddr, bsize, blk,
+		    now, prefetch);
+}
+
+/* l1 data victim cache block miss handler function */
+static unsigned int			/* latency of block access */
+vc_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
+	     md_addr_t baddr,		/* block address to access */
+	     int bsize,			/* size of block to access */
+	     struct cache_blk_t *blk,	/* ptr to block in upper level */
+	     tick_t now,		/* time of access */
+	     int prefetch)		/* access is a prefetch? */
+{
+  return hier_fetch(cache_dl2, cmd, baddr, bsize, blk, now, prefetch);
 }
 
 /* l2 data cache block miss handler function */
@@ -154,11 +318,22 @@ dl2_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
 	      tick_t now,		/* time of access */
 	      int prefetch)
-	      
+{
+  return hier_fetch(cache_dl3, cmd, baddr, bsize, blk, now, prefetch);
+}
+
+/* l3 cache block miss handler function */
+static unsigned int			/* latency of block access */
+dl3_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
+	      md_addr_t baddr,		/* block address to access */
+	      int bsize,		/* size of block to access */
+	      struct cache_blk_t *blk,	/* ptr to block in upper level */
+	      tick_t now,		/* time of access */
+	      int prefetch)
 {
   /* this is a miss to the lowest level, so access main memory, which is
      always done in the main simulator loop */
-  return /* access latency, ignored */1;
+  return /* access latency */MEM_LATENCY;
 }
 
 /* l1 inst cache l1 block miss handler function */
@@ -171,17 +346,7 @@ il1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      int prefetch)		/* if 1 the access is a prefetch, if 0 it is a regular cache access */
 
 {
-  if (cache_il2)
-    {
-      /* access next level of inst cache hierarchy */
-      return cache_access(cache_il2, cmd, baddr, NULL, bsize,
-			  /* now */now, /* pudata */NULL, /* repl addr */NULL, prefetch);
-    }
-  else
-    {
-      /* access main memory, which is always done in the main simulator loop */
-      return /* access latency, ignored */1;
-    }
+  return hier_fetch(cache_il2, cmd, baddr, bsize, blk, now, prefetch);
 }
 
 /* l2 inst cache block miss handler function */
@@ -193,9 +358,81 @@ il2_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      tick_t now,		/* time of access */
 	      int prefetch)
 {
-  /* this is a miss to the lowest level, so access main memory, which is
-     always done in the main simulator loop */
-  return /* access latency, ignored */1;
+  return hier_fetch(cache_dl3, cmd, baddr, bsize, blk, now, prefetch);
+}
+
+/* return the next level down from cache CP, NULL for main memory */
+static struct cache_t *
+hier_next(struct cache_t *cp)
+{
+  if (cp == cache_dl1)
+    return cache_vc ? cache_vc : cache_dl2;
+  if (cp == cache_vc)
+    return cache_dl2;
+  if (cp == cache_dl2)
+    return cache_dl3;
+  if (cp == cache_il1)
+    return cache_il2;
+  if (cp == cache_il2)
+    return cache_dl3;
+  return NULL;
+}
+
+/* back-invalidate the BSIZE bytes at BADDR, evicted by cache CP, from all
+   levels above it, returns non-zero if any copy removed was dirty */
+static int
+hier_back_inval(struct cache_t *cp, md_addr_t baddr, int bsize)
+{
+  struct cache_t *above[5];
+  md_addr_t addr, ubaddr;
+  int i, j, dirty = FALSE;
+
+  above[0] = cache_dl1; above[1] = cache_vc; above[2] = cache_il1;
+  above[3] = cache_dl2; above[4] = cache_il2;
+  for (i=0; i < 5; i++)
+    {
+      struct cache_t *up = above[i];
+
+      if (!up || up == cp || hier_next(up) != cp)
+	continue;
+      for (j=0; j < i && above[j] != up; j++)
+	/* unified levels appear twice */;
+      if (j < i)
+	continue;
+
+      /* the caches above the one above hold it too, if anywhere */
+      for (addr = baddr; addr < baddr + bsize; addr += up->bsize)
+	{
+	  ubaddr = addr & ~(md_addr_t)(up->bsize - 1);
+	  if (cache_remove_addr(up, ubaddr, /* inval */TRUE) > 0)
+	    dirty = TRUE;
+	  if (hier_back_inval(up, ubaddr, up->bsize))
+	    dirty = TRUE;
+	}
+    }
+  return dirty;
+}
+
+/* eviction hook of the caches with an Inclusive policy, or above an
+   Exclusive or victim cache: the first drop the block from every level
+   above (writing back the dirtiest copy), the others move the block into
+   the level below */
+static int				/* write the block back? */
+hier_evict_fn(struct cache_t *cp,	/* cache evicting the block */
+	      md_addr_t baddr,		/* address of the evicted block */
+	      int dirty,		/* block is dirty? */
+	      tick_t now)		/* time of the eviction */
+{
+  struct cache_t *next = hier_next(cp);
+
+  if (cp->inclusion == Inclusive && hier_back_inval(cp, baddr, cp->bsize))
+    dirty = TRUE;
+  if (next && next->inclusion == Exclusive)
+    {
+      cache_fill(next, baddr, dirty, now);
+      return FALSE;
+    }
+  return dirty;
 }
 
 /* inst cache block miss handler function */
@@ -243,8 +480,12 @@ static char *cache_dl1_opt /* = "none" */;
 static char *cache_dl2_opt /* = "none" */;
 static char *cache_il1_opt /* = "none" */;
 static char *cache_il2_opt /* = "none" */;
+static char *cache_dl3_opt /* = "none" */;
+static char *cache_vc_opt /* = "none" */;
+static char *cache_incl_opt /* = "nine" */;
 static char *itlb_opt /* = "none" */;
 static char *dtlb_opt /* = "none" */;
+static char *sdist_opt /* = "none" */;
 static int flush_on_syscalls /* = FALSE */;
 static int compress_icache_addrs /* = FALSE */;
 
@@ -280,24 +521,47 @@ sim_reg_options(struct opt_odb_t *odb)	/* options database */
 	       &max_insts, /* default */0,
 	       /* print */TRUE, /* format */NULL);
 
+  opt_reg_int(odb, "-fastfwd",
+	      "number of insts skipped before cache simulation starts",
+	      &fastfwd_count, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_string(odb, "-trace:out",
+		 "write the memory reference trace to this file",
+		 &mtrace_fname, /* default */NULL, /* print */TRUE, NULL);
+  opt_reg_note(odb,
+"  A memory reference trace written with -trace:out (by sim-cache or\n"
+"  sim-fast) may be given in place of the program, sim-cache then replays\n"
+"  its instruction fetches and data references through the caches without\n"
+"  executing the program, e.g., sim-cache -cache:dl1 ... anagram.mtr.\n"
+"  A trace holds all references after -fastfwd, system call accesses\n"
+"  included, so it can be replayed with or without -flush.\n"
+	       );
+
   opt_reg_string(odb, "-cache:dl1",
 		 "l1 data cache config, i.e., {<config>|none}",
 		 &cache_dl1_opt, "dl1:256:32:1:l:0", /* print */TRUE, NULL);
   opt_reg_note(odb,
 "  The cache config parameter <config> has the following format:\n"
 "\n"
-"    <name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>\n"
+"    <name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>[:<degree>[:<dist>]]\n"
 "\n"
 "    <name>   - name of the cache being defined\n"
 "    <nsets>  - number of sets in the cache\n"
 "    <bsize>  - block size of the cache\n"
 "    <assoc>  - associativity of the cache\n"
 "    <repl>   - block replacement strategy, 'l'-LRU, 'f'-FIFO, 'r'-random, 'n'-NRU\n"
+"	       'p'-tree PLRU, 's'-SRRIP, 'b'-BRRIP, 'd'-DRRIP, 'h'-SHiP\n"
 "    <pref>   - prefetcher type, 0 - no prefetcher, 1 - next line prefetcher,\n"
 "	       2 - open-ended prefetcher, \n"
 "	       any other number num - stride prefetcher with num entries in the Reference Prediction Table (RPT)\n"
+"    <degree> - stride prefetcher degree, max blocks prefetched per access\n"
+"	       (default 1), throttled down when prefetches prove inaccurate\n"
+"    <dist>   - stride prefetcher look-ahead in strides (default 1), reduced\n"
+"	       when fewer strides suffice to cover the observed miss latency\n"
 "\n"
 "    Examples:   -cache:dl1 dl1:4096:32:1:l:1\n"
+"                -cache:dl1 dl1:64:64:4:l:64:4:8\n"
 "                -dtlb dtlb:128:4096:32:r:0\n"
 	       );
   opt_reg_string(odb, "-cache:dl2",
@@ -322,18 +586,93 @@ sim_reg_options(struct opt_odb_t *odb)	/* options database */
   opt_reg_string(odb, "-cache:il2",
 		 "l2 instruction cache config, i.e., {<config>|dl2|none}",
 		 &cache_il2_opt, "dl2", /* print */TRUE, NULL);
+  opt_reg_string(odb, "-cache:dl3",
+		 "l3 cache config, i.e., {<config>|none}",
+		 &cache_dl3_opt, "none", /* print */TRUE, NULL);
+  opt_reg_string(odb, "-cache:vc",
+		 "l1 data victim cache config, i.e., {<name>:<nblocks>|none}",
+		 &cache_vc_opt, "none", /* print */TRUE, NULL);
+  opt_reg_string(odb, "-cache:incl",
+		 "l2 and l3 inclusion policy, i.e., <l2>[:<l3>], each "
+		 "{nine|incl|excl}",
+		 &cache_incl_opt, "nine", /* print */TRUE, NULL);
+  opt_reg_note(odb,
+"  The l3 cache takes the misses of the l2 data and instruction caches, and\n"
+"  the victim cache, a fully associative LRU cache of <nblocks> l1 data\n"
+"  blocks, holds the blocks the l1 data cache evicts, which move back on\n"
+"  an l1 miss.  The inclusion policy of a level towards the ones above:\n"
+"\n"
+"    nine - neither inclusive nor exclusive, fills on every miss above\n"
+"    incl - inclusive, blocks it evicts are invalidated above\n"
+"    excl - exclusive, holds only blocks the level above evicted, blocks\n"
+"           move up on a hit, needs that level's block size\n"
+"\n"
+"    Example:    -cache:dl2 ul2:1024:32:8:l:0 -cache:incl excl\n"
+	       );
   opt_reg_string(odb, "-tlb:itlb",
 		 "instruction TLB config, i.e., {<config>|none}",
 		 &itlb_opt, "itlb:16:4096:4:l:0", /* print */TRUE, NULL);
   opt_reg_string(odb, "-tlb:dtlb",
 		 "data TLB config, i.e., {<config>|none}",
 		 &dtlb_opt, "dtlb:32:4096:4:l:0", /* print */TRUE, NULL);
+  opt_reg_string(odb, "-cache:sdist",
+		 "stack distance sweep config, i.e., {<config>|none}",
+		 &sdist_opt, "none", /* print */TRUE, NULL);
+  opt_reg_note(odb,
+"  The stack distance sweep simulates, in the same pass as the caches\n"
+"  above, an LRU cache of every power-of-two set count and associativity\n"
+"  in the given ranges, and reports the misses of each.  Its config has\n"
+"  the following format:\n"
+"\n"
+"    <name>:<refs>:<bsize>:<min_sets>:<max_sets>:<max_assoc>\n"
+"\n"
+"    <name>      - name of the sweep, prefixes its statistics\n"
+"    <refs>      - references simulated, 'd'-data, 'i'-instruction,\n"
+"                  'u'-both (unified)\n"
+"    <bsize>     - block size of the caches\n"
+"    <min_sets>  - smallest set count, a power of two\n"
+"    <max_sets>  - largest set count, a power of two\n"
+"    <max_assoc> - largest associativity, a power of two\n"
+"\n"
+"    Example:    -cache:sdist sd:d:32:16:4096:16\n"
+"                (16 to 4096 sets of 1 to 16 ways, 512B to 2MB)\n"
+	       );
+  opt_reg_string_list(odb, "-sweep",
+		      "cache hierarchy config file(s) simulated alongside",
+		      sweep_cfgs, MAX_SWEEPS, &sweep_nelt,
+		      /* default */NULL, /* print */TRUE, /* format */NULL,
+		      /* !accrue */FALSE);
+  opt_reg_note(odb,
+"  Each -sweep config file builds one more cache hierarchy, fed the same\n"
+"  references as the one above by its own worker thread, e.g.,\n"
+"  -sweep a.cfg b.cfg -max:inst 0 <program>.  A sweep config\n"
+"  may only set -cache:dl1, -cache:dl2, -cache:il1, -cache:il2, -tlb:itlb\n"
+"  and -tlb:dtlb, the others are taken from the main hierarchy.  The\n"
+"  stats of the hierarchy built from the n-th file are prefixed `sw<n>.',\n"
+"  e.g., sw0.dl1.misses.  Random replacement draws from one shared\n"
+"  generator, so sweep results with it vary from run to run.\n"
+	       );
   opt_reg_flag(odb, "-flush", "flush caches on system calls",
 	       &flush_on_syscalls, /* default */FALSE, /* print */TRUE, NULL);
   opt_reg_flag(odb, "-cache:icompress",
 	       "convert 64-bit inst addresses to 32-bit inst equivalents",
 	       &compress_icache_addrs, /* default */FALSE,
 	       /* print */TRUE, NULL);
+  opt_reg_int(odb, "-cache:mshr",
+	      "MSHRs per cache, 0 = unlimited (untimed simulation)",
+	      &cache_mshrs, /* default */0, /* print */TRUE, NULL);
+  opt_reg_int(odb, "-cache:pfq",
+	      "prefetch queue entries per cache (with -cache:mshr)",
+	      &cache_pfq_size, /* default */16, /* print */TRUE, NULL);
+  opt_reg_int(odb, "-mem:lat",
+	      "memory access latency in cycles (with -cache:mshr)",
+	      &mem_lat, /* default */100, /* print */TRUE, NULL);
+  opt_reg_note(odb,
+"  With -cache:mshr, cache accesses are timed at one instruction per cycle,\n"
+"  each cache tracks at most that many outstanding block fills, and\n"
+"  prefetches wait in a per-cache queue until an MSHR and the bus to the\n"
+"  next level are free.  Prefetches are dropped when the queue is full.\n"
+	       );
 
   opt_reg_string_list(odb, "-pcstat",
 		      "profile stat(s) against text addr's (mult uses ok)",
@@ -342,14 +681,91 @@ sim_reg_options(struct opt_odb_t *odb)	/* options database */
 
 }
 
-/* check simulator-specific option values */
-void
-sim_check_options(struct opt_odb_t *odb,	/* options database */
-		  int argc, char **argv)	/* command line arguments */
+/* return cache NAME, prefixed with PREFIX and a dot unless PREFIX is NULL */
+static char *
+hier_name(char *prefix, char *name)
+{
+  static char buf[256];
+
+  if (!prefix)
+    return name;
+  sprintf(buf, "%s.%s", prefix, name);
+  return buf;
+}
+
+/* parse inclusion policy NAME, as given to -cache:incl */
+static enum cache_inclusion
+hier_char2inclusion(char *name)
+{
+  if (!mystricmp(name, "nine"))
+    return NINE;
+  else if (!mystricmp(name, "incl"))
+    return Inclusive;
+  else if (!mystricmp(name, "excl"))
+    return Exclusive;
+  fatal("bad inclusion policy `%s', use {nine|incl|excl}", name);
+  return NINE;
+}
+
+/* set up the inclusion policies and eviction hooks of the cache hierarchy */
+static void
+hier_inclusion(void)
+{
+  struct cache_t *caches[6];
+  char l2[32], l3[32];
+  int i, j;
+
+  l3[0] = '\0';
+  if (sscanf(cache_incl_opt, "%31[^:]:%31s", l2, l3) < 1)
+    fatal("bad inclusion policies: <l2>[:<l3>]");
+  if (cache_dl2)
+    cache_dl2->inclusion = hier_char2inclusion(l2);
+  if (cache_il2 && cache_il2 != cache_dl2)
+    cache_il2->inclusion = hier_char2inclusion(l2);
+  if (cache_dl3)
+    cache_dl3->inclusion = l3[0] ? hier_char2inclusion(l3) : NINE;
+
+  caches[0] = cache_dl1; caches[1] = cache_vc; caches[2] = cache_il1;
+  caches[3] = cache_dl2; caches[4] = cache_il2; caches[5] = cache_dl3;
+  for (i=0; i < 6; i++)
+    {
+      struct cache_t *cp = caches[i];
+
+      if (!cp || cp->inclusion == NINE)
+	continue;
+
+      /* an exclusive level is filled with blocks of the levels above */
+      for (j=0; cp->inclusion == Exclusive && j < 6; j++)
+	{
+	  if (caches[j] && caches[j] != cp && hier_next(caches[j]) == cp
+	      && caches[j]->bsize != cp->bsize)
+	    fatal("exclusive cache `%s' needs the block size of `%s'",
+		  cp->name, caches[j]->name);
+	}
+      if (cp->inclusion == Exclusive && cache_il1 == cp)
+	fatal("exclusive cache `%s' cannot also be the l1 inst cache",
+	      cp->name);
+
+      /* inclusive levels invalidate the levels above on evictions */
+      if (cp->inclusion == Inclusive)
+	cp->evict_fn = hier_evict_fn;
+      for (j=0; cp->inclusion == Exclusive && j < 6; j++)
+	{
+	  if (caches[j] && hier_next(caches[j]) == cp)
+	    caches[j]->evict_fn = hier_evict_fn;
+	}
+    }
+}
+
+/* build the cache hierarchy, CACHE_IL1 through DTLB, from the cache and TLB
+   options, the cache names are prefixed by PREFIX unless it is NULL */
+static void
+cache_hier_create(char *prefix)
 {
   char name[128], c;
   int nsets, bsize, assoc;
   int prefetch_type;			/* this specifies the type of the prefetcher */
+  int pf_degree, pf_distance;		/* stride prefetcher degree/distance */
 
   /* use a level 1 D-cache? */
   if (!mystricmp(cache_dl1_opt, "none"))
@@ -363,25 +779,34 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
     }
   else /* dl1 is defined */
     {
-      if (sscanf(cache_dl1_opt, "%[^:]:%d:%d:%d:%c:%d", 
-		 name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
-	fatal("bad l1 D-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>");
-      cache_dl1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
+      pf_degree = pf_distance = 1;
+      if (sscanf(cache_dl1_opt, "%[^:]:%d:%d:%d:%c:%d:%d:%d",
+		 name, &nsets, &bsize, &assoc, &c, &prefetch_type,
+		 &pf_degree, &pf_distance) < 6)
+	fatal("bad l1 D-cache parms: "
+	      "<name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>[:<degree>[:<dist>]]");
+      cache_dl1 = cache_create(hier_name(prefix, name), nsets, bsize, /* balloc */FALSE,
 			       /* usize */0, assoc, cache_char2policy(c),
-			       dl1_access_fn, /* hit latency */1, prefetch_type);
+			       dl1_access_fn, /* hit latency */1, prefetch_type,
+			       pf_degree, pf_distance,
+			       cache_mshrs, cache_pfq_size);
 
       /* is the level 2 D-cache defined? */
       if (!mystricmp(cache_dl2_opt, "none"))
 	cache_dl2 = NULL;
       else
 	{
-	  if (sscanf(cache_dl2_opt, "%[^:]:%d:%d:%d:%c:%d",
-		     name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
+	  pf_degree = pf_distance = 1;
+	  if (sscanf(cache_dl2_opt, "%[^:]:%d:%d:%d:%c:%d:%d:%d",
+		     name, &nsets, &bsize, &assoc, &c, &prefetch_type,
+		     &pf_degree, &pf_distance) < 6)
 	    fatal("bad l2 D-cache parms: "
-		  "<name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>");
-	  cache_dl2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
+		  "<name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>[:<degree>[:<dist>]]");
+	  cache_dl2 = cache_create(hier_name(prefix, name), nsets, bsize, /* balloc */FALSE,
 				   /* usize */0, assoc, cache_char2policy(c), 
-				   dl2_access_fn, /* hit latency */1, prefetch_type);
+				   dl2_access_fn, /* hit latency */1, prefetch_type,
+				   pf_degree, pf_distance,
+				   cache_mshrs, cache_pfq_size);
 	}
     }
 
@@ -419,12 +844,17 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
     }
   else /* il1 is defined */
     {
-      if (sscanf(cache_il1_opt, "%[^:]:%d:%d:%d:%c:%d",
-		 name, &nsets, &bsize, &assoc, &c,&prefetch_type) != 6)
-	fatal("bad l1 I-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>");
-      cache_il1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
+      pf_degree = pf_distance = 1;
+      if (sscanf(cache_il1_opt, "%[^:]:%d:%d:%d:%c:%d:%d:%d",
+		 name, &nsets, &bsize, &assoc, &c, &prefetch_type,
+		 &pf_degree, &pf_distance) < 6)
+	fatal("bad l1 I-cache parms: "
+	      "<name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>[:<degree>[:<dist>]]");
+      cache_il1 = cache_create(hier_name(prefix, name), nsets, bsize, /* balloc */FALSE,
 			       /* usize */0, assoc, cache_char2policy(c), 
-			       il1_access_fn, /* hit latency */1, prefetch_type);
+			       il1_access_fn, /* hit latency */1, prefetch_type,
+			       pf_degree, pf_distance,
+			       cache_mshrs, cache_pfq_size);
 
       /* is the level 2 D-cache defined? */
       if (!mystricmp(cache_il2_opt, "none"))
@@ -437,16 +867,60 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
 	}
       else
 	{
-	  if (sscanf(cache_il2_opt, "%[^:]:%d:%d:%d:%c:%d",
-		     name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
+	  pf_degree = pf_distance = 1;
+	  if (sscanf(cache_il2_opt, "%[^:]:%d:%d:%d:%c:%d:%d:%d",
+		     name, &nsets, &bsize, &assoc, &c, &prefetch_type,
+		     &pf_degree, &pf_distance) < 6)
 	    fatal("bad l2 I-cache parms: "
-		  "<name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>");
-	  cache_il2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
+		  "<name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>[:<degree>[:<dist>]]");
+	  cache_il2 = cache_create(hier_name(prefix, name), nsets, bsize, /* balloc */FALSE,
 				   /* usize */0, assoc, cache_char2policy(c), 
-				   il2_access_fn, /* hit latency */1, prefetch_type);
+				   il2_access_fn, /* hit latency */1, prefetch_type,
+				   pf_degree, pf_distance,
+				   cache_mshrs, cache_pfq_size);
 	}
     }
 
+  /* use a level 3 cache? */
+  if (!mystricmp(cache_dl3_opt, "none"))
+    cache_dl3 = NULL;
+  else
+    {
+      if (!cache_dl2)
+	fatal("the l2 data cache must defined if the l3 cache is defined");
+      pf_degree = pf_distance = 1;
+      if (sscanf(cache_dl3_opt, "%[^:]:%d:%d:%d:%c:%d:%d:%d",
+		 name, &nsets, &bsize, &assoc, &c, &prefetch_type,
+		 &pf_degree, &pf_distance) < 6)
+	fatal("bad l3 cache parms: "
+	      "<name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>[:<degree>[:<dist>]]");
+      cache_dl3 = cache_create(hier_name(prefix, name), nsets, bsize, /* balloc */FALSE,
+			       /* usize */0, assoc, cache_char2policy(c),
+			       dl3_access_fn, /* hit latency */1, prefetch_type,
+			       pf_degree, pf_distance,
+			       cache_mshrs, cache_pfq_size);
+    }
+
+  /* use an l1 data victim cache? */
+  if (!mystricmp(cache_vc_opt, "none"))
+    cache_vc = NULL;
+  else
+    {
+      if (!cache_dl1)
+	fatal("the l1 data cache must defined if the victim cache is defined");
+      if (sscanf(cache_vc_opt, "%[^:]:%d", name, &assoc) != 2)
+	fatal("bad victim cache parms: <name>:<nblocks>");
+      cache_vc = cache_create(hier_name(prefix, name), /* nsets */1,
+			      cache_dl1->bsize, /* balloc */FALSE,
+			      /* usize */0, assoc, LRU,
+			      vc_access_fn, /* hit latency */1, /* pref */0,
+			      /* pf degree */1, /* pf distance */1,
+			      /* mshrs */0, /* pfq */0);
+      /* the victim cache holds only l1 evictions */
+      cache_vc->inclusion = Exclusive;
+    }
+  hier_inclusion();
+
   /* use an I-TLB? */
   if (!mystricmp(itlb_opt, "none"))
     itlb = NULL;
@@ -455,10 +929,12 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
       if (sscanf(itlb_opt, "%[^:]:%d:%d:%d:%c:%d",
 		 name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
 	fatal("bad TLB parms: <name>:<nsets>:<page_size>:<assoc>:<repl>:<pref>");
-      itlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
+      itlb = cache_create(hier_name(prefix, name), nsets, bsize, /* balloc */FALSE,
 			  /* usize */sizeof(md_addr_t), assoc,
 			  cache_char2policy(c), itlb_access_fn,
-			  /* hit latency */1, prefetch_type);
+			  /* hit latency */1, prefetch_type,
+			  /* pf degree */1, /* pf distance */1,
+			  /* mshrs */0, /* pfq */0);
     }
 
   /* use a D-TLB? */
@@ -469,10 +945,336 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
       if (sscanf(dtlb_opt, "%[^:]:%d:%d:%d:%c:%d",
 		 name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
 	fatal("bad TLB parms: <name>:<nsets>:<page_size>:<assoc>:<repl>:<pref>");
-      dtlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
+      dtlb = cache_create(hier_name(prefix, name), nsets, bsize, /* balloc */FALSE,
 			  /* usize */sizeof(md_addr_t), assoc,
 			  cache_char2policy(c),  dtlb_access_fn,
-			  /* hit latency */1, prefetch_type);
+			  /* hit latency */1, prefetch_type,
+			  /* pf degree */1, /* pf distance */1,
+			  /* mshrs */0, /* pfq */0);
+    }
+}
+
+#ifndef _MSC_VER
+/* build sweep hierarchy SW, number N, from config file CFG, which may set
+   only the cache and TLB options, any it leaves unset are taken from the
+   main cache hierarchy */
+static void
+sweep_create(struct sweep_t *sw, int n, char *cfg)
+{
+  struct opt_odb_t *odb;
+  char *args[3];
+  char *dl1_opt = cache_dl1_opt, *dl2_opt = cache_dl2_opt;
+  char *il1_opt = cache_il1_opt, *il2_opt = cache_il2_opt;
+  char *dl3_opt = cache_dl3_opt, *vc_opt = cache_vc_opt;
+  char *incl_opt = cache_incl_opt;
+  char *itlb_o = itlb_opt, *dtlb_o = dtlb_opt;
+  struct cache_t *il1 = cache_il1, *il2 = cache_il2;
+  struct cache_t *dl1 = cache_dl1, *dl2 = cache_dl2;
+  struct cache_t *vc = cache_vc, *dl3 = cache_dl3;
+  struct cache_t *itlb_p = itlb, *dtlb_p = dtlb;
+
+  /* read the config over the main hierarchy's options */
+  odb = opt_new(NULL);
+  opt_reg_string(odb, "-cache:dl1", "", &cache_dl1_opt, dl1_opt,
+		 /* !print */FALSE, NULL);
+  opt_reg_string(odb, "-cache:dl2", "", &cache_dl2_opt, dl2_opt,
+		 /* !print */FALSE, NULL);
+  opt_reg_string(odb, "-cache:il1", "", &cache_il1_opt, il1_opt,
+		 /* !print */FALSE, NULL);
+  opt_reg_string(odb, "-cache:il2", "", &cache_il2_opt, il2_opt,
+		 /* !print */FALSE, NULL);
+  opt_reg_string(odb, "-cache:dl3", "", &cache_dl3_opt, dl3_opt,
+		 /* !print */FALSE, NULL);
+  opt_reg_string(odb, "-cache:vc", "", &cache_vc_opt, vc_opt,
+		 /* !print */FALSE, NULL);
+  opt_reg_string(odb, "-cache:incl", "", &cache_incl_opt, incl_opt,
+		 /* !print */FALSE, NULL);
+  opt_reg_string(odb, "-tlb:itlb", "", &itlb_opt, itlb_o,
+		 /* !print */FALSE, NULL);
+  opt_reg_string(odb, "-tlb:dtlb", "", &dtlb_opt, dtlb_o,
+		 /* !print */FALSE, NULL);
+  args[0] = "sweep";
+  args[1] = "-config";
+  args[2] = cfg;
+  opt_process_options(odb, 3, args);
+  opt_delete(odb);
+
+  sw->cfg = cfg;
+  sprintf(sw->name, "sw%d", n);
+  cache_hier_create(sw->name);
+  sw->il1 = cache_il1; sw->il2 = cache_il2;
+  sw->dl1 = cache_dl1; sw->dl2 = cache_dl2;
+  sw->vc = cache_vc; sw->dl3 = cache_dl3;
+  sw->itlb = itlb; sw->dtlb = dtlb;
+
+  /* restore the main hierarchy */
+  cache_dl1_opt = dl1_opt; cache_dl2_opt = dl2_opt;
+  cache_il1_opt = il1_opt; cache_il2_opt = il2_opt;
+  cache_dl3_opt = dl3_opt; cache_vc_opt = vc_opt;
+  cache_incl_opt = incl_opt;
+  itlb_opt = itlb_o; dtlb_opt = dtlb_o;
+  cache_il1 = il1; cache_il2 = il2;
+  cache_dl1 = dl1; cache_dl2 = dl2;
+  cache_vc = vc; cache_dl3 = dl3;
+  itlb = itlb_p; dtlb = dtlb_p;
+
+  sw->tail = 0;
+}
+
+/* simulate reference REF in the hierarchy of the calling worker */
+static void
+sweep_access(struct sweep_t *sw, struct sweep_ref_t *ref)
+{
+  sw->pc = ref->pc;
+  switch (ref->kind)
+    {
+    case sweep_inst:
+      if (itlb)
+	cache_access(itlb, Read, ref->addr, NULL, ref->nbytes, ref->now,
+		     NULL, NULL, 0);
+      if (cache_il1)
+	cache_access(cache_il1, Read, ref->addr, NULL, ref->nbytes, ref->now,
+		     NULL, NULL, 0);
+      break;
+    case sweep_data:
+      if (dtlb)
+	cache_access(dtlb, (enum mem_cmd)ref->cmd, ref->addr, NULL,
+		     ref->nbytes, ref->now, NULL, NULL, 0);
+      if (cache_dl1)
+	cache_access(cache_dl1, (enum mem_cmd)ref->cmd, ref->addr, NULL,
+		     ref->nbytes, ref->now, NULL, NULL, 0);
+      break;
+    case sweep_flush:
+      if (dtlb)
+	cache_flush(dtlb, 0);
+      if (cache_dl1)
+	cache_flush(cache_dl1, 0);
+      if (cache_vc)
+	cache_flush(cache_vc, 0);
+      if (cache_dl2)
+	cache_flush(cache_dl2, 0);
+      if (cache_dl3)
+	cache_flush(cache_dl3, 0);
+      break;
+    default:
+      panic("bogus sweep reference kind");
+    }
+}
+
+/* sweep worker thread, simulates the published batches of the ring */
+static void *
+sweep_worker(void *arg)
+{
+  struct sweep_t *sw = (struct sweep_t *)arg;
+  struct sweep_batch_t *batch;
+  int i;
+
+  /* this thread's hierarchy */
+  sweep_cur = sw;
+  cache_il1 = sw->il1; cache_il2 = sw->il2;
+  cache_dl1 = sw->dl1; cache_dl2 = sw->dl2;
+  cache_vc = sw->vc; cache_dl3 = sw->dl3;
+  itlb = sw->itlb; dtlb = sw->dtlb;
+
+  for (;;)
+    {
+      pthread_mutex_lock(&sweep_lock);
+      while (sw->tail == sweep_head && !sweep_done)
+	pthread_cond_wait(&sweep_more, &sweep_lock);
+      if (sw->tail == sweep_head)
+	{
+	  pthread_mutex_unlock(&sweep_lock);
+	  break;
+	}
+      pthread_mutex_unlock(&sweep_lock);
+
+      batch = &sweep_ring[sw->tail % SWEEP_RING];
+      for (i=0; i < batch->nrefs; i++)
+	sweep_access(sw, &batch->refs[i]);
+
+      pthread_mutex_lock(&sweep_lock);
+      sw->tail++;
+      pthread_cond_signal(&sweep_room);
+      pthread_mutex_unlock(&sweep_lock);
+    }
+  return NULL;
+}
+
+/* non-zero if batch number HEAD can be collected, i.e., every worker is
+   done with the batch that used its slot */
+static int
+sweep_room_for(unsigned int head)
+{
+  int i;
+
+  for (i=0; i < sweep_nelt; i++)
+    {
+      if (head - sweeps[i].tail >= SWEEP_RING)
+	return FALSE;
+    }
+  return TRUE;
+}
+
+/* publish the batch being collected to the workers, and wait for a free
+   slot to collect the next one in */
+static void
+sweep_publish(void)
+{
+  if (sweep_ring[sweep_head % SWEEP_RING].nrefs == 0)
+    return;
+
+  pthread_mutex_lock(&sweep_lock);
+  sweep_head++;
+  pthread_cond_broadcast(&sweep_more);
+  while (!sweep_room_for(sweep_head))
+    pthread_cond_wait(&sweep_room, &sweep_lock);
+  pthread_mutex_unlock(&sweep_lock);
+
+  sweep_ring[sweep_head % SWEEP_RING].nrefs = 0;
+}
+
+/* collect a reference for the sweep workers, returns zero */
+static int
+sweep_ref(enum sweep_kind_t kind, enum mem_cmd cmd, md_addr_t addr,
+	  int nbytes)
+{
+  struct sweep_batch_t *batch = &sweep_ring[sweep_head % SWEEP_RING];
+  struct sweep_ref_t *ref = &batch->refs[batch->nrefs++];
+
+  ref->now = CACHE_NOW;
+  ref->addr = addr;
+  ref->pc = regs.regs_PC;
+  ref->kind = kind;
+  ref->cmd = cmd;
+  ref->nbytes = nbytes;
+  if (batch->nrefs == SWEEP_BATCH)
+    sweep_publish();
+  return 0;
+}
+
+/* bring the sweep stats up to date, waits for the workers to simulate all
+   references collected so far; a no-op in the workers themselves */
+static void
+sweep_sync(void)
+{
+  int i;
+
+  if (!sweep_on || sweep_cur)
+    return;
+
+  sweep_publish();
+  pthread_mutex_lock(&sweep_lock);
+  for (i=0; i < sweep_nelt; i++)
+    {
+      while (sweeps[i].tail != sweep_head)
+	pthread_cond_wait(&sweep_room, &sweep_lock);
+    }
+  pthread_mutex_unlock(&sweep_lock);
+}
+
+/* start a worker thread per sweep hierarchy */
+static void
+sweep_start(void)
+{
+  int i;
+
+  if (sweep_nelt == 0)
+    return;
+
+  sweep_ring = (struct sweep_batch_t *)
+    calloc(SWEEP_RING, sizeof(struct sweep_batch_t));
+  if (!sweep_ring)
+    fatal("out of virtual memory");
+  sweep_head = 0;
+  sweep_done = FALSE;
+
+  for (i=0; i < sweep_nelt; i++)
+    {
+      sweeps[i].tail = 0;
+      if (pthread_create(&sweeps[i].thread, NULL, sweep_worker, &sweeps[i]))
+	fatal("could not start sweep thread %d", i);
+    }
+  sweep_on = TRUE;
+
+  /* stats are printed only once the workers have caught up */
+  sim_stats_hook(sweep_sync);
+}
+
+/* simulate all outstanding references and stop the worker threads */
+static void
+sweep_stop(void)
+{
+  int i;
+
+  if (!sweep_on)
+    return;
+
+  sweep_sync();
+  pthread_mutex_lock(&sweep_lock);
+  sweep_done = TRUE;
+  pthread_cond_broadcast(&sweep_more);
+  pthread_mutex_unlock(&sweep_lock);
+  for (i=0; i < sweep_nelt; i++)
+    pthread_join(sweeps[i].thread, NULL);
+  sweep_on = FALSE;
+}
+
+/* collect a reference for the sweep workers, if any are running */
+#define SWEEP_REF(KIND, CMD, ADDR, NBYTES)				\
+  (sweep_on ? sweep_ref((KIND), (CMD), (ADDR), (NBYTES)) : 0)
+#else /* _MSC_VER */
+#define SWEEP_REF(KIND, CMD, ADDR, NBYTES)	0
+#endif /* _MSC_VER */
+
+/* check simulator-specific option values */
+void
+sim_check_options(struct opt_odb_t *odb,	/* options database */
+		  int argc, char **argv)	/* command line arguments */
+{
+  char name[128], c;
+  int bsize, assoc, i;
+
+  if (fastfwd_count < 0 || fastfwd_count >= 2147483647)
+    fatal("bad fast forward count: %d", fastfwd_count);
+
+  if (cache_mshrs < 0)
+    fatal("number of MSHRs must be a positive value");
+  if (cache_mshrs && cache_pfq_size < 1)
+    fatal("prefetch queue must have at least one entry");
+  if (cache_mshrs && mem_lat < 1)
+    fatal("memory latency must be greater than zero");
+
+  /* build the cache hierarchy */
+  cache_hier_create(/* prefix */NULL);
+
+  /* use a stack distance sweep? */
+  sdist = sdist_il = sdist_dl = NULL;
+  if (mystricmp(sdist_opt, "none"))
+    {
+      int min_sets, max_sets;
+
+      if (sscanf(sdist_opt, "%[^:]:%c:%d:%d:%d:%d",
+		 name, &c, &bsize, &min_sets, &max_sets, &assoc) != 6)
+	fatal("bad stack distance parms: "
+	      "<name>:<refs>:<bsize>:<min_sets>:<max_sets>:<max_assoc>");
+      if (c != 'd' && c != 'i' && c != 'u')
+	fatal("stack distance references `%c' must be 'd', 'i' or 'u'", c);
+      sdist = cache_sdist_create(name, bsize, min_sets, max_sets, assoc);
+      if (c != 'i')
+	sdist_dl = sdist;
+      if (c != 'd')
+	sdist_il = sdist;
+    }
+
+  /* build the -sweep cache hierarchies */
+  if (sweep_nelt > 0)
+    {
+#ifndef _MSC_VER
+      for (i=0; i < sweep_nelt; i++)
+	sweep_create(&sweeps[i], i, sweep_cfgs[i]);
+#else /* _MSC_VER */
+      fatal("cache sweeps are not supported on this host");
+#endif /* _MSC_VER */
     }
 }
 
@@ -510,18 +1312,41 @@ sim_load_prog(char *fname,		/* program to load */
 	      int argc, char **argv,	/* program arguments */
 	      char **envp)		/* program environment */
 {
+  /* replay a memory reference trace instead of running a program? */
+  if (mtrace_valid(fname))
+    {
+      if (mtrace_fname)
+	fatal("cannot write a memory reference trace while replaying one");
+      mtrace_in = mtrace_open(fname);
+
+      /* the text segment, for -cache:icompress and the loader stats */
+      ld_text_base = mtrace_in->text_base;
+      ld_text_size = mtrace_in->text_size;
+      return;
+    }
+
   /* load program text and data, set up environment, memory, and regs */
   ld_load_prog(fname, argc, argv, envp, &regs, mem, TRUE);
 
   /* initialize the DLite debugger */
   dlite_init(md_reg_obj, dlite_mem_obj, cache_mstate_obj);
+
+  /* trace the references made from here on */
+  if (mtrace_fname)
+    mtrace_out = mtrace_create(mtrace_fname, ld_text_base, ld_text_size);
 }
 
 /* print simulator-specific configuration information */
 void
 sim_aux_config(FILE *stream)		/* output stream */
 {
-  /* nada */
+  int i;
+
+  if (sdist)
+    cache_sdist_config(sdist, stream);
+  for (i=0; i < sweep_nelt; i++)
+    fprintf(stream, "sweep hierarchy: %s: config `%s'\n",
+	    sweeps[i].name, sweeps[i].cfg);
 }
 
 /* register simulator-specific statistics */
@@ -553,12 +1378,41 @@ sim_reg_stats(struct stat_sdb_t *sdb)	/* stats database */
     cache_reg_stats(cache_il2, sdb);
   if (cache_dl1)
     cache_reg_stats(cache_dl1, sdb);
+  if (cache_vc)
+    cache_reg_stats(cache_vc, sdb);
   if (cache_dl2)
     cache_reg_stats(cache_dl2, sdb);
+  if (cache_dl3)
+    cache_reg_stats(cache_dl3, sdb);
   if (itlb)
     cache_reg_stats(itlb, sdb);
   if (dtlb)
     cache_reg_stats(dtlb, sdb);
+  if (sdist)
+    cache_sdist_reg_stats(sdist, sdb);
+
+  /* register the -sweep hierarchies' cache stats */
+  for (i=0; i < sweep_nelt; i++)
+    {
+      struct sweep_t *sw = &sweeps[i];
+
+      if (sw->il1 && (sw->il1 != sw->dl1 && sw->il1 != sw->dl2))
+	cache_reg_stats(sw->il1, sdb);
+      if (sw->il2 && (sw->il2 != sw->dl1 && sw->il2 != sw->dl2))
+	cache_reg_stats(sw->il2, sdb);
+      if (sw->dl1)
+	cache_reg_stats(sw->dl1, sdb);
+      if (sw->vc)
+	cache_reg_stats(sw->vc, sdb);
+      if (sw->dl2)
+	cache_reg_stats(sw->dl2, sdb);
+      if (sw->dl3)
+	cache_reg_stats(sw->dl3, sdb);
+      if (sw->itlb)
+	cache_reg_stats(sw->itlb, sdb);
+      if (sw->dtlb)
+	cache_reg_stats(sw->dtlb, sdb);
+    }
 
   for (i=0; i<pcstat_nelt; i++)
     {
@@ -605,7 +1459,25 @@ sim_aux_stats(FILE *stream)		/* output stream */
 void
 sim_uninit(void)
 {
-  /* nada */
+#ifndef _MSC_VER
+  /* finish and stop the -sweep workers */
+  sweep_stop();
+#endif /* !_MSC_VER */
+
+  if (mtrace_out)
+    {
+      /* the first snapshot owns the trace, it writes its end */
+      if (sim_snapshot_parent)
+	mtrace_discard(mtrace_out);
+      else
+	mtrace_close(mtrace_out);
+      mtrace_out = NULL;
+    }
+  if (mtrace_in)
+    {
+      mtrace_close(mtrace_in);
+      mtrace_in = NULL;
+    }
 }
 
 /*
@@ -664,14 +1536,20 @@ sim_uninit(void)
 
 /* precise architected memory state accessor macros */
 #define __READ_CACHE(addr, SRC_T)					\
+  (fastfwd_on ? 0 :							\
   ((dtlb								\
     ? cache_access(dtlb, Read, (addr), NULL,				\
-		   sizeof(SRC_T), 0, NULL, NULL, 0)			\
+		   sizeof(SRC_T), CACHE_NOW, NULL, NULL, 0)		\
     : 0),								\
    (cache_dl1								\
     ? cache_access(cache_dl1, Read, (addr), NULL,			\
-		   sizeof(SRC_T), 0, NULL, NULL, 0)			\
-    : 0))
+		   sizeof(SRC_T), CACHE_NOW, NULL, NULL, 0)		\
+    : 0),								\
+   SWEEP_REF(sweep_data, Read, (addr), sizeof(SRC_T)),			\
+   (sdist_dl ? (cache_sdist_access(sdist_dl, (addr)), 0) : 0),		\
+   (mtrace_out								\
+    ? (mtrace_data(mtrace_out, Read, (addr), sizeof(SRC_T), FALSE), 0)	\
+    : 0)))
 
 #define READ_BYTE(SRC, FAULT)						\
   ((FAULT) = md_fault_none, addr = (SRC),				\
@@ -689,14 +1567,20 @@ sim_uninit(void)
 #endif /* HOST_HAS_QWORD */
 
 #define __WRITE_CACHE(addr, DST_T)					\
+  (fastfwd_on ? 0 :							\
   ((dtlb								\
     ? cache_access(dtlb, Write, (addr), NULL,				\
-		   sizeof(DST_T), 0, NULL, NULL, 0)			\
+		   sizeof(DST_T), CACHE_NOW, NULL, NULL, 0)		\
     : 0),								\
    (cache_dl1								\
     ? cache_access(cache_dl1, Write, (addr), NULL,			\
-		   sizeof(DST_T), 0,  NULL, NULL, 0)			\
-    : 0))
+		   sizeof(DST_T), CACHE_NOW, NULL, NULL, 0)		\
+    : 0),								\
+   SWEEP_REF(sweep_data, Write, (addr), sizeof(DST_T)),		\
+   (sdist_dl ? (cache_sdist_access(sdist_dl, (addr)), 0) : 0),		\
+   (mtrace_out								\
+    ? (mtrace_data(mtrace_out, Write, (addr), sizeof(DST_T), FALSE), 0)	\
+    : 0)))
 
 #define WRITE_BYTE(SRC, DST, FAULT)					\
   ((FAULT) = md_fault_none, addr = (DST),				\
@@ -721,21 +1605,187 @@ dcache_access_fn(struct mem_t *mem,	/* memory space to access */
 		 void *p,		/* data input/output buffer */
 		 int nbytes)		/* number of bytes to access */
 {
+  if (fastfwd_on)
+    return mem_access(mem, cmd, addr, p, nbytes);
+
   if (dtlb)
-    cache_access(dtlb, cmd, addr, NULL, nbytes, 0, NULL, NULL, 0);
+    cache_access(dtlb, cmd, addr, NULL, nbytes, CACHE_NOW, NULL, NULL, 0);
   if (cache_dl1)
-    cache_access(cache_dl1, cmd, addr, NULL, nbytes, 0, NULL, NULL, 0);
+    cache_access(cache_dl1, cmd, addr, NULL, nbytes, CACHE_NOW,
+		 NULL, NULL, 0);
+  if (sdist_dl)
+    cache_sdist_access(sdist_dl, addr);
+  SWEEP_REF(sweep_data, cmd, addr, nbytes);
+  if (mtrace_out)
+    mtrace_data(mtrace_out, cmd, addr, nbytes, TRUE);
+  return mem_access(mem, cmd, addr, p, nbytes);
+}
+
+/* system call memory access function with flushed caches, the accesses
+   are only traced */
+static enum md_fault_type
+mtrace_access_fn(struct mem_t *mem,	/* memory space to access */
+		 enum mem_cmd cmd,	/* memory access cmd, Read or Write */
+		 md_addr_t addr,	/* data address to access */
+		 void *p,		/* data input/output buffer */
+		 int nbytes)		/* number of bytes to access */
+{
+  mtrace_data(mtrace_out, cmd, addr, nbytes, TRUE);
   return mem_access(mem, cmd, addr, p, nbytes);
 }
 
 /* system call handler macro */
 #define SYSCALL(INST)							\
-  (flush_on_syscalls							\
-   ? ((dtlb ? cache_flush(dtlb, 0) : 0),				\
-      (cache_dl1 ? cache_flush(cache_dl1, 0) : 0),			\
-      (cache_dl2 ? cache_flush(cache_dl2, 0) : 0),			\
-      sys_syscall(&regs, mem_access, mem, INST, TRUE))			\
-   : sys_syscall(&regs, dcache_access_fn, mem, INST, TRUE))
+  (fastfwd_on								\
+   ? sys_syscall(&regs, mem_access, mem, INST, TRUE)			\
+   : ((mtrace_out ? (mtrace_syscall(mtrace_out), 0) : 0),		\
+   (flush_on_syscalls							\
+    ? ((dtlb ? cache_flush(dtlb, 0) : 0),				\
+       (cache_dl1 ? cache_flush(cache_dl1, 0) : 0),			\
+       (cache_vc ? cache_flush(cache_vc, 0) : 0),			\
+       (cache_dl2 ? cache_flush(cache_dl2, 0) : 0),			\
+       (cache_dl3 ? cache_flush(cache_dl3, 0) : 0),			\
+       SWEEP_REF(sweep_flush, Read, 0, 0),				\
+       sys_syscall(&regs, mtrace_out ? mtrace_access_fn : mem_access,	\
+		   mem, INST, TRUE))					\
+    : sys_syscall(&regs, dcache_access_fn, mem, INST, TRUE))))
+
+/* update the stats tracked by PC after the instruction at PC */
+static void
+pcstat_update(md_addr_t pc)
+{
+  int i;
+
+  for (i=0; i < pcstat_nelt; i++)
+    {
+      counter_t newval;
+      int delta;
+
+      /* check if any tracked stats changed */
+      newval = STATVAL(pcstat_stats[i]);
+      delta = newval - pcstat_lastvals[i];
+      if (delta != 0)
+	{
+	  stat_add_samples(pcstat_sdists[i], pc, delta);
+	  pcstat_lastvals[i] = newval;
+	}
+    }
+}
+
+/* replay memory reference trace MTRACE_IN through the caches */
+static void
+sim_replay(void)
+{
+  struct mtrace_ref_t ref;
+  enum mtrace_event_t event;
+  int started = FALSE, counted = FALSE;
+
+  fprintf(stderr, "sim: ** replaying memory reference trace w/ caches **\n");
+
+  event = mtrace_next(mtrace_in, &ref);
+
+  /* skip the references of the first FASTFWD_COUNT insts */
+  if (fastfwd_count > 0)
+    {
+      fprintf(stderr, "sim: ** fast forwarding %d insts **\n", fastfwd_count);
+      for (; event != mtrace_ev_end; event = mtrace_next(mtrace_in, &ref))
+	{
+	  if (event != mtrace_ev_inst)
+	    continue;
+	  if (sim_num_insn == fastfwd_count)
+	    break;
+	  regs.regs_PC = ref.pc;
+	  sim_num_insn++;
+	}
+    }
+
+  /* fork a cache simulator per -snapshot configuration from here */
+  if (sim_snapshot() >= 0)
+    fprintf(stderr, "sim: ** starting snapshot cache simulation **\n");
+
+#ifndef _MSC_VER
+  /* start the -sweep hierarchies' worker threads */
+  sweep_start();
+#endif /* !_MSC_VER */
+
+  for (; event != mtrace_ev_end; event = mtrace_next(mtrace_in, &ref))
+    {
+      switch (event)
+	{
+	case mtrace_ev_inst:
+	  /* the last instruction is complete */
+	  if (started)
+	    {
+	      pcstat_update(regs.regs_PC);
+	      if (max_insts && sim_num_insn >= max_insts)
+		return;
+	    }
+	  started = TRUE;
+
+	  /* fetch the next one */
+	  regs.regs_PC = ref.pc;
+	  if (itlb)
+	    cache_access(itlb, Read, IACOMPRESS(regs.regs_PC),
+			 NULL, ISCOMPRESS(sizeof(md_inst_t)), CACHE_NOW,
+			 NULL, NULL, 0);
+	  if (cache_il1)
+	    cache_access(cache_il1, Read, IACOMPRESS(regs.regs_PC),
+			 NULL, ISCOMPRESS(sizeof(md_inst_t)), CACHE_NOW,
+			 NULL, NULL, 0);
+	  if (sdist_il)
+	    cache_sdist_access(sdist_il, IACOMPRESS(regs.regs_PC));
+	  SWEEP_REF(sweep_inst, Read, IACOMPRESS(regs.regs_PC),
+		    ISCOMPRESS(sizeof(md_inst_t)));
+	  sim_num_insn++;
+	  counted = FALSE;
+	  break;
+
+	case mtrace_ev_data:
+	  /* system calls bypass flushed caches */
+	  if (ref.sys && flush_on_syscalls)
+	    break;
+	  if (!ref.sys && !counted)
+	    {
+	      /* one reference per load or store instruction */
+	      sim_num_refs++;
+	      counted = TRUE;
+	    }
+	  if (dtlb)
+	    cache_access(dtlb, ref.cmd, ref.addr, NULL, ref.nbytes, CACHE_NOW,
+			 NULL, NULL, 0);
+	  if (cache_dl1)
+	    cache_access(cache_dl1, ref.cmd, ref.addr, NULL, ref.nbytes,
+			 CACHE_NOW, NULL, NULL, 0);
+	  if (sdist_dl)
+	    cache_sdist_access(sdist_dl, ref.addr);
+	  SWEEP_REF(sweep_data, ref.cmd, ref.addr, ref.nbytes);
+	  break;
+
+	case mtrace_ev_syscall:
+	  if (flush_on_syscalls)
+	    {
+	      if (dtlb)
+		cache_flush(dtlb, 0);
+	      if (cache_dl1)
+		cache_flush(cache_dl1, 0);
+	      if (cache_vc)
+		cache_flush(cache_vc, 0);
+	      if (cache_dl2)
+		cache_flush(cache_dl2, 0);
+	      if (cache_dl3)
+		cache_flush(cache_dl3, 0);
+	      SWEEP_REF(sweep_flush, Read, 0, 0);
+	    }
+	  break;
+
+	default:
+	  panic("bogus memory reference trace event");
+	}
+    }
+
+  if (started)
+    pcstat_update(regs.regs_PC);
+}
 
 /* start simulation, program loaded, processor precise state initialized */
 void
@@ -747,6 +1797,13 @@ sim_main(void)
   enum md_opcode op;
   register int is_write;
   enum md_fault_type fault;
+
+  /* replaying a trace rather than running a program? */
+  if (mtrace_in)
+    {
+      sim_replay();
+      return;
+    }
  
   fprintf(stderr, "sim: ** starting functional simulation w/ caches **\n");
 
@@ -758,8 +1815,36 @@ sim_main(void)
     dlite_main(regs.regs_PC - sizeof(md_inst_t), regs.regs_PC,
 	       sim_num_insn, &regs, mem);
 
+  /* fast forward, performs functional simulation for FASTFWD_COUNT insts,
+     then turns on cache simulation */
+  fastfwd_on = TRUE;
+  if (fastfwd_count > 0)
+    fprintf(stderr, "sim: ** fast forwarding %d insts **\n", fastfwd_count);
+
   while (TRUE)
     {
+      if (fastfwd_on && sim_num_insn >= fastfwd_count)
+	{
+	  fastfwd_on = FALSE;
+
+	  /* fork a cache simulator per -snapshot configuration from here,
+	     each child rebuilds its caches from its own configuration */
+	  if ((i = sim_snapshot()) >= 0)
+	    {
+	      fprintf(stderr,
+		      "sim: ** starting snapshot cache simulation **\n");
+
+	      /* only the first snapshot writes the trace */
+	      if (i > 0)
+		mtrace_out = NULL;
+	    }
+
+#ifndef _MSC_VER
+	  /* start the -sweep hierarchies' worker threads */
+	  sweep_start();
+#endif /* !_MSC_VER */
+	}
+
       /* maintain $r0 semantics */
       regs.regs_R[MD_REG_ZERO] = 0;
 #ifdef TARGET_ALPHA
@@ -767,15 +1852,26 @@ sim_main(void)
 #endif /* TARGET_ALPHA */
 
       /* get the next instruction to execute */
-      if (itlb)
-	cache_access(itlb, Read, IACOMPRESS(regs.regs_PC),
-		     NULL, ISCOMPRESS(sizeof(md_inst_t)), 0, NULL, NULL, 0);
-      if (cache_il1)
-	cache_access(cache_il1, Read, IACOMPRESS(regs.regs_PC),
-		     NULL, ISCOMPRESS(sizeof(md_inst_t)), 0, NULL, NULL, 0);
+      if (!fastfwd_on)
+	{
+	  if (itlb)
+	    cache_access(itlb, Read, IACOMPRESS(regs.regs_PC),
+			 NULL, ISCOMPRESS(sizeof(md_inst_t)), CACHE_NOW,
+			 NULL, NULL, 0);
+	  if (cache_il1)
+	    cache_access(cache_il1, Read, IACOMPRESS(regs.regs_PC),
+			 NULL, ISCOMPRESS(sizeof(md_inst_t)), CACHE_NOW,
+			 NULL, NULL, 0);
+	  if (sdist_il)
+	    cache_sdist_access(sdist_il, IACOMPRESS(regs.regs_PC));
+	  SWEEP_REF(sweep_inst, Read, IACOMPRESS(regs.regs_PC),
+		    ISCOMPRESS(sizeof(md_inst_t)));
+	  if (mtrace_out)
+	    mtrace_inst(mtrace_out, regs.regs_PC);
+	}
       MD_FETCH_INST(inst, mem, regs.regs_PC);
 
-      /* keep an instruction count */
+      /* keep an instruction count, EIO traces are indexed by it */
       sim_num_insn++;
 
       /* set default reference address and access mode */
@@ -810,27 +1906,15 @@ sim_main(void)
 
       if (MD_OP_FLAGS(op) & F_MEM)
 	{
-	  sim_num_refs++;
+	  if (!fastfwd_on)
+	    sim_num_refs++;
 	  if (MD_OP_FLAGS(op) & F_STORE)
 	    is_write = TRUE;
 	}
 
       /* update any stats tracked by PC */
-      for (i=0; i < pcstat_nelt; i++)
-	{
-	  counter_t newval;
-	  int delta;
-
-	  /* check if any tracked stats changed */
-	  newval = STATVAL(pcstat_stats[i]);
-	  delta = newval - pcstat_lastvals[i];
-	  if (delta != 0)
-	    {
-	      stat_add_samples(pcstat_sdists[i], regs.regs_PC, delta);
-	      pcstat_lastvals[i] = newval;
-	    }
-
-	}
+      if (!fastfwd_on)
+	pcstat_update(regs.regs_PC);
 
       /* check for DLite debugger entry condition */
       if (dlite_check_break(regs.regs_NPC,
@@ -843,7 +1927,7 @@ sim_main(void)
       regs.regs_NPC += sizeof(md_inst_t);
 
       /* finish early? */
-      if (max_insts && sim_num_insn >= max_insts)
+      if (!fastfwd_on && max_insts && sim_num_insn >= max_insts)
 	return;
     }
 }
@@ -96,6 +96,10 @@ static int fastfwding = FALSE;
 static char *trace_fname;
 static FILE *trace_fd = NULL;
 
+/* write a binary EIO trace, with a checkpoint every so many insts */
+static int trace_binary;
+static unsigned int trace_chkpt_interval;
+
 /* checkpoint filename and file descriptor */
 static enum { no_chkpt, one_shot_chkpt, periodic_chkpt } chkpt_kind = no_chkpt;
 static char *chkpt_fname;
@@ -115,6 +119,9 @@ static char *chkpt_opts[2];
 static int per_chkpt_nelt = 0;
 static char *per_chkpt_opts[2];
 
+/* write binary checkpoints instead of EXO text checkpoints */
+static int chkpt_binary;
+
 
 /* register simulator-specific options */
 void
@@ -145,6 +152,16 @@ sim_reg_options(struct opt_odb_t *odb)
 		 &trace_fname, /* default */NULL,
 		 /* print */TRUE, NULL);
 
+  opt_reg_flag(odb, "-trace:binary",
+	       "write a binary, indexed EIO trace",
+	       &trace_binary, /* default */FALSE, /* print */TRUE, NULL);
+
+  opt_reg_uint(odb, "-trace:chkpt",
+	       "min insts between binary EIO trace checkpoints "
+	       "(taken at syscalls, 0 = none)",
+	       &trace_chkpt_interval, /* default */0,
+	       /* print */TRUE, /* format */NULL);
+
   opt_reg_string_list(odb, "-perdump",
 		      "periodic checkpoint every n instructions: "
 		      "<base fname> <interval>",
@@ -157,6 +174,10 @@ sim_reg_options(struct opt_odb_t *odb)
 		      chkpt_opts, /* sz */2, &chkpt_nelt, /* default */NULL,
 		      /* !print */FALSE, /* format */NULL, /* !accrue */FALSE);
 
+  opt_reg_flag(odb, "-dump:binary",
+	       "write binary checkpoints (mapped lazily on restore)",
+	       &chkpt_binary, /* default */FALSE, /* print */TRUE, NULL);
+
   opt_reg_note(odb,
 "  Checkpoint range triggers are formatted as follows:\n"
 "\n"
@@ -251,7 +272,8 @@ sim_load_prog(char *fname,		/* program to load */
 
       /* create the checkpoint file */
       chkpt_fname = chkpt_opts[0];
-      chkpt_fd = eio_create(chkpt_fname);
+      if (!chkpt_binary)
+	chkpt_fd = eio_create(chkpt_fname);
 
       /* indicate checkpointing is now active... */
       chkpt_kind = one_shot_chkpt;
@@ -279,7 +301,12 @@ sim_load_prog(char *fname,		/* program to load */
 	      trace_fname);
 
       /* create an EIO trace file */
-      trace_fd = eio_create(trace_fname);
+      if (trace_binary)
+	trace_fd = eio_bin_create(trace_fname, trace_chkpt_interval);
+      else if (trace_chkpt_interval != 0)
+	fatal("trace checkpoints require a binary EIO trace, use -trace:binary");
+      else
+	trace_fd = eio_create(trace_fname);
     }
 
   /* initialize the DLite debugger */
@@ -512,10 +539,15 @@ sim_main(void)
 		  chkpt_fname, sim_num_insn);
 
 	  /* write the checkpoint file */
-	  eio_write_chkpt(&regs, mem, chkpt_fd);
+	  if (chkpt_binary)
+	    eio_write_bin_chkpt(&regs, mem, chkpt_fname);
+	  else
+	    {
+	      eio_write_chkpt(&regs, mem, chkpt_fd);
 
-	  /* close the checkpoint file */
-	  eio_close(chkpt_fd);
+	      /* close the checkpoint file */
+	      eio_close(chkpt_fd);
+	    }
 
 	  /* exit jumps to the target set in main() */
 	  longjmp(sim_exit_buf, /* exitcode + fudge */0+1);
@@ -527,16 +559,21 @@ sim_main(void)
 
 	  /* 'chkpt_fname' should be a printf format string */
 	  sprintf(this_chkpt_fname, chkpt_fname, chkpt_num);
-	  chkpt_fd = eio_create(this_chkpt_fname);
 
 	  myfprintf(stderr, "sim: writing checkpoint file `%s' @ inst %n...\n",
 		  this_chkpt_fname, sim_num_insn);
 
 	  /* write the checkpoint file */
-	  eio_write_chkpt(&regs, mem, chkpt_fd);
+	  if (chkpt_binary)
+	    eio_write_bin_chkpt(&regs, mem, this_chkpt_fname);
+	  else
+	    {
+	      chkpt_fd = eio_create(this_chkpt_fname);
+	      eio_write_chkpt(&regs, mem, chkpt_fd);
 
-	  /* close the checkpoint file */
-	  eio_close(chkpt_fd);
+	      /* close the checkpoint file */
+	      eio_close(chkpt_fd);
+	    }
 
 	  chkpt_num++;
 	  next_chkpt_cycle += per_chkpt_interval;
@@ -84,6 +84,7 @@
 #include "loader.h"
 #include "syscall.h"
 #include "dlite.h"
+#include "mtrace.h"
 #include "sim.h"
 
 /* simulated registers */
@@ -97,6 +98,10 @@ static struct mem_t *mem = NULL;
 static struct mem_t *dec = NULL;
 #endif
 
+/* memory reference trace being written (-trace:out), else NULL */
+static char *mtrace_fname /* = NULL */;
+static struct mtrace_t *mtrace_out = NULL;
+
 /* register simulator-specific options */
 void
 sim_reg_options(struct opt_odb_t *odb)
@@ -110,6 +115,15 @@ sim_reg_options(struct opt_odb_t *odb)
 "causing sim-fast to execute incorrectly or dump core.  Such is the\n"
 "price we pay for speed!!!!\n"
 		 );
+
+  opt_reg_string(odb, "-trace:out",
+		 "write the memory reference trace to this file",
+		 &mtrace_fname, /* default */NULL, /* print */TRUE, NULL);
+  opt_reg_note(odb,
+"  A memory reference trace written with -trace:out may be given to\n"
+"  sim-cache in place of the program, which then replays it through the\n"
+"  caches.\n"
+	       );
 }
 
 /* check simulator-specific option values */
@@ -165,6 +179,10 @@ sim_load_prog(char *fname,		/* program to load */
   /* load program text and data, set up environment, memory, and regs */
   ld_load_prog(fname, argc, argv, envp, &regs, mem, TRUE);
 
+  /* trace the program's references */
+  if (mtrace_fname)
+    mtrace_out = mtrace_create(mtrace_fname, ld_text_base, ld_text_size);
+
 #ifdef TARGET_ALPHA
   /* pre-decode text segment */
   {
@@ -217,7 +235,11 @@ sim_aux_stats(FILE *stream)
 void
 sim_uninit(void)
 {
-  /* nada */
+  if (mtrace_out)
+    {
+      mtrace_close(mtrace_out);
+      mtrace_out = NULL;
+    }
 }
 
 /*
@@ -270,31 +292,63 @@ sim_uninit(void)
 #error No ISA target defined...
 #endif
 
+/* trace an instruction fetch or a data reference, if tracing */
+#define TRACE_INST(PC)							\
+  (mtrace_out ? (mtrace_inst(mtrace_out, (PC)), 0) : 0)
+#define TRACE_REF(CMD, ADDR, DATA_T)					\
+  (mtrace_out								\
+   ? (mtrace_data(mtrace_out, (CMD), (ADDR), sizeof(DATA_T), FALSE), 0)	\
+   : 0)
+
 /* precise architected memory state accessor macros */
 #define READ_BYTE(SRC, FAULT)						\
-  ((FAULT) = md_fault_none, MEM_READ_BYTE(mem, (SRC)))
+  ((FAULT) = md_fault_none, TRACE_REF(Read, (SRC), byte_t),		\
+   MEM_READ_BYTE(mem, (SRC)))
 #define READ_HALF(SRC, FAULT)						\
-  ((FAULT) = md_fault_none, MEM_READ_HALF(mem, (SRC)))
+  ((FAULT) = md_fault_none, TRACE_REF(Read, (SRC), half_t),		\
+   MEM_READ_HALF(mem, (SRC)))
 #define READ_WORD(SRC, FAULT)						\
-  ((FAULT) = md_fault_none, MEM_READ_WORD(mem, (SRC)))
+  ((FAULT) = md_fault_none, TRACE_REF(Read, (SRC), word_t),		\
+   MEM_READ_WORD(mem, (SRC)))
 #ifdef HOST_HAS_QWORD
 #define READ_QWORD(SRC, FAULT)						\
-  ((FAULT) = md_fault_none, MEM_READ_QWORD(mem, (SRC)))
+  ((FAULT) = md_fault_none, TRACE_REF(Read, (SRC), qword_t),		\
+   MEM_READ_QWORD(mem, (SRC)))
 #endif /* HOST_HAS_QWORD */
 
 #define WRITE_BYTE(SRC, DST, FAULT)					\
-  ((FAULT) = md_fault_none, MEM_WRITE_BYTE(mem, (DST), (SRC)))
+  ((FAULT) = md_fault_none, TRACE_REF(Write, (DST), byte_t),		\
+   MEM_WRITE_BYTE(mem, (DST), (SRC)))
 #define WRITE_HALF(SRC, DST, FAULT)					\
-  ((FAULT) = md_fault_none, MEM_WRITE_HALF(mem, (DST), (SRC)))
+  ((FAULT) = md_fault_none, TRACE_REF(Write, (DST), half_t),		\
+   MEM_WRITE_HALF(mem, (DST), (SRC)))
 #define WRITE_WORD(SRC, DST, FAULT)					\
-  ((FAULT) = md_fault_none, MEM_WRITE_WORD(mem, (DST), (SRC)))
+  ((FAULT) = md_fault_none, TRACE_REF(Write, (DST), word_t),		\
+   MEM_WRITE_WORD(mem, (DST), (SRC)))
 #ifdef HOST_HAS_QWORD
 #define WRITE_QWORD(SRC, DST, FAULT)					\
-  ((FAULT) = md_fault_none, MEM_WRITE_QWORD(mem, (DST), (SRC)))
+  ((FAULT) = md_fault_none, TRACE_REF(Write, (DST), qword_t),		\
+   MEM_WRITE_QWORD(mem, (DST), (SRC)))
 #endif /* HOST_HAS_QWORD */
 
+/* system call memory access function, traces the accesses */
+static enum md_fault_type
+mtrace_access_fn(struct mem_t *mem,	/* memory space to access */
+		 enum mem_cmd cmd,	/* memory access cmd, Read or Write */
+		 md_addr_t addr,	/* data address to access */
+		 void *p,		/* data input/output buffer */
+		 int nbytes)		/* number of bytes to access */
+{
+  mtrace_data(mtrace_out, cmd, addr, nbytes, TRUE);
+  return mem_access(mem, cmd, addr, p, nbytes);
+}
+
 /* system call handler macro */
-#define SYSCALL(INST)	sys_syscall(&regs, mem_access, mem, INST, TRUE)
+#define SYSCALL(INST)							\
+  (mtrace_out								\
+   ? (mtrace_syscall(mtrace_out),					\
+      sys_syscall(&regs, mtrace_access_fn, mem, INST, TRUE))		\
+   : sys_syscall(&regs, mem_access, mem, INST, TRUE))
 
 #ifndef NO_INSN_COUNT
 #define INC_INSN_CTR()	sim_num_insn++
@@ -367,6 +421,7 @@ sim_main(void)
 									\
     /* locate next instruction */					\
     regs.regs_PC = regs.regs_NPC;					\
+    TRACE_INST(regs.regs_PC);						\
 									\
     /* set up default next PC */					\
     regs.regs_NPC += sizeof(md_inst_t);					\
@@ -413,6 +468,9 @@ sim_main(void)
       sim_num_insn++;
 #endif /* !NO_INSN_COUNT */
 
+      /* trace the fetch */
+      TRACE_INST(regs.regs_PC);
+
 #ifdef TARGET_ALPHA
       /* load predecoded instruction */
       op = (enum md_opcode)__UNCHK_MEM_READ(dec, regs.regs_PC << 1, word_t);
@@ -51,9 +51,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
 #include <signal.h>
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#endif
 
 #include "host.h"
 #include "misc.h"
@@ -61,6 +69,7 @@
 #include "regs.h"
 #include "memory.h"
 #include "cache.h"
+#include "dram.h"
 #include "loader.h"
 #include "syscall.h"
 #include "bpred.h"
@@ -81,10 +90,10 @@
  */
 
 /* simulated registers */
-static struct regs_t regs;
+static HOST_TLS struct regs_t regs;
 
 /* simulated memory */
-static struct mem_t *mem = NULL;
+static HOST_TLS struct mem_t *mem = NULL;
 
 
 /*
@@ -97,6 +106,31 @@ static unsigned int max_insts;
 /* number of insts skipped before timing starts */
 static int fastfwd_count;
 
+/* warm the caches, TLBs and branch predictor while fast forwarding? */
+static int fastfwd_warm;
+
+/* sampled simulation (SMARTS): one unit measured every SAMPLE_PERIOD
+   insts, 0 for none, after SAMPLE_WARMUP insts of detailed warm-up */
+static unsigned int sample_period;
+static unsigned int sample_unit;
+static unsigned int sample_warmup;
+
+/* warm the caches, TLBs and branch predictor between sampling units? */
+static int sample_warm;
+
+/* z-score of the CPI confidence interval, and the target relative error
+   the number of units needed is computed for */
+static double sample_z;
+static double sample_err;
+
+/* sampling units simulated at once by forked worker processes */
+static int sample_jobs;
+
+/* SimPoint simulation points and weights files, and their interval size */
+static char *simpoint_fname;
+static char *simpoint_weights;
+static unsigned int simpoint_interval;
+
 /* pipeline trace range and output filename */
 static int ptrace_nelt = 0;
 static char *ptrace_opts[2];
@@ -110,6 +144,18 @@ static int ruu_branch_penalty;
 /* speed of front-end of machine relative to execution core */
 static int fetch_speed;
 
+/* fetch target queue size (in fetch blocks), 0 for a coupled front end */
+static int ftq_size;
+
+/* fetch blocks predicted and fetched per cycle, with a fetch target queue */
+static int ftq_blocks;
+
+/* prefetch the I-cache lines of fetch target queue entries */
+static int ftq_prefetch;
+
+/* loop stream buffer size (in insts), 0 for none */
+static int lsb_size;
+
 /* branch predictor type {nottaken|taken|perfect|bimod|2lev} */
 static char *pred_type;
 
@@ -157,6 +203,55 @@ static int RUU_size = 8;
 /* load/store queue (LSQ) size */
 static int LSQ_size = 4;
 
+/* memory dependence predictor type, i.e., {storeset|perfect|blind} */
+static char *mdp_type;
+
+/* memory dependence predictor, parsed from -mdp */
+#define MDP_STORESET		0	/* store set predictor */
+#define MDP_PERFECT		1	/* oracle, loads wait for aliases only */
+#define MDP_BLIND		2	/* loads wait for no store */
+static int mdp_kind = MDP_STORESET;
+
+/* store set predictor config (<SSIT size> <LFST size> <clear interval>) */
+static int storeset_nelt = 3;
+static int storeset_config[3] =
+  { /* SSIT size */1024, /* LFST size */128, /* clear interval */1000000 };
+
+/* out-of-order back end, i.e., {ruu|prf} */
+static char *backend_type;
+
+/* issue queues of the physical register file back end */
+#define IQ_INT			0	/* integer operations */
+#define IQ_FP			1	/* floating point operations */
+#define IQ_MEM			2	/* load/store address computations */
+#define IQ_NUM			3
+
+/* physical register files of the physical register file back end, and
+   the number of architected register names each holds per thread */
+#define PRF_INT			0
+#define PRF_FP			1
+#define PRF_NUM			2
+#if defined(TARGET_PISA)
+#define PRF_INT_NAMES		(31+2)	/* $r1-$r31, HI, LO */
+#define PRF_FP_NAMES		(16+1)	/* $f0-$f30 pairs, FCC */
+#elif defined(TARGET_ALPHA)
+#define PRF_INT_NAMES		(31+1)	/* $r0-$r30, UNIQ */
+#define PRF_FP_NAMES		(31+1)	/* $f0-$f30, FPCR */
+#endif
+#define PRF_NAMES(F)		((F) == PRF_INT ? PRF_INT_NAMES : PRF_FP_NAMES)
+
+/* non-zero for the physical register file back end, see -backend */
+static int backend_prf = FALSE;
+
+/* reorder buffer (ROB) size, replaces the RUU size with -backend prf */
+static int ROB_size;
+
+/* issue queue sizes, by queue, see IQ_INT etc. */
+static int IQ_size[IQ_NUM];
+
+/* physical register file sizes, by register file, see PRF_INT etc. */
+static int PRF_size[PRF_NUM];
+
 /* l1 data cache config, i.e., {<config>|none} */
 static char *cache_dl1_opt;
 
@@ -195,6 +290,35 @@ static int mem_lat[2] =
 /* memory access bus width (in bytes) */
 static int mem_bus_width;
 
+/* main memory model, i.e., {fixed|dram} */
+static char *mem_model;
+
+/* DRAM organization (<channels> <banks> <row size>) */
+static int mem_dram_nelt = 3;
+static int mem_dram_config[3] =
+  { /* channels */1, /* banks */8, /* row size */2048 };
+
+/* DRAM timing (<tRCD> <tCAS> <tRP> <tRAS>) */
+static int mem_timing_nelt = 4;
+static int mem_timing[4] =
+  { /* tRCD */12, /* tCAS */12, /* tRP */12, /* tRAS */30 };
+
+/* DRAM row buffer policy, i.e., {open|close} */
+static char *mem_page;
+
+/* DRAM scheduling policy, i.e., {frfcfs|fcfs} */
+static char *mem_sched;
+
+/* DRAM request queue sizes (<read queue> <write queue>) */
+static int mem_queue_nelt = 2;
+static int mem_queue[2] =
+  { /* read queue */16, /* write queue */16 };
+
+/* MSHRs per cache, i.e., outstanding misses (<l1> <l2>) */
+static int cache_mshr_nelt = 2;
+static int cache_mshr[2] =
+  { /* l1 */0, /* l2 */0 };
+
 /* instruction TLB config, i.e., {<config>|none} */
 static char *itlb_opt;
 
@@ -238,6 +362,43 @@ static char *pcstat_vars[MAX_PCSTAT_VARS];
 /* operate in backward-compatible bugs mode (for testing only) */
 static int bugcompat_mode;
 
+/* maximum number of SMT hardware threads */
+#define MAX_THREADS		4
+
+/* number of SMT hardware threads */
+static int smt_nthreads;
+
+/* programs (with arguments and optional `< <infile>') of threads 1 and up */
+static int smt_prog_nelt = 0;
+static char *smt_progs[MAX_THREADS-1];
+
+/* SMT fetch policy, i.e., {icount|rr} */
+static char *smt_fetch_policy;
+
+/* maximum number of threads fetched from per cycle */
+static int smt_fetch_threads;
+
+/* maximum number of CMP cores, the directory keeps a bit per core */
+#define MAX_CORES		16
+
+/* number of CMP cores */
+static int cmp_ncores;
+
+/* programs (with arguments and optional `< <infile>') of cores 1 and up */
+static int cmp_prog_nelt = 0;
+static char *cmp_progs[MAX_CORES-1];
+
+/* cycles the cores run between synchronizations */
+static int cmp_quantum;
+
+/* latency of a coherence action involving another core's L1 D-cache */
+static int cmp_dir_lat;
+
+/* bytes of memory shared by all CMP cores, mapped at CMP_SHM_BASE, clear
+   of the text, data and stack segments of both targets */
+static int cmp_shm_size;
+#define CMP_SHM_BASE		((md_addr_t)0x60000000)
+
 /*
  * functional unit resource configuration
  */
@@ -304,61 +465,108 @@ struct res_desc fu_config[] = {
  * simulator stats
  */
 /* SLIP variable */
-static counter_t sim_slip = 0;
+static HOST_TLS counter_t sim_slip = 0;
 
 /* total number of instructions executed */
-static counter_t sim_total_insn = 0;
+static HOST_TLS counter_t sim_total_insn = 0;
 
 /* total number of memory references committed */
-static counter_t sim_num_refs = 0;
+static HOST_TLS counter_t sim_num_refs = 0;
 
 /* total number of memory references executed */
-static counter_t sim_total_refs = 0;
+static HOST_TLS counter_t sim_total_refs = 0;
 
 /* total number of loads committed */
-static counter_t sim_num_loads = 0;
+static HOST_TLS counter_t sim_num_loads = 0;
 
 /* total number of loads executed */
-static counter_t sim_total_loads = 0;
+static HOST_TLS counter_t sim_total_loads = 0;
 
 /* total number of branches committed */
-static counter_t sim_num_branches = 0;
+static HOST_TLS counter_t sim_num_branches = 0;
 
 /* total number of branches executed */
-static counter_t sim_total_branches = 0;
+static HOST_TLS counter_t sim_total_branches = 0;
 
 /* cycle counter */
-static tick_t sim_cycle = 0;
+static HOST_TLS tick_t sim_cycle = 0;
+
+/* cycles the clock advanced during functional warming */
+static HOST_TLS tick_t sim_warm_cycle = 0;
+
+/* total number of instructions fast forwarded */
+static HOST_TLS counter_t sim_func_insn = 0;
+
+/* instructions committed by the current core, sim_num_insn on core 0 and
+   the count in its CMP core state on the others */
+static HOST_TLS counter_t *core_insn = &sim_num_insn;
+#define CORE_NUM_INSN		(*core_insn)
 
 /* occupancy counters */
-static counter_t IFQ_count;		/* cumulative IFQ occupancy */
-static counter_t IFQ_fcount;		/* cumulative IFQ full count */
-static counter_t RUU_count;		/* cumulative RUU occupancy */
-static counter_t RUU_fcount;		/* cumulative RUU full count */
-static counter_t LSQ_count;		/* cumulative LSQ occupancy */
-static counter_t LSQ_fcount;		/* cumulative LSQ full count */
+static HOST_TLS counter_t IFQ_count;		/* cumulative IFQ occupancy */
+static HOST_TLS counter_t IFQ_fcount;		/* cumulative IFQ full count */
+static HOST_TLS counter_t RUU_count;		/* cumulative RUU occupancy */
+static HOST_TLS counter_t RUU_fcount;		/* cumulative RUU full count */
+static HOST_TLS counter_t LSQ_count;		/* cumulative LSQ occupancy */
+static HOST_TLS counter_t LSQ_fcount;		/* cumulative LSQ full count */
+
+/* fetch target queue and loop stream buffer stats */
+static HOST_TLS counter_t ftq_predicted;	/* fetch blocks predicted */
+static HOST_TLS counter_t ftq_prefetches;	/* I-cache lines prefetched */
+static HOST_TLS counter_t FTQ_count;		/* cumulative FTQ occupancy */
+static HOST_TLS counter_t lsb_captures;		/* loops captured by the LSB */
+static HOST_TLS counter_t lsb_insn;		/* insts fetched from the LSB */
+
+/* back end structures that can stall dispatch, see -backend */
+#define STALL_ROB		0
+#define STALL_LSQ		1
+#define STALL_IQ(Q)		(2+(Q))
+#define STALL_PRF(F)		(2+IQ_NUM+(F))
+#define STALL_NUM		(2+IQ_NUM+PRF_NUM)
+
+/* physical register file back end stats */
+static HOST_TLS int backend_stall;		/* a bit for each structure that
+						   stalled dispatch this cycle */
+static HOST_TLS counter_t backend_stalls[STALL_NUM];/* cycles each structure
+						   stalled dispatch */
+static HOST_TLS counter_t IQ_count[IQ_NUM];	/* cumulative IQ occupancy */
+static HOST_TLS counter_t PRF_count[PRF_NUM];	/* cumulative renamed registers
+						   in use */
+
+/* memory dependence predictor stats */
+static HOST_TLS counter_t mdp_waits;		/* loads held for a predicted store */
+static HOST_TLS counter_t mdp_false_waits;	/* ... that did not alias the load */
+static HOST_TLS counter_t mdp_violations;	/* loads issued before an aliasing
+					   store's address was known */
 
 /* total non-speculative bogus addresses seen (debug var) */
-static counter_t sim_invalid_addrs;
+static HOST_TLS counter_t sim_invalid_addrs;
 
 /*
  * simulator state variables
  */
 
 /* instruction sequence counter, used to assign unique id's to insts */
-static unsigned int inst_seq = 0;
+static HOST_TLS unsigned int inst_seq = 0;
 
 /* pipetrace instruction sequence counter */
-static unsigned int ptrace_seq = 0;
+static HOST_TLS unsigned int ptrace_seq = 0;
 
 /* speculation mode, non-zero when mis-speculating, i.e., executing
    instructions down the wrong path, thus state recovery will eventually have
    to occur that resets processor register and memory state back to the last
    precise state */
-static int spec_mode = FALSE;
+static HOST_TLS int spec_mode = FALSE;
 
 /* cycles until fetch issue resumes */
-static unsigned ruu_fetch_issue_delay = 0;
+static HOST_TLS unsigned ruu_fetch_issue_delay = 0;
+
+/* SMT thread whose state is in the globals, see thread_switch() */
+static HOST_TLS int cur_thread = 0;
+
+/* address A in the address space of thread ID, the threads' address spaces
+   are kept apart in the shared caches and TLBs by the top address bits */
+#define THREAD_ADDR(ID, A)	((A) ^ ((md_addr_t)(ID) << 30))
 
 /* perfect prediction enabled */
 static int pred_perfect = FALSE;
@@ -368,28 +576,42 @@ static char *bpred_spec_opt;
 static enum { spec_ID, spec_WB, spec_CT } bpred_spec_update;
 
 /* level 1 instruction cache, entry level instruction cache */
-static struct cache_t *cache_il1;
+static HOST_TLS struct cache_t *cache_il1;
 
 /* level 1 instruction cache */
 static struct cache_t *cache_il2;
 
 /* level 1 data cache, entry level data cache */
-static struct cache_t *cache_dl1;
+static HOST_TLS struct cache_t *cache_dl1;
 
 /* level 2 data cache */
 static struct cache_t *cache_dl2;
 
 /* instruction TLB */
-static struct cache_t *itlb;
+static HOST_TLS struct cache_t *itlb;
 
 /* data TLB */
-static struct cache_t *dtlb;
+static HOST_TLS struct cache_t *dtlb;
+
+/* DRAM main memory, NULL for a fixed memory latency */
+static struct dram_t *mem_dram = NULL;
+
+/* PC of the instruction accessing the caches, seen by the PC-indexed
+   prefetchers and replacement policies through get_PC() */
+static HOST_TLS md_addr_t cache_access_PC = 0;
+
+/* return the PC of the instruction accessing the caches */
+md_addr_t
+get_PC(void)
+{
+  return cache_access_PC;
+}
 
 /* branch predictor */
-static struct bpred_t *pred;
+static HOST_TLS struct bpred_t *pred;
 
 /* functional unit resource pool */
-static struct res_pool *fu_pool = NULL;
+static HOST_TLS struct res_pool *fu_pool = NULL;
 
 /* text-based stat profiles */
 static struct stat_stat_t *pcstat_stats[MAX_PCSTAT_VARS];
@@ -419,6 +641,419 @@ mem_access_latency(int blk_sz)		/* block size accessed */
 	  (/* remainder chunk latency */mem_lat[1] * (chunks - 1)));
 }
 
+/* main memory access of block BADDR at time NOW, from the DRAM model if
+   there is one */
+static unsigned int			/* latency of access */
+main_mem_access(enum mem_cmd cmd,	/* access cmd, Read or Write */
+		md_addr_t baddr,	/* block address to access */
+		int bsize,		/* size of block to access */
+		tick_t now)		/* time of access */
+{
+  if (mem_dram)
+    return dram_access(mem_dram, cmd, baddr, bsize, now);
+
+  if (cmd == Read)
+    return mem_access_latency(bsize);
+  else
+    {
+      /* FIXME: unlimited write buffers */
+      return 0;
+    }
+}
+
+
+/*
+ * CMP memory system: the cores' private L1 caches see virtual addresses,
+ * the shared L2 caches and main memory physical ones, a directory tracks
+ * the L1 D-cache copies of each physical block (MESI: a block is M or E in
+ * its directory owner's L1, S when it may be in several, and a core holds
+ * S blocks with CACHE_BLK_SHARED set), other cores' L1s are changed by
+ * messages they apply at their next cycle
+ */
+
+#ifndef _MSC_VER
+/* CMP_MEM_LOCK guards the shared L2 caches, main memory, the page map, the
+   directory and the message queues, CMP_SYS_LOCK system calls */
+static pthread_mutex_t cmp_mem_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t cmp_sys_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CMP_LOCK(LOCK)							\
+  (cmp_ncores > 1 ? (void)pthread_mutex_lock(&(LOCK)) : (void)0)
+#define CMP_UNLOCK(LOCK)						\
+  (cmp_ncores > 1 ? (void)pthread_mutex_unlock(&(LOCK)) : (void)0)
+#else /* _MSC_VER */
+#define CMP_LOCK(LOCK)		((void)0)
+#define CMP_UNLOCK(LOCK)	((void)0)
+#endif /* _MSC_VER */
+
+/* coherence message to a core's L1 D-cache */
+enum cmp_msg_type {
+  cmp_msg_inval,			/* drop the block */
+  cmp_msg_downgrade			/* write the block back, keep it S */
+};
+
+struct cmp_msg_t {
+  enum cmp_msg_type type;		/* message type */
+  md_addr_t addr;			/* block address, in the receiver's
+					   address space */
+};
+
+/* a queue of coherence messages */
+struct cmp_msgq_t {
+  struct cmp_msg_t *msg;		/* messages */
+  int num, size;			/* messages queued, allocated */
+};
+
+/* a CMP core, its private state lives in the thread-local globals of the
+   host thread running it, the pointers below let the other threads see it */
+struct core_t {
+#ifndef _MSC_VER
+  pthread_t thread;			/* host thread running the core */
+#endif /* !_MSC_VER */
+  char **envp;				/* program environment */
+  int exited;				/* program has exited? */
+  int done;				/* reached -max:inst? */
+
+  /* the core's private state, for stats */
+  struct cache_t *il1, *dl1, *itlb, *dtlb;
+  struct mem_t *mem;
+  counter_t num_insn;			/* insts committed, core 0 uses
+					   sim_num_insn */
+  counter_t *num_refs, *num_loads, *num_branches;
+  tick_t *cycle;
+
+  /* page map, an open hash of virtual page numbers and their frames */
+  md_addr_t *page_vpn;
+  md_addr_t *page_frame;		/* 0 for an empty slot */
+  unsigned int page_size, page_num;	/* slots allocated, used */
+
+  /* coherence messages to the core, and the queue being applied */
+  struct cmp_msgq_t msgq, spare;
+};
+
+/* the CMP cores, and the core of the running host thread */
+static struct core_t cores[MAX_CORES];
+static HOST_TLS int core_id = 0;
+
+/* first cycle of the next quantum, and the last cycle of the run */
+static tick_t cmp_cycle = 0;
+
+/* physical page frames allocated, frame 0 is never used */
+static md_addr_t cmp_nframes = 0;
+
+/* virtual page of each frame, frames are private to a core except those
+   of the -cmp:shm segment, which come first and are mapped by all cores */
+static md_addr_t *cmp_frame_vpn = NULL;
+static md_addr_t cmp_frame_vpn_size = 0;
+
+/* host file holding the -cmp:shm segment, mapped into every core's memory */
+static FILE *cmp_shm_file = NULL;
+
+/* L1 D-cache block size, the directory's granularity */
+static int cmp_bsize;
+
+/* directory hash table size, must be a power of two */
+#define DIR_HASH_SIZE		65536
+
+/* directory entry of a physical block held by one or more L1 D-caches */
+struct dir_ent_t {
+  struct dir_ent_t *next;		/* next entry in hash bucket */
+  md_addr_t addr;			/* physical block address */
+  unsigned int sharers;			/* bit mask of cores holding it */
+  int owner;				/* core holding it M or E, or -1 */
+};
+
+static struct dir_ent_t *dir_htable[DIR_HASH_SIZE];
+static struct dir_ent_t *dir_free_list = NULL;
+
+#define DIR_HASH(BADDR)							\
+  (((BADDR) / cmp_bsize) & (DIR_HASH_SIZE - 1))
+
+/* directory stats */
+static counter_t dir_reads = 0;
+static counter_t dir_forwards = 0;
+static counter_t dir_upgrades = 0;
+static counter_t dir_invals = 0;
+static counter_t dir_back_invals = 0;
+
+/* double the size of core C's page map */
+static void
+cmp_page_grow(struct core_t *c)			/* core to grow map of */
+{
+  md_addr_t *vpn = c->page_vpn, *frame = c->page_frame;
+  unsigned int i, j, size = c->page_size;
+
+  c->page_size = size ? 2*size : 1024;
+  c->page_vpn = calloc(c->page_size, sizeof(md_addr_t));
+  c->page_frame = calloc(c->page_size, sizeof(md_addr_t));
+  if (!c->page_vpn || !c->page_frame)
+    fatal("out of virtual memory");
+
+  for (i=0; i < size; i++)
+    {
+      if (!frame[i])
+	continue;
+      for (j=vpn[i] & (c->page_size-1); c->page_frame[j];
+	   j=(j+1) & (c->page_size-1))
+	/* nada */;
+      c->page_vpn[j] = vpn[i];
+      c->page_frame[j] = frame[i];
+    }
+  if (vpn)
+    {
+      free(vpn);
+      free(frame);
+    }
+}
+
+/* allocate the next physical page frame to virtual page VPN */
+static md_addr_t				/* frame number */
+cmp_frame_new(md_addr_t vpn)			/* virtual page number */
+{
+  if (cmp_nframes == ((~(md_addr_t)0) >> MD_LOG_PAGE_SIZE))
+    fatal("CMP cores are out of physical page frames");
+  if (++cmp_nframes >= cmp_frame_vpn_size)
+    {
+      cmp_frame_vpn_size = cmp_frame_vpn_size ? 2*cmp_frame_vpn_size : 4096;
+      cmp_frame_vpn =
+	realloc(cmp_frame_vpn, cmp_frame_vpn_size * sizeof(md_addr_t));
+      if (!cmp_frame_vpn)
+	fatal("out of virtual memory");
+    }
+  cmp_frame_vpn[cmp_nframes] = vpn;
+  return cmp_nframes;
+}
+
+/* physical address of the current core's virtual address ADDR, pages get
+   frames in first touch order, call with CMP_MEM_LOCK held */
+static md_addr_t
+cmp_paddr(md_addr_t addr)			/* virtual address */
+{
+  struct core_t *c = &cores[core_id];
+  md_addr_t vpn = addr >> MD_LOG_PAGE_SIZE;
+  unsigned int i;
+
+  /* the shared segment has frames 1 and up in every core */
+  if (addr - CMP_SHM_BASE < (md_addr_t)cmp_shm_size)
+    return (addr - CMP_SHM_BASE) + MD_PAGE_SIZE;
+
+  if (2*(c->page_num+1) > c->page_size)
+    cmp_page_grow(c);
+
+  for (i=vpn & (c->page_size-1); c->page_frame[i]; i=(i+1) & (c->page_size-1))
+    {
+      if (c->page_vpn[i] == vpn)
+	return ((c->page_frame[i] << MD_LOG_PAGE_SIZE)
+		| (addr & (MD_PAGE_SIZE-1)));
+    }
+
+  /* first touch, map the page to the next frame */
+  c->page_vpn[i] = vpn;
+  c->page_frame[i] = cmp_frame_new(vpn);
+  c->page_num++;
+
+  return (c->page_frame[i] << MD_LOG_PAGE_SIZE) | (addr & (MD_PAGE_SIZE-1));
+}
+
+/* queue a message of TYPE for physical block BADDR to core C's L1 D-cache,
+   call with CMP_MEM_LOCK held */
+static void
+cmp_post(int c,					/* receiving core */
+	 enum cmp_msg_type type,		/* message type */
+	 md_addr_t baddr)			/* physical block address */
+{
+  struct cmp_msgq_t *q = &cores[c].msgq;
+
+  if (q->num == q->size)
+    {
+      q->size = q->size ? 2*q->size : 64;
+      q->msg = realloc(q->msg, q->size * sizeof(struct cmp_msg_t));
+      if (!q->msg)
+	fatal("out of virtual memory");
+    }
+  q->msg[q->num].type = type;
+  q->msg[q->num].addr = ((cmp_frame_vpn[baddr >> MD_LOG_PAGE_SIZE]
+			  << MD_LOG_PAGE_SIZE)
+			 | (baddr & (MD_PAGE_SIZE-1)));
+  q->num++;
+}
+
+/* directory entry of physical block BADDR, allocated with no sharers if
+   the block is in no L1 D-cache */
+static struct dir_ent_t *
+dir_get(md_addr_t baddr)			/* physical block address */
+{
+  struct dir_ent_t *ent;
+
+  for (ent=dir_htable[DIR_HASH(baddr)]; ent; ent=ent->next)
+    {
+      if (ent->addr == baddr)
+	return ent;
+    }
+
+  if (dir_free_list)
+    {
+      ent = dir_free_list;
+      dir_free_list = ent->next;
+    }
+  else
+    {
+      ent = calloc(1, sizeof(struct dir_ent_t));
+      if (!ent)
+	fatal("out of virtual memory");
+    }
+  ent->addr = baddr;
+  ent->sharers = 0;
+  ent->owner = -1;
+  ent->next = dir_htable[DIR_HASH(baddr)];
+  dir_htable[DIR_HASH(baddr)] = ent;
+  return ent;
+}
+
+/* drop the directory entry of physical block BADDR, if any */
+static void
+dir_put(md_addr_t baddr)			/* physical block address */
+{
+  struct dir_ent_t *ent, **link;
+
+  for (link=&dir_htable[DIR_HASH(baddr)]; *link; link=&(*link)->next)
+    {
+      if ((*link)->addr == baddr)
+	{
+	  ent = *link;
+	  *link = ent->next;
+	  ent->next = dir_free_list;
+	  dir_free_list = ent;
+	  return;
+	}
+    }
+}
+
+/* the current core reads physical block BADDR into its L1 D-cache block
+   BLK (if not NULL), returns the latency of getting it from another core */
+static unsigned int				/* latency of the read */
+dir_read(md_addr_t baddr,			/* physical block address */
+	 struct cache_blk_t *blk)		/* L1 block being filled */
+{
+  struct dir_ent_t *ent = dir_get(baddr);
+  unsigned int lat = 0;
+
+  dir_reads++;
+  if (ent->owner >= 0 && ent->owner != core_id)
+    {
+      /* the owner may have it modified, it writes it back and keeps it S */
+      cmp_post(ent->owner, cmp_msg_downgrade, baddr);
+      dir_forwards++;
+      lat = cmp_dir_lat;
+      ent->owner = -1;
+    }
+  ent->sharers |= (1 << core_id);
+
+  /* E if no one else has it, S otherwise */
+  if (ent->sharers == (1u << core_id))
+    ent->owner = core_id;
+  else if (blk)
+    blk->status |= CACHE_BLK_SHARED;
+
+  return lat;
+}
+
+/* the current core writes its S copy of physical block BADDR, returns the
+   latency of invalidating the other copies */
+static unsigned int				/* latency of the upgrade */
+dir_upgrade(md_addr_t baddr)			/* physical block address */
+{
+  struct dir_ent_t *ent = dir_get(baddr);
+  unsigned int lat = 0;
+  int i;
+
+  dir_upgrades++;
+  for (i=0; i < cmp_ncores; i++)
+    {
+      if (i != core_id && (ent->sharers & (1 << i)))
+	{
+	  cmp_post(i, cmp_msg_inval, baddr);
+	  dir_invals++;
+	  lat = cmp_dir_lat;
+	}
+    }
+  ent->sharers = (1 << core_id);
+  ent->owner = core_id;
+
+  return lat;
+}
+
+/* L1 D-cache eviction hook, removes the current core from the sharers of
+   the block */
+static int					/* write the block back? */
+cmp_dl1_evict(struct cache_t *cp,		/* cache evicting the block */
+	      md_addr_t baddr,			/* virtual block address */
+	      int dirty,			/* block is dirty? */
+	      tick_t now)			/* time of the eviction */
+{
+  struct dir_ent_t *ent;
+
+  CMP_LOCK(cmp_mem_lock);
+  baddr = cmp_paddr(baddr);
+  ent = dir_get(baddr);
+  ent->sharers &= ~(1 << core_id);
+  if (ent->owner == core_id)
+    ent->owner = -1;
+  if (!ent->sharers)
+    dir_put(baddr);
+  CMP_UNLOCK(cmp_mem_lock);
+
+  return dirty;
+}
+
+/* shared L2 cache eviction hook, keeps the L2 inclusive of the L1
+   D-caches by invalidating their copies of the block, called from L1 miss
+   handlers with CMP_MEM_LOCK held */
+static int					/* write the block back? */
+cmp_l2_evict(struct cache_t *cp,		/* cache evicting the block */
+	     md_addr_t baddr,			/* physical block address */
+	     int dirty,				/* block is dirty? */
+	     tick_t now)			/* time of the eviction */
+{
+  struct dir_ent_t *ent;
+  md_addr_t addr;
+  int i;
+
+  for (addr=baddr & ~(md_addr_t)(cmp_bsize-1);
+       addr < baddr + cp->bsize; addr += cmp_bsize)
+    {
+      ent = dir_get(addr);
+      for (i=0; i < cmp_ncores; i++)
+	{
+	  if (ent->sharers & (1 << i))
+	    {
+	      cmp_post(i, cmp_msg_inval, addr);
+	      dir_back_invals++;
+	    }
+	}
+      dir_put(addr);
+    }
+
+  return dirty;
+}
+
+/* the current core wrote ADDR in its L1 D-cache, take the block from the
+   other cores if they may have it, returns the latency of doing so */
+static unsigned int				/* latency of the upgrade */
+cmp_upgrade(md_addr_t addr)			/* virtual address written */
+{
+  int status = cache_mark_shared(cache_dl1, addr, /* shared */FALSE);
+  unsigned int lat = 0;
+
+  if (status >= 0 && (status & CACHE_BLK_SHARED))
+    {
+      CMP_LOCK(cmp_mem_lock);
+      lat = dir_upgrade(cmp_paddr(addr & ~cache_dl1->blk_mask));
+      CMP_UNLOCK(cmp_mem_lock);
+    }
+  return lat;
+}
+
 
 /*
  * cache miss handlers
@@ -430,15 +1065,31 @@ dl1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* access is a prefetch? */
 {
   unsigned int lat;
 
-  if (cache_dl2)
+  if (cmp_ncores > 1)
+    {
+      /* access the shared L2 cache with the physical address, reads first
+	 join the block's sharers */
+      CMP_LOCK(cmp_mem_lock);
+      baddr = cmp_paddr(baddr);
+      lat = (cmd == Read ? dir_read(baddr, blk) : 0);
+      lat += cache_access(cache_dl2, cmd, baddr, NULL, bsize,
+			  /* now */now+lat, /* pudata */NULL,
+			  /* repl addr */NULL, prefetch);
+      CMP_UNLOCK(cmp_mem_lock);
+
+      /* FIXME: unlimited write buffers */
+      return (cmd == Read ? lat : 0);
+    }
+  else if (cache_dl2)
     {
       /* access next level of data cache hierarchy */
       lat = cache_access(cache_dl2, cmd, baddr, NULL, bsize,
-			 /* now */now, /* pudata */NULL, /* repl addr */NULL);
+			 /* now */now, /* pudata */NULL, /* repl addr */NULL, prefetch);
       if (cmd == Read)
 	return lat;
       else
@@ -450,13 +1101,7 @@ dl1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
   else
     {
       /* access main memory */
-      if (cmd == Read)
-	return mem_access_latency(bsize);
-      else
-	{
-	  /* FIXME: unlimited write buffers */
-	  return 0;
-	}
+      return main_mem_access(cmd, baddr, bsize, now);
     }
 }
 
@@ -466,16 +1111,11 @@ dl2_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* access is a prefetch? */
 {
   /* this is a miss to the lowest level, so access main memory */
-  if (cmd == Read)
-    return mem_access_latency(bsize);
-  else
-    {
-      /* FIXME: unlimited write buffers */
-      return 0;
-    }
+  return main_mem_access(cmd, baddr, bsize, now);
 }
 
 /* l1 inst cache l1 block miss handler function */
@@ -484,28 +1124,33 @@ il1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* access is a prefetch? */
 {
   unsigned int lat;
 
-if (cache_il2)
+  if (cmd != Read)
+    panic("writes to instruction memory not supported");
+
+  /* the levels below are shared by CMP cores, and see physical addresses */
+  CMP_LOCK(cmp_mem_lock);
+  if (cmp_ncores > 1)
+    baddr = cmp_paddr(baddr);
+
+  if (cache_il2)
     {
       /* access next level of inst cache hierarchy */
       lat = cache_access(cache_il2, cmd, baddr, NULL, bsize,
-			 /* now */now, /* pudata */NULL, /* repl addr */NULL);
-      if (cmd == Read)
-	return lat;
-      else
-	panic("writes to instruction memory not supported");
+			 /* now */now, /* pudata */NULL, /* repl addr */NULL, prefetch);
     }
   else
     {
       /* access main memory */
-      if (cmd == Read)
-	return mem_access_latency(bsize);
-      else
-	panic("writes to instruction memory not supported");
+      lat = main_mem_access(cmd, baddr, bsize, now);
     }
+  CMP_UNLOCK(cmp_mem_lock);
+
+  return lat;
 }
 
 /* l2 inst cache block miss handler function */
@@ -514,11 +1159,12 @@ il2_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* access is a prefetch? */
 {
   /* this is a miss to the lowest level, so access main memory */
   if (cmd == Read)
-    return mem_access_latency(bsize);
+    return main_mem_access(cmd, baddr, bsize, now);
   else
     panic("writes to instruction memory not supported");
 }
@@ -534,7 +1180,8 @@ itlb_access_fn(enum mem_cmd cmd,	/* access cmd, Read or Write */
 	       md_addr_t baddr,		/* block address to access */
 	       int bsize,		/* size of block to access */
 	       struct cache_blk_t *blk,	/* ptr to block in upper level */
-	       tick_t now)		/* time of access */
+	       tick_t now,		/* time of access */
+	       int prefetch)		/* access is a prefetch? */
 {
   md_addr_t *phy_page_ptr = (md_addr_t *)blk->user_data;
 
@@ -554,7 +1201,8 @@ dtlb_access_fn(enum mem_cmd cmd,	/* access cmd, Read or Write */
 	       md_addr_t baddr,	/* block address to access */
 	       int bsize,		/* size of block to access */
 	       struct cache_blk_t *blk,	/* ptr to block in upper level */
-	       tick_t now)		/* time of access */
+	       tick_t now,		/* time of access */
+	       int prefetch)		/* access is a prefetch? */
 {
   md_addr_t *phy_page_ptr = (md_addr_t *)blk->user_data;
 
@@ -591,6 +1239,76 @@ sim_reg_options(struct opt_odb_t *odb)
   opt_reg_int(odb, "-fastfwd", "number of insts skipped before timing starts",
 	      &fastfwd_count, /* default */0,
 	      /* print */TRUE, /* format */NULL);
+  opt_reg_flag(odb, "-fastfwd:warm",
+	       "warm caches, TLBs and branch predictor while fast forwarding",
+	       &fastfwd_warm, /* default */FALSE,
+	       /* print */TRUE, /* format */NULL);
+
+  /* sampling options */
+
+  opt_reg_uint(odb, "-sample:period",
+	       "measure one sampling unit every <n> insts (0 = no sampling)",
+	       &sample_period, /* default */0,
+	       /* print */TRUE, /* format */NULL);
+  opt_reg_uint(odb, "-sample:unit", "insts measured per sampling unit",
+	       &sample_unit, /* default */1000,
+	       /* print */TRUE, /* format */NULL);
+  opt_reg_uint(odb, "-sample:warmup",
+	       "insts of detailed warm-up before each sampling unit",
+	       &sample_warmup, /* default */2000,
+	       /* print */TRUE, /* format */NULL);
+  opt_reg_flag(odb, "-sample:warm",
+	       "warm caches, TLBs and branch predictor between units",
+	       &sample_warm, /* default */TRUE,
+	       /* print */TRUE, /* format */NULL);
+  opt_reg_double(odb, "-sample:z",
+		 "z-score of the CPI confidence interval (3.0 for 99.7%)",
+		 &sample_z, /* default */3.0,
+		 /* print */TRUE, /* format */NULL);
+  opt_reg_double(odb, "-sample:err",
+		 "target relative CPI error, for the units needed estimate",
+		 &sample_err, /* default */0.03,
+		 /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-sample:jobs",
+	      "units simulated in parallel by forked worker processes",
+	      &sample_jobs, /* default */1,
+	      /* print */TRUE, /* format */NULL);
+  opt_reg_string(odb, "-simpoint",
+		 "simulate the SimPoint simulation points in file <fname>",
+		 &simpoint_fname, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+  opt_reg_string(odb, "-simpoint:weights",
+		 "SimPoint weights file (default: equal weights)",
+		 &simpoint_weights, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+  opt_reg_uint(odb, "-simpoint:interval",
+	       "insts per SimPoint interval, as profiled with -bbv:interval",
+	       &simpoint_interval, /* default */10000000,
+	       /* print */TRUE, /* format */NULL);
+
+  opt_reg_note(odb,
+"  With -sample:period, the program runs functionally between sampling\n"
+"  units, keeping the caches, TLBs and branch predictor warm unless\n"
+"  -sample:warm is false, then -sample:warmup insts run detailed to fill\n"
+"  the pipeline, and the next -sample:unit insts are measured.  The\n"
+"  sample.* stats give the mean unit CPI, its confidence interval for\n"
+"  -sample:z, and the number of units needed to reach -sample:err.  With\n"
+"  -simpoint, the measured units are the intervals listed in a SimPoint\n"
+"  .simpoints file (`<interval> <cluster>' lines), weighted by the\n"
+"  .weights file (`<weight> <cluster>' lines), see sim-profile's -bbv for\n"
+"  the basic block vectors SimPoint clusters.  Functional warming charges\n"
+"  the clock as an in-order core waiting on every miss would, so that\n"
+"  the caches' and main memory's timing stays consistent; sim_clock counts\n"
+"  these cycles as well, sim_cycle only detailed ones.  Cache and branch\n"
+"  predictor stats include the warming accesses.  In sampled runs,\n"
+"  -max:inst counts all insts, functional ones included.  With\n"
+"  -sample:jobs above 1, the functional run forks a worker process at each\n"
+"  unit, which simulates the unit from the warmed state and exits, and up\n"
+"  to -sample:jobs workers run at once; the functional run warms through\n"
+"  the units as well, and the workers' stats are added to its own at the\n"
+"  end (sparse distributions excepted).  Workers reopen the files the\n"
+"  program has open, standard input included, and discard its output.\n"
+	       );
   opt_reg_string_list(odb, "-ptrace",
 	      "generate pipetrace, i.e., <fname|stdout|stderr> <range>",
 	      ptrace_opts, /* arr_sz */2, &ptrace_nelt, /* default */NULL,
@@ -631,6 +1349,40 @@ sim_reg_options(struct opt_odb_t *odb)
 	      &fetch_speed, /* default */1,
 	      /* print */TRUE, /* format */NULL);
 
+  opt_reg_int(odb, "-fetch:ftq",
+	      "fetch target queue size (in fetch blocks), 0 for none",
+	      &ftq_size, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-fetch:blocks",
+	      "fetch blocks predicted and fetched per cycle, with -fetch:ftq",
+	      &ftq_blocks, /* default */2,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_flag(odb, "-fetch:prefetch",
+	       "prefetch fetch target queue blocks into the I-cache",
+	       &ftq_prefetch, /* default */TRUE,
+	       /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-fetch:lsb",
+	      "loop stream buffer size (in insts), 0 for none, with -fetch:ftq",
+	      &lsb_size, /* default */32,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_note(odb,
+"  By default, fetch looks up the branch predictor as it fetches each\n"
+"  instruction, and stops after -fetch:speed predicted taken branches.\n"
+"  With -fetch:ftq N, the branch predictor runs ahead of fetch instead: each\n"
+"  cycle it predicts up to -fetch:blocks fetch blocks, runs of instructions\n"
+"  that end at a predicted taken branch or at the end of an I-cache line,\n"
+"  into an N entry fetch target queue (FTQ), and prefetches their lines into\n"
+"  the I-cache.  Fetch reads up to -fetch:blocks FTQ blocks per cycle, one\n"
+"  I-cache access each, so it continues past taken branches.  A loop of at\n"
+"  most -fetch:lsb instructions, found at the predicted taken branch that\n"
+"  closes it, is kept in the loop stream buffer (LSB), blocks inside it are\n"
+"  fetched without accessing the I-cache or counting against -fetch:blocks.\n"
+	       );
+
   /* branch predictor options */
 
   opt_reg_note(odb,
@@ -733,31 +1485,114 @@ sim_reg_options(struct opt_odb_t *odb)
 	      &LSQ_size, /* default */8,
 	      /* print */TRUE, /* format */NULL);
 
-  /* cache options */
+  opt_reg_string(odb, "-lsq:mdp",
+		 "memory dependence predictor, i.e., {storeset|perfect|blind}",
+		 &mdp_type, /* default */"storeset",
+		 /* print */TRUE, /* format */NULL);
 
-  opt_reg_string(odb, "-cache:dl1",
-		 "l1 data cache config, i.e., {<config>|none}",
-		 &cache_dl1_opt, "dl1:128:32:4:l",
-		 /* print */TRUE, NULL);
+  opt_reg_int_list(odb, "-lsq:storeset",
+		   "store set predictor config "
+		   "(<SSIT size> <LFST size> <clear interval>)",
+		   storeset_config, storeset_nelt, &storeset_nelt,
+		   /* default */storeset_config,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
 
   opt_reg_note(odb,
-"  The cache config parameter <config> has the following format:\n"
-"\n"
-"    <name>:<nsets>:<bsize>:<assoc>:<repl>\n"
+"  Loads may issue before older stores whose addresses are not yet known,\n"
+"  unless the memory dependence predictor says they alias:\n"
 "\n"
-"    <name>   - name of the cache being defined\n"
-"    <nsets>  - number of sets in the cache\n"
-"    <bsize>  - block size of the cache\n"
-"    <assoc>  - associativity of the cache\n"
-"    <repl>   - block replacement strategy, 'l'-LRU, 'f'-FIFO, 'r'-random\n"
+"    storeset - loads wait for the last store of their store set, the\n"
+"               sets are learned from violations and cleared every\n"
+"               <clear interval> cycles (0 for never)\n"
+"    perfect  - loads wait for the store they alias, if any\n"
+"    blind    - loads never wait for unknown store addresses\n"
 "\n"
-"    Examples:   -cache:dl1 dl1:4096:32:1:l\n"
-"                -dtlb dtlb:128:4096:32:r\n"
+"  A load that issues before an aliasing store's address is known is\n"
+"  replayed once the store's data is ready, and fetch stalls for the branch\n"
+"  misprediction penalty when the violation is detected.\n"
 	       );
 
-  opt_reg_int(odb, "-cache:dl1lat",
-	      "l1 data cache hit latency (in cycles)",
-	      &cache_dl1_lat, /* default */1,
+  /* back end options */
+
+  opt_reg_string(odb, "-backend",
+		 "out-of-order back end, i.e., {ruu|prf}",
+		 &backend_type, /* default */"ruu",
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-rob:size",
+	      "reorder buffer (ROB) size, with -backend prf",
+	      &ROB_size, /* default */64,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-iq:int",
+	      "integer issue queue size, with -backend prf",
+	      &IQ_size[IQ_INT], /* default */32,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-iq:fp",
+	      "floating point issue queue size, with -backend prf",
+	      &IQ_size[IQ_FP], /* default */16,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-iq:mem",
+	      "load/store issue queue size, with -backend prf",
+	      &IQ_size[IQ_MEM], /* default */16,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-prf:int",
+	      "integer physical register file size, with -backend prf",
+	      &PRF_size[PRF_INT], /* default */96,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-prf:fp",
+	      "floating point physical register file size, with -backend prf",
+	      &PRF_size[PRF_FP], /* default */64,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_note(odb,
+"  The default back end is the RUU, a unified window of -ruu:size entries\n"
+"  that holds instructions from dispatch until they commit, and their\n"
+"  results.  With -backend prf, dispatch instead needs a slot in each of\n"
+"  three structures, sized separately:\n"
+"\n"
+"    ROB - every instruction, from dispatch to commit (-rob:size)\n"
+"    IQ  - the integer, floating point or load/store issue queue, from\n"
+"          dispatch to issue (-iq:int, -iq:fp, -iq:mem), the address\n"
+"          computation of loads and stores goes to the load/store one\n"
+"    PRF - a physical register per result, in the integer or floating\n"
+"          point register file (-prf:int, -prf:fp), the architected\n"
+"          registers always hold one physical register each, a result's\n"
+"          register replaces its name's previous one, which is freed when\n"
+"          the instruction commits\n"
+"\n"
+"  The `backend.*' stats count the cycles each structure stalled dispatch.\n"
+	       );
+
+  /* cache options */
+
+  opt_reg_string(odb, "-cache:dl1",
+		 "l1 data cache config, i.e., {<config>|none}",
+		 &cache_dl1_opt, "dl1:128:32:4:l",
+		 /* print */TRUE, NULL);
+
+  opt_reg_note(odb,
+"  The cache config parameter <config> has the following format:\n"
+"\n"
+"    <name>:<nsets>:<bsize>:<assoc>:<repl>\n"
+"\n"
+"    <name>   - name of the cache being defined\n"
+"    <nsets>  - number of sets in the cache\n"
+"    <bsize>  - block size of the cache\n"
+"    <assoc>  - associativity of the cache\n"
+"    <repl>   - block replacement strategy, 'l'-LRU, 'f'-FIFO, 'r'-random\n"
+"\n"
+"    Examples:   -cache:dl1 dl1:4096:32:1:l\n"
+"                -dtlb dtlb:128:4096:32:r\n"
+	       );
+
+  opt_reg_int(odb, "-cache:dl1lat",
+	      "l1 data cache hit latency (in cycles)",
+	      &cache_dl1_lat, /* default */1,
 	      /* print */TRUE, /* format */NULL);
 
   opt_reg_string(odb, "-cache:dl2",
@@ -804,6 +1639,12 @@ sim_reg_options(struct opt_odb_t *odb)
 	      &cache_il2_lat, /* default */6,
 	      /* print */TRUE, /* format */NULL);
 
+  opt_reg_int_list(odb, "-cache:mshr",
+		   "MSHRs per cache, 0 for unlimited (<l1> <l2>)",
+		   cache_mshr, cache_mshr_nelt, &cache_mshr_nelt,
+		   /* default */cache_mshr,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
   opt_reg_flag(odb, "-cache:flush", "flush caches on system calls",
 	       &flush_on_syscalls, /* default */FALSE, /* print */TRUE, NULL);
 
@@ -822,6 +1663,53 @@ sim_reg_options(struct opt_odb_t *odb)
 	      &mem_bus_width, /* default */8,
 	      /* print */TRUE, /* format */NULL);
 
+  opt_reg_string(odb, "-mem:model",
+		 "main memory model, i.e., {fixed|dram}",
+		 &mem_model, /* default */"fixed",
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_int_list(odb, "-mem:dram",
+		   "DRAM organization (<channels> <banks> <row size>)",
+		   mem_dram_config, mem_dram_nelt, &mem_dram_nelt,
+		   /* default */mem_dram_config,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int_list(odb, "-mem:timing",
+		   "DRAM timing in cycles (<tRCD> <tCAS> <tRP> <tRAS>)",
+		   mem_timing, mem_timing_nelt, &mem_timing_nelt,
+		   /* default */mem_timing,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_string(odb, "-mem:page",
+		 "DRAM row buffer policy, i.e., {open|close}",
+		 &mem_page, /* default */"open",
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_string(odb, "-mem:sched",
+		 "DRAM scheduling policy, i.e., {frfcfs|fcfs}",
+		 &mem_sched, /* default */"frfcfs",
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_int_list(odb, "-mem:queue",
+		   "DRAM queue entries per channel (<read queue> <write queue>)",
+		   mem_queue, mem_queue_nelt, &mem_queue_nelt,
+		   /* default */mem_queue,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_note(odb,
+"  The fixed memory model gives every miss to memory the -mem:lat latency.\n"
+"  The dram model schedules misses on the channels and banks of -mem:dram,\n"
+"  a block's data takes <inter_chunk> cycles per -mem:width bytes on its\n"
+"  channel's bus after the column access.  Reads queue behind the requests\n"
+"  of their channel, write-backs are buffered in the write queue and\n"
+"  drained when the channel is idle or the queue fills.  The frfcfs\n"
+"  scheduler serves row hits before older requests, fcfs serves requests\n"
+"  in order.  With -cache:mshr, each cache has a limited number of\n"
+"  outstanding misses and a further miss waits for one to complete, use it\n"
+"  with the dram model as nothing else limits the misses in flight (stores\n"
+"  write the D-cache at commit without waiting for their misses).\n"
+	       );
+
   /* TLB options */
 
   opt_reg_string(odb, "-tlb:itlb",
@@ -872,43 +1760,109 @@ sim_reg_options(struct opt_odb_t *odb)
   opt_reg_flag(odb, "-bugcompat",
 	       "operate in backward-compatible bugs mode (for testing only)",
 	       &bugcompat_mode, /* default */FALSE, /* print */TRUE, NULL);
-}
 
-/* check simulator-specific option values */
-void
-sim_check_options(struct opt_odb_t *odb,        /* options database */
-		  int argc, char **argv)        /* command line arguments */
-{
-  char name[128], c;
-  int nsets, bsize, assoc;
+  /* simultaneous multithreading options */
 
-  if (fastfwd_count < 0 || fastfwd_count >= 2147483647)
-    fatal("bad fast forward count: %d", fastfwd_count);
+  opt_reg_int(odb, "-smt:threads",
+	      "number of SMT hardware threads",
+	      &smt_nthreads, /* default */1,
+	      /* print */TRUE, /* format */NULL);
 
-  if (ruu_ifq_size < 1 || (ruu_ifq_size & (ruu_ifq_size - 1)) != 0)
-    fatal("inst fetch queue size must be positive > 0 and a power of two");
+  opt_reg_string_list(odb, "-smt:prog",
+		      "program of the next SMT thread (\"<prog> <args> "
+		      "[< <infile>]\")",
+		      smt_progs, MAX_THREADS-1, &smt_prog_nelt, NULL,
+		      /* print */TRUE, /* format */NULL, /* accrue */TRUE);
 
-  if (ruu_branch_penalty < 1)
-    fatal("mis-prediction penalty must be at least 1 cycle");
+  opt_reg_string(odb, "-smt:fetch",
+		 "SMT fetch policy, i.e., {icount|rr}",
+		 &smt_fetch_policy, /* default */"icount",
+		 /* print */TRUE, /* format */NULL);
 
-  if (fetch_speed < 1)
-    fatal("front-end speed must be positive and non-zero");
+  opt_reg_int(odb, "-smt:fetch:threads",
+	      "maximum number of SMT threads fetched from per cycle",
+	      &smt_fetch_threads, /* default */2,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_note(odb,
+"  With -smt:threads N > 1, the simulated program is thread 0, and threads\n"
+"  1 to N-1 run the programs given by N-1 -smt:prog options, e.g.,\n"
+"\n"
+"    -smt:threads 2 -smt:prog \"anagram words < input.txt\"\n"
+"\n"
+"  Each thread has its own registers, memory, speculative state, fetch\n"
+"  queue and return address stack, the threads share the RUU, LSQ,\n"
+"  functional units, caches, TLBs and branch predictor tables.  Fetch\n"
+"  bandwidth goes to up to -smt:fetch:threads threads per cycle, in order\n"
+"  of fewest instructions in the fetch queue and RUU (icount) or round\n"
+"  robin (rr); decode bandwidth is shared round robin.  The simulation\n"
+"  ends when all threads have exited, -max:inst counts all threads'\n"
+"  instructions.\n"
+	       );
+
+  opt_reg_int(odb, "-cmp:cores",
+	      "number of CMP cores",
+	      &cmp_ncores, /* default */1,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_string_list(odb, "-cmp:prog",
+		      "program of the next CMP core (\"<prog> <args> "
+		      "[< <infile>]\")",
+		      cmp_progs, MAX_CORES-1, &cmp_prog_nelt, NULL,
+		      /* print */TRUE, /* format */NULL, /* accrue */TRUE);
+
+  opt_reg_int(odb, "-cmp:quantum",
+	      "cycles CMP cores run between synchronizations",
+	      &cmp_quantum, /* default */200,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-cmp:dir_lat",
+	      "latency of a coherence action involving another core",
+	      &cmp_dir_lat, /* default */20,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-cmp:shm",
+	      "bytes of memory shared by all CMP cores at 0x60000000",
+	      &cmp_shm_size, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_note(odb,
+"  With -cmp:cores N > 1, the simulated program runs on core 0, and cores\n"
+"  1 to N-1 run the programs given by N-1 -cmp:prog options.  Each core has\n"
+"  its own pipeline, branch predictor, TLBs and L1 caches, the cores share\n"
+"  the L2 caches and main memory, which see physical addresses (pages are\n"
+"  mapped on first touch).  The programs share no memory but the -cmp:shm\n"
+"  bytes at 0x60000000, which are the same memory and physical frames in\n"
+"  every core.  A MESI directory keeps the L1 D-caches coherent on that\n"
+"  data, L2 evictions invalidate the L1 copies.  Each core runs on its own\n"
+"  host thread, the threads synchronize every -cmp:quantum cycles, so cores\n"
+"  drift up to that many cycles apart in the shared L2 and results vary\n"
+"  slightly from run to run.  Unprefixed stats are core 0's, c<n>.* those\n"
+"  of core n, cmp.* and dir.* those of the chip.  The simulation ends when\n"
+"  all programs have exited or a core reaches -max:inst.\n"
+	       );
+}
 
+/* create the branch predictor given by the options, NULL for a perfect
+   predictor, called once per core */
+static struct bpred_t *
+bpred_create_opt(void)
+{
   if (!mystricmp(pred_type, "perfect"))
     {
       /* perfect predictor */
-      pred = NULL;
       pred_perfect = TRUE;
+      return NULL;
     }
   else if (!mystricmp(pred_type, "taken"))
     {
       /* static predictor, not taken */
-      pred = bpred_create(BPredTaken, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+      return bpred_create(BPredTaken, 0, 0, 0, 0, 0, 0, 0, 0, 0);
     }
   else if (!mystricmp(pred_type, "nottaken"))
     {
       /* static predictor, taken */
-      pred = bpred_create(BPredNotTaken, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+      return bpred_create(BPredNotTaken, 0, 0, 0, 0, 0, 0, 0, 0, 0);
     }
   else if (!mystricmp(pred_type, "bimod"))
     {
@@ -919,7 +1873,7 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 	fatal("bad btb config (<num_sets> <associativity>)");
 
       /* bimodal predictor, bpred_create() checks BTB_SIZE */
-      pred = bpred_create(BPred2bit,
+      return bpred_create(BPred2bit,
 			  /* bimod table size */bimod_config[0],
 			  /* 2lev l1 size */0,
 			  /* 2lev l2 size */0,
@@ -938,7 +1892,7 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
       if (btb_nelt != 2)
 	fatal("bad btb config (<num_sets> <associativity>)");
 
-      pred = bpred_create(BPred2Level,
+      return bpred_create(BPred2Level,
 			  /* bimod table size */0,
 			  /* 2lev l1 size */twolev_config[0],
 			  /* 2lev l2 size */twolev_config[1],
@@ -961,7 +1915,7 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
       if (btb_nelt != 2)
 	fatal("bad btb config (<num_sets> <associativity>)");
 
-      pred = bpred_create(BPredComb,
+      return bpred_create(BPredComb,
 			  /* bimod table size */bimod_config[0],
 			  /* l1 size */twolev_config[0],
 			  /* l2 size */twolev_config[1],
@@ -974,6 +1928,67 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
     }
   else
     fatal("cannot parse predictor type `%s'", pred_type);
+}
+
+/* load the SimPoint simulation points, defined below */
+static void simpoint_load(char *fname, char *weights);
+
+/* check simulator-specific option values */
+void
+sim_check_options(struct opt_odb_t *odb,        /* options database */
+		  int argc, char **argv)        /* command line arguments */
+{
+  char name[128], c;
+  int i, nsets, bsize, assoc;
+
+  if (fastfwd_count < 0 || fastfwd_count >= 2147483647)
+    fatal("bad fast forward count: %d", fastfwd_count);
+
+  if (sample_period && simpoint_fname)
+    fatal("`-sample:period' and `-simpoint' cannot be combined");
+  if (sample_jobs < 1)
+    fatal("sampling jobs must be positive non-zero");
+  if (sample_jobs > 1 && !sample_period && !simpoint_fname)
+    fatal("`-sample:jobs' needs `-sample:period' or `-simpoint'");
+  if (sample_period || simpoint_fname)
+    {
+      if (fastfwd_count > 0)
+	fatal("sampled simulation fast forwards by itself, drop `-fastfwd'");
+      if (smt_nthreads > 1 || cmp_ncores > 1)
+	fatal("sampled simulation supports a single thread and core only");
+      if (sample_period
+	  && (sample_unit < 1
+	      || sample_period < sample_unit + sample_warmup))
+	fatal("sampling period must hold a non-empty unit and its warm-up");
+      if (simpoint_fname && simpoint_interval < 1)
+	fatal("SimPoint interval must be positive non-zero");
+      if (sample_z <= 0.0 || sample_err <= 0.0)
+	fatal("sampling z-score and target error must be positive");
+#ifdef _MSC_VER
+      if (sample_jobs > 1)
+	fatal("parallel sampled simulation needs fork(), use `-sample:jobs 1'");
+#endif /* _MSC_VER */
+      if (simpoint_fname)
+	simpoint_load(simpoint_fname, simpoint_weights);
+    }
+
+  if (ruu_ifq_size < 1 || (ruu_ifq_size & (ruu_ifq_size - 1)) != 0)
+    fatal("inst fetch queue size must be positive > 0 and a power of two");
+
+  if (ruu_branch_penalty < 1)
+    fatal("mis-prediction penalty must be at least 1 cycle");
+
+  if (fetch_speed < 1)
+    fatal("front-end speed must be positive and non-zero");
+
+  if (ftq_size < 0)
+    fatal("fetch target queue size must be non-negative");
+  if (ftq_size && ftq_blocks < 1)
+    fatal("fetch blocks per cycle must be positive and non-zero");
+  if (lsb_size < 0)
+    fatal("loop stream buffer size must be non-negative");
+
+  pred = bpred_create_opt();
 
   if (!bpred_spec_opt)
     bpred_spec_update = spec_CT;
@@ -993,12 +2008,98 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
   if (ruu_commit_width < 1)
     fatal("commit width must be positive non-zero");
 
+  if (!mystricmp(backend_type, "ruu"))
+    backend_prf = FALSE;
+  else if (!mystricmp(backend_type, "prf"))
+    {
+      backend_prf = TRUE;
+
+      /* the ROB takes the place of the RUU */
+      if (ROB_size < 2 || (ROB_size & (ROB_size-1)) != 0)
+	fatal("ROB size must be a positive number > 1 and a power of two");
+      RUU_size = ROB_size;
+
+      if (IQ_size[IQ_INT] < 1 || IQ_size[IQ_FP] < 1 || IQ_size[IQ_MEM] < 1)
+	fatal("issue queue sizes must be positive non-zero");
+    }
+  else
+    fatal("bad back end `%s', use {ruu|prf}", backend_type);
+
   if (RUU_size < 2 || (RUU_size & (RUU_size-1)) != 0)
     fatal("RUU size must be a positive number > 1 and a power of two");
 
   if (LSQ_size < 2 || (LSQ_size & (LSQ_size-1)) != 0)
     fatal("LSQ size must be a positive number > 1 and a power of two");
 
+  if (smt_nthreads < 1 || smt_nthreads > MAX_THREADS)
+    fatal("number of SMT threads must be between 1 and %d", MAX_THREADS);
+  if (smt_prog_nelt != smt_nthreads - 1)
+    fatal("%d SMT threads need %d `-smt:prog' programs",
+	  smt_nthreads, smt_nthreads - 1);
+  if (mystricmp(smt_fetch_policy, "icount")
+      && mystricmp(smt_fetch_policy, "rr"))
+    fatal("bad SMT fetch policy `%s', use {icount|rr}", smt_fetch_policy);
+  if (smt_fetch_threads < 1)
+    fatal("SMT threads fetched per cycle must be positive non-zero");
+
+  /* the architected registers of all threads must leave some to rename */
+  for (i=0; backend_prf && i < PRF_NUM; i++)
+    if (PRF_size[i] <= smt_nthreads * PRF_NAMES(i))
+      fatal("%s PRF needs more than %d registers",
+	    i == PRF_INT ? "integer" : "floating point",
+	    smt_nthreads * PRF_NAMES(i));
+
+  if (cmp_ncores < 1 || cmp_ncores > MAX_CORES)
+    fatal("number of CMP cores must be between 1 and %d", MAX_CORES);
+  if (cmp_prog_nelt != cmp_ncores - 1)
+    fatal("%d CMP cores need %d `-cmp:prog' programs",
+	  cmp_ncores, cmp_ncores - 1);
+  if (cmp_ncores > 1)
+    {
+#ifdef _MSC_VER
+      fatal("CMP cores need host threads, not supported by this build");
+#endif /* _MSC_VER */
+      if (smt_nthreads > 1)
+	fatal("CMP cores cannot run SMT threads");
+      if (ptrace_nelt > 0 || pcstat_nelt > 0)
+	fatal("pipetracing and `-pcstat' are not supported with CMP cores");
+    }
+  if (cmp_quantum < 1)
+    fatal("CMP quantum must be at least one cycle");
+  if (cmp_dir_lat < 0)
+    fatal("CMP directory latency must be non-negative");
+  if (cmp_shm_size < 0 || (cmp_shm_size & (MD_PAGE_SIZE-1)) != 0)
+    fatal("CMP shared memory size must be a multiple of %d bytes",
+	  MD_PAGE_SIZE);
+  if (cmp_shm_size > 0 && cmp_ncores == 1)
+    fatal("`-cmp:shm' needs more than one CMP core");
+
+  if (!mystricmp(mdp_type, "storeset"))
+    mdp_kind = MDP_STORESET;
+  else if (!mystricmp(mdp_type, "perfect"))
+    mdp_kind = MDP_PERFECT;
+  else if (!mystricmp(mdp_type, "blind"))
+    mdp_kind = MDP_BLIND;
+  else
+    fatal("bad memory dependence predictor `%s', "
+	  "use {storeset|perfect|blind}", mdp_type);
+
+  if (storeset_nelt != 3)
+    fatal("bad store set predictor config "
+	  "(<SSIT size> <LFST size> <clear interval>)");
+  if (storeset_config[0] < 1
+      || (storeset_config[0] & (storeset_config[0]-1)) != 0)
+    fatal("SSIT size must be a positive number and a power of two");
+  if (storeset_config[1] < 1)
+    fatal("LFST size must be a positive number");
+  if (storeset_config[2] < 0)
+    fatal("store set clear interval must be non-negative");
+
+  if (cache_mshr_nelt != 2)
+    fatal("bad MSHR config (<l1> <l2>)");
+  if (cache_mshr[0] < 0 || cache_mshr[1] < 0)
+    fatal("number of MSHRs must be non-negative");
+
   /* use a level 1 D-cache? */
   if (!mystricmp(cache_dl1_opt, "none"))
     {
@@ -1016,7 +2117,9 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 	fatal("bad l1 D-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>");
       cache_dl1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			       /* usize */0, assoc, cache_char2policy(c),
-			       dl1_access_fn, /* hit lat */cache_dl1_lat);
+			       dl1_access_fn, /* hit lat */cache_dl1_lat,
+			       /* no prefetcher */0, 1, 1, cache_mshr[0],
+			       /* pfq */1);
 
       /* is the level 2 D-cache defined? */
       if (!mystricmp(cache_dl2_opt, "none"))
@@ -1029,7 +2132,9 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 		  "<name>:<nsets>:<bsize>:<assoc>:<repl>");
 	  cache_dl2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 				   /* usize */0, assoc, cache_char2policy(c),
-				   dl2_access_fn, /* hit lat */cache_dl2_lat);
+				   dl2_access_fn, /* hit lat */cache_dl2_lat,
+				   /* no prefetcher */0, 1, 1, cache_mshr[1],
+				   /* pfq */1);
 	}
     }
 
@@ -1072,7 +2177,9 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 	fatal("bad l1 I-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>");
       cache_il1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			       /* usize */0, assoc, cache_char2policy(c),
-			       il1_access_fn, /* hit lat */cache_il1_lat);
+			       il1_access_fn, /* hit lat */cache_il1_lat,
+			       /* no prefetcher */0, 1, 1, cache_mshr[0],
+			       /* pfq */1);
 
       /* is the level 2 D-cache defined? */
       if (!mystricmp(cache_il2_opt, "none"))
@@ -1091,7 +2198,9 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 		  "<name>:<nsets>:<bsize>:<assoc>:<repl>");
 	  cache_il2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 				   /* usize */0, assoc, cache_char2policy(c),
-				   il2_access_fn, /* hit lat */cache_il2_lat);
+				   il2_access_fn, /* hit lat */cache_il2_lat,
+				   /* no prefetcher */0, 1, 1, cache_mshr[1],
+				   /* pfq */1);
 	}
     }
 
@@ -1106,7 +2215,8 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
       itlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			  /* usize */sizeof(md_addr_t), assoc,
 			  cache_char2policy(c), itlb_access_fn,
-			  /* hit latency */1);
+			  /* hit latency */1, /* no prefetcher */0, 1, 1,
+			  /* mshrs */0, /* pfq */0);
     }
 
   /* use a D-TLB? */
@@ -1120,7 +2230,8 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
       dtlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			  /* usize */sizeof(md_addr_t), assoc,
 			  cache_char2policy(c), dtlb_access_fn,
-			  /* hit latency */1);
+			  /* hit latency */1, /* no prefetcher */0, 1, 1,
+			  /* mshrs */0, /* pfq */0);
     }
 
   if (cache_dl1_lat < 1)
@@ -1144,9 +2255,46 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
   if (mem_bus_width < 1 || (mem_bus_width & (mem_bus_width-1)) != 0)
     fatal("memory bus width must be positive non-zero and a power of two");
 
+  /* use a DRAM model? */
+  if (!mystricmp(mem_model, "fixed"))
+    mem_dram = NULL;
+  else if (!mystricmp(mem_model, "dram"))
+    {
+      if (mem_dram_nelt != 3)
+	fatal("bad DRAM organization (<channels> <banks> <row size>)");
+      if (mem_timing_nelt != 4)
+	fatal("bad DRAM timing (<tRCD> <tCAS> <tRP> <tRAS>)");
+      if (mem_queue_nelt != 2)
+	fatal("bad DRAM queue config (<read queue> <write queue>)");
+      if (mystricmp(mem_page, "open") && mystricmp(mem_page, "close"))
+	fatal("bad DRAM row buffer policy `%s', use {open|close}", mem_page);
+      if (mystricmp(mem_sched, "frfcfs") && mystricmp(mem_sched, "fcfs"))
+	fatal("bad DRAM scheduling policy `%s', use {frfcfs|fcfs}",
+	      mem_sched);
+
+      mem_dram = dram_create("mem", mem_dram_config[0], mem_dram_config[1],
+			     mem_dram_config[2], mem_bus_width,
+			     /* transfer latency */mem_lat[1],
+			     mem_timing[0], mem_timing[1], mem_timing[2],
+			     mem_timing[3],
+			     !mystricmp(mem_page, "open")
+			     ? dram_open_page : dram_close_page,
+			     !mystricmp(mem_sched, "frfcfs")
+			     ? dram_frfcfs : dram_fcfs,
+			     mem_queue[0], mem_queue[1]);
+    }
+  else
+    fatal("bad main memory model `%s', use {fixed|dram}", mem_model);
+
   if (tlb_miss_lat < 1)
     fatal("TLB miss latency must be greater than zero");
 
+  /* CMP cores share the L2 caches, and have private L1s */
+  if (cmp_ncores > 1 && !cache_dl2)
+    fatal("CMP cores need an L2 D-cache to share");
+  if (cmp_ncores > 1 && cache_il1 && cache_il1 == cache_dl2)
+    fatal("CMP cores need L1 I-caches of their own");
+
   if (res_ialu < 1)
     fatal("number of integer ALU's must be greater than zero");
   if (res_ialu > MAX_INSTS_PER_CLASS)
@@ -1185,6 +2333,12 @@ sim_aux_config(FILE *stream)            /* output stream */
   /* nada */
 }
 
+/* register the per-thread statistics of an SMT run */
+static void smt_reg_stats(struct stat_sdb_t *sdb);
+static void backend_reg_stats(struct stat_sdb_t *sdb);
+static void cmp_reg_stats(struct stat_sdb_t *sdb);
+static void sample_reg_stats(struct stat_sdb_t *sdb);
+
 /* register simulator-specific statistics */
 void
 sim_reg_stats(struct stat_sdb_t *sdb)   /* stats database */
@@ -1228,10 +2382,24 @@ sim_reg_stats(struct stat_sdb_t *sdb)   /* stats database */
 		   "total number of branches executed",
 		   &sim_total_branches, /* initial value */0, /* format */NULL);
 
-  /* register performance stats */
-  stat_reg_counter(sdb, "sim_cycle",
-		   "total simulation time in cycles",
-		   &sim_cycle, /* initial value */0, /* format */NULL);
+  /* register performance stats, with functional warming the clock runs
+     on during it, but sim_cycle counts detailed simulation only */
+  if (fastfwd_warm || ((sample_period || simpoint_fname) && sample_warm))
+    {
+      stat_reg_counter(sdb, "sim_clock",
+		       "total simulation time in cycles, warming included",
+		       &sim_cycle, /* initial value */0, /* format */NULL);
+      stat_reg_counter(sdb, "sim_warm_cycle",
+		       "total cycles of functional warming",
+		       &sim_warm_cycle, /* initial value */0, /* format */NULL);
+      stat_reg_formula(sdb, "sim_cycle",
+		       "total simulation time in cycles",
+		       "sim_clock - sim_warm_cycle", /* format */"%12.0f");
+    }
+  else
+    stat_reg_counter(sdb, "sim_cycle",
+		     "total simulation time in cycles",
+		     &sim_cycle, /* initial value */0, /* format */NULL);
   stat_reg_formula(sdb, "sim_IPC",
 		   "instructions per cycle",
 		   "sim_num_insn / sim_cycle", /* format */NULL);
@@ -1259,6 +2427,32 @@ sim_reg_stats(struct stat_sdb_t *sdb)   /* stats database */
   stat_reg_formula(sdb, "ifq_full", "fraction of time (cycle's) IFQ was full",
                    "IFQ_fcount / sim_cycle", /* format */NULL);
 
+  if (ftq_size)
+    {
+      stat_reg_counter(sdb, "ftq.predicted",
+		       "total number of fetch blocks predicted",
+		       &ftq_predicted, /* initial value */0, /* format */NULL);
+      stat_reg_formula(sdb, "ftq.block_size",
+		       "avg insts per fetch block (mis-spec + committed)",
+		       "sim_total_insn / ftq.predicted", /* format */NULL);
+      stat_reg_counter(sdb, "ftq.prefetches",
+		       "total number of I-cache lines prefetched from the FTQ",
+		       &ftq_prefetches, /* initial value */0, /* format */NULL);
+      stat_reg_counter(sdb, "ftq.FTQ_count", "cumulative FTQ occupancy",
+		       &FTQ_count, /* initial value */0, /* format */NULL);
+      stat_reg_formula(sdb, "ftq.occupancy", "avg FTQ occupancy (blocks)",
+		       "ftq.FTQ_count / sim_cycle", /* format */NULL);
+      stat_reg_counter(sdb, "lsb.captures",
+		       "total number of loops captured by the LSB",
+		       &lsb_captures, /* initial value */0, /* format */NULL);
+      stat_reg_counter(sdb, "lsb.insn",
+		       "total number of insts fetched from the LSB",
+		       &lsb_insn, /* initial value */0, /* format */NULL);
+      stat_reg_formula(sdb, "lsb.rate",
+		       "fraction of insts fetched from the LSB",
+		       "lsb.insn / sim_total_insn", /* format */NULL);
+    }
+
   stat_reg_counter(sdb, "RUU_count", "cumulative RUU occupancy",
                    &RUU_count, /* initial value */0, /* format */NULL);
   stat_reg_counter(sdb, "RUU_fcount", "cumulative RUU full count",
@@ -1285,6 +2479,16 @@ sim_reg_stats(struct stat_sdb_t *sdb)   /* stats database */
   stat_reg_formula(sdb, "lsq_full", "fraction of time (cycle's) LSQ was full",
                    "LSQ_fcount / sim_cycle", /* format */NULL);
 
+  stat_reg_counter(sdb, "lsq_mdp_waits",
+		   "total loads held for a predicted store",
+		   &mdp_waits, /* initial value */0, /* format */NULL);
+  stat_reg_counter(sdb, "lsq_mdp_false_waits",
+		   "total loads held for a store they did not alias",
+		   &mdp_false_waits, /* initial value */0, /* format */NULL);
+  stat_reg_counter(sdb, "lsq_mdp_violations",
+		   "total loads issued before an aliasing store's address",
+		   &mdp_violations, /* initial value */0, /* format */NULL);
+
   stat_reg_counter(sdb, "sim_slip",
                    "total number of slip cycles",
                    &sim_slip, 0, NULL);
@@ -1313,6 +2517,10 @@ sim_reg_stats(struct stat_sdb_t *sdb)   /* stats database */
   if (dtlb)
     cache_reg_stats(dtlb, sdb);
 
+  /* register DRAM stats */
+  if (mem_dram)
+    dram_reg_stats(mem_dram, sdb);
+
   /* debug variable(s) */
   stat_reg_counter(sdb, "sim_invalid_addrs",
 		   "total non-speculative bogus addresses seen (debug var)",
@@ -1350,6 +2558,15 @@ sim_reg_stats(struct stat_sdb_t *sdb)   /* stats database */
     }
   ld_reg_stats(sdb);
   mem_reg_stats(mem, sdb);
+
+  if (smt_nthreads > 1)
+    smt_reg_stats(sdb);
+  if (backend_prf)
+    backend_reg_stats(sdb);
+  if (cmp_ncores > 1)
+    cmp_reg_stats(sdb);
+  if (sample_period || simpoint_fname)
+    sample_reg_stats(sdb);
 }
 
 /* forward declarations */
@@ -1361,6 +2578,9 @@ static void readyq_init(void);
 static void cv_init(void);
 static void tracer_init(void);
 static void fetch_init(void);
+static void smt_load_thread(int id, char **envp);
+static void cmp_start(char **envp);
+static void cmp_finish(void);
 
 /* initialize the simulator */
 void
@@ -1402,14 +2622,47 @@ simoo_mstate_obj(FILE *stream,			/* output stream */
 /* total RS links allocated at program start */
 #define MAX_RS_LINKS                    4096
 
+static void core_pipe_init(void);
+
+/* load a program into the current core's simulated state, and initialize
+   the core's pipeline */
+static void
+core_load_prog(char *fname,		/* program to load */
+	       int argc, char **argv,	/* program arguments */
+	       char **envp)		/* program environment */
+{
+  /* load program text and data, set up environment, memory, and regs */
+  ld_load_prog(fname, argc, argv, envp, &regs, mem, TRUE);
+
+  /* finish initialization of the simulation engine */
+  core_pipe_init();
+}
+
+/* allocate and initialize the pipeline of the current core for the
+   current configuration */
+static void
+core_pipe_init(void)
+{
+  fu_pool = res_create_pool("fu-pool", fu_config, N_ELT(fu_config));
+  rslink_init(MAX_RS_LINKS);
+  tracer_init();
+  fetch_init();
+  cv_init();
+  eventq_init();
+  readyq_init();
+  ruu_init();
+  lsq_init();
+}
+
 /* load program into simulated state */
 void
 sim_load_prog(char *fname,		/* program to load */
 	      int argc, char **argv,	/* program arguments */
 	      char **envp)		/* program environment */
 {
-  /* load program text and data, set up environment, memory, and regs */
-  ld_load_prog(fname, argc, argv, envp, &regs, mem, TRUE);
+  int i;
+
+  core_load_prog(fname, argc, argv, envp);
 
   /* initialize here, so symbols can be loaded */
   if (ptrace_nelt == 2)
@@ -1424,16 +2677,13 @@ sim_load_prog(char *fname,		/* program to load */
   else
     fatal("bad pipetrace args, use: <fname|stdout|stderr> <range>");
 
-  /* finish initialization of the simulation engine */
-  fu_pool = res_create_pool("fu-pool", fu_config, N_ELT(fu_config));
-  rslink_init(MAX_RS_LINKS);
-  tracer_init();
-  fetch_init();
-  cv_init();
-  eventq_init();
-  readyq_init();
-  ruu_init();
-  lsq_init();
+  /* load the programs of the other SMT threads */
+  for (i=1; i < smt_nthreads; i++)
+    smt_load_thread(i, envp);
+
+  /* start the other CMP cores */
+  if (cmp_ncores > 1)
+    cmp_start(envp);
 
   /* initialize the DLite debugger */
   dlite_init(simoo_reg_obj, simoo_mem_obj, simoo_mstate_obj);
@@ -1452,6 +2702,9 @@ sim_uninit(void)
 {
   if (ptrace_nelt > 0)
     ptrace_close();
+
+  if (cmp_ncores > 1)
+    cmp_finish();
 }
 
 
@@ -1467,6 +2720,19 @@ typedef unsigned int INST_TAG_TYPE;
    but execution will continue and complete correctly */
 typedef unsigned int INST_SEQ_TYPE;
 
+/* a reference to an RUU or LSQ entry, only valid while the entry holds the
+   same instruction instance */
+struct RS_ref {
+  struct RUU_station *rs;		/* referenced entry */
+  INST_TAG_TYPE tag;			/* inst instance tag */
+};
+
+/* non-zero if RS reference REF is to a valid (non-squashed) entry */
+#define RSREF_VALID(REF)	((REF).rs && (REF).rs->tag == (REF).tag)
+
+/* set RS reference REF to entry RS */
+#define RSREF_INIT(REF, RS)	((REF).rs = (RS), (REF).tag = (RS)->tag)
+
 
 /* total input dependencies possible */
 #define MAX_IDEPS               3
@@ -1492,6 +2758,9 @@ struct RUU_station {
   md_inst_t IR;			/* instruction bits */
   enum md_opcode op;			/* decoded instruction opcode */
   md_addr_t PC, next_PC, pred_PC;	/* inst PC, next PC, predicted PC */
+  int thread;				/* SMT thread of the inst */
+  int squashed;				/* squashed, but not yet at the tail
+					   of the RUU or LSQ (SMT only) */
   int in_LSQ;				/* non-zero if op is in LSQ */
   int ea_comp;				/* non-zero if op is an addr comp */
   int recover_inst;			/* start of mis-speculation? */
@@ -1509,6 +2778,11 @@ struct RUU_station {
   int queued;				/* operands ready and queued */
   int issued;				/* operation is/was executing */
   int completed;			/* operation has completed execution */
+  /* physical register file back end resources, see -backend */
+  int iq;				/* issue queue held until issue, or
+					   -1 for none */
+  int prf_regs[PRF_NUM];		/* physical registers of the results,
+					   by register file */
   /* output operand dependency list, these lists are used to
      limit the number of associative searches into the RUU when
      instructions complete and need to wake up dependent insts */
@@ -1519,9 +2793,20 @@ struct RUU_station {
      fields to mark input operands as ready, when all these fields have
      been set non-zero, the RUU operation has all of its register
      operands, it may commence execution as soon as all of its memory
-     operands are known to be read (see lsq_refresh() for details on
+     operands are known to be read (see lsq_load_ready() for details on
      enforcing memory dependencies) */
   int idep_ready[MAX_IDEPS];		/* input operand ready? */
+
+  /* memory dependences of loads and stores in the LSQ, see
+     lsq_load_ready() for details */
+  struct RS_ref st_prev;		/* store: store dispatched before it
+					   in its LSQ address bucket */
+  struct RS_ref st_alias;		/* load: last older store to the same
+					   address */
+  struct RS_ref st_pred;		/* load: store predicted to alias */
+  int st_violation;			/* load: waits as a replay for
+					   ST_ALIAS, whose address it passed */
+  struct RS_link *st_waiters;		/* store: loads waiting for it */
 };
 
 /* non-zero if all register operands are ready, update with MAX_IDEPS */
@@ -1530,9 +2815,80 @@ struct RUU_station {
 
 /* register update unit, combination of reservation stations and reorder
    buffer device, organized as a circular queue */
-static struct RUU_station *RUU;		/* register update unit */
-static int RUU_head, RUU_tail;		/* RUU head and tail pointers */
-static int RUU_num;			/* num entries currently in RUU */
+static HOST_TLS struct RUU_station *RUU;		/* register update unit */
+static HOST_TLS int RUU_head, RUU_tail;		/* RUU head and tail pointers */
+static HOST_TLS int RUU_num;			/* num entries currently in RUU */
+
+/* the physical register file back end (-backend prf) uses the RUU as its
+   reorder buffer, the issue queues and physical register files only limit
+   dispatch, so they are modelled by their occupancy: an instruction holds
+   its issue queue entry until it issues, and a new physical register for
+   each result; with a merged register file, each architected register
+   always holds one physical register, its previous one is freed when the
+   result's instruction commits, or the new one when it is squashed, the
+   dependences are still tracked by the create vector */
+static HOST_TLS int IQ_num[IQ_NUM];		/* entries in each issue queue */
+static HOST_TLS int PRF_free[PRF_NUM];		/* free physical registers */
+
+/* release the issue queue entry of RUU entry RS, if it holds one */
+static void
+backend_iq_release(struct RUU_station *rs)	/* RUU entry */
+{
+  if (rs->iq >= 0)
+    {
+      IQ_num[rs->iq]--;
+      rs->iq = -1;
+    }
+}
+
+/* register the statistics of the physical register file back end */
+static void
+backend_reg_stats(struct stat_sdb_t *sdb)	/* stats database */
+{
+  int i;
+  char buf[512], buf1[512], buf2[512];
+  static char *stall_names[STALL_NUM] =
+    { "rob", "lsq", "iq_int", "iq_fp", "iq_mem", "prf_int", "prf_fp" };
+  static char *iq_names[IQ_NUM] = { "int", "fp", "mem" };
+  static char *prf_names[PRF_NUM] = { "int", "fp" };
+  static char *stall_descs[STALL_NUM] =
+    { "a full ROB", "a full LSQ", "a full integer IQ",
+      "a full floating point IQ", "a full load/store IQ",
+      "no free integer physical register",
+      "no free floating point physical register" };
+
+  for (i=0; i < STALL_NUM; i++)
+    {
+      sprintf(buf, "backend.%s_stalls", stall_names[i]);
+      sprintf(buf1, "cycles dispatch stalled on %s", stall_descs[i]);
+      stat_reg_counter(sdb, buf, buf1, &backend_stalls[i], 0, NULL);
+      sprintf(buf, "backend.%s_stall_rate", stall_names[i]);
+      sprintf(buf1, "fraction of cycles dispatch stalled on %s",
+	      stall_descs[i]);
+      sprintf(buf2, "backend.%s_stalls / sim_cycle", stall_names[i]);
+      stat_reg_formula(sdb, buf, buf1, buf2, NULL);
+    }
+
+  for (i=0; i < IQ_NUM; i++)
+    {
+      sprintf(buf, "backend.IQ_%s_count", iq_names[i]);
+      stat_reg_counter(sdb, buf, "cumulative IQ occupancy",
+		       &IQ_count[i], 0, NULL);
+      sprintf(buf, "backend.iq_%s_occupancy", iq_names[i]);
+      sprintf(buf2, "backend.IQ_%s_count / sim_cycle", iq_names[i]);
+      stat_reg_formula(sdb, buf, "avg IQ occupancy (insn's)", buf2, NULL);
+    }
+
+  for (i=0; i < PRF_NUM; i++)
+    {
+      sprintf(buf, "backend.PRF_%s_count", prf_names[i]);
+      stat_reg_counter(sdb, buf, "cumulative renamed registers in use",
+		       &PRF_count[i], 0, NULL);
+      sprintf(buf, "backend.prf_%s_occupancy", prf_names[i]);
+      sprintf(buf2, "backend.PRF_%s_count / sim_cycle", prf_names[i]);
+      stat_reg_formula(sdb, buf, "avg renamed registers in use", buf2, NULL);
+    }
+}
 
 /* allocate and initialize register update unit (RUU) */
 static void
@@ -1546,6 +2902,18 @@ ruu_init(void)
   RUU_head = RUU_tail = 0;
   RUU_count = 0;
   RUU_fcount = 0;
+
+  if (backend_prf)
+    {
+      int i;
+
+      for (i=0; i < IQ_NUM; i++)
+	IQ_num[i] = 0;
+
+      /* the architected registers of all threads hold a register each */
+      for (i=0; i < PRF_NUM; i++)
+	PRF_free[i] = PRF_size[i] - smt_nthreads * PRF_NAMES(i);
+    }
 }
 
 /* dump the contents of the RUU */
@@ -1637,9 +3005,9 @@ ruu_dump(FILE *stream)				/* output stream */
  *   cycle the store executes (using a bypass network), thus stores complete
  *   in effective zero time after their effective address is known
  */
-static struct RUU_station *LSQ;         /* load/store queue */
-static int LSQ_head, LSQ_tail;          /* LSQ head and tail pointers */
-static int LSQ_num;                     /* num entries currently in LSQ */
+static HOST_TLS struct RUU_station *LSQ;         /* load/store queue */
+static HOST_TLS int LSQ_head, LSQ_tail;          /* LSQ head and tail pointers */
+static HOST_TLS int LSQ_num;                     /* num entries currently in LSQ */
 
 /*
  * input dependencies for stores in the LSQ:
@@ -1652,14 +3020,45 @@ static int LSQ_num;                     /* num entries currently in LSQ */
 #define STORE_OP_READY(RS)              ((RS)->idep_ready[STORE_OP_INDEX])
 #define STORE_ADDR_READY(RS)            ((RS)->idep_ready[STORE_ADDR_INDEX])
 
+/*
+ * the stores in the LSQ are indexed by address, LSQ_ST_INDEX[] has the last
+ * store dispatched in each address bucket, which links to the one before it
+ * through ST_PREV, so a load finds the store it reads from at dispatch
+ */
+#define LSQ_ST_BUCKET(ADDR)	(((ADDR) >> 2) & (2*LSQ_size-1))
+static HOST_TLS struct RS_ref *lsq_st_index;
+
+/*
+ * store set memory dependence predictor, the store set ID table (SSIT),
+ * indexed by PC, gives the store set of a load or store, and the last
+ * fetched store table (LFST) the last store dispatched from each set
+ */
+#define SSIT_INDEX(PC)		(((PC) >> MD_BR_SHIFT) & (storeset_config[0]-1))
+static HOST_TLS int *ssit;			/* store set IDs, -1 for none */
+static HOST_TLS struct RS_ref *lfst;		/* last store of each set */
+static HOST_TLS int ssit_next_id;		/* next store set ID to allocate */
+static HOST_TLS tick_t ssit_next_clear;		/* cycle of next SSIT clear */
+
 /* allocate and initialize the load/store queue (LSQ) */
 static void
 lsq_init(void)
 {
+  int i;
+
   LSQ = calloc(LSQ_size, sizeof(struct RUU_station));
   if (!LSQ)
     fatal("out of virtual memory");
 
+  lsq_st_index = calloc(2*LSQ_size, sizeof(struct RS_ref));
+  ssit = calloc(storeset_config[0], sizeof(int));
+  lfst = calloc(storeset_config[1], sizeof(struct RS_ref));
+  if (!lsq_st_index || !ssit || !lfst)
+    fatal("out of virtual memory");
+  for (i=0; i < storeset_config[0]; i++)
+    ssit[i] = -1;
+  ssit_next_id = 0;
+  ssit_next_clear = storeset_config[2];
+
   LSQ_num = 0;
   LSQ_head = LSQ_tail = 0;
   LSQ_count = 0;
@@ -1716,7 +3115,7 @@ struct RS_link {
 };
 
 /* RS link free list, grab RS_LINKs from here, when needed */
-static struct RS_link *rslink_free_list;
+static HOST_TLS struct RS_link *rslink_free_list;
 
 /* NULL value for an RS link */
 #define RSLINK_NULL_DATA		{ NULL, NULL, 0 }
@@ -1809,16 +3208,64 @@ ruu_release_fu(void)
  * drains this queue
  */
 
-/* pending event queue, sorted from soonest to latest event (in time), NOTE:
-   RS_LINK nodes are used for the event queue list so that it need not be
-   updated during squash events */
-static struct RS_link *event_queue;
+/* pending event queue, a calendar queue with one bucket per cycle for the
+   next EVENTQ_HORIZON cycles, indexed by the cycle modulo the horizon,
+   events due further out wait in an overflow min-heap, ordered by cycle
+   and queue order, until their cycle comes within the horizon; a bucket
+   lists its events most recently queued first, the order the sorted event
+   list this replaces returned them in, NOTE: RS_LINK nodes are used for the
+   event queue so that it need not be updated during squash events */
+#define EVENTQ_HORIZON		512	/* must be a power of two */
+static HOST_TLS struct RS_link *eventq_bucket[EVENTQ_HORIZON];
+
+/* bucket of the events due at cycle WHEN */
+#define EVENTQ_BUCKET(WHEN)	(eventq_bucket[(WHEN) & (EVENTQ_HORIZON-1)])
+
+/* an event beyond the horizon, in the overflow heap */
+struct eventq_far {
+  tick_t when;				/* cycle of the event */
+  counter_t seq;			/* queue order, breaks ties */
+  struct RS_link *ev;			/* the event */
+};
+
+/* overflow heap, HEAP[0] is the earliest event */
+static HOST_TLS struct eventq_far *eventq_heap;
+static HOST_TLS int eventq_heap_num;		/* events in the heap */
+static HOST_TLS int eventq_heap_size;		/* heap entries allocated */
+static HOST_TLS counter_t eventq_seq;		/* events queued in the heap so far */
+
+/* non-zero if overflow heap entry A is due before entry B */
+#define EVENTQ_FAR_LT(A, B)						\
+  ((A)->when < (B)->when || ((A)->when == (B)->when && (A)->seq < (B)->seq))
 
 /* initialize the event queue structures */
 static void
 eventq_init(void)
 {
-  event_queue = NULL;
+  memset(eventq_bucket, 0, sizeof(eventq_bucket));
+  eventq_heap_num = 0;
+  eventq_heap_size = 64;
+  eventq_heap = calloc(eventq_heap_size, sizeof(struct eventq_far));
+  if (!eventq_heap)
+    fatal("out of virtual memory");
+  eventq_seq = 0;
+}
+
+/* dump event EV of the event queue */
+static void
+eventq_dumpent(struct RS_link *ev,		/* event to dump */
+	       FILE *stream)			/* output stream */
+{
+  /* is event still valid? */
+  if (RSLINK_VALID(ev))
+    {
+      struct RUU_station *rs = RSLINK_RS(ev);
+
+      fprintf(stream, "idx: %2d: @ %.0f\n",
+	      (int)(rs - (rs->in_LSQ ? LSQ : RUU)), (double)ev->x.when);
+      ruu_dumpent(rs, rs - (rs->in_LSQ ? LSQ : RUU),
+		  stream, /* !header */FALSE);
+    }
 }
 
 /* dump the contents of the event queue */
@@ -1826,34 +3273,60 @@ static void
 eventq_dump(FILE *stream)			/* output stream */
 {
   struct RS_link *ev;
+  int i;
 
   if (!stream)
     stream = stderr;
 
   fprintf(stream, "** event queue state **\n");
 
-  for (ev = event_queue; ev != NULL; ev = ev->next)
+  for (i=0; i < EVENTQ_HORIZON; i++)
     {
-      /* is event still valid? */
-      if (RSLINK_VALID(ev))
-	{
-	  struct RUU_station *rs = RSLINK_RS(ev);
+      for (ev = EVENTQ_BUCKET(sim_cycle + i); ev != NULL; ev = ev->next)
+	eventq_dumpent(ev, stream);
+    }
+  for (i=0; i < eventq_heap_num; i++)
+    eventq_dumpent(eventq_heap[i].ev, stream);
+}
 
-	  fprintf(stream, "idx: %2d: @ %.0f\n",
-		  (int)(rs - (rs->in_LSQ ? LSQ : RUU)), (double)ev->x.when);
-	  ruu_dumpent(rs, rs - (rs->in_LSQ ? LSQ : RUU),
-		      stream, /* !header */FALSE);
+/* move the events of the overflow heap that are now within the horizon
+   into their buckets */
+static void
+eventq_migrate(void)
+{
+  struct eventq_far far;
+  int i, child;
+
+  while (eventq_heap_num > 0
+	 && eventq_heap[0].when < sim_cycle + EVENTQ_HORIZON)
+    {
+      far = eventq_heap[0];
+      far.ev->next = EVENTQ_BUCKET(far.when);
+      EVENTQ_BUCKET(far.when) = far.ev;
+
+      /* sift the last entry down from the root */
+      far = eventq_heap[--eventq_heap_num];
+      for (i=0; (child = 2*i + 1) < eventq_heap_num; i=child)
+	{
+	  if (child+1 < eventq_heap_num
+	      && EVENTQ_FAR_LT(&eventq_heap[child+1], &eventq_heap[child]))
+	    child++;
+	  if (!EVENTQ_FAR_LT(&eventq_heap[child], &far))
+	    break;
+	  eventq_heap[i] = eventq_heap[child];
 	}
+      eventq_heap[i] = far;
     }
 }
 
-/* insert an event for RS into the event queue, event queue is sorted from
-   earliest to latest event, event and associated side-effects will be
-   apparent at the start of cycle WHEN */
+/* insert an event for RS into the event queue, event and associated
+   side-effects will be apparent at the start of cycle WHEN */
 static void
 eventq_queue_event(struct RUU_station *rs, tick_t when)
 {
-  struct RS_link *prev, *ev, *new_ev;
+  struct RS_link *new_ev;
+  struct eventq_far far;
+  int i;
 
   if (rs->completed)
     panic("event completed");
@@ -1865,23 +3338,31 @@ eventq_queue_event(struct RUU_station *rs, tick_t when)
   RSLINK_NEW(new_ev, rs);
   new_ev->x.when = when;
 
-  /* locate insertion point */
-  for (prev=NULL, ev=event_queue;
-       ev && ev->x.when < when;
-       prev=ev, ev=ev->next);
-
-  if (prev)
+  if (when < sim_cycle + EVENTQ_HORIZON)
     {
-      /* insert middle or end */
-      new_ev->next = prev->next;
-      prev->next = new_ev;
+      /* within the horizon, goes on the front of its bucket */
+      new_ev->next = EVENTQ_BUCKET(when);
+      EVENTQ_BUCKET(when) = new_ev;
+      return;
     }
-  else
+
+  /* beyond the horizon, sift it up the overflow heap */
+  if (eventq_heap_num == eventq_heap_size)
     {
-      /* insert at beginning */
-      new_ev->next = event_queue;
-      event_queue = new_ev;
+      eventq_heap_size *= 2;
+      eventq_heap = realloc(eventq_heap,
+			    eventq_heap_size * sizeof(struct eventq_far));
+      if (!eventq_heap)
+	fatal("out of virtual memory");
     }
+  far.when = when;
+  far.seq = eventq_seq++;
+  far.ev = new_ev;
+  for (i=eventq_heap_num++;
+       i > 0 && EVENTQ_FAR_LT(&far, &eventq_heap[(i-1)/2]);
+       i=(i-1)/2)
+    eventq_heap[i] = eventq_heap[(i-1)/2];
+  eventq_heap[i] = far;
 }
 
 /* return the next event that has already occurred, returns NULL when no
@@ -1890,17 +3371,22 @@ static struct RUU_station *
 eventq_next_event(void)
 {
   struct RS_link *ev;
+  struct RUU_station *rs;
 
-  if (event_queue && event_queue->x.when <= sim_cycle)
+  /* events due within the horizon now are in their buckets */
+  eventq_migrate();
+
+  /* events are drained every cycle, so the current cycle's bucket only
+     holds events due now */
+  while ((ev = EVENTQ_BUCKET(sim_cycle)) != NULL)
     {
-      /* unlink and return first event on priority list */
-      ev = event_queue;
-      event_queue = event_queue->next;
+      /* unlink the event */
+      EVENTQ_BUCKET(sim_cycle) = ev->next;
 
       /* event still valid? */
       if (RSLINK_VALID(ev))
 	{
-	  struct RUU_station *rs = RSLINK_RS(ev);
+	  rs = RSLINK_RS(ev);
 
 	  /* reclaim event record */
 	  RSLINK_FREE(ev);
@@ -1908,20 +3394,14 @@ eventq_next_event(void)
 	  /* event is valid, return resv station */
 	  return rs;
 	}
-      else
-	{
-	  /* reclaim event record */
-	  RSLINK_FREE(ev);
 
-	  /* receiving inst was squashed, return next event */
-	  return eventq_next_event();
-	}
-    }
-  else
-    {
-      /* no event or no event is ready */
-      return NULL;
+      /* receiving inst was squashed, reclaim event record and try the
+	 next event */
+      RSLINK_FREE(ev);
     }
+
+  /* no event is ready */
+  return NULL;
 }
 
 
@@ -1929,7 +3409,7 @@ eventq_next_event(void)
  * the ready instruction queue implementation follows, the ready instruction
  * queue indicates which instruction have all of there *register* dependencies
  * satisfied, instruction will issue when 1) all memory dependencies for
- * the instruction have been satisfied (see lsq_refresh() for details on how
+ * the instruction have been satisfied (see lsq_load_ready() for details on how
  * this is accomplished) and 2) resources are available; ready queue is fully
  * constructed each cycle before any operation is issued from it -- this
  * ensures that instruction issue priorities are properly observed; NOTE:
@@ -1937,33 +3417,90 @@ eventq_next_event(void)
  * updated during squash events
  */
 
-/* the ready instruction queue */
-static struct RS_link *ready_queue;
-
-/* initialize the event queue structures */
+/* the ready instruction queue, a bitmap over the slots of the LSQ and two
+   over the slots of the RUU, one for long latency operations and branches,
+   the other for all the rest, a slot's bit is set while the instruction in
+   it is queued, NOTE: squashed instructions are removed by ruu_recover() */
+#define READYQ_LSQ		0	/* loads and stores, in the LSQ */
+#define READYQ_FIRST		1	/* long latency ops and branches */
+#define READYQ_REST		2	/* all other operations */
+#define READYQ_NUM		3
+static HOST_TLS BITMAP_PTR_TYPE ready_queue[READYQ_NUM];
+
+/* ready queue of RUU or LSQ entry RS */
+#define READYQ_OF(RS)							\
+  ((RS)->in_LSQ								\
+   ? READYQ_LSQ								\
+   : ((MD_OP_FLAGS((RS)->op) & (F_LONGLAT|F_CTRL))			\
+      ? READYQ_FIRST : READYQ_REST))
+
+/* slot of the entry AGE entries from the head of ready queue Q's window */
+#define READYQ_SLOT(Q, AGE)						\
+  ((Q) == READYQ_LSQ							\
+   ? (LSQ_head + (AGE)) & (LSQ_size-1)					\
+   : (RUU_head + (AGE)) & (RUU_size-1))
+
+/* entry in the slot AGE entries from the head of ready queue Q's window */
+#define READYQ_ENTRY(Q, AGE)						\
+  ((Q) == READYQ_LSQ							\
+   ? &LSQ[READYQ_SLOT(Q, AGE)] : &RUU[READYQ_SLOT(Q, AGE)])
+
+/* initialize the ready queue structures */
 static void
 readyq_init(void)
 {
-  ready_queue = NULL;
+  int q;
+
+  for (q=0; q < READYQ_NUM; q++)
+    {
+      ready_queue[q] =
+	calloc(BITMAP_SIZE(q == READYQ_LSQ ? LSQ_size : RUU_size),
+	       sizeof(BITMAP_ENT_TYPE));
+      if (!ready_queue[q])
+	fatal("out of virtual memory");
+    }
+}
+
+/* return the age (distance from the head of the RUU or LSQ) of the oldest
+   instruction in ready queue Q that is at least AGE entries from the head,
+   or -1 if there is none, the scan visits each bitmap word at most once */
+static int
+readyq_next(int q, int age)
+{
+  int size = (q == READYQ_LSQ ? LSQ_size : RUU_size);
+  int slot, avail;
+  BITMAP_ENT_TYPE word;
+
+  while (age < size)
+    {
+      slot = READYQ_SLOT(q, age);
+      avail = MIN(32 - slot % 32, MIN(size - slot, size - age));
+      word = ready_queue[q][slot / 32] >> (slot % 32);
+      if (avail < 32)
+	word &= (1U << avail) - 1;
+      if (word)
+	return age + BITMAP_WORD_FFS(word);
+      age += avail;
+    }
+  return -1;
 }
 
 /* dump the contents of the ready queue */
 static void
 readyq_dump(FILE *stream)			/* output stream */
 {
-  struct RS_link *link;
+  int q, age;
 
   if (!stream)
     stream = stderr;
 
   fprintf(stream, "** ready queue state **\n");
 
-  for (link = ready_queue; link != NULL; link = link->next)
+  for (q=0; q < READYQ_NUM; q++)
     {
-      /* is entry still valid? */
-      if (RSLINK_VALID(link))
+      for (age = readyq_next(q, 0); age >= 0; age = readyq_next(q, age+1))
 	{
-	  struct RUU_station *rs = RSLINK_RS(link);
+	  struct RUU_station *rs = READYQ_ENTRY(q, age);
 
 	  ruu_dumpent(rs, rs - (rs->in_LSQ ? LSQ : RUU),
 		      stream, /* header */TRUE);
@@ -1971,10 +3508,12 @@ readyq_dump(FILE *stream)			/* output stream */
     }
 }
 
-/* insert ready node into the ready list using ready instruction scheduling
-   policy; currently the following scheduling policy is enforced:
+/* insert ready node into the ready queue, ruu_issue() enforces the ready
+   instruction scheduling policy; currently the following scheduling policy
+   is enforced:
 
-     memory and long latency operands, and branch instructions first
+     memory and long latency operands, and branch instructions first,
+     oldest instructions first
 
    then
 
@@ -1987,44 +3526,25 @@ readyq_dump(FILE *stream)			/* output stream */
 static void
 readyq_enqueue(struct RUU_station *rs)		/* RS to enqueue */
 {
-  struct RS_link *prev, *node, *new_node;
-
   /* node is now queued */
   if (rs->queued)
     panic("node is already queued");
   rs->queued = TRUE;
 
-  /* get a free ready list node */
-  RSLINK_NEW(new_node, rs);
-  new_node->x.seq = rs->seq;
+  (void)BITMAP_SET(ready_queue[READYQ_OF(rs)], /* unused */0,
+		   rs - (rs->in_LSQ ? LSQ : RUU));
+}
 
-  /* locate insertion point */
-  if (rs->in_LSQ || MD_OP_FLAGS(rs->op) & (F_LONGLAT|F_CTRL))
-    {
-      /* insert loads/stores and long latency ops at the head of the queue */
-      prev = NULL;
-      node = ready_queue;
-    }
-  else
-    {
-      /* otherwise insert in program order (earliest seq first) */
-      for (prev=NULL, node=ready_queue;
-	   node && node->x.seq < rs->seq;
-	   prev=node, node=node->next);
-    }
+/* remove RS from the ready queue, if it is queued */
+static void
+readyq_dequeue(struct RUU_station *rs)		/* RS to dequeue */
+{
+  if (!rs->queued)
+    return;
+  rs->queued = FALSE;
 
-  if (prev)
-    {
-      /* insert middle or end */
-      new_node->next = prev->next;
-      prev->next = new_node;
-    }
-  else
-    {
-      /* insert at beginning */
-      new_node->next = ready_queue;
-      ready_queue = new_node;
-    }
+  (void)BITMAP_CLEAR(ready_queue[READYQ_OF(rs)], /* unused */0,
+		     rs - (rs->in_LSQ ? LSQ : RUU));
 }
 
 
@@ -2051,15 +3571,15 @@ static struct CV_link CVLINK_NULL = { NULL, 0 };
 
 /* the create vector, NOTE: speculative copy on write storage provided
    for fast recovery during wrong path execute (see tracer_recover() for
-   details on this process */
-static BITMAP_TYPE(MD_TOTAL_REGS, use_spec_cv);
-static struct CV_link create_vector[MD_TOTAL_REGS];
-static struct CV_link spec_create_vector[MD_TOTAL_REGS];
+   details on this process, the vectors are allocated per SMT thread */
+static HOST_TLS BITMAP_TYPE(MD_TOTAL_REGS, use_spec_cv);
+static HOST_TLS struct CV_link *create_vector;
+static HOST_TLS struct CV_link *spec_create_vector;
 
 /* these arrays shadow the create vector an indicate when a register was
    last created */
-static tick_t create_vector_rt[MD_TOTAL_REGS];
-static tick_t spec_create_vector_rt[MD_TOTAL_REGS];
+static HOST_TLS tick_t *create_vector_rt;
+static HOST_TLS tick_t *spec_create_vector_rt;
 
 /* read a create vector entry */
 #define CREATE_VECTOR(N)        (BITMAP_SET_P(use_spec_cv, CV_BMAP_SZ, (N))\
@@ -2083,6 +3603,14 @@ cv_init(void)
 {
   int i;
 
+  create_vector = calloc(MD_TOTAL_REGS, sizeof(struct CV_link));
+  spec_create_vector = calloc(MD_TOTAL_REGS, sizeof(struct CV_link));
+  create_vector_rt = calloc(MD_TOTAL_REGS, sizeof(tick_t));
+  spec_create_vector_rt = calloc(MD_TOTAL_REGS, sizeof(tick_t));
+  if (!create_vector || !spec_create_vector
+      || !create_vector_rt || !spec_create_vector_rt)
+    fatal("out of virtual memory");
+
   /* initially all registers are valid in the architected register file,
      i.e., the create vector entry is CVLINK_NULL */
   for (i=0; i < MD_TOTAL_REGS; i++)
@@ -2122,6 +3650,89 @@ cv_dump(FILE *stream)				/* output stream */
 }
 
 
+/*
+ * simultaneous multithreading (SMT), the threads share the RUU, LSQ,
+ * functional units, caches, TLBs and branch predictor tables; each has its
+ * own architected and speculative state, create vector, LSQ store index,
+ * fetch queue and return address stack, those of the current thread
+ * (CUR_THREAD) are in the usual globals, thread_switch() saves them here
+ * and loads another thread's, so the single threaded paths are unchanged;
+ * the input, exit, RUU occupancy and stats fields are always kept here
+ */
+struct thread_t {
+  /* architected state */
+  struct regs_t regs;			/* register file */
+  struct mem_t *mem;			/* memory space */
+  md_addr_t ld_text_base;		/* loader state, used by syscalls */
+  unsigned int ld_text_size;
+  md_addr_t ld_data_base;
+  unsigned int ld_data_size;
+  md_addr_t ld_brk_point;
+  md_addr_t ld_stack_base;
+  unsigned int ld_stack_size;
+  md_addr_t ld_stack_min;
+  char *ld_prog_fname;
+  md_addr_t ld_prog_entry;
+  md_addr_t ld_environ_base;
+  int stdin_fd;				/* program input, 0 for stdin */
+  int exited;				/* program has exited? */
+
+  /* speculative state */
+  int spec_mode;
+  md_gpr_t spec_regs_R;
+  md_fpr_t spec_regs_F;
+  md_ctrl_t spec_regs_C;
+  BITMAP_TYPE(MD_NUM_IREGS, use_spec_R);
+  BITMAP_TYPE(MD_NUM_FREGS, use_spec_F);
+  BITMAP_TYPE(MD_NUM_FREGS, use_spec_C);
+  struct spec_mem_ent **store_htable;	/* speculative memory hash table */
+
+  /* dependence state */
+  BITMAP_TYPE(MD_TOTAL_REGS, use_spec_cv);
+  struct CV_link *create_vector;
+  struct CV_link *spec_create_vector;
+  tick_t *create_vector_rt;
+  tick_t *spec_create_vector_rt;
+  struct RS_ref *lsq_st_index;
+  struct RS_link last_op;
+
+  /* front end state */
+  md_addr_t pred_PC, recover_PC;
+  md_addr_t fetch_regs_PC, fetch_pred_PC;
+  md_addr_t fetch_miss_PC;
+  struct fetch_rec *fetch_data;
+  int fetch_num, fetch_tail, fetch_head;
+  unsigned ruu_fetch_issue_delay;
+  struct ftq_ent *ftq;			/* fetch target queue */
+  int ftq_num, ftq_head, ftq_off;
+  md_addr_t lsb_start, lsb_end;		/* loop stream buffer */
+  int ras_tos;				/* return address stack */
+  struct bpred_btb_ent_t *ras_stack;
+
+  /* insts in the RUU, for syscall drains and the icount fetch policy */
+  int ruu_num;
+
+  /* per-thread stats */
+  counter_t sim_num_insn;
+  counter_t sim_num_refs;
+  counter_t sim_num_loads;
+  counter_t sim_num_branches;
+};
+
+/* the SMT threads */
+static HOST_TLS struct thread_t threads[MAX_THREADS];
+
+/* make thread ID the current thread */
+static void thread_switch(int id);
+
+/* next PC of the last instruction committed, where the program continues
+   once the pipeline has drained */
+static HOST_TLS md_addr_t commit_next_PC = 0;
+
+/* sampled simulation is draining the pipeline, no more dispatch */
+static int sample_drain = FALSE;
+
+
 /*
  *  RUU_COMMIT() - instruction retirement pipeline stage
  */
@@ -2133,13 +3744,29 @@ static void
 ruu_commit(void)
 {
   int i, lat, events, committed = 0;
-  static counter_t sim_ret_insn = 0;
+  static HOST_TLS counter_t sim_ret_insn = 0;
 
   /* all values must be retired to the architected reg file in program order */
   while (RUU_num > 0 && committed < ruu_commit_width)
     {
       struct RUU_station *rs = &(RUU[RUU_head]);
 
+      /* release the slots of instructions squashed behind other threads'
+	 instructions, see ruu_recover() */
+      if (rs->squashed)
+	{
+	  if (rs->ea_comp)
+	    {
+	      if (LSQ_num <= 0 || !LSQ[LSQ_head].squashed)
+		panic("RUU out of sync with LSQ");
+	      LSQ_head = (LSQ_head + 1) % LSQ_size;
+	      LSQ_num--;
+	    }
+	  RUU_head = (RUU_head + 1) % RUU_size;
+	  RUU_num--;
+	  continue;
+	}
+
       if (!rs->completed)
 	{
 	  /* at least RUU entry must be complete */
@@ -2182,12 +3809,17 @@ ruu_commit(void)
 		  fu->master->busy = fu->issuelat;
 
 		  /* go to the data cache */
+		  cache_access_PC = LSQ[LSQ_head].PC;
 		  if (cache_dl1)
 		    {
 		      /* commit store value to D-cache */
 		      lat =
-			cache_access(cache_dl1, Write, (LSQ[LSQ_head].addr&~3),
-				     NULL, 4, sim_cycle, NULL, NULL);
+			cache_access(cache_dl1, Write,
+				     THREAD_ADDR(rs->thread,
+						 LSQ[LSQ_head].addr & ~3),
+				     NULL, 4, sim_cycle, NULL, NULL, 0);
+		      if (cmp_ncores > 1)
+			lat += cmp_upgrade(LSQ[LSQ_head].addr & ~3);
 		      if (lat > cache_dl1_lat)
 			events |= PEV_CACHEMISS;
 		    }
@@ -2197,8 +3829,10 @@ ruu_commit(void)
 		    {
 		      /* access the D-TLB */
 		      lat =
-			cache_access(dtlb, Read, (LSQ[LSQ_head].addr & ~3),
-				     NULL, 4, sim_cycle, NULL, NULL);
+			cache_access(dtlb, Read,
+				     THREAD_ADDR(rs->thread,
+						 LSQ[LSQ_head].addr & ~3),
+				     NULL, 4, sim_cycle, NULL, NULL, 0);
 		      if (lat > 1)
 			events |= PEV_TLBMISS;
 		    }
@@ -2258,9 +3892,15 @@ ruu_commit(void)
       ptrace_newstage(RUU[RUU_head].ptrace_seq, PST_COMMIT, events);
       ptrace_endinst(RUU[RUU_head].ptrace_seq);
 
+      /* free the physical registers its results replaced */
+      for (i=0; i<PRF_NUM; i++)
+	PRF_free[i] += rs->prf_regs[i];
+
       /* commit head entry of RUU */
+      commit_next_PC = RUU[RUU_head].next_PC;
       RUU_head = (RUU_head + 1) % RUU_size;
       RUU_num--;
+      threads[rs->thread].ruu_num--;
 
       /* one more instruction committed to architected state */
       committed++;
@@ -2274,17 +3914,220 @@ ruu_commit(void)
 }
 
 
+/*
+ *  LSQ memory dependences - when loads may issue past older stores
+ */
+
+/* a load may issue as soon as its address is known, unless the memory
+   dependence predictor says it aliases an older store whose data is not
+   yet ready, or the address of the last older store to the same address
+   (ST_ALIAS, found through the LSQ address index at dispatch) is known,
+   in which case it waits for the store's data; a load that issues before
+   its ST_ALIAS store's address is known reads a stale value, this is
+   detected when the store address resolves, so the load is instead held
+   until the store's data is ready, as if replayed, and fetch stalls for
+   the branch misprediction penalty, NOTE: instructions are functionally
+   executed at dispatch, so squashing the load and the instructions after
+   it through ruu_recover() is not an option */
+
+/* return the store set ID of the load or store at PC, -1 if none */
+static int
+ssit_lookup(md_addr_t PC)
+{
+  int i;
+
+  /* periodically forget all store sets, so false dependences die out */
+  if (storeset_config[2] && sim_cycle >= ssit_next_clear)
+    {
+      for (i=0; i < storeset_config[0]; i++)
+	ssit[i] = -1;
+      ssit_next_clear = sim_cycle + storeset_config[2];
+    }
+  return ssit[SSIT_INDEX(PC)];
+}
+
+/* put the load at LOAD_PC and the store at STORE_PC it passed in the same
+   store set */
+static void
+ssit_train(md_addr_t load_PC, md_addr_t store_PC)
+{
+  int *load_id = &ssit[SSIT_INDEX(load_PC)];
+  int *store_id = &ssit[SSIT_INDEX(store_PC)];
+
+  if (*load_id < 0 && *store_id < 0)
+    {
+      /* allocate a new store set */
+      *load_id = *store_id = ssit_next_id;
+      ssit_next_id = (ssit_next_id + 1) % storeset_config[1];
+    }
+  else if (*load_id < 0)
+    *load_id = *store_id;
+  else if (*store_id < 0)
+    *store_id = *load_id;
+  else
+    {
+      /* merge the two sets, the smaller ID wins */
+      *load_id = *store_id = MIN(*load_id, *store_id);
+    }
+}
+
+/* enter the memory dependences of load or store RS, just dispatched into
+   the LSQ */
+static void
+lsq_dispatch_mem(struct RUU_station *rs)
+{
+  struct RS_ref *bucket = &lsq_st_index[LSQ_ST_BUCKET(rs->addr)];
+  struct RS_ref ref;
+  int id;
+
+  rs->st_alias.rs = rs->st_pred.rs = NULL;
+  rs->st_violation = FALSE;
+  rs->st_waiters = NULL;
+
+  id = mdp_kind == MDP_STORESET ? ssit_lookup(rs->PC) : -1;
+  if ((MD_OP_FLAGS(rs->op) & (F_MEM|F_STORE)) == (F_MEM|F_STORE))
+    {
+      /* the last store in its address bucket and in its store set */
+      rs->st_prev = *bucket;
+      RSREF_INIT(*bucket, rs);
+      if (id >= 0)
+	RSREF_INIT(lfst[id], rs);
+    }
+  else
+    {
+      /* find the last older store to the same address, committed stores
+	 end the walk as all stores before them are committed as well */
+      for (ref = *bucket; RSREF_VALID(ref); ref = ref.rs->st_prev)
+	{
+	  if (ref.rs->addr == rs->addr)
+	    {
+	      rs->st_alias = ref;
+	      break;
+	    }
+	}
+
+      if (mdp_kind == MDP_PERFECT)
+	rs->st_pred = rs->st_alias;
+      else if (id >= 0)
+	rs->st_pred = lfst[id];
+    }
+}
+
+/* undo the memory dependences of squashed load or store RS */
+static void
+lsq_squash_mem(struct RUU_station *rs)
+{
+  struct RS_ref *bucket = &lsq_st_index[LSQ_ST_BUCKET(rs->addr)];
+
+  /* stores are squashed youngest first, so each is last in its bucket */
+  if ((MD_OP_FLAGS(rs->op) & (F_MEM|F_STORE)) == (F_MEM|F_STORE)
+      && bucket->rs == rs && bucket->tag == rs->tag)
+    *bucket = rs->st_prev;
+
+  RSLINK_FREE_LIST(rs->st_waiters);
+  rs->st_waiters = NULL;
+}
+
+/* queue load RS for issue if its address is known and the stores it
+   depends on have their data, otherwise make it wait for that store */
+static void
+lsq_load_ready(struct RUU_station *rs)
+{
+  struct RUU_station *st = NULL;
+  struct RS_link *link;
+
+  if (rs->queued || rs->issued || rs->completed || !OPERANDS_READY(rs))
+    return;
+
+  if (RSREF_VALID(rs->st_pred) && !OPERANDS_READY(rs->st_pred.rs))
+    {
+      /* predicted to alias a store whose data is not ready */
+      st = rs->st_pred.rs;
+      mdp_waits++;
+      if (!RSREF_VALID(rs->st_alias) || rs->st_alias.rs != st)
+	mdp_false_waits++;
+    }
+  else if (RSREF_VALID(rs->st_alias) && !OPERANDS_READY(rs->st_alias.rs))
+    {
+      /* aliases a store whose data is not ready, the load would go ahead
+	 if the store address is still unknown */
+      st = rs->st_alias.rs;
+      if (!STORE_ADDR_READY(st))
+	rs->st_violation = TRUE;
+    }
+
+  if (st)
+    {
+      /* wait for the store's address and data */
+      RSLINK_NEW(link, rs);
+      link->next = st->st_waiters;
+      st->st_waiters = link;
+    }
+  else
+    {
+      /* no memory dependences, put load on ready queue */
+      readyq_enqueue(rs);
+    }
+}
+
+/* the address of store ST just became known, detect the violations of the
+   loads that passed it */
+static void
+lsq_store_addr_ready(struct RUU_station *st)
+{
+  struct RS_link *link;
+
+  for (link = st->st_waiters; link; link = link->next)
+    {
+      struct RUU_station *rs = RSLINK_RS(link);
+
+      if (RSLINK_VALID(link) && rs->st_violation && rs->st_alias.rs == st)
+	{
+	  rs->st_violation = FALSE;
+	  mdp_violations++;
+	  if (mdp_kind == MDP_STORESET)
+	    ssit_train(rs->PC, st->PC);
+
+	  /* refetch the instructions after the load */
+	  ruu_fetch_issue_delay = MAX(ruu_fetch_issue_delay,
+				      ruu_branch_penalty);
+	}
+    }
+}
+
+/* the address and data of store ST are ready, retry the loads waiting
+   for it */
+static void
+lsq_store_ready(struct RUU_station *st)
+{
+  struct RS_link *link, *next;
+
+  link = st->st_waiters;
+  st->st_waiters = NULL;
+  for (; link; link = next)
+    {
+      next = link->next;
+      if (RSLINK_VALID(link))
+	lsq_load_ready(RSLINK_RS(link));
+      RSLINK_FREE(link);
+    }
+}
+
+
 /*
  *  RUU_RECOVER() - squash mispredicted microarchitecture state
  */
 
 /* recover processor microarchitecture state back to point of the
-   mis-predicted branch at RUU[BRANCH_INDEX] */
+   mis-predicted branch at RUU[BRANCH_INDEX], only the instructions of the
+   branch's SMT thread are squashed, those behind other threads' younger
+   instructions are marked squashed and release their slots at commit */
 static void
 ruu_recover(int branch_index)			/* index of mis-pred branch */
 {
   int i, RUU_index = RUU_tail, LSQ_index = LSQ_tail;
   int RUU_prev_tail = RUU_tail, LSQ_prev_tail = LSQ_tail;
+  int thread = RUU[branch_index].thread, at_tail = TRUE;
 
   /* recover from the tail of the RUU towards the head until the branch index
      is reached, this direction ensures that the LSQ can be synchronized with
@@ -2305,51 +4148,77 @@ ruu_recover(int branch_index)			/* index of mis-pred branch */
       if (RUU_index == RUU_head)
 	panic("RUU head and tail broken");
 
-      /* is this operation an effective addr calc for a load or store? */
-      if (RUU[RUU_index].ea_comp)
+      /* should be at least one load or store in the LSQ */
+      if (RUU[RUU_index].ea_comp && !LSQ_num)
+	panic("RUU and LSQ out of sync");
+
+      if (RUU[RUU_index].thread == thread && !RUU[RUU_index].squashed)
 	{
-	  /* should be at least one load or store in the LSQ */
-	  if (!LSQ_num)
-	    panic("RUU and LSQ out of sync");
+	  /* is this operation an effective addr calc for a load or store? */
+	  if (RUU[RUU_index].ea_comp)
+	    {
+	      /* recover any resources consumed by the load or store op */
+	      for (i=0; i<MAX_ODEPS; i++)
+		{
+		  RSLINK_FREE_LIST(LSQ[LSQ_index].odep_list[i]);
+		  /* blow away the consuming op list */
+		  LSQ[LSQ_index].odep_list[i] = NULL;
+		}
+
+	      /* squash this LSQ entry */
+	      lsq_squash_mem(&LSQ[LSQ_index]);
+	      LSQ[LSQ_index].tag++;
+	      LSQ[LSQ_index].squashed = TRUE;
+	      readyq_dequeue(&LSQ[LSQ_index]);
+
+	      /* indicate in pipetrace that this instruction was squashed */
+	      ptrace_endinst(LSQ[LSQ_index].ptrace_seq);
+	    }
 
-	  /* recover any resources consumed by the load or store operation */
+	  /* recover any resources used by this RUU operation */
 	  for (i=0; i<MAX_ODEPS; i++)
 	    {
-	      RSLINK_FREE_LIST(LSQ[LSQ_index].odep_list[i]);
+	      RSLINK_FREE_LIST(RUU[RUU_index].odep_list[i]);
 	      /* blow away the consuming op list */
-	      LSQ[LSQ_index].odep_list[i] = NULL;
+	      RUU[RUU_index].odep_list[i] = NULL;
 	    }
-      
-	  /* squash this LSQ entry */
-	  LSQ[LSQ_index].tag++;
 
-	  /* indicate in pipetrace that this instruction was squashed */
-	  ptrace_endinst(LSQ[LSQ_index].ptrace_seq);
+	  /* release its issue queue entry and physical registers */
+	  backend_iq_release(&RUU[RUU_index]);
+	  for (i=0; i<PRF_NUM; i++)
+	    PRF_free[i] += RUU[RUU_index].prf_regs[i];
 
-	  /* go to next earlier LSQ slot */
-	  LSQ_prev_tail = LSQ_index;
-	  LSQ_index = (LSQ_index + (LSQ_size-1)) % LSQ_size;
-	  LSQ_num--;
-	}
+	  /* squash this RUU entry */
+	  RUU[RUU_index].tag++;
+	  RUU[RUU_index].squashed = TRUE;
+	  readyq_dequeue(&RUU[RUU_index]);
+	  threads[thread].ruu_num--;
 
-      /* recover any resources used by this RUU operation */
-      for (i=0; i<MAX_ODEPS; i++)
+	  /* indicate in pipetrace that this instruction was squashed */
+	  ptrace_endinst(RUU[RUU_index].ptrace_seq);
+	}
+      else if (!RUU[RUU_index].squashed)
 	{
-	  RSLINK_FREE_LIST(RUU[RUU_index].odep_list[i]);
-	  /* blow away the consuming op list */
-	  RUU[RUU_index].odep_list[i] = NULL;
+	  /* another thread's instruction, keep it and the slots before it */
+	  at_tail = FALSE;
 	}
-      
-      /* squash this RUU entry */
-      RUU[RUU_index].tag++;
 
-      /* indicate in pipetrace that this instruction was squashed */
-      ptrace_endinst(RUU[RUU_index].ptrace_seq);
+      /* release squashed slots at the tail of the RUU and LSQ */
+      if (at_tail)
+	{
+	  if (RUU[RUU_index].ea_comp)
+	    {
+	      LSQ_prev_tail = LSQ_index;
+	      LSQ_num--;
+	    }
+	  RUU_prev_tail = RUU_index;
+	  RUU_num--;
+	}
 
-      /* go to next earlier slot in the RUU */
-      RUU_prev_tail = RUU_index;
+      /* go to next earlier slot in the RUU and LSQ */
+      if (RUU[RUU_index].ea_comp)
+	LSQ_index = (LSQ_index + (LSQ_size-1)) % LSQ_size;
       RUU_index = (RUU_index + (RUU_size-1)) % RUU_size;
-      RUU_num--;
     }
 
   /* reset head/tail pointers to point to the mis-predicted branch */
@@ -2393,6 +4262,10 @@ ruu_writeback(void)
       /* operation has completed */
       rs->completed = TRUE;
 
+      /* recovery and create vector updates work on the inst's thread */
+      if (rs->thread != cur_thread)
+	thread_switch(rs->thread);
+
       /* does this operation reveal a mis-predicted branch? */
       if (rs->recover_inst)
 	{
@@ -2485,17 +4358,34 @@ ruu_writeback(void)
 		      /* input is now ready */
 		      olink->rs->idep_ready[olink->x.opnum] = TRUE;
 
+		      /* a store address resolved, check for loads that
+			 went ahead of it */
+		      if (olink->rs->in_LSQ
+			  && olink->x.opnum == STORE_ADDR_INDEX
+			  && ((MD_OP_FLAGS(olink->rs->op)&(F_MEM|F_STORE))
+			      == (F_MEM|F_STORE)))
+			lsq_store_addr_ready(olink->rs);
+
 		      /* are all the register operands of target ready? */
 		      if (OPERANDS_READY(olink->rs))
 			{
 			  /* yes! enqueue instruction as ready, NOTE: stores
 			     complete at dispatch, so no need to enqueue
 			     them */
-			  if (!olink->rs->in_LSQ
-			      || ((MD_OP_FLAGS(olink->rs->op)&(F_MEM|F_STORE))
-				  == (F_MEM|F_STORE)))
+			  if (!olink->rs->in_LSQ)
 			    readyq_enqueue(olink->rs);
-			  /* else, ld op, issued when no mem conflict */
+			  else if ((MD_OP_FLAGS(olink->rs->op)&(F_MEM|F_STORE))
+				   == (F_MEM|F_STORE))
+			    {
+			      /* the loads waiting for its data may go */
+			      readyq_enqueue(olink->rs);
+			      lsq_store_ready(olink->rs);
+			    }
+			  else
+			    {
+			      /* ld op, issued when no mem conflict */
+			      lsq_load_ready(olink->rs);
+			    }
 			}
 		    }
 
@@ -2517,85 +4407,6 @@ ruu_writeback(void)
 }
 
 
-/*
- *  LSQ_REFRESH() - memory access dependence checker/scheduler
- */
-
-/* this function locates ready instructions whose memory dependencies have
-   been satisfied, this is accomplished by walking the LSQ for loads, looking
-   for blocking memory dependency condition (e.g., earlier store with an
-   unknown address) */
-#define MAX_STD_UNKNOWNS		64
-static void
-lsq_refresh(void)
-{
-  int i, j, index, n_std_unknowns;
-  md_addr_t std_unknowns[MAX_STD_UNKNOWNS];
-
-  /* scan entire queue for ready loads: scan from oldest instruction
-     (head) until we reach the tail or an unresolved store, after which no
-     other instruction will become ready */
-  for (i=0, index=LSQ_head, n_std_unknowns=0;
-       i < LSQ_num;
-       i++, index=(index + 1) % LSQ_size)
-    {
-      /* terminate search for ready loads after first unresolved store,
-	 as no later load could be resolved in its presence */
-      if (/* store? */
-	  (MD_OP_FLAGS(LSQ[index].op) & (F_MEM|F_STORE)) == (F_MEM|F_STORE))
-	{
-	  if (!STORE_ADDR_READY(&LSQ[index]))
-	    {
-	      /* FIXME: a later STD + STD known could hide the STA unknown */
-	      /* sta unknown, blocks all later loads, stop search */
-	      break;
-	    }
-	  else if (!OPERANDS_READY(&LSQ[index]))
-	    {
-	      /* sta known, but std unknown, may block a later store, record
-		 this address for later referral, we use an array here because
-		 for most simulations the number of entries to search will be
-		 very small */
-	      if (n_std_unknowns == MAX_STD_UNKNOWNS)
-		fatal("STD unknown array overflow, increase MAX_STD_UNKNOWNS");
-	      std_unknowns[n_std_unknowns++] = LSQ[index].addr;
-	    }
-	  else /* STORE_ADDR_READY() && OPERANDS_READY() */
-	    {
-	      /* a later STD known hides an earlier STD unknown */
-	      for (j=0; j<n_std_unknowns; j++)
-		{
-		  if (std_unknowns[j] == /* STA/STD known */LSQ[index].addr)
-		    std_unknowns[j] = /* bogus addr */0;
-		}
-	    }
-	}
-
-      if (/* load? */
-	  ((MD_OP_FLAGS(LSQ[index].op) & (F_MEM|F_LOAD)) == (F_MEM|F_LOAD))
-	  && /* queued? */!LSQ[index].queued
-	  && /* waiting? */!LSQ[index].issued
-	  && /* completed? */!LSQ[index].completed
-	  && /* regs ready? */OPERANDS_READY(&LSQ[index]))
-	{
-	  /* no STA unknown conflict (because we got to this check), check for
-	     a STD unknown conflict */
-	  for (j=0; j<n_std_unknowns; j++)
-	    {
-	      /* found a relevant STD unknown? */
-	      if (std_unknowns[j] == LSQ[index].addr)
-		break;
-	    }
-	  if (j == n_std_unknowns)
-	    {
-	      /* no STA or STD unknown conflicts, put load on ready queue */
-	      readyq_enqueue(&LSQ[index]);
-	    }
-	}
-    }
-}
-
-
 /*
  *  RUU_ISSUE() - issue instructions to functional units
  */
@@ -2603,7 +4414,7 @@ lsq_refresh(void)
 /* attempt to issue all operations in the ready queue; insts in the ready
    instruction queue have all register dependencies satisfied, this function
    must then 1) ensure the instructions memory dependencies have been satisfied
-   (see lsq_refresh() for details on this process) and 2) a function unit
+   (see lsq_load_ready() for details on this process) and 2) a function unit
    is available in this cycle to commence execution of the operation; if all
    goes well, the function unit is allocated, a writeback event is scheduled,
    and the instruction begins execution */
@@ -2611,40 +4422,53 @@ static void
 ruu_issue(void)
 {
   int i, load_lat, tlb_lat, n_issued;
-  struct RS_link *node, *next_node;
+  int age[READYQ_NUM];
+  int fu_busy[NUM_FU_CLASSES];
+  struct RUU_station *rs;
   struct res_template *fu;
 
-  /* FIXME: could be a little more efficient when scanning the ready queue */
+  /* a functional unit class found busy stays busy for the rest of the
+     cycle, so its other ready instructions are skipped */
+  for (i=0; i < NUM_FU_CLASSES; i++)
+    fu_busy[i] = FALSE;
 
-  /* copy and then blow away the ready list, NOTE: the ready list is
-     always totally reclaimed each cycle, and instructions that are not
-     issue are explicitly reinserted into the ready instruction queue,
-     this management strategy ensures that the ready instruction queue
-     is always properly sorted */
-  node = ready_queue;
-  ready_queue = NULL;
+  /* the oldest instruction of each ready queue */
+  for (i=0; i < READYQ_NUM; i++)
+    age[i] = readyq_next(i, 0);
 
   /* visit all ready instructions (i.e., insts whose register input
      dependencies have been satisfied, stop issue when no more instructions
-     are available or issue bandwidth is exhausted */
-  for (n_issued=0;
-       node && n_issued < ruu_issue_width;
-       node = next_node)
+     are available or issue bandwidth is exhausted, instructions in the LSQ
+     and long latency ops go first, merged in age order */
+  for (n_issued=0; n_issued < ruu_issue_width; )
     {
-      next_node = node->next;
-
-      /* still valid? */
-      if (RSLINK_VALID(node))
+      if (age[READYQ_LSQ] >= 0
+	  && (age[READYQ_FIRST] < 0
+	      || (READYQ_ENTRY(READYQ_LSQ, age[READYQ_LSQ])->seq
+		  < READYQ_ENTRY(READYQ_FIRST, age[READYQ_FIRST])->seq)))
+	i = READYQ_LSQ;
+      else if (age[READYQ_FIRST] >= 0)
+	i = READYQ_FIRST;
+      else if (age[READYQ_REST] >= 0)
+	i = READYQ_REST;
+      else
+	break;
+      rs = READYQ_ENTRY(i, age[i]);
+      age[i] = readyq_next(i, age[i] + 1);
+
+      /* try to issue it, unless it needs a functional unit of a class
+	 already found busy */
+      if ((rs->in_LSQ && (MD_OP_FLAGS(rs->op) & F_STORE))
+	  || MD_OP_FUCLASS(rs->op) == NA
+	  || !fu_busy[MD_OP_FUCLASS(rs->op)])
 	{
-	  struct RUU_station *rs = RSLINK_RS(node);
-
 	  /* issue operation, both reg and mem deps have been satisfied */
 	  if (!OPERANDS_READY(rs) || !rs->queued
 	      || rs->issued || rs->completed)
 	    panic("issued inst !ready, issued, or completed");
 
 	  /* node is now un-queued */
-	  rs->queued = FALSE;
+	  readyq_dequeue(rs);
 
 	  if (rs->in_LSQ
 	      && ((MD_OP_FLAGS(rs->op) & (F_MEM|F_STORE)) == (F_MEM|F_STORE)))
@@ -2658,6 +4482,7 @@ ruu_issue(void)
 	      if (rs->onames[0] || rs->onames[1])
 		panic("store creates result");
 
+
 	      if (rs->recover_inst)
 		panic("mis-predicted store");
 
@@ -2677,6 +4502,7 @@ ruu_issue(void)
 		    {
 		      /* got one! issue inst to functional unit */
 		      rs->issued = TRUE;
+		      backend_iq_release(rs);
 		      /* reserve the functional unit */
 		      if (fu->master->busy)
 			panic("functional unit already in use");
@@ -2692,30 +4518,15 @@ ruu_issue(void)
 			  int events = 0;
 
 			  /* for loads, determine cache access latency:
-			     first scan LSQ to see if a store forward is
+			     first check the LSQ to see if a store forward is
 			     possible, if not, access the data cache */
 			  load_lat = 0;
-			  i = (rs - LSQ);
-			  if (i != LSQ_head)
+
+			  /* FIXME: not dealing with partials! */
+			  if (RSREF_VALID(rs->st_alias))
 			    {
-			      for (;;)
-				{
-				  /* go to next earlier LSQ entry */
-				  i = (i + (LSQ_size-1)) % LSQ_size;
-
-				  /* FIXME: not dealing with partials! */
-				  if ((MD_OP_FLAGS(LSQ[i].op) & F_STORE)
-				      && (LSQ[i].addr == rs->addr))
-				    {
-				      /* hit in the LSQ */
-				      load_lat = 1;
-				      break;
-				    }
-
-				  /* scan finished? */
-				  if (i == LSQ_head)
-				    break;
-				}
+			      /* hit in the LSQ */
+			      load_lat = 1;
 			    }
 
 			  /* was the value store forwared from the LSQ? */
@@ -2727,13 +4538,16 @@ ruu_issue(void)
 				sim_invalid_addrs++;
 
 			      /* no! go to the data cache if addr is valid */
+			      cache_access_PC = rs->PC;
 			      if (cache_dl1 && valid_addr)
 				{
 				  /* access the cache if non-faulting */
 				  load_lat =
 				    cache_access(cache_dl1, Read,
-						 (rs->addr & ~3), NULL, 4,
-						 sim_cycle, NULL, NULL);
+						 THREAD_ADDR(rs->thread,
+							     rs->addr & ~3),
+						 NULL, 4, sim_cycle,
+						 NULL, NULL, 0);
 				  if (load_lat > cache_dl1_lat)
 				    events |= PEV_CACHEMISS;
 				}
@@ -2750,8 +4564,10 @@ ruu_issue(void)
 			      /* access the D-DLB, NOTE: this code will
 				 initiate speculative TLB misses */
 			      tlb_lat =
-				cache_access(dtlb, Read, (rs->addr & ~3),
-					     NULL, 4, sim_cycle, NULL, NULL);
+				cache_access(dtlb, Read,
+					     THREAD_ADDR(rs->thread,
+							 rs->addr & ~3),
+					     NULL, 4, sim_cycle, NULL, NULL, 0);
 			      if (tlb_lat > 1)
 				events |= PEV_TLBMISS;
 
@@ -2785,6 +4601,7 @@ ruu_issue(void)
 		      /* insufficient functional unit resources, put operation
 			 back onto the ready list, we'll try to issue it
 			 again next cycle */
+		      fu_busy[MD_OP_FUCLASS(rs->op)] = TRUE;
 		      readyq_enqueue(rs);
 		    }
 		}
@@ -2793,6 +4610,7 @@ ruu_issue(void)
 		  /* FIXME: need better solution for these */
 		  /* the instruction does not need a functional unit */
 		  rs->issued = TRUE;
+		  backend_iq_release(rs);
 
 		  /* schedule a result event */
 		  eventq_queue_event(rs, sim_cycle + 1);
@@ -2805,42 +4623,7 @@ ruu_issue(void)
 		  n_issued++;
 		}
 	    } /* !store */
-
 	}
-      /* else, RUU entry was squashed */
-
-      /* reclaim ready list entry, NOTE: this is done whether or not the
-         instruction issued, since the instruction was once again reinserted
-         into the ready queue if it did not issue, this ensures that the ready
-         queue is always properly sorted */
-      RSLINK_FREE(node);
-    }
-
-  /* put any instruction not issued back into the ready queue, go through
-     normal channels to ensure instruction stay ordered correctly */
-  for (; node; node = next_node)
-    {
-      next_node = node->next;
-
-      /* still valid? */
-      if (RSLINK_VALID(node))
-        {
-	  struct RUU_station *rs = RSLINK_RS(node);
-
-          /* node is now un-queued */
-          rs->queued = FALSE;
-
-	  /* not issued, put operation back onto the ready list, we'll try to
-	     issue it again next cycle */
-          readyq_enqueue(rs);
-        }
-      /* else, RUU entry was squashed */
-
-      /* reclaim ready list entry, NOTE: this is done whether or not the
-         instruction issued, since the instruction was once again reinserted
-         into the ready queue if it did not issue, this ensures that the ready
-         queue is always properly sorted */
-      RSLINK_FREE(node);
     }
 }
 
@@ -2852,18 +4635,18 @@ ruu_issue(void)
 
 /* integer register file */
 #define R_BMAP_SZ       (BITMAP_SIZE(MD_NUM_IREGS))
-static BITMAP_TYPE(MD_NUM_IREGS, use_spec_R);
-static md_gpr_t spec_regs_R;
+static HOST_TLS BITMAP_TYPE(MD_NUM_IREGS, use_spec_R);
+static HOST_TLS md_gpr_t spec_regs_R;
 
 /* floating point register file */
 #define F_BMAP_SZ       (BITMAP_SIZE(MD_NUM_FREGS))
-static BITMAP_TYPE(MD_NUM_FREGS, use_spec_F);
-static md_fpr_t spec_regs_F;
+static HOST_TLS BITMAP_TYPE(MD_NUM_FREGS, use_spec_F);
+static HOST_TLS md_fpr_t spec_regs_F;
 
 /* miscellaneous registers */
 #define C_BMAP_SZ       (BITMAP_SIZE(MD_NUM_CREGS))
-static BITMAP_TYPE(MD_NUM_FREGS, use_spec_C);
-static md_ctrl_t spec_regs_C;
+static HOST_TLS BITMAP_TYPE(MD_NUM_FREGS, use_spec_C);
+static HOST_TLS md_ctrl_t spec_regs_C;
 
 /* dump speculative register state */
 static void
@@ -2923,19 +4706,24 @@ struct spec_mem_ent {
 };
 
 /* speculative memory hash table */
-static struct spec_mem_ent *store_htable[STORE_HASH_SIZE];
+static HOST_TLS struct spec_mem_ent *store_htable[STORE_HASH_SIZE];
 
 /* speculative memory hash table bucket free list */
-static struct spec_mem_ent *bucket_free_list = NULL;
+static HOST_TLS struct spec_mem_ent *bucket_free_list = NULL;
 
 
 /* program counter */
-static md_addr_t pred_PC;
-static md_addr_t recover_PC;
+static HOST_TLS md_addr_t pred_PC;
+static HOST_TLS md_addr_t recover_PC;
 
 /* fetch unit next fetch address */
-static md_addr_t fetch_regs_PC;
-static md_addr_t fetch_pred_PC;
+static HOST_TLS md_addr_t fetch_regs_PC;
+static HOST_TLS md_addr_t fetch_pred_PC;
+
+/* last fetch address that missed in the I-cache or I-TLB, its fill is
+   delivered to the fetch unit even if another SMT thread evicted the line
+   while the miss was outstanding */
+static HOST_TLS md_addr_t fetch_miss_PC = 0;
 
 /* IFETCH -> DISPATCH instruction queue definition */
 struct fetch_rec {
@@ -2945,9 +4733,37 @@ struct fetch_rec {
   int stack_recover_idx;		/* branch predictor RSB index */
   unsigned int ptrace_seq;		/* print trace sequence id */
 };
-static struct fetch_rec *fetch_data;	/* IFETCH -> DISPATCH inst queue */
-static int fetch_num;			/* num entries in IF -> DIS queue */
-static int fetch_tail, fetch_head;	/* head and tail pointers of queue */
+static HOST_TLS struct fetch_rec *fetch_data;	/* IFETCH -> DISPATCH inst queue */
+static HOST_TLS int fetch_num;			/* num entries in IF -> DIS queue */
+static HOST_TLS int fetch_tail, fetch_head;	/* head and tail pointers of queue */
+
+/* the branch prediction of an instruction in a fetch block */
+struct ftq_pred {
+  md_addr_t pred_PC;			/* predicted next PC */
+  struct bpred_update_t dir_update;	/* bpred direction update info */
+  int stack_recover_idx;		/* branch predictor RSB index */
+};
+
+/* a fetch target queue entry, a fetch block of instructions from PC up to
+   a predicted taken branch or the end of PC's I-cache line */
+struct ftq_ent {
+  md_addr_t PC;				/* first inst of the block */
+  int ninsn;				/* insts in the block */
+  struct ftq_pred *preds;		/* their predictions */
+};
+static HOST_TLS struct ftq_ent *ftq;		/* fetch target queue (FTQ) */
+static HOST_TLS int ftq_num;			/* num entries in the FTQ */
+static HOST_TLS int ftq_head;			/* head of the FTQ */
+static HOST_TLS int ftq_off;			/* insts of the head entry fetched */
+static HOST_TLS int ftq_block_insns;		/* max insts per fetch block */
+
+/* loop in the loop stream buffer, from LSB_START to LSB_END (inclusive),
+   LSB_END is 0 while the LSB is empty */
+static HOST_TLS md_addr_t lsb_start, lsb_end;
+
+/* squash the fetch blocks in the fetch target queue */
+#define FTQ_FLUSH()							\
+  (ftq_num = 0, ftq_off = 0)
 
 /* recover instruction trace generator state to precise state state immediately
    before the first mis-predicted branch; this is accomplished by resetting
@@ -3003,6 +4819,7 @@ tracer_recover(void)
   fetch_num = 0;
   fetch_tail = fetch_head = 0;
   fetch_pred_PC = fetch_regs_PC = recover_PC;
+  FTQ_FLUSH();
 }
 
 /* initialize the speculative instruction state generator state */
@@ -3371,6 +5188,11 @@ ruu_install_odep(struct RUU_station *rs,	/* creating RUU station */
 #define DFCC			(2+32+32)
 #define DTMP			(3+32+32)
 
+/* physical register file of dependence name N, -1 if it is not renamed */
+#define PRF_OF(N)							\
+  (((N) == DNA || (N) == DTMP)						\
+   ? -1 : ((((N) >= 32 && (N) < 64) || (N) == DFCC) ? PRF_FP : PRF_INT))
+
 #elif defined(TARGET_ALPHA)
 
 /* general register dependence decoders, $r31 maps to DNA (0) */
@@ -3384,10 +5206,53 @@ ruu_install_odep(struct RUU_station *rs,	/* creating RUU station */
 #define DUNIQ			(1+32+32)
 #define DTMP			(2+32+32)
 
+/* physical register file of dependence name N, -1 if it is not renamed */
+#define PRF_OF(N)							\
+  (((N) == DNA || (N) == DTMP)						\
+   ? -1 : ((((N) >= 32 && (N) < 64) || (N) == DFPCR) ? PRF_FP : PRF_INT))
+
 #else
 #error No ISA target defined...
 #endif
 
+/* issue queue of instruction OP, with -backend prf, loads and stores are
+   queued for their effective address computation */
+#define IQ_OF(OP)							\
+  ((MD_OP_FLAGS(OP) & F_MEM)						\
+   ? IQ_MEM : ((MD_OP_FLAGS(OP) & F_FCOMP) ? IQ_FP : IQ_INT))
+
+/* count the physical registers needed by the results of instruction INST,
+   with opcode OP, by register file into NREGS, with -backend prf */
+static void
+backend_regs(md_inst_t inst,			/* instruction to decode */
+	     enum md_opcode op,			/* its opcode */
+	     int nregs[PRF_NUM])		/* output register counts */
+{
+  int out1, out2;
+
+  switch (op)
+    {
+#define DEFINST(OP,MSK,NAME,OPFORM,RES,CLASS,O1,O2,I1,I2,I3)		\
+    case OP:								\
+      out1 = O1; out2 = O2;						\
+      break;
+#define DEFLINK(OP,MSK,NAME,MASK,SHIFT)					\
+    case OP:								\
+      out1 = NA; out2 = NA;						\
+      break;
+#define CONNECT(OP)
+#include "machine.def"
+    default:
+      out1 = NA; out2 = NA;
+    }
+
+  nregs[PRF_INT] = nregs[PRF_FP] = 0;
+  if (PRF_OF(out1) >= 0)
+    nregs[PRF_OF(out1)]++;
+  if (PRF_OF(out2) >= 0 && out2 != out1)
+    nregs[PRF_OF(out2)]++;
+}
+
 
 /*
  * configure the execution engine
@@ -3571,7 +5436,9 @@ ruu_install_odep(struct RUU_station *rs,	/* creating RUU station */
 #define SYSCALL(INST)							\
   (/* only execute system calls in non-speculative mode */		\
    (spec_mode ? panic("speculative syscall") : (void) 0),		\
-   sys_syscall(&regs, mem_access, mem, INST, TRUE))
+   (smt_nthreads > 1 || cmp_ncores > 1					\
+    ? smt_syscall(INST)							\
+    : sys_syscall(&regs, mem_access, mem, INST, TRUE)))
 
 /* default register state accessor, used by DLite */
 static char *					/* err str, NULL for no err */
@@ -3692,33 +5559,293 @@ simoo_reg_obj(struct regs_t *xregs,		/* registers to access */
 
 /* the last operation that ruu_dispatch() attempted to dispatch, for
    implementing in-order issue */
-static struct RS_link last_op = RSLINK_NULL_DATA;
+static HOST_TLS struct RS_link last_op = RSLINK_NULL_DATA;
 
-/* dispatch instructions from the IFETCH -> DISPATCH queue: instructions are
-   first decoded, then they allocated RUU (and LSQ for load/stores) resources
-   and input and output dependence chains are updated accordingly */
+/* copy the state of the current thread between the globals and thread T,
+   into T if SAVE is non-zero */
 static void
-ruu_dispatch(void)
+thread_state(struct thread_t *t,		/* thread to save or load */
+	     int save)				/* save into T? */
 {
-  int i;
-  int n_dispatched;			/* total insts dispatched */
-  md_inst_t inst;			/* actual instruction bits */
-  enum md_opcode op;			/* decoded opcode enum */
-  int out1, out2, in1, in2, in3;	/* output/input register names */
-  md_addr_t target_PC;			/* actual next/target PC address */
-  md_addr_t addr;			/* effective address, if load/store */
-  struct RUU_station *rs;		/* RUU station being allocated */
-  struct RUU_station *lsq;		/* LSQ station for ld/st's */
-  struct bpred_update_t *dir_update_ptr;/* branch predictor dir update ptr */
-  int stack_recover_idx;		/* bpred retstack recovery index */
-  unsigned int pseq;			/* pipetrace sequence number */
-  int is_write;				/* store? */
-  int made_check;			/* used to ensure DLite entry */
-  int br_taken, br_pred_taken;		/* if br, taken?  predicted taken? */
-  int fetch_redirected = FALSE;
-  byte_t temp_byte = 0;			/* temp variable for spec mem access */
-  half_t temp_half = 0;			/* " ditto " */
-  word_t temp_word = 0;			/* " ditto " */
+#define THREAD_STATE(X)							\
+  (save ? memcpy(&t->X, &X, sizeof(X)) : memcpy(&X, &t->X, sizeof(X)))
+
+  THREAD_STATE(regs);
+  THREAD_STATE(mem);
+  THREAD_STATE(ld_text_base);
+  THREAD_STATE(ld_text_size);
+  THREAD_STATE(ld_data_base);
+  THREAD_STATE(ld_data_size);
+  THREAD_STATE(ld_brk_point);
+  THREAD_STATE(ld_stack_base);
+  THREAD_STATE(ld_stack_size);
+  THREAD_STATE(ld_stack_min);
+  THREAD_STATE(ld_prog_fname);
+  THREAD_STATE(ld_prog_entry);
+  THREAD_STATE(ld_environ_base);
+
+  THREAD_STATE(spec_mode);
+  THREAD_STATE(spec_regs_R);
+  THREAD_STATE(spec_regs_F);
+  THREAD_STATE(spec_regs_C);
+  THREAD_STATE(use_spec_R);
+  THREAD_STATE(use_spec_F);
+  THREAD_STATE(use_spec_C);
+
+  THREAD_STATE(use_spec_cv);
+  THREAD_STATE(create_vector);
+  THREAD_STATE(spec_create_vector);
+  THREAD_STATE(create_vector_rt);
+  THREAD_STATE(spec_create_vector_rt);
+  THREAD_STATE(lsq_st_index);
+  THREAD_STATE(last_op);
+
+  THREAD_STATE(pred_PC);
+  THREAD_STATE(recover_PC);
+  THREAD_STATE(fetch_regs_PC);
+  THREAD_STATE(fetch_pred_PC);
+  THREAD_STATE(fetch_miss_PC);
+  THREAD_STATE(fetch_data);
+  THREAD_STATE(fetch_num);
+  THREAD_STATE(fetch_tail);
+  THREAD_STATE(fetch_head);
+  THREAD_STATE(ruu_fetch_issue_delay);
+  THREAD_STATE(ftq);
+  THREAD_STATE(ftq_num);
+  THREAD_STATE(ftq_head);
+  THREAD_STATE(ftq_off);
+  THREAD_STATE(lsb_start);
+  THREAD_STATE(lsb_end);
+#undef THREAD_STATE
+
+  if (save)
+    memcpy(t->store_htable, store_htable, sizeof(store_htable));
+  else
+    memcpy(store_htable, t->store_htable, sizeof(store_htable));
+
+  if (pred && save)
+    {
+      t->ras_tos = pred->retstack.tos;
+      t->ras_stack = pred->retstack.stack;
+    }
+  else if (pred)
+    {
+      pred->retstack.tos = t->ras_tos;
+      pred->retstack.stack = t->ras_stack;
+    }
+}
+
+/* make thread ID the current thread */
+static void
+thread_switch(int id)				/* thread to switch to */
+{
+  if (id == cur_thread)
+    return;
+
+  thread_state(&threads[cur_thread], /* save */TRUE);
+  thread_state(&threads[id], /* save */FALSE);
+  cur_thread = id;
+}
+
+/* split PROG, the `<prog> <args> [< <infile>]' value of option OPT, into
+   at most NARGS-1 arguments ARGV, sets *INFILE to the input file or NULL,
+   returns the argument count */
+static int
+prog_parse(char *opt,				/* option name */
+	   char *prog,				/* program string */
+	   char **argv,				/* output arguments */
+	   int nargs,				/* size of ARGV */
+	   char **infile)			/* output input file */
+{
+  int argc = 0;
+  char *buf, *tok;
+
+  /* split the program into arguments and input redirection */
+  *infile = NULL;
+  buf = mystrdup(prog);
+  for (tok = strtok(buf, " \t"); tok; tok = strtok(NULL, " \t"))
+    {
+      if (*tok == '<')
+	{
+	  *infile = tok[1] ? tok+1 : strtok(NULL, " \t");
+	  if (!*infile)
+	    fatal("no input file in `%s %s'", opt, prog);
+	}
+      else if (argc < nargs-1)
+	argv[argc++] = tok;
+      else
+	fatal("too many arguments in `%s %s'", opt, prog);
+    }
+  argv[argc] = NULL;
+  if (!argc)
+    fatal("no program in `%s %s'", opt, prog);
+
+  return argc;
+}
+
+/* load the program of SMT thread ID, given by its `-smt:prog' option */
+static void
+smt_load_thread(int id,				/* thread to load */
+		char **envp)			/* program environment */
+{
+  int i, argc;
+  char *argv[256], *infile, name[32];
+
+  argc = prog_parse("-smt:prog", smt_progs[id-1], argv, N_ELT(argv), &infile);
+
+  /* storage of the saved state */
+  for (i=0; i <= id; i++)
+    {
+      if (!threads[i].store_htable)
+	threads[i].store_htable =
+	  calloc(STORE_HASH_SIZE, sizeof(struct spec_mem_ent *));
+      if (!threads[i].store_htable)
+	fatal("out of virtual memory");
+    }
+
+  /* switch to the (empty) thread and initialize its state */
+  thread_switch(id);
+
+  regs_init(&regs);
+  sprintf(name, "t%d.mem", id);
+  mem = mem_create(name);
+  mem_init(mem);
+  ld_load_prog(argv[0], argc, argv, envp, &regs, mem, TRUE);
+
+  if (infile)
+    {
+#ifndef _MSC_VER
+      threads[id].stdin_fd = open(infile, O_RDONLY);
+      if (threads[id].stdin_fd < 0)
+#endif /* !_MSC_VER */
+	fatal("cannot open SMT thread %d input `%s'", id, infile);
+    }
+
+  tracer_init();
+  fetch_init();
+  cv_init();
+  last_op = RSLINK_NULL;
+  lsq_st_index = calloc(2*LSQ_size, sizeof(struct RS_ref));
+  if (!lsq_st_index)
+    fatal("out of virtual memory");
+  if (pred && pred->retstack.size)
+    {
+      pred->retstack.stack =
+	calloc(pred->retstack.size, sizeof(struct bpred_btb_ent_t));
+      if (!pred->retstack.stack)
+	fatal("out of virtual memory");
+      pred->retstack.tos = pred->retstack.size - 1;
+    }
+
+  thread_switch(0);
+}
+
+/* execute system call INST of the current SMT thread or CMP core, an
+   exit() ends only the thread, reads from stdin read the thread's input
+   file; CMP cores take turns, as they share SIM_EXIT_BUF and stdin */
+static void
+smt_syscall(md_inst_t inst)			/* system call inst */
+{
+  struct thread_t *t = &threads[cur_thread];
+  jmp_buf exit_buf;
+  volatile int saved_stdin = -1;
+
+  CMP_LOCK(cmp_sys_lock);
+
+  /* catch the thread's exit() */
+  memcpy(exit_buf, sim_exit_buf, sizeof(jmp_buf));
+  if (setjmp(sim_exit_buf) != 0)
+    {
+      t->exited = TRUE;
+      if (cmp_ncores > 1)
+	fprintf(stderr, "sim: ** core %d exited @ cycle %.0f **\n",
+		core_id, (double)sim_cycle);
+      else
+	fprintf(stderr, "sim: ** thread %d exited @ cycle %.0f **\n",
+		cur_thread, (double)sim_cycle);
+    }
+  else
+    {
+#ifndef _MSC_VER
+      if (t->stdin_fd)
+	{
+	  saved_stdin = dup(0);
+	  dup2(t->stdin_fd, 0);
+	}
+#endif /* !_MSC_VER */
+      sys_syscall(&regs, mem_access, mem, inst, TRUE);
+    }
+
+#ifndef _MSC_VER
+  if (saved_stdin >= 0)
+    {
+      dup2(saved_stdin, 0);
+      close(saved_stdin);
+    }
+#endif /* !_MSC_VER */
+  memcpy(sim_exit_buf, exit_buf, sizeof(jmp_buf));
+
+  CMP_UNLOCK(cmp_sys_lock);
+}
+
+/* register the per-thread statistics of an SMT run */
+static void
+smt_reg_stats(struct stat_sdb_t *sdb)		/* stats database */
+{
+  int i;
+  char buf[512], buf1[512];
+
+  for (i=0; i < smt_nthreads; i++)
+    {
+      sprintf(buf, "t%d.sim_num_insn", i);
+      stat_reg_counter(sdb, buf, "total number of instructions committed",
+		       &threads[i].sim_num_insn, 0, NULL);
+      sprintf(buf, "t%d.sim_num_refs", i);
+      stat_reg_counter(sdb, buf, "total number of loads and stores committed",
+		       &threads[i].sim_num_refs, 0, NULL);
+      sprintf(buf, "t%d.sim_num_loads", i);
+      stat_reg_counter(sdb, buf, "total number of loads committed",
+		       &threads[i].sim_num_loads, 0, NULL);
+      sprintf(buf, "t%d.sim_num_branches", i);
+      stat_reg_counter(sdb, buf, "total number of branches committed",
+		       &threads[i].sim_num_branches, 0, NULL);
+      sprintf(buf, "t%d.sim_IPC", i);
+      sprintf(buf1, "t%d.sim_num_insn / sim_cycle", i);
+      stat_reg_formula(sdb, buf, "instructions per cycle", buf1, NULL);
+    }
+
+  for (i=1; i < smt_nthreads; i++)
+    mem_reg_stats(threads[i].mem, sdb);
+}
+
+/* dispatch up to WIDTH instructions of the current thread from the IFETCH
+   -> DISPATCH queue: instructions are first decoded, then they allocated RUU
+   (and LSQ for load/stores) resources and input and output dependence chains
+   are updated accordingly, returns the number of instructions dispatched */
+static int
+ruu_dispatch_thread(int width)			/* decode B/W left */
+{
+  int i;
+  int n_dispatched;			/* total insts dispatched */
+  md_inst_t inst;			/* actual instruction bits */
+  enum md_opcode op;			/* decoded opcode enum */
+  int out1, out2, in1, in2, in3;	/* output/input register names */
+  int iq = -1, nregs[PRF_NUM];		/* -backend prf issue queue and
+					   physical registers needed */
+  md_addr_t target_PC;			/* actual next/target PC address */
+  md_addr_t addr;			/* effective address, if load/store */
+  struct RUU_station *rs;		/* RUU station being allocated */
+  struct RUU_station *lsq;		/* LSQ station for ld/st's */
+  struct bpred_update_t *dir_update_ptr;/* branch predictor dir update ptr */
+  int stack_recover_idx;		/* bpred retstack recovery index */
+  unsigned int pseq;			/* pipetrace sequence number */
+  int is_write;				/* store? */
+  int made_check;			/* used to ensure DLite entry */
+  int br_taken, br_pred_taken;		/* if br, taken?  predicted taken? */
+  int fetch_redirected = FALSE;
+  byte_t temp_byte = 0;			/* temp variable for spec mem access */
+  half_t temp_half = 0;			/* " ditto " */
+  word_t temp_word = 0;			/* " ditto " */
 #ifdef HOST_HAS_QWORD
   qword_t temp_qword = 0;		/* " ditto " */
 #endif /* HOST_HAS_QWORD */
@@ -3727,13 +5854,17 @@ ruu_dispatch(void)
   made_check = FALSE;
   n_dispatched = 0;
   while (/* instruction decode B/W left? */
-	 n_dispatched < (ruu_decode_width * fetch_speed)
+	 n_dispatched < width
 	 /* RUU and LSQ not full? */
 	 && RUU_num < RUU_size && LSQ_num < LSQ_size
 	 /* insts still available from fetch unit? */
 	 && fetch_num != 0
 	 /* on an acceptable trace path */
-	 && (ruu_include_spec || !spec_mode))
+	 && (ruu_include_spec || !spec_mode)
+	 /* thread has not exited? */
+	 && !threads[cur_thread].exited
+	 /* not draining for sampled simulation? */
+	 && !sample_drain)
     {
       /* if issuing in-order, block until last op issues if inorder issue */
       if (ruu_inorder_issue
@@ -3761,7 +5892,7 @@ ruu_dispatch(void)
       /* drain RUU for TRAPs and system calls */
       if (MD_OP_FLAGS(op) & F_TRAP)
 	{
-	  if (RUU_num != 0)
+	  if (threads[cur_thread].ruu_num != 0)
 	    break;
 
 	  /* else, syscall is only instruction in the machine, at this
@@ -3770,6 +5901,29 @@ ruu_dispatch(void)
 	    panic("drained and speculative");
 	}
 
+      /* with -backend prf, the inst needs an entry in its issue queue and
+	 a free physical register for each result */
+      if (backend_prf && op != MD_NOP_OP)
+	{
+	  iq = IQ_OF(op);
+	  if (IQ_num[iq] == IQ_size[iq])
+	    {
+	      backend_stall |= (1 << STALL_IQ(iq));
+	      break;
+	    }
+	  backend_regs(inst, op, nregs);
+	  if (nregs[PRF_INT] > PRF_free[PRF_INT])
+	    {
+	      backend_stall |= (1 << STALL_PRF(PRF_INT));
+	      break;
+	    }
+	  if (nregs[PRF_FP] > PRF_free[PRF_FP])
+	    {
+	      backend_stall |= (1 << STALL_PRF(PRF_FP));
+	      break;
+	    }
+	}
+
       /* maintain $r0 semantics (in spec and non-spec space) */
       regs.regs_R[MD_REG_ZERO] = 0; spec_regs_R[MD_REG_ZERO] = 0;
 #ifdef TARGET_ALPHA
@@ -3779,7 +5933,8 @@ ruu_dispatch(void)
       if (!spec_mode)
 	{
 	  /* one more non-speculative instruction executed */
-	  sim_num_insn++;
+	  CORE_NUM_INSN++;
+	  threads[cur_thread].sim_num_insn++;
 	}
 
       /* default effective address (none) and access */
@@ -3836,7 +5991,7 @@ ruu_dispatch(void)
       if (!spec_mode && verbose)
         {
           myfprintf(stderr, "++ %10n [xor: 0x%08x] {%d} @ 0x%08p: ",
-                    sim_num_insn, md_xor_regs(&regs),
+                    CORE_NUM_INSN, md_xor_regs(&regs),
                     inst_seq+1, regs.regs_PC);
           md_print_insn(inst, regs.regs_PC, stderr);
           fprintf(stderr, "\n");
@@ -3852,7 +6007,10 @@ ruu_dispatch(void)
 	{
 	  sim_total_refs++;
 	  if (!spec_mode)
-	    sim_num_refs++;
+	    {
+	      sim_num_refs++;
+	      threads[cur_thread].sim_num_refs++;
+	    }
 
 	  if (MD_OP_FLAGS(op) & F_STORE)
 	    is_write = TRUE;
@@ -3860,7 +6018,10 @@ ruu_dispatch(void)
 	    {
 	      sim_total_loads++;
 	      if (!spec_mode)
-		sim_num_loads++;
+		{
+		  sim_num_loads++;
+		  threads[cur_thread].sim_num_loads++;
+		}
 	    }
 	}
 
@@ -3887,6 +6048,7 @@ ruu_dispatch(void)
 	  fetch_head = (ruu_ifq_size-1);
 	  fetch_num = 1;
 	  fetch_tail = 0;
+	  FTQ_FLUSH();
 
 	  if (!pred_perfect)
 	    ruu_fetch_issue_delay = ruu_branch_penalty;
@@ -3919,6 +6081,8 @@ ruu_dispatch(void)
 	  rs->op = op;
 	  rs->PC = regs.regs_PC;
 	  rs->next_PC = regs.regs_NPC; rs->pred_PC = pred_PC;
+	  rs->thread = cur_thread;
+	  rs->squashed = FALSE;
 	  rs->in_LSQ = FALSE;
 	  rs->ea_comp = FALSE;
 	  rs->recover_inst = FALSE;
@@ -3931,6 +6095,21 @@ ruu_dispatch(void)
 	  rs->queued = rs->issued = rs->completed = FALSE;
 	  rs->ptrace_seq = pseq;
 
+	  /* allocate its issue queue entry and physical registers */
+	  rs->iq = -1;
+	  for (i=0; i<PRF_NUM; i++)
+	    rs->prf_regs[i] = 0;
+	  if (backend_prf)
+	    {
+	      rs->iq = iq;
+	      IQ_num[iq]++;
+	      for (i=0; i<PRF_NUM; i++)
+		{
+		  rs->prf_regs[i] = nregs[i];
+		  PRF_free[i] -= nregs[i];
+		}
+	    }
+
 	  /* split ld/st's into two operations: eff addr comp + mem access */
 	  if (MD_OP_FLAGS(op) & F_MEM)
 	    {
@@ -3945,6 +6124,8 @@ ruu_dispatch(void)
 	      lsq->op = op;
 	      lsq->PC = regs.regs_PC;
 	      lsq->next_PC = regs.regs_NPC; lsq->pred_PC = pred_PC;
+	      lsq->thread = cur_thread;
+	      lsq->squashed = FALSE;
 	      lsq->in_LSQ = TRUE;
 	      lsq->ea_comp = FALSE;
 	      lsq->recover_inst = FALSE;
@@ -3957,6 +6138,10 @@ ruu_dispatch(void)
 	      lsq->seq = ++inst_seq;
 	      lsq->queued = lsq->issued = lsq->completed = FALSE;
 	      lsq->ptrace_seq = ptrace_seq++;
+	      lsq->iq = -1;
+	      for (i=0; i<PRF_NUM; i++)
+		lsq->prf_regs[i] = 0;
+	      lsq_dispatch_mem(lsq);
 
 	      /* pipetrace this uop */
 	      ptrace_newuop(lsq->ptrace_seq, "internal ld/st", lsq->PC, 0);
@@ -3988,6 +6173,7 @@ ruu_dispatch(void)
 	      n_dispatched++;
 	      RUU_tail = (RUU_tail + 1) % RUU_size;
 	      RUU_num++;
+	      threads[cur_thread].ruu_num++;
 	      LSQ_tail = (LSQ_tail + 1) % LSQ_size;
 	      LSQ_num++;
 
@@ -3999,7 +6185,7 @@ ruu_dispatch(void)
 	      /* issue may continue when the load/store is issued */
 	      RSLINK_INIT(last_op, lsq);
 
-	      /* issue stores only, loads are issued by lsq_refresh() */
+	      /* issue stores only, loads are issued by lsq_load_ready() */
 	      if (((MD_OP_FLAGS(op) & (F_MEM|F_STORE)) == (F_MEM|F_STORE))
 		  && OPERANDS_READY(lsq))
 		{
@@ -4023,6 +6209,7 @@ ruu_dispatch(void)
 	      n_dispatched++;
 	      RUU_tail = (RUU_tail + 1) % RUU_size;
 	      RUU_num++;
+	      threads[cur_thread].ruu_num++;
 
 	      /* issue op if all its reg operands are ready (no mem input) */
 	      if (OPERANDS_READY(rs))
@@ -4062,6 +6249,7 @@ ruu_dispatch(void)
 	  if (MD_OP_FLAGS(op) & F_CTRL)
 	    {
 	      sim_num_branches++;
+	      threads[cur_thread].sim_num_branches++;
 	      if (pred && bpred_spec_update == spec_ID)
 		{
 		  bpred_update(pred,
@@ -4120,18 +6308,47 @@ ruu_dispatch(void)
       made_check = TRUE;
       if (dlite_check_break(pred_PC,
 			    is_write ? ACCESS_WRITE : ACCESS_READ,
-			    addr, sim_num_insn, sim_cycle))
+			    addr, CORE_NUM_INSN, sim_cycle))
 	dlite_main(regs.regs_PC, pred_PC, sim_cycle, &regs, mem);
     }
 
+  /* note a full ROB or LSQ that stopped dispatch, with -backend prf */
+  if (backend_prf && n_dispatched < width && fetch_num != 0)
+    {
+      if (RUU_num == RUU_size)
+	backend_stall |= (1 << STALL_ROB);
+      else if (LSQ_num == LSQ_size)
+	backend_stall |= (1 << STALL_LSQ);
+    }
+
   /* need to enter DLite at least once per cycle */
   if (!made_check)
     {
       if (dlite_check_break(/* no next PC */0,
 			    is_write ? ACCESS_WRITE : ACCESS_READ,
-			    addr, sim_num_insn, sim_cycle))
+			    addr, CORE_NUM_INSN, sim_cycle))
 	dlite_main(regs.regs_PC, /* no next PC */0, sim_cycle, &regs, mem);
     }
+
+  return n_dispatched;
+}
+
+/* decode and dispatch instructions, the SMT threads share the decode B/W,
+   the first thread to dispatch from changes every cycle */
+static void
+ruu_dispatch(void)
+{
+  int i, id, width = ruu_decode_width * fetch_speed;
+
+  for (i=0; i < smt_nthreads && width > 0; i++)
+    {
+      id = (sim_cycle + i) % smt_nthreads;
+      if (threads[id].exited)
+	continue;
+
+      thread_switch(id);
+      width -= ruu_dispatch_thread(width);
+    }
 }
 
 
@@ -4153,6 +6370,27 @@ fetch_init(void)
   fetch_tail = fetch_head = 0;
   IFQ_count = 0;
   IFQ_fcount = 0;
+
+  /* allocate the fetch target queue, and the predictions of its blocks */
+  if (ftq_size)
+    {
+      int i;
+
+      ftq_block_insns = (cache_il1
+			 ? cache_il1->bsize / ISCOMPRESS(sizeof(md_inst_t))
+			 : ruu_decode_width * fetch_speed);
+      ftq = calloc(ftq_size, sizeof(struct ftq_ent));
+      if (!ftq)
+	fatal("out of virtual memory");
+      for (i=0; i < ftq_size; i++)
+	{
+	  ftq[i].preds = calloc(ftq_block_insns, sizeof(struct ftq_pred));
+	  if (!ftq[i].preds)
+	    fatal("out of virtual memory");
+	}
+    }
+  ftq_num = ftq_head = ftq_off = 0;
+  lsb_start = lsb_end = 0;
 }
 
 /* dump contents of fetch stage registers and fetch queue */
@@ -4192,22 +6430,248 @@ fetch_dump(FILE *stream)			/* output stream */
     }
 }
 
-static int last_inst_missed = FALSE;
-static int last_inst_tmissed = FALSE;
+static HOST_TLS int last_inst_missed = FALSE;
+static HOST_TLS int last_inst_tmissed = FALSE;
+
+/* non-zero if PC is a valid program text address of the current thread */
+#define TEXT_PC(PC)							\
+  (ld_text_base <= (PC) && (PC) < (ld_text_base+ld_text_size)		\
+   && !((PC) & (sizeof(md_inst_t)-1)))
+
+/* I-cache line of PC, fetch blocks do not cross lines */
+#define FTQ_LINE(PC)							\
+  (cache_il1 ? (IACOMPRESS(PC) & ~cache_il1->blk_mask) : 0)
 
-/* fetch up as many instruction as one branch prediction and one cache line
-   acess will support without overflowing the IFETCH -> DISPATCH QUEUE */
+/* predict up to FTQ_BLOCKS fetch blocks of the current thread into the
+   fetch target queue, running ahead of fetch from FETCH_PRED_PC, and
+   prefetch their I-cache lines */
 static void
-ruu_fetch(void)
+ftq_predict(void)
+{
+  int n, taken;
+  md_addr_t PC, addr;
+  md_inst_t inst;
+  enum md_opcode op;
+  struct ftq_ent *ent;
+  struct ftq_pred *p;
+
+  for (n=0; n < ftq_blocks && ftq_num < ftq_size; n++)
+    {
+      ent = &ftq[(ftq_head + ftq_num) % ftq_size];
+      ent->PC = PC = fetch_pred_PC;
+      ent->ninsn = 0;
+
+      /* add insts up to a predicted taken branch or the end of the line */
+      do
+	{
+	  p = &ent->preds[ent->ninsn++];
+	  p->stack_recover_idx = 0;
+
+	  /* only use branch predictor result for branches (assumes pre-decode
+	     bits); NOTE: returned value may be 1 if bpred can only predict a
+	     direction */
+	  fetch_pred_PC = 0;
+	  if (pred && TEXT_PC(PC))
+	    {
+	      MD_FETCH_INST(inst, mem, PC);
+	      MD_SET_OPCODE(op, inst);
+	      if (MD_OP_FLAGS(op) & F_CTRL)
+		fetch_pred_PC =
+		  bpred_lookup(pred,
+			       /* branch address */PC,
+			       /* target address *//* FIXME: not computed */0,
+			       /* opcode */op,
+			       /* call? */MD_IS_CALL(op),
+			       /* return? */MD_IS_RETURN(op),
+			       /* updt */&p->dir_update,
+			       /* RSB index */&p->stack_recover_idx);
+	    }
+
+	  /* no predicted taken target, attempt not taken target */
+	  taken = (fetch_pred_PC != 0);
+	  if (!taken)
+	    fetch_pred_PC = PC + sizeof(md_inst_t);
+	  p->pred_PC = fetch_pred_PC;
+
+	  PC += sizeof(md_inst_t);
+	}
+      while (!taken
+	     && ent->ninsn < ftq_block_insns
+	     && FTQ_LINE(PC) == FTQ_LINE(ent->PC));
+
+      ftq_num++;
+      ftq_predicted++;
+
+      /* start the I-cache fill of the block, if it misses */
+      if (cache_il1 && ftq_prefetch && TEXT_PC(ent->PC))
+	{
+	  addr = THREAD_ADDR(cur_thread, IACOMPRESS(ent->PC));
+	  if (!cache_probe(cache_il1, addr))
+	    {
+	      cache_prefetch(cache_il1, addr, sim_cycle);
+	      ftq_prefetches++;
+	    }
+	}
+    }
+}
+
+/* fetch up to WIDTH instructions of the current thread from the blocks in
+   the fetch target queue, one I-cache access per block and up to
+   FTQ_BLOCKS of them, blocks in the loop stream buffer bypass the I-cache,
+   returns the number fetched */
+static int
+ftq_fetch(int width)				/* fetch B/W left */
+{
+  int i = 0, nblocks = 0, lat, tlb_lat, in_lsb;
+  md_addr_t PC, last_PC;
+  md_inst_t inst;
+  struct ftq_ent *ent;
+  struct ftq_pred *p;
+
+  while (i < width && fetch_num < ruu_ifq_size && ftq_num != 0)
+    {
+      ent = &ftq[ftq_head];
+      last_PC = ent->PC + (ent->ninsn - 1) * sizeof(md_inst_t);
+      in_lsb = (lsb_end && lsb_start <= ent->PC && last_PC <= lsb_end);
+
+      if (!in_lsb)
+	{
+	  if (nblocks == ftq_blocks)
+	    break;
+	  nblocks++;
+
+	  PC = ent->PC + ftq_off * sizeof(md_inst_t);
+	  if (TEXT_PC(PC))
+	    {
+	      lat = cache_il1_lat;
+	      cache_access_PC = PC;
+	      if (cache_il1)
+		{
+		  /* access the I-cache */
+		  lat =
+		    cache_access(cache_il1, Read,
+				 THREAD_ADDR(cur_thread, IACOMPRESS(PC)),
+				 NULL, ISCOMPRESS(sizeof(md_inst_t)), sim_cycle,
+				 NULL, NULL, 0);
+		  if (lat > cache_il1_lat)
+		    last_inst_missed = TRUE;
+		}
+
+	      if (itlb)
+		{
+		  /* access the I-TLB, NOTE: this code will initiate
+		     speculative TLB misses */
+		  tlb_lat =
+		    cache_access(itlb, Read,
+				 THREAD_ADDR(cur_thread, IACOMPRESS(PC)),
+				 NULL, ISCOMPRESS(sizeof(md_inst_t)), sim_cycle,
+				 NULL, NULL, 0);
+		  if (tlb_lat > 1)
+		    last_inst_tmissed = TRUE;
+
+		  /* I-cache/I-TLB accesses occur in parallel */
+		  lat = MAX(tlb_lat, lat);
+		}
+
+	      /* I-cache/I-TLB miss? assumes I-cache hit >= I-TLB hit */
+	      if (lat != cache_il1_lat && fetch_miss_PC != PC)
+		{
+		  /* I-cache miss, block fetch until it is resolved */
+		  ruu_fetch_issue_delay += lat - 1;
+		  fetch_miss_PC = PC;
+		  break;
+		}
+	      /* else, I-cache/I-TLB hit, or the fill of the last miss */
+	      fetch_miss_PC = 0;
+	    }
+	}
+
+      /* move the block's insts to the IFETCH -> DISPATCH queue */
+      for (; (ftq_off < ent->ninsn
+	      && i < width && fetch_num < ruu_ifq_size); ftq_off++, i++)
+	{
+	  fetch_regs_PC = ent->PC + ftq_off * sizeof(md_inst_t);
+	  p = &ent->preds[ftq_off];
+
+	  /* bogus text addresses (can happen on mis-spec path) send NOPs */
+	  if (TEXT_PC(fetch_regs_PC))
+	    {
+	      MD_FETCH_INST(inst, mem, fetch_regs_PC);
+	    }
+	  else
+	    inst = MD_NOP_INST;
+
+	  fetch_data[fetch_tail].IR = inst;
+	  fetch_data[fetch_tail].regs_PC = fetch_regs_PC;
+	  fetch_data[fetch_tail].pred_PC = p->pred_PC;
+	  fetch_data[fetch_tail].dir_update = p->dir_update;
+	  fetch_data[fetch_tail].stack_recover_idx = p->stack_recover_idx;
+	  fetch_data[fetch_tail].ptrace_seq = ptrace_seq++;
+
+	  /* for pipe trace */
+	  ptrace_newinst(fetch_data[fetch_tail].ptrace_seq,
+			 inst, fetch_data[fetch_tail].regs_PC,
+			 0);
+	  ptrace_newstage(fetch_data[fetch_tail].ptrace_seq,
+			  PST_IFETCH,
+			  ((last_inst_missed ? PEV_CACHEMISS : 0)
+			   | (last_inst_tmissed ? PEV_TLBMISS : 0)));
+	  last_inst_missed = FALSE;
+	  last_inst_tmissed = FALSE;
+
+	  /* adjust instruction fetch queue */
+	  fetch_tail = (fetch_tail + 1) & (ruu_ifq_size - 1);
+	  fetch_num++;
+
+	  if (in_lsb)
+	    lsb_insn++;
+	}
+
+      /* rest of the block is fetched next cycle */
+      if (ftq_off < ent->ninsn)
+	break;
+
+      /* a small loop closed by a predicted taken backward branch at the end
+	 of the block goes into the loop stream buffer */
+      p = &ent->preds[ent->ninsn - 1];
+      if (lsb_size
+	  && p->pred_PC != last_PC + sizeof(md_inst_t)
+	  && p->pred_PC <= last_PC
+	  && (last_PC - p->pred_PC) / sizeof(md_inst_t) < lsb_size
+	  && (p->pred_PC != lsb_start || last_PC != lsb_end))
+	{
+	  lsb_start = p->pred_PC;
+	  lsb_end = last_PC;
+	  lsb_captures++;
+	}
+
+      /* release the FTQ entry */
+      ftq_head = (ftq_head + 1) % ftq_size;
+      ftq_num--;
+      ftq_off = 0;
+    }
+
+  return i;
+}
+
+/* fetch up to WIDTH instructions of the current thread, as many as one
+   branch prediction and one cache line acess will support without
+   overflowing the IFETCH -> DISPATCH QUEUE, returns the number fetched */
+static int
+ruu_fetch_thread(int width)			/* fetch B/W left */
 {
   int i, lat, tlb_lat, done = FALSE;
   md_inst_t inst;
   int stack_recover_idx;
   int branch_cnt;
 
+  /* fetch from the fetch target queue, if the front end is decoupled */
+  if (ftq_size)
+    return ftq_fetch(width);
+
   for (i=0, branch_cnt=0;
        /* fetch up to as many instruction as the DISPATCH stage can decode */
-       i < (ruu_decode_width * fetch_speed)
+       i < width
        /* fetch until IFETCH -> DISPATCH queue fills */
        && fetch_num < ruu_ifq_size
        /* and no IFETCH blocking condition encountered */
@@ -4227,13 +6691,16 @@ ruu_fetch(void)
 
 	  /* address is within program text, read instruction from memory */
 	  lat = cache_il1_lat;
+	  cache_access_PC = fetch_regs_PC;
 	  if (cache_il1)
 	    {
 	      /* access the I-cache */
 	      lat =
-		cache_access(cache_il1, Read, IACOMPRESS(fetch_regs_PC),
+		cache_access(cache_il1, Read,
+			     THREAD_ADDR(cur_thread,
+					 IACOMPRESS(fetch_regs_PC)),
 			     NULL, ISCOMPRESS(sizeof(md_inst_t)), sim_cycle,
-			     NULL, NULL);
+			     NULL, NULL, 0);
 	      if (lat > cache_il1_lat)
 		last_inst_missed = TRUE;
 	    }
@@ -4243,9 +6710,11 @@ ruu_fetch(void)
 	      /* access the I-TLB, NOTE: this code will initiate
 		 speculative TLB misses */
 	      tlb_lat =
-		cache_access(itlb, Read, IACOMPRESS(fetch_regs_PC),
+		cache_access(itlb, Read,
+			     THREAD_ADDR(cur_thread,
+					 IACOMPRESS(fetch_regs_PC)),
 			     NULL, ISCOMPRESS(sizeof(md_inst_t)), sim_cycle,
-			     NULL, NULL);
+			     NULL, NULL, 0);
 	      if (tlb_lat > 1)
 		last_inst_tmissed = TRUE;
 
@@ -4254,13 +6723,15 @@ ruu_fetch(void)
 	    }
 
 	  /* I-cache/I-TLB miss? assumes I-cache hit >= I-TLB hit */
-	  if (lat != cache_il1_lat)
+	  if (lat != cache_il1_lat && fetch_miss_PC != fetch_regs_PC)
 	    {
 	      /* I-cache miss, block fetch until it is resolved */
 	      ruu_fetch_issue_delay += lat - 1;
+	      fetch_miss_PC = fetch_regs_PC;
 	      break;
 	    }
-	  /* else, I-cache/I-TLB hit */
+	  /* else, I-cache/I-TLB hit, or the fill of the last miss */
+	  fetch_miss_PC = 0;
 	}
       else
 	{
@@ -4337,6 +6808,73 @@ ruu_fetch(void)
       fetch_tail = (fetch_tail + 1) & (ruu_ifq_size - 1);
       fetch_num++;
     }
+
+  return i;
+}
+
+/* instructions of SMT thread ID in the front end and RUU */
+#define THREAD_ICOUNT(ID)						\
+  (threads[ID].ruu_num							\
+   + ((ID) == cur_thread ? fetch_num : threads[ID].fetch_num))
+
+/* call the instruction fetch unit of each thread that is not blocked, in
+   the order of the SMT fetch policy, the threads share the fetch B/W, up
+   to SMT_FETCH_THREADS of them per cycle */
+static void
+ruu_fetch(void)
+{
+  int i, j, id, order[MAX_THREADS], nfetch = 0;
+  int width = ruu_decode_width * fetch_speed;
+
+  if (smt_nthreads == 1)
+    {
+      /* call instruction fetch unit if it is not blocked */
+      if (!ruu_fetch_issue_delay)
+	ruu_fetch_thread(width);
+      else
+	ruu_fetch_issue_delay--;
+
+      /* the branch predictor runs ahead, even while fetch is blocked */
+      if (ftq_size)
+	ftq_predict();
+      return;
+    }
+
+  /* round robin, starting from a different thread every cycle */
+  for (i=0; i < smt_nthreads; i++)
+    order[i] = (sim_cycle + i) % smt_nthreads;
+
+  /* icount, the threads with the fewest instructions in the front end and
+     RUU go first */
+  if (!mystricmp(smt_fetch_policy, "icount"))
+    {
+      for (i=1; i < smt_nthreads; i++)
+	{
+	  id = order[i];
+	  for (j=i; j > 0 && THREAD_ICOUNT(order[j-1]) > THREAD_ICOUNT(id); j--)
+	    order[j] = order[j-1];
+	  order[j] = id;
+	}
+    }
+
+  for (i=0; i < smt_nthreads; i++)
+    {
+      id = order[i];
+      if (threads[id].exited)
+	continue;
+
+      thread_switch(id);
+      if (ruu_fetch_issue_delay)
+	ruu_fetch_issue_delay--;
+      else if (width > 0 && nfetch < smt_fetch_threads
+	       && fetch_num < ruu_ifq_size)
+	{
+	  width -= ruu_fetch_thread(width);
+	  nfetch++;
+	}
+      if (ftq_size)
+	ftq_predict();
+    }
 }
 
 /* default machine state accessor, used by DLite */
@@ -4421,186 +6959,1283 @@ simoo_mstate_obj(FILE *stream,			/* output stream */
 }
 
 
-/* start simulation, program loaded, processor precise state initialized */
-void
-sim_main(void)
+/* I-cache block of the last instruction warmed */
+static HOST_TLS md_addr_t warm_iblk = 0;
+
+/* warm the caches, TLBs and branch predictor with the functionally executed
+   instruction INST (opcode OP) at PC, with next PC NPC and effective address
+   ADDR for loads and stores, returns its latency on an in-order core that waits for
+   every miss, which keeps the memory system's timing in step with the
+   clock */
+static unsigned int				/* latency of the inst */
+sim_warm(md_inst_t inst,			/* inst bits */
+	 enum md_opcode op,			/* opcode */
+	 md_addr_t PC,				/* inst address */
+	 md_addr_t NPC,				/* next inst address */
+	 md_addr_t addr)			/* effective address */
 {
-  /* ignore any floating point exceptions, they may occur on mis-speculated
-     execution paths */
-  signal(SIGFPE, SIG_IGN);
-
-  /* set up program entry state */
-  regs.regs_PC = ld_prog_entry;
-  regs.regs_NPC = regs.regs_PC + sizeof(md_inst_t);
-
-  /* check for DLite debugger entry condition */
-  if (dlite_check_break(regs.regs_PC, /* no access */0, /* addr */0, 0, 0))
-    dlite_main(regs.regs_PC, regs.regs_PC + sizeof(md_inst_t),
-	       sim_cycle, &regs, mem);
-
-  /* fast forward simulator loop, performs functional simulation for
-     FASTFWD_COUNT insts, then turns on performance (timing) simulation */
-  if (fastfwd_count > 0)
-    {
-      int icount;
-      md_inst_t inst;			/* actual instruction bits */
-      enum md_opcode op;		/* decoded opcode enum */
-      md_addr_t target_PC;		/* actual next/target PC address */
-      md_addr_t addr;			/* effective address, if load/store */
-      int is_write;			/* store? */
-      byte_t temp_byte = 0;		/* temp variable for spec mem access */
-      half_t temp_half = 0;		/* " ditto " */
-      word_t temp_word = 0;		/* " ditto " */
-#ifdef HOST_HAS_QWORD
-      qword_t temp_qword = 0;		/* " ditto " */
-#endif /* HOST_HAS_QWORD */
-      enum md_fault_type fault;
+  unsigned int ilat = 0, dlat = 0, tlb_lat;
+  md_addr_t iaddr = THREAD_ADDR(cur_thread, IACOMPRESS(PC));
+  md_addr_t daddr = THREAD_ADDR(cur_thread, addr & ~3);
+  struct bpred_update_t dir_update;
+  md_addr_t bpred_PC;
+  int stack_idx;
 
-      fprintf(stderr, "sim: ** fast forwarding %d insts **\n", fastfwd_count);
+  cache_access_PC = PC;
 
-      for (icount=0; icount < fastfwd_count; icount++)
+  /* instruction fetch, once per I-cache block */
+  if (cache_il1 && (iaddr & ~cache_il1->blk_mask) != warm_iblk)
+    {
+      warm_iblk = iaddr & ~cache_il1->blk_mask;
+      ilat = cache_access(cache_il1, Read, iaddr, NULL,
+			  ISCOMPRESS(sizeof(md_inst_t)), sim_cycle,
+			  NULL, NULL, 0) - cache_il1_lat;
+      if (itlb)
 	{
-	  /* maintain $r0 semantics */
-	  regs.regs_R[MD_REG_ZERO] = 0;
-#ifdef TARGET_ALPHA
-	  regs.regs_F.d[MD_REG_ZERO] = 0.0;
-#endif /* TARGET_ALPHA */
+	  tlb_lat = cache_access(itlb, Read, iaddr, NULL,
+				 ISCOMPRESS(sizeof(md_inst_t)), sim_cycle,
+				 NULL, NULL, 0) - 1;
+	  ilat = MAX(ilat, tlb_lat);
+	}
+    }
 
-	  /* get the next instruction to execute */
-	  MD_FETCH_INST(inst, mem, regs.regs_PC);
+  /* data access, stores retire into the write buffer */
+  if ((MD_OP_FLAGS(op) & F_MEM) && MD_VALID_ADDR(addr))
+    {
+      if (cache_dl1)
+	dlat = cache_access(cache_dl1,
+			    (MD_OP_FLAGS(op) & F_STORE) ? Write : Read,
+			    daddr, NULL, 4, sim_cycle + ilat,
+			    NULL, NULL, 0) - cache_dl1_lat;
+      if (dtlb)
+	{
+	  tlb_lat = cache_access(dtlb, Read, daddr, NULL, 4,
+				 sim_cycle + ilat, NULL, NULL, 0) - 1;
+	  dlat = MAX(dlat, tlb_lat);
+	}
+      if (MD_OP_FLAGS(op) & F_STORE)
+	dlat = 0;
+    }
 
-	  /* set default reference address */
-	  addr = 0; is_write = FALSE;
+  /* branch prediction, looked up and updated at once */
+  if (pred && (MD_OP_FLAGS(op) & F_CTRL))
+    {
+      bpred_PC = bpred_lookup(pred, PC, /* target */0, op,
+			      MD_IS_CALL(op), MD_IS_RETURN(op),
+			      &dir_update, &stack_idx);
+      if (!bpred_PC)
+	bpred_PC = PC + sizeof(md_inst_t);
+      bpred_update(pred, PC, NPC,
+		   /* taken? */NPC != (PC + sizeof(md_inst_t)),
+		   /* pred taken? */bpred_PC != (PC + sizeof(md_inst_t)),
+		   /* correct pred? */bpred_PC == NPC,
+		   op, &dir_update);
+    }
 
-	  /* set default fault - none */
-	  fault = md_fault_none;
+  return 1 + ilat + dlat;
+}
 
-	  /* decode the instruction */
-	  MD_SET_OPCODE(op, inst);
+/* the fast forward loop has no use for branch targets */
+#undef  SET_TPC
+#define SET_TPC(EXPR)		(void)0
 
-	  /* execute the instruction */
-	  switch (op)
-	    {
-#define DEFINST(OP,MSK,NAME,OPFORM,RES,FLAGS,O1,O2,I1,I2,I3)		\
-	    case OP:							\
-	      SYMCAT(OP,_IMPL);						\
-	      break;
-#define DEFLINK(OP,MSK,NAME,MASK,SHIFT)					\
-	    case OP:							\
-	      panic("attempted to execute a linking opcode");
+/* functionally simulate COUNT instructions of the current thread, to fast
+   forward it to the point of interest, warming the caches, TLBs and
+   branch predictor if WARM */
+static void
+sim_fastfwd(int count,				/* insts to fast forward */
+	    int warm)				/* warm the caches? */
+{
+  unsigned int lat;
+  int icount;
+  md_inst_t inst;			/* actual instruction bits */
+  enum md_opcode op;			/* decoded opcode enum */
+  md_addr_t addr;			/* effective address, if load/store */
+  int is_write;				/* store? */
+  byte_t temp_byte = 0;			/* temp variable for spec mem access */
+  half_t temp_half = 0;			/* " ditto " */
+  word_t temp_word = 0;			/* " ditto " */
+#if defined(HOST_HAS_QWORD) && defined(TARGET_ALPHA)
+  qword_t temp_qword = 0;		/* " ditto " */
+#endif /* HOST_HAS_QWORD && TARGET_ALPHA */
+  enum md_fault_type fault;
+
+  for (icount=0; icount < count && !threads[cur_thread].exited; icount++)
+    {
+      /* maintain $r0 semantics */
+      regs.regs_R[MD_REG_ZERO] = 0;
+#ifdef TARGET_ALPHA
+      regs.regs_F.d[MD_REG_ZERO] = 0.0;
+#endif /* TARGET_ALPHA */
+
+      /* get the next instruction to execute */
+      MD_FETCH_INST(inst, mem, regs.regs_PC);
+
+      /* set default reference address */
+      addr = 0; is_write = FALSE;
+
+      /* set default fault - none */
+      fault = md_fault_none;
+
+      /* decode the instruction */
+      MD_SET_OPCODE(op, inst);
+
+      /* execute the instruction */
+      switch (op)
+	{
+#define DEFINST(OP,MSK,NAME,OPFORM,RES,FLAGS,O1,O2,I1,I2,I3)		\
+	case OP:							\
+	  SYMCAT(OP,_IMPL);						\
+	  break;
+#define DEFLINK(OP,MSK,NAME,MASK,SHIFT)					\
+	case OP:							\
+	  panic("attempted to execute a linking opcode");
 #define CONNECT(OP)
 #undef DECLARE_FAULT
 #define DECLARE_FAULT(FAULT)						\
-	      { fault = (FAULT); break; }
+	  { fault = (FAULT); break; }
 #include "machine.def"
-	    default:
-	      panic("attempted to execute a bogus opcode");
-	    }
+	default:
+	  panic("attempted to execute a bogus opcode");
+	}
+
+      if (fault != md_fault_none)
+	fatal("fault (%d) detected @ 0x%08p", fault, regs.regs_PC);
 
-	  if (fault != md_fault_none)
-	    fatal("fault (%d) detected @ 0x%08p", fault, regs.regs_PC);
+      /* update memory access stats */
+      if (MD_OP_FLAGS(op) & F_MEM)
+	{
+	  if (MD_OP_FLAGS(op) & F_STORE)
+	    is_write = TRUE;
+	}
 
-	  /* update memory access stats */
-	  if (MD_OP_FLAGS(op) & F_MEM)
-	    {
-	      if (MD_OP_FLAGS(op) & F_STORE)
-		is_write = TRUE;
-	    }
+      /* warm the microarchitectural state, charging the clock */
+      if (warm)
+	{
+	  lat = sim_warm(inst, op, regs.regs_PC, regs.regs_NPC, addr);
+	  sim_cycle += lat;
+	  sim_warm_cycle += lat;
+	}
 
-	  /* check for DLite debugger entry condition */
-	  if (dlite_check_break(regs.regs_NPC,
-				is_write ? ACCESS_WRITE : ACCESS_READ,
-				addr, sim_num_insn, sim_num_insn))
-	    dlite_main(regs.regs_PC, regs.regs_NPC, sim_num_insn, &regs, mem);
+      /* check for DLite debugger entry condition */
+      if (dlite_check_break(regs.regs_NPC,
+			    is_write ? ACCESS_WRITE : ACCESS_READ,
+			    addr, CORE_NUM_INSN, CORE_NUM_INSN))
+	dlite_main(regs.regs_PC, regs.regs_NPC, CORE_NUM_INSN, &regs, mem);
+
+      /* go to the next instruction */
+      regs.regs_PC = regs.regs_NPC;
+      regs.regs_NPC += sizeof(md_inst_t);
+      sim_func_insn++;
+    }
+}
+
+/* set up the entry state of each thread of the current core, thread 0
+   last, fast forwarding them if asked to */
+static void
+sim_enter(void)
+{
+  int i;
+
+  for (i=smt_nthreads-1; i >= 0; i--)
+    {
+      thread_switch(i);
+
+      /* set up program entry state */
+      regs.regs_PC = ld_prog_entry;
+      regs.regs_NPC = regs.regs_PC + sizeof(md_inst_t);
 
-	  /* go to the next instruction */
-	  regs.regs_PC = regs.regs_NPC;
-	  regs.regs_NPC += sizeof(md_inst_t);
+      /* check for DLite debugger entry condition */
+      if (dlite_check_break(regs.regs_PC, /* no access */0, /* addr */0, 0, 0))
+	dlite_main(regs.regs_PC, regs.regs_PC + sizeof(md_inst_t),
+		   sim_cycle, &regs, mem);
+
+      /* fast forward simulator loop, performs functional simulation for
+	 FASTFWD_COUNT insts, then turns on performance (timing) simulation */
+      if (fastfwd_count > 0)
+	{
+	  fprintf(stderr, "sim: ** fast forwarding %d insts **\n",
+		  fastfwd_count);
+	  sim_fastfwd(fastfwd_count, fastfwd_warm);
 	}
+
+      /* set up timing simulation entry state */
+      fetch_regs_PC = regs.regs_PC - sizeof(md_inst_t);
+      fetch_pred_PC = regs.regs_PC;
+      regs.regs_PC = regs.regs_PC - sizeof(md_inst_t);
     }
+}
 
-  fprintf(stderr, "sim: ** starting performance simulation **\n");
+/* simulate one cycle of the current core, NOTE: the pipe stages are
+   traverse in reverse order to eliminate this/next state synchronization
+   and relaxation problems */
+static void
+core_cycle(void)
+{
+  int i, n;
 
-  /* set up timing simulation entry state */
-  fetch_regs_PC = regs.regs_PC - sizeof(md_inst_t);
-  fetch_pred_PC = regs.regs_PC;
-  regs.regs_PC = regs.regs_PC - sizeof(md_inst_t);
+  /* RUU/LSQ sanity checks */
+  if (RUU_num < LSQ_num)
+    panic("RUU_num < LSQ_num");
+  if (((RUU_head + RUU_num) % RUU_size) != RUU_tail)
+    panic("RUU_head/RUU_tail wedged");
+  if (((LSQ_head + LSQ_num) % LSQ_size) != LSQ_tail)
+    panic("LSQ_head/LSQ_tail wedged");
 
-  /* main simulator loop, NOTE: the pipe stages are traverse in reverse order
-     to eliminate this/next state synchronization and relaxation problems */
-  for (;;)
+  /* check if pipetracing is still active */
+  ptrace_check_active(regs.regs_PC, CORE_NUM_INSN, sim_cycle);
+
+  /* indicate new cycle in pipetrace */
+  ptrace_newcycle(sim_cycle);
+
+  /* commit entries from RUU/LSQ to architected register file */
+  ruu_commit();
+
+  /* service function unit release events */
+  ruu_release_fu();
+
+  /* ==> may have ready queue entries carried over from previous cycles */
+
+  /* service result completions, also readies dependent operations */
+  /* ==> inserts operations into ready queue --> register deps resolved */
+  ruu_writeback();
+
+  if (!bugcompat_mode)
     {
-      /* RUU/LSQ sanity checks */
-      if (RUU_num < LSQ_num)
-	panic("RUU_num < LSQ_num");
-      if (((RUU_head + RUU_num) % RUU_size) != RUU_tail)
-	panic("RUU_head/RUU_tail wedged");
-      if (((LSQ_head + LSQ_num) % LSQ_size) != LSQ_tail)
-	panic("LSQ_head/LSQ_tail wedged");
+      /* issue operations ready to execute from a previous cycle */
+      /* <== drains ready queue <-- ready operations commence execution */
+      ruu_issue();
+    }
 
-      /* check if pipetracing is still active */
-      ptrace_check_active(regs.regs_PC, sim_num_insn, sim_cycle);
+  /* decode and dispatch new operations */
+  /* ==> insert ops w/ no deps or all regs ready --> reg deps resolved */
+  ruu_dispatch();
 
-      /* indicate new cycle in pipetrace */
-      ptrace_newcycle(sim_cycle);
+  if (bugcompat_mode)
+    {
+      /* issue operations ready to execute from a previous cycle */
+      /* <== drains ready queue <-- ready operations commence execution */
+      ruu_issue();
+    }
 
-      /* commit entries from RUU/LSQ to architected register file */
-      ruu_commit();
+  /* call instruction fetch unit if it is not blocked */
+  ruu_fetch();
+
+  /* update buffer occupancy stats, of all threads' fetch queues */
+  for (i=0, n=0; i < smt_nthreads; i++)
+    n += (i == cur_thread ? fetch_num : threads[i].fetch_num);
+  IFQ_count += n;
+  IFQ_fcount += ((n == smt_nthreads * ruu_ifq_size) ? 1 : 0);
+  for (i=0, n=0; ftq_size && i < smt_nthreads; i++)
+    n += (i == cur_thread ? ftq_num : threads[i].ftq_num);
+  FTQ_count += n;
+  RUU_count += RUU_num;
+  RUU_fcount += ((RUU_num == RUU_size) ? 1 : 0);
+  LSQ_count += LSQ_num;
+  LSQ_fcount += ((LSQ_num == LSQ_size) ? 1 : 0);
+
+  /* update physical register file back end stats */
+  if (backend_prf)
+    {
+      for (i=0; i < STALL_NUM; i++)
+	if (backend_stall & (1 << i))
+	  backend_stalls[i]++;
+      backend_stall = 0;
+      for (i=0; i < IQ_NUM; i++)
+	IQ_count[i] += IQ_num[i];
+      for (i=0; i < PRF_NUM; i++)
+	PRF_count[i] +=
+	  PRF_size[i] - smt_nthreads * PRF_NAMES(i) - PRF_free[i];
+    }
 
-      /* service function unit release events */
-      ruu_release_fu();
+  /* go to next cycle */
+  sim_cycle++;
+}
 
-      /* ==> may have ready queue entries carried over from previous cycles */
 
-      /* service result completions, also readies dependent operations */
-      /* ==> inserts operations into ready queue --> register deps resolved */
-      ruu_writeback();
+/*
+ * CMP cores: core 0 runs on the main host thread, the others each on a
+ * host thread of their own, all meet at a barrier every -cmp:quantum
+ * cycles, where the last one in decides whether the run goes on
+ */
 
-      if (!bugcompat_mode)
+#ifndef _MSC_VER
+/* CMP_SYNC_LOCK guards the barrier state and the cores' EXITED and DONE
+   flags, the host threads wait on CMP_SYNC_COND */
+static pthread_mutex_t cmp_sync_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cmp_sync_cond = PTHREAD_COND_INITIALIZER;
+static int cmp_sync_count = 0;		/* cores at the barrier */
+static int cmp_sync_gen = 0;		/* barrier generation */
+static int cmp_stop = FALSE;		/* simulation is over? */
+static int cmp_exit = FALSE;		/* host threads may exit? */
+
+/* apply the coherence messages to the current core's L1 D-cache */
+static void
+cmp_drain(void)
+{
+  struct core_t *c = &cores[core_id];
+  struct cmp_msgq_t q;
+  int i, status, dirty;
+
+  CMP_LOCK(cmp_mem_lock);
+  q = c->spare;
+  c->spare = c->msgq;
+  c->msgq = q;
+  c->msgq.num = 0;
+  CMP_UNLOCK(cmp_mem_lock);
+
+  for (i=0; i < c->spare.num; i++)
+    {
+      if (c->spare.msg[i].type == cmp_msg_inval)
+	dirty = cache_remove_addr(cache_dl1, c->spare.msg[i].addr,
+				  /* inval */TRUE) > 0;
+      else
 	{
-	  /* try to locate memory operations that are ready to execute */
-	  /* ==> inserts operations into ready queue --> mem deps resolved */
-	  lsq_refresh();
+	  status = cache_mark_shared(cache_dl1, c->spare.msg[i].addr,
+				     /* shared */TRUE);
+	  dirty = status >= 0 && (status & CACHE_BLK_DIRTY);
+	}
 
-	  /* issue operations ready to execute from a previous cycle */
-	  /* <== drains ready queue <-- ready operations commence execution */
-	  ruu_issue();
+      /* write back a modified block */
+      if (dirty)
+	{
+	  cache_dl1->writebacks++;
+	  dl1_access_fn(Write, c->spare.msg[i].addr, cache_dl1->bsize,
+			/* blk */NULL, sim_cycle, /* prefetch */0);
 	}
+    }
+}
 
-      /* decode and dispatch new operations */
-      /* ==> insert ops w/ no deps or all regs ready --> reg deps resolved */
-      ruu_dispatch();
+/* wait for all cores at the barrier, the last one in updates CMP_CYCLE and
+   decides whether to stop: once all programs have exited, or a core
+   reached -max:inst */
+static void
+cmp_sync(void)
+{
+  int i, gen, exited;
 
-      if (bugcompat_mode)
+  pthread_mutex_lock(&cmp_sync_lock);
+  gen = cmp_sync_gen;
+  if (++cmp_sync_count == cmp_ncores)
+    {
+      exited = TRUE;
+      for (i=0; i < cmp_ncores; i++)
 	{
-	  /* try to locate memory operations that are ready to execute */
-	  /* ==> inserts operations into ready queue --> mem deps resolved */
-	  lsq_refresh();
+	  cmp_cycle = MAX(cmp_cycle, *cores[i].cycle);
+	  if (cores[i].done)
+	    cmp_stop = TRUE;
+	  if (!cores[i].exited)
+	    exited = FALSE;
+	}
+      if (exited)
+	cmp_stop = TRUE;
 
-	  /* issue operations ready to execute from a previous cycle */
-	  /* <== drains ready queue <-- ready operations commence execution */
-	  ruu_issue();
+      cmp_sync_count = 0;
+      cmp_sync_gen++;
+      pthread_cond_broadcast(&cmp_sync_cond);
+    }
+  else
+    {
+      while (gen == cmp_sync_gen && !cmp_exit)
+	pthread_cond_wait(&cmp_sync_cond, &cmp_sync_lock);
+    }
+  pthread_mutex_unlock(&cmp_sync_lock);
+}
+
+/* run the current core a quantum at a time, until the cores stop */
+static void
+cmp_run(void)
+{
+  struct core_t *c = &cores[core_id];
+  tick_t until;
+
+  while (!cmp_stop)
+    {
+      until = cmp_cycle + cmp_quantum;
+      while (sim_cycle < until && !c->exited && !c->done)
+	{
+	  if (c->msgq.num)
+	    cmp_drain();
+
+	  core_cycle();
+
+	  c->exited = threads[0].exited;
+	  if (max_insts && CORE_NUM_INSN >= max_insts)
+	    c->done = TRUE;
 	}
+      cmp_sync();
+    }
+}
 
-      /* call instruction fetch unit if it is not blocked */
-      if (!ruu_fetch_issue_delay)
-	ruu_fetch();
-      else
-	ruu_fetch_issue_delay--;
+/* create the private caches and TLBs of the current core from the L1
+   cache and TLB options, named c<N>.<name> */
+static void
+cmp_create_caches(void)
+{
+  char name[128+16], cname[128];
+  int nsets, bsize, assoc;
+  char c;
 
-      /* update buffer occupancy stats */
-      IFQ_count += fetch_num;
-      IFQ_fcount += ((fetch_num == ruu_ifq_size) ? 1 : 0);
-      RUU_count += RUU_num;
-      RUU_fcount += ((RUU_num == RUU_size) ? 1 : 0);
-      LSQ_count += LSQ_num;
-      LSQ_fcount += ((LSQ_num == LSQ_size) ? 1 : 0);
+  sscanf(cache_dl1_opt, "%[^:]:%d:%d:%d:%c", cname, &nsets, &bsize, &assoc, &c);
+  sprintf(name, "c%d.%s", core_id, cname);
+  cache_dl1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
+			   /* usize */0, assoc, cache_char2policy(c),
+			   dl1_access_fn, /* hit lat */cache_dl1_lat,
+			   /* no prefetcher */0, 1, 1, cache_mshr[0],
+			   /* pfq */1);
+  cache_dl1->evict_fn = cmp_dl1_evict;
 
-      /* go to next cycle */
-      sim_cycle++;
+  if (!mystricmp(cache_il1_opt, "none"))
+    cache_il1 = NULL;
+  else if (!mystricmp(cache_il1_opt, "dl1"))
+    cache_il1 = cache_dl1;
+  else
+    {
+      sscanf(cache_il1_opt, "%[^:]:%d:%d:%d:%c",
+	     cname, &nsets, &bsize, &assoc, &c);
+      sprintf(name, "c%d.%s", core_id, cname);
+      cache_il1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
+			       /* usize */0, assoc, cache_char2policy(c),
+			       il1_access_fn, /* hit lat */cache_il1_lat,
+			       /* no prefetcher */0, 1, 1, cache_mshr[0],
+			       /* pfq */1);
+    }
+
+  if (!mystricmp(itlb_opt, "none"))
+    itlb = NULL;
+  else
+    {
+      sscanf(itlb_opt, "%[^:]:%d:%d:%d:%c", cname, &nsets, &bsize, &assoc, &c);
+      sprintf(name, "c%d.%s", core_id, cname);
+      itlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
+			  /* usize */sizeof(md_addr_t), assoc,
+			  cache_char2policy(c), itlb_access_fn,
+			  /* hit latency */1, /* no prefetcher */0, 1, 1,
+			  /* mshrs */0, /* pfq */0);
+    }
+
+  if (!mystricmp(dtlb_opt, "none"))
+    dtlb = NULL;
+  else
+    {
+      sscanf(dtlb_opt, "%[^:]:%d:%d:%d:%c", cname, &nsets, &bsize, &assoc, &c);
+      sprintf(name, "c%d.%s", core_id, cname);
+      dtlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
+			  /* usize */sizeof(md_addr_t), assoc,
+			  cache_char2policy(c), dtlb_access_fn,
+			  /* hit latency */1, /* no prefetcher */0, 1, 1,
+			  /* mshrs */0, /* pfq */0);
+    }
+}
+
+/* map the -cmp:shm segment into the current core's memory, over the same
+   host file in every core, so each core sees the others' stores */
+static void
+cmp_map_shm(void)
+{
+  if (cmp_shm_size > 0
+      && !mem_map_file(mem, CMP_SHM_BASE, fileno(cmp_shm_file), /* offset */0,
+		       cmp_shm_size / MD_PAGE_SIZE, /* shared */TRUE))
+    fatal("cannot map the CMP shared memory into core %d", core_id);
+}
+
+/* point core C's entry at the current host thread's core state */
+static void
+cmp_attach(struct core_t *c)			/* core to attach */
+{
+  c->il1 = cache_il1;
+  c->dl1 = cache_dl1;
+  c->itlb = itlb;
+  c->dtlb = dtlb;
+  c->mem = mem;
+  c->num_refs = &sim_num_refs;
+  c->num_loads = &sim_num_loads;
+  c->num_branches = &sim_num_branches;
+  c->cycle = &sim_cycle;
+}
+
+/* host thread of CMP core ARG, loads the core's program and runs it */
+static void *
+cmp_core(void *arg)				/* core number */
+{
+  struct core_t *c = &cores[(long)arg];
+  int argc;
+  char *argv[256], *infile, name[32];
+
+  core_id = (long)arg;
+  core_insn = &c->num_insn;
+
+  /* initialize the core, one at a time as the loader is not reentrant */
+  pthread_mutex_lock(&cmp_sys_lock);
+  pred = bpred_create_opt();
+  cmp_create_caches();
+  regs_init(&regs);
+  sprintf(name, "c%d.mem", core_id);
+  mem = mem_create(name);
+  mem_init(mem);
+
+  argc = prog_parse("-cmp:prog", cmp_progs[core_id-1], argv, N_ELT(argv),
+		    &infile);
+  core_load_prog(argv[0], argc, argv, c->envp);
+  cmp_map_shm();
+  if (infile)
+    {
+      threads[0].stdin_fd = open(infile, O_RDONLY);
+      if (threads[0].stdin_fd < 0)
+	fatal("cannot open CMP core %d input `%s'", core_id, infile);
+    }
+  cmp_attach(c);
+  pthread_mutex_unlock(&cmp_sys_lock);
+
+  sim_enter();
+  c->exited = threads[0].exited;
+
+  /* wait for the others to initialize, then for sim_main() */
+  cmp_sync();
+  cmp_sync();
+  cmp_run();
+
+  /* keep the core's thread-local state around for the stats */
+  pthread_mutex_lock(&cmp_sync_lock);
+  while (!cmp_exit)
+    pthread_cond_wait(&cmp_sync_cond, &cmp_sync_lock);
+  pthread_mutex_unlock(&cmp_sync_lock);
+
+  return NULL;
+}
+#endif /* !_MSC_VER */
+
+/* start the host threads of CMP cores 1 and up, and wait for them to
+   load their programs */
+static void
+cmp_start(char **envp)				/* program environment */
+{
+#ifndef _MSC_VER
+  long i;
+  md_addr_t addr;
+
+  cmp_bsize = cache_dl1->bsize;
+  cache_dl1->evict_fn = cmp_dl1_evict;
+  cache_dl2->evict_fn = cmp_l2_evict;
+
+  /* create the shared memory, its pages take the first frames, see
+     cmp_paddr() */
+  if (cmp_shm_size > 0)
+    {
+      cmp_shm_file = tmpfile();
+      if (!cmp_shm_file || ftruncate(fileno(cmp_shm_file), cmp_shm_size) != 0)
+	fatal("cannot create %d bytes of CMP shared memory", cmp_shm_size);
+      for (addr=CMP_SHM_BASE; addr < CMP_SHM_BASE + cmp_shm_size;
+	   addr += MD_PAGE_SIZE)
+	cmp_frame_new(addr >> MD_LOG_PAGE_SIZE);
+    }
+  cmp_map_shm();
+  cmp_attach(&cores[0]);
+
+  for (i=1; i < cmp_ncores; i++)
+    {
+      cores[i].envp = envp;
+      if (pthread_create(&cores[i].thread, NULL, cmp_core, (void *)i) != 0)
+	fatal("cannot create the host thread of CMP core %d", (int)i);
+    }
+  cmp_sync();
+#endif /* !_MSC_VER */
+}
+
+/* end the host threads of the CMP cores */
+static void
+cmp_finish(void)
+{
+#ifndef _MSC_VER
+  int i;
+
+  pthread_mutex_lock(&cmp_sync_lock);
+  cmp_exit = TRUE;
+  pthread_cond_broadcast(&cmp_sync_cond);
+  pthread_mutex_unlock(&cmp_sync_lock);
+
+  for (i=1; i < cmp_ncores; i++)
+    pthread_join(cores[i].thread, NULL);
+#endif /* !_MSC_VER */
+}
+
+/* register the per-core and chip statistics of a CMP run */
+static void
+cmp_reg_stats(struct stat_sdb_t *sdb)		/* stats database */
+{
+  int i;
+  char buf[512], buf1[512], *p;
+
+  for (i=1; i < cmp_ncores; i++)
+    {
+      sprintf(buf, "c%d.sim_num_insn", i);
+      stat_reg_counter(sdb, buf, "total number of instructions committed",
+		       &cores[i].num_insn, 0, NULL);
+      sprintf(buf, "c%d.sim_num_refs", i);
+      stat_reg_counter(sdb, buf, "total number of loads and stores committed",
+		       cores[i].num_refs, 0, NULL);
+      sprintf(buf, "c%d.sim_num_loads", i);
+      stat_reg_counter(sdb, buf, "total number of loads committed",
+		       cores[i].num_loads, 0, NULL);
+      sprintf(buf, "c%d.sim_num_branches", i);
+      stat_reg_counter(sdb, buf, "total number of branches committed",
+		       cores[i].num_branches, 0, NULL);
+      sprintf(buf, "c%d.sim_cycle", i);
+      stat_reg_counter(sdb, buf, "total simulation time in cycles",
+		       cores[i].cycle, 0, NULL);
+      sprintf(buf, "c%d.sim_IPC", i);
+      sprintf(buf1, "c%d.sim_num_insn / c%d.sim_cycle", i, i);
+      stat_reg_formula(sdb, buf, "instructions per cycle", buf1, NULL);
+
+      if (cores[i].il1)
+	cache_reg_stats(cores[i].il1, sdb);
+      if (cores[i].dl1 && cores[i].dl1 != cores[i].il1)
+	cache_reg_stats(cores[i].dl1, sdb);
+      if (cores[i].itlb)
+	cache_reg_stats(cores[i].itlb, sdb);
+      if (cores[i].dtlb)
+	cache_reg_stats(cores[i].dtlb, sdb);
+      mem_reg_stats(cores[i].mem, sdb);
+    }
+
+  for (i=0, p=buf1; i < cmp_ncores; i++)
+    p += sprintf(p, i ? " + c%d.sim_num_insn" : "sim_num_insn", i);
+  stat_reg_formula(sdb, "cmp.sim_num_insn",
+		   "total number of instructions committed by all cores",
+		   buf1, "%12.0f");
+  stat_reg_counter(sdb, "cmp.sim_cycle",
+		   "total simulation time in cycles, of the slowest core",
+		   &cmp_cycle, 0, NULL);
+  stat_reg_formula(sdb, "cmp.sim_IPC",
+		   "instructions per cycle, of all cores",
+		   "cmp.sim_num_insn / cmp.sim_cycle", NULL);
+
+  stat_reg_counter(sdb, "dir.reads", "total number of L1 D-cache fills",
+		   &dir_reads, 0, NULL);
+  stat_reg_counter(sdb, "dir.forwards",
+		   "total number of fills of blocks another core owned",
+		   &dir_forwards, 0, NULL);
+  stat_reg_counter(sdb, "dir.upgrades", "total number of writes to S blocks",
+		   &dir_upgrades, 0, NULL);
+  stat_reg_counter(sdb, "dir.invalidations",
+		   "total number of copies invalidated by upgrades",
+		   &dir_invals, 0, NULL);
+  stat_reg_counter(sdb, "dir.back_invalidations",
+		   "total number of copies invalidated by L2 evictions",
+		   &dir_back_invals, 0, NULL);
+}
+
+
+/*
+ * sampled simulation: the program runs functionally, warming the caches,
+ * TLBs and branch predictor, up to each sampling unit, which runs detailed
+ * after a detailed warm-up, then the pipeline drains and the program goes
+ * on functionally; periodic (SMARTS) units measure -sample:unit insts every
+ * -sample:period insts, SimPoint units are whole -simpoint:interval insts
+ * intervals picked by SimPoint, weighted by their phase's share of the run
+ */
+
+/* a sampling unit */
+struct sample_unit_t {
+  counter_t start;			/* first inst measured */
+  counter_t len;			/* insts measured */
+  double weight;			/* weight of the unit's CPI */
+};
+
+/* SimPoint units, sorted by start */
+static struct sample_unit_t *simpoints = NULL;
+static int simpoint_num = 0;
+
+/* position of a sampled run in the program, in insts */
+#define SAMPLE_POS		(sim_func_insn + sim_num_insn)
+
+/* sampling stats, the CPI ones are computed by sample_stats() */
+static counter_t sample_units = 0;	/* units measured */
+static counter_t sample_insn = 0;	/* insts measured */
+static counter_t sample_cycles = 0;	/* cycles measured */
+static double sample_cpi_sum = 0.0;	/* sum of weighted unit CPIs */
+static double sample_cpi_sum2 = 0.0;	/* sum of squared unit CPIs */
+static double sample_wsum = 0.0;	/* sum of unit weights */
+static double sample_cpi = 0.0;		/* estimated CPI */
+static double sample_cpi_sd = 0.0;	/* unit CPI standard deviation */
+static double sample_cpi_ci = 0.0;	/* CPI confidence interval */
+static double sample_cpi_err = 0.0;	/* relative CPI error */
+static double sample_units_needed = 0.0;/* units needed for -sample:err */
+
+/* the unit being simulated detailed, kept here rather than on the stack so
+   that a unit the program's exit cuts short can still be counted */
+static enum {
+  sample_in_none,			/* between units */
+  sample_in_warmup,			/* in the unit's detailed warm-up */
+  sample_in_unit			/* measuring the unit */
+} sample_state = sample_in_none;
+static struct sample_unit_t sample_cur;	/* the unit */
+static counter_t sample_insn0;		/* sim_num_insn at its start */
+static tick_t sample_cycle0;		/* sim_cycle at its start */
+
+/* compare SimPoint units by start, for qsort() */
+static int
+simpoint_compare(const void *a, const void *b)
+{
+  const struct sample_unit_t *ua = a, *ub = b;
+
+  return ua->start < ub->start ? -1 : ua->start > ub->start;
+}
+
+/* load the SimPoint simulation points in file FNAME, `<interval> <cluster>'
+   lines, and their weights in file WEIGHTS, `<weight> <cluster>' lines,
+   all points weigh the same without a weights file */
+static void
+simpoint_load(char *fname,			/* simulation points file */
+	      char *weights)			/* weights file, or NULL */
+{
+  FILE *fd;
+  int i, size = 0, cluster, *clusters = NULL;
+  unsigned long interval;
+  double weight;
+
+  if (!(fd = fopen(fname, "r")))
+    fatal("cannot open SimPoint file `%s'", fname);
+  while (fscanf(fd, "%lu %d", &interval, &cluster) == 2)
+    {
+      if (simpoint_num == size)
+	{
+	  size = size ? 2 * size : 16;
+	  simpoints = realloc(simpoints, size * sizeof(*simpoints));
+	  clusters = realloc(clusters, size * sizeof(int));
+	  if (!simpoints || !clusters)
+	    fatal("out of virtual memory");
+	}
+      simpoints[simpoint_num].start = (counter_t)interval * simpoint_interval;
+      simpoints[simpoint_num].len = simpoint_interval;
+      simpoints[simpoint_num].weight = 1.0;
+      clusters[simpoint_num++] = cluster;
+    }
+  if (!feof(fd))
+    fatal("SimPoint file `%s' is not `<interval> <cluster>' lines", fname);
+  fclose(fd);
+  if (!simpoint_num)
+    fatal("SimPoint file `%s' holds no simulation points", fname);
+
+  if (weights)
+    {
+      for (i=0; i < simpoint_num; i++)
+	simpoints[i].weight = -1.0;
+      if (!(fd = fopen(weights, "r")))
+	fatal("cannot open SimPoint weights file `%s'", weights);
+      while (fscanf(fd, "%lf %d", &weight, &cluster) == 2)
+	for (i=0; i < simpoint_num; i++)
+	  if (clusters[i] == cluster)
+	    simpoints[i].weight = weight;
+      if (!feof(fd))
+	fatal("SimPoint weights file `%s' is not `<weight> <cluster>' lines",
+	      weights);
+      fclose(fd);
+      for (i=0; i < simpoint_num; i++)
+	if (simpoints[i].weight < 0.0)
+	  fatal("SimPoint cluster %d has no weight", clusters[i]);
+    }
+  free(clusters);
+
+  qsort(simpoints, simpoint_num, sizeof(*simpoints), simpoint_compare);
+  for (i=1; i < simpoint_num; i++)
+    if (simpoints[i].start == simpoints[i-1].start)
+      fatal("SimPoint interval %lu listed twice",
+	    (unsigned long)(simpoints[i].start / simpoint_interval));
+}
+
+/* get sampling unit N into UNIT, returns FALSE past the last one */
+static int
+sample_next(int n,				/* unit number */
+	    struct sample_unit_t *unit)		/* unit, returned */
+{
+  if (simpoint_fname)
+    {
+      if (n >= simpoint_num)
+	return FALSE;
+      *unit = simpoints[n];
+    }
+  else
+    {
+      unit->start = (counter_t)n * sample_period + sample_period - sample_unit;
+      unit->len = sample_unit;
+      unit->weight = 1.0;
+    }
+  return TRUE;
+}
+
+/* sampled run is over? */
+#define SAMPLE_DONE()		(max_insts && SAMPLE_POS >= max_insts)
+
+/* run the program functionally up to inst POS, or up to -max:inst */
+static void
+sample_skip(counter_t pos)			/* inst to stop at */
+{
+  counter_t n;
+
+  if (max_insts && pos > max_insts)
+    pos = max_insts;
+  while (SAMPLE_POS < pos)
+    {
+      n = MIN(pos - SAMPLE_POS, 1 << 30);
+      sim_fastfwd((int)n, sample_warm);
+    }
+}
+
+/* run the pipeline up to inst POS, or up to -max:inst */
+static void
+sample_detail(counter_t pos)			/* inst to stop at */
+{
+  while (SAMPLE_POS < pos && !SAMPLE_DONE())
+    core_cycle();
+}
+
+/* drain the pipeline, and leave the program where its last committed inst
+   left it, ready to go on functionally */
+static void
+sample_drain_pipe(void)
+{
+  sample_drain = TRUE;
+  while (RUU_num > 0)
+    core_cycle();
+  sample_drain = FALSE;
+
+  regs.regs_PC = commit_next_PC;
+  regs.regs_NPC = regs.regs_PC + sizeof(md_inst_t);
+}
+
+/* set up the pipeline to resume detailed simulation at the program's PC */
+static void
+sample_resume(void)
+{
+  fetch_num = 0;
+  fetch_head = fetch_tail = 0;
+  fetch_miss_PC = 0;
+  ruu_fetch_issue_delay = 0;
+  FTQ_FLUSH();
+
+  fetch_regs_PC = regs.regs_PC - sizeof(md_inst_t);
+  fetch_pred_PC = regs.regs_PC;
+  regs.regs_PC = regs.regs_PC - sizeof(md_inst_t);
+}
+
+/* add the current unit, as measured so far, to the sampling stats */
+static void
+sample_add(void)
+{
+  double cpi;
+
+  if (sim_num_insn > sample_insn0)
+    {
+      cpi = ((double)(sim_cycle - sample_cycle0)
+	     / (double)(sim_num_insn - sample_insn0));
+      sample_units++;
+      sample_insn += sim_num_insn - sample_insn0;
+      sample_cycles += sim_cycle - sample_cycle0;
+      sample_cpi_sum += sample_cur.weight * cpi;
+      sample_cpi_sum2 += cpi * cpi;
+      sample_wsum += sample_cur.weight;
+    }
+  sample_state = sample_in_none;
+}
+
+/* simulate sampling unit UNIT detailed, from the start of its detailed
+   warm-up, and add it to the sampling stats */
+static void
+sample_measure(struct sample_unit_t *unit)	/* unit to simulate */
+{
+  sample_cur = *unit;
+
+  /* detailed warm-up */
+  sample_state = sample_in_warmup;
+  sample_resume();
+  sample_detail(unit->start);
+
+  /* measure the unit */
+  sample_state = sample_in_unit;
+  sample_insn0 = sim_num_insn;
+  sample_cycle0 = sim_cycle;
+  sample_detail(unit->start + unit->len);
+  sample_add();
+}
+
+#ifndef _MSC_VER
+/*
+ * parallel sampled simulation: the functional run forks a worker process
+ * per unit, each worker simulates its unit and sends its sampling sums and
+ * the changes to all stats back through a socket pair (not a pipe, which
+ * sim_private_files() would warn about), the functional run reaps
+ * the workers oldest first and adds their stats to its own at the end
+ */
+
+/* sampling sums a worker sends, followed by its stat changes */
+struct sample_result_t {
+  double cpi_sum;			/* sum of weighted unit CPIs */
+  double cpi_sum2;			/* sum of squared unit CPIs */
+  double wsum;				/* sum of unit weights */
+};
+
+/* a running worker */
+struct sample_worker_t {
+  pid_t pid;				/* worker process */
+  int fd;				/* parent's end of its result socket */
+};
+
+/* running workers, oldest first */
+static struct sample_worker_t *sample_workers = NULL;
+static int sample_nworkers = 0;
+
+/* this process is a worker? and its result socket */
+static int sample_worker = FALSE;
+static int sample_result_fd = -1;
+
+/* stat values, in stat_get_values() order: the worker's at its fork, and
+   the finished workers' changes still to be added */
+static int sample_nvals = 0;
+static double *sample_base = NULL;
+static double *sample_merge = NULL;
+static double *sample_vals = NULL;
+
+/* write NBYTES of BUF to socket FD */
+static void
+sample_write(int fd, void *buf, size_t nbytes)
+{
+  ssize_t n;
+
+  while (nbytes > 0)
+    {
+      n = write(fd, buf, nbytes);
+      if (n < 0)
+	fatal("cannot write sampling results");
+      buf = (char *)buf + n;
+      nbytes -= n;
+    }
+}
+
+/* read NBYTES from socket FD into BUF, returns FALSE at a short read */
+static int
+sample_read(int fd, void *buf, size_t nbytes)
+{
+  ssize_t n;
+
+  while (nbytes > 0)
+    {
+      n = read(fd, buf, nbytes);
+      if (n <= 0)
+	return FALSE;
+      buf = (char *)buf + n;
+      nbytes -= n;
+    }
+  return TRUE;
+}
+
+/* worker: send the sampling sums and stat changes, and exit */
+static void
+sample_send(void)
+{
+  struct sample_result_t res;
+  int i;
+
+  res.cpi_sum = sample_cpi_sum;
+  res.cpi_sum2 = sample_cpi_sum2;
+  res.wsum = sample_wsum;
+  stat_get_values(sim_sdb, sample_vals);
+  for (i=0; i < sample_nvals; i++)
+    sample_vals[i] -= sample_base[i];
+
+  sample_write(sample_result_fd, &res, sizeof(res));
+  sample_write(sample_result_fd, sample_vals, sample_nvals * sizeof(double));
+  _exit(0);
+}
+
+/* wait for the oldest worker and collect its results */
+static void
+sample_reap(void)
+{
+  struct sample_worker_t w = sample_workers[0];
+  struct sample_result_t res;
+  int i, ok, status;
+
+  sample_nworkers--;
+  memmove(sample_workers, sample_workers + 1,
+	  sample_nworkers * sizeof(struct sample_worker_t));
+
+  ok = (sample_read(w.fd, &res, sizeof(res))
+	&& sample_read(w.fd, sample_vals, sample_nvals * sizeof(double)));
+  close(w.fd);
+  if (waitpid(w.pid, &status, 0) < 0
+      || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || !ok)
+    {
+      warn("sampling worker %d failed, its unit is lost", (int)w.pid);
+      return;
+    }
+
+  sample_cpi_sum += res.cpi_sum;
+  sample_cpi_sum2 += res.cpi_sum2;
+  sample_wsum += res.wsum;
+  for (i=0; i < sample_nvals; i++)
+    sample_merge[i] += sample_vals[i];
+}
+
+/* fork a worker to simulate sampling unit UNIT, once a worker is free */
+static void
+sample_fork(struct sample_unit_t *unit)		/* unit to simulate */
+{
+  int i, fds[2];
+  pid_t pid;
+
+  if (!sample_workers)
+    {
+      sample_workers = calloc(sample_jobs, sizeof(struct sample_worker_t));
+      sample_nvals = stat_get_values(sim_sdb, NULL);
+      sample_base = calloc(sample_nvals + 1, sizeof(double));
+      sample_merge = calloc(sample_nvals + 1, sizeof(double));
+      sample_vals = calloc(sample_nvals + 1, sizeof(double));
+      if (!sample_workers || !sample_base || !sample_merge || !sample_vals)
+	fatal("out of virtual memory");
+    }
+
+  while (sample_nworkers >= sample_jobs)
+    sample_reap();
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    fatal("cannot create a sampling worker socket");
+
+  /* don't let the worker inherit unwritten output */
+  fflush(NULL);
+
+  pid = fork();
+  if (pid < 0)
+    fatal("cannot fork a sampling worker");
+  if (pid != 0)
+    {
+      close(fds[1]);
+      sample_workers[sample_nworkers].pid = pid;
+      sample_workers[sample_nworkers].fd = fds[0];
+      sample_nworkers++;
+      return;
+    }
+
+  /* worker: private files, no program output */
+  close(fds[0]);
+  for (i=0; i < sample_nworkers; i++)
+    close(sample_workers[i].fd);
+  sample_nworkers = 0;
+  sample_worker = TRUE;
+  sample_result_fd = fds[1];
+  sim_private_files();
+  sim_progfd = fopen("/dev/null", "w");
+  if (!sim_progfd)
+    fatal("cannot discard the program output of a sampling worker");
+
+  /* simulate the unit, starting the sums and stat changes from zero */
+  stat_get_values(sim_sdb, sample_base);
+  sample_cpi_sum = sample_cpi_sum2 = sample_wsum = 0.0;
+  sample_measure(unit);
+  sample_send();
+}
+
+/* wait for all workers, and add their stats to this process's */
+static void
+sample_finish(void)
+{
+  int i;
+
+  if (!sample_workers)
+    return;
+
+  while (sample_nworkers > 0)
+    sample_reap();
+  stat_add_values(sim_sdb, sample_merge);
+  for (i=0; i < sample_nvals; i++)
+    sample_merge[i] = 0.0;
+}
+#endif /* !_MSC_VER */
+
+/* sampled simulation main loop, returns at the last SimPoint unit or at
+   -max:inst, the program's exit ends the run as usual */
+static void
+sample_run(void)
+{
+  int n;
+  struct sample_unit_t unit;
+
+  for (n=0; sample_next(n, &unit) && !SAMPLE_DONE(); n++)
+    {
+      /* functional warming up to the unit's detailed warm-up */
+      sample_skip(unit.start > sample_warmup ? unit.start - sample_warmup : 0);
+      if (SAMPLE_DONE())
+	break;
+
+#ifndef _MSC_VER
+      /* leave the unit to a worker, and warm through it */
+      if (sample_jobs > 1)
+	{
+	  sample_fork(&unit);
+	  continue;
+	}
+#endif /* !_MSC_VER */
+
+      sample_measure(&unit);
+      sample_drain_pipe();
+    }
+}
+
+/* compute the CPI estimate and its confidence, before the stats print,
+   a worker sends its results instead, a parallel run collects them */
+static void
+sample_stats(void)
+{
+  double n, var;
+
+  /* the program exited in the middle of a unit, count the part of it that
+     ran, a unit still in its warm-up is lost along with its weight */
+  if (sample_state == sample_in_unit)
+    {
+      myfprintf(stderr, "sim: ** unit @ inst %n cut short by the program's "
+		"exit, measured %n of %n insts **\n", sample_cur.start,
+		sim_num_insn - sample_insn0, sample_cur.len);
+      sample_add();
+    }
+  else if (sample_state == sample_in_warmup)
+    {
+      warn("program exited in the warm-up of the unit @ inst %.0f, "
+	   "the unit and its weight (%g) are lost",
+	   (double)sample_cur.start, sample_cur.weight);
+      sample_state = sample_in_none;
+    }
+
+#ifndef _MSC_VER
+  if (sample_worker)
+    sample_send();
+  sample_finish();
+#endif /* !_MSC_VER */
+
+  n = (double)sample_units;
+  if (!sample_units)
+    return;
+
+  sample_cpi = sample_cpi_sum / sample_wsum;
+  if (simpoint_fname || sample_units < 2)
+    return;
+
+  /* sample variance of the unit CPIs, and the CPI's confidence interval */
+  var = (sample_cpi_sum2 - n * sample_cpi * sample_cpi) / (n - 1.0);
+  sample_cpi_sd = var > 0.0 ? sqrt(var) : 0.0;
+  sample_cpi_ci = sample_z * sample_cpi_sd / sqrt(n);
+  sample_cpi_err = sample_cpi_ci / sample_cpi;
+  sample_units_needed =
+    ceil(pow(sample_z * sample_cpi_sd / sample_cpi / sample_err, 2.0));
+}
+
+/* register the stats of a sampled run */
+static void
+sample_reg_stats(struct stat_sdb_t *sdb)	/* stats database */
+{
+  stat_reg_counter(sdb, "sample.units", "total number of units measured",
+		   &sample_units, 0, NULL);
+  stat_reg_counter(sdb, "sample.insn", "total number of insts measured",
+		   &sample_insn, 0, NULL);
+  stat_reg_counter(sdb, "sample.cycles", "total number of cycles measured",
+		   &sample_cycles, 0, NULL);
+  stat_reg_counter(sdb, "sample.func_insn",
+		   "total number of insts simulated functionally",
+		   &sim_func_insn, 0, NULL);
+  stat_reg_double(sdb, "sample.cpi",
+		  simpoint_fname
+		  ? "estimated CPI, weighted mean of the SimPoint units' CPI"
+		  : "estimated CPI, mean of the units' CPI",
+		  &sample_cpi, 0.0, NULL);
+  stat_reg_formula(sdb, "sample.ipc", "estimated IPC",
+		   "1 / sample.cpi", NULL);
+  if (!simpoint_fname)
+    {
+      stat_reg_double(sdb, "sample.cpi_stddev",
+		      "standard deviation of the units' CPI",
+		      &sample_cpi_sd, 0.0, NULL);
+      stat_reg_double(sdb, "sample.cpi_ci",
+		      "CPI confidence interval (+/-), for -sample:z",
+		      &sample_cpi_ci, 0.0, NULL);
+      stat_reg_double(sdb, "sample.cpi_err",
+		      "relative CPI error, of the confidence interval",
+		      &sample_cpi_err, 0.0, NULL);
+      stat_reg_double(sdb, "sample.units_needed",
+		      "units needed to reach -sample:err at -sample:z",
+		      &sample_units_needed, 0.0, "%12.0f");
+    }
+  sim_stats_hook(sample_stats);
+}
+
+/* start simulation, program loaded, processor precise state initialized */
+void
+sim_main(void)
+{
+  int i;
+
+  /* ignore any floating point exceptions, they may occur on mis-speculated
+     execution paths */
+  signal(SIGFPE, SIG_IGN);
+
+  /* sampled simulation alternates functional and detailed simulation */
+  if (sample_period || simpoint_fname)
+    {
+      regs.regs_PC = ld_prog_entry;
+      regs.regs_NPC = regs.regs_PC + sizeof(md_inst_t);
+
+      fprintf(stderr, "sim: ** starting sampled simulation **\n");
+      sample_run();
+      return;
+    }
+
+  /* set up the entry state of each thread */
+  sim_enter();
+
+  /* fork a timing simulator per -snapshot configuration from here, each
+     rebuilds the pipeline for its own configuration; the CMP cores run
+     on host threads, which fork() does not copy, and the SMT threads are
+     set up by sim_load_prog(), so only a single thread and core snapshot */
+  if (cmp_ncores == 1 && smt_nthreads == 1 && sim_snapshot() >= 0)
+    {
+      if (cmp_ncores != 1 || smt_nthreads != 1
+	  || sample_period || simpoint_fname)
+	fatal("snapshot configurations cannot add SMT threads, CMP cores "
+	      "or sampling");
+      core_pipe_init();
+      fprintf(stderr, "sim: ** starting snapshot timing simulation **\n");
+    }
+
+  fprintf(stderr, "sim: ** starting performance simulation **\n");
+
+#ifndef _MSC_VER
+  /* run core 0 along with the other CMP cores */
+  if (cmp_ncores > 1)
+    {
+      cores[0].exited = threads[0].exited;
+      cmp_sync();
+      cmp_run();
+      return;
+    }
+#endif /* !_MSC_VER */
+
+  /* main simulator loop */
+  for (;;)
+    {
+      core_cycle();
 
       /* finish early? */
       if (max_insts && sim_num_insn >= max_insts)
-	return;
+	{
+	  thread_switch(0);
+	  return;
+	}
+
+      /* all SMT threads exited? */
+      for (i=0; i < smt_nthreads && threads[i].exited; i++)
+	/* nada */;
+      if (i == smt_nthreads)
+	{
+	  thread_switch(0);
+	  return;
+	}
     }
 }
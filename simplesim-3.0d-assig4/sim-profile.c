@@ -100,6 +100,10 @@ static int prof_taddr /* = FALSE */;
 static int pcstat_nelt = 0;
 static char *pcstat_vars[MAX_PCSTAT_VARS];
 
+/* basic block vector output file and interval size, for SimPoint */
+static char *bbv_fname;
+static unsigned int bbv_interval;
+
 /* register simulator-specific options */
 void
 sim_reg_options(struct opt_odb_t *odb)
@@ -150,8 +154,18 @@ sim_reg_options(struct opt_odb_t *odb)
 		      "profile stat(s) against text addr's (mult uses ok)",
 		      pcstat_vars, MAX_PCSTAT_VARS, &pcstat_nelt, NULL,
 		      /* !print */FALSE, /* format */NULL, /* accrue */TRUE);
+
+  opt_reg_string(odb, "-bbv",
+		 "write SimPoint basic block vectors to file <fname>",
+		 &bbv_fname, /* default */NULL, /* print */TRUE, NULL);
+
+  opt_reg_uint(odb, "-bbv:interval", "insts per basic block vector",
+	       &bbv_interval, /* default */10000000, /* print */TRUE, NULL);
 }
 
+/* basic block vector output stream */
+static FILE *bbv_fd = NULL;
+
 /* check simulator-specific option values */
 void
 sim_check_options(struct opt_odb_t *odb, int argc, char **argv)
@@ -168,6 +182,14 @@ sim_check_options(struct opt_odb_t *odb, int argc, char **argv)
       prof_dsyms = TRUE;
       prof_taddr = TRUE;
     }
+
+  if (bbv_fname)
+    {
+      if (bbv_interval < 1)
+	fatal("basic block vector interval must be positive non-zero");
+      if (!(bbv_fd = fopen(bbv_fname, "w")))
+	fatal("cannot open basic block vector file `%s'", bbv_fname);
+    }
 }
 
 /* instruction classes */
@@ -282,6 +304,101 @@ static struct stat_stat_t *pcstat_stats[MAX_PCSTAT_VARS];
 static counter_t pcstat_lastvals[MAX_PCSTAT_VARS];
 static struct stat_stat_t *pcstat_sdists[MAX_PCSTAT_VARS];
 
+/* a basic block, by the PC it starts at */
+struct bbv_block_t {
+  struct bbv_block_t *next;		/* next block in hash bucket */
+  md_addr_t pc;				/* block start PC */
+  int id;				/* block id, 1 and up */
+  counter_t count;			/* insts executed in this interval */
+};
+
+/* basic blocks seen, hashed by start PC */
+#define BBV_HASH_SIZE		16384
+#define BBV_HASH(PC)		(((PC) >> 3) & (BBV_HASH_SIZE - 1))
+static struct bbv_block_t *bbv_htable[BBV_HASH_SIZE];
+
+/* blocks executed in the current interval, in first-execution order */
+static struct bbv_block_t **bbv_touched = NULL;
+static int bbv_ntouched = 0, bbv_touched_size = 0;
+
+/* block being executed, NULL at a block start */
+static struct bbv_block_t *bbv_cur = NULL;
+
+/* insts executed in the current interval */
+static unsigned int bbv_insn = 0;
+
+/* basic block vector stats */
+static int bbv_nblocks = 0;
+static counter_t bbv_nintervals = 0;
+
+/* get the basic block starting at PC, adding it if it is new */
+static struct bbv_block_t *
+bbv_block(md_addr_t pc)				/* block start PC */
+{
+  struct bbv_block_t *blk;
+
+  for (blk=bbv_htable[BBV_HASH(pc)]; blk; blk=blk->next)
+    if (blk->pc == pc)
+      return blk;
+
+  if (!(blk = calloc(1, sizeof(struct bbv_block_t))))
+    fatal("out of virtual memory");
+  blk->pc = pc;
+  blk->id = ++bbv_nblocks;
+  blk->next = bbv_htable[BBV_HASH(pc)];
+  bbv_htable[BBV_HASH(pc)] = blk;
+  return blk;
+}
+
+/* write the current interval's basic block vector, `T:<id>:<count> ...',
+   with each block's count in insts executed, and start a new interval */
+static void
+bbv_dump(void)
+{
+  int i;
+
+  fprintf(bbv_fd, "T");
+  for (i=0; i < bbv_ntouched; i++)
+    {
+      myfprintf(bbv_fd, ":%d:%n ", bbv_touched[i]->id, bbv_touched[i]->count);
+      bbv_touched[i]->count = 0;
+    }
+  fprintf(bbv_fd, "\n");
+
+  bbv_ntouched = 0;
+  bbv_insn = 0;
+  bbv_nintervals++;
+}
+
+/* profile the executed inst at PC, with operation flags FLAGS */
+static void
+bbv_profile(md_addr_t pc,			/* inst PC */
+	    unsigned int flags)			/* inst flags */
+{
+  if (!bbv_cur)
+    bbv_cur = bbv_block(pc);
+
+  if (!bbv_cur->count++)
+    {
+      if (bbv_ntouched == bbv_touched_size)
+	{
+	  bbv_touched_size = bbv_touched_size ? 2 * bbv_touched_size : 1024;
+	  bbv_touched = realloc(bbv_touched, bbv_touched_size
+				* sizeof(struct bbv_block_t *));
+	  if (!bbv_touched)
+	    fatal("out of virtual memory");
+	}
+      bbv_touched[bbv_ntouched++] = bbv_cur;
+    }
+
+  /* control transfers end the block, a block spanning two intervals counts
+     in both */
+  if (flags & F_CTRL)
+    bbv_cur = NULL;
+  if (++bbv_insn == bbv_interval)
+    bbv_dump();
+}
+
 /* wedge all stat values into a counter_t */
 #define STATVAL(STAT)							\
   ((STAT)->sc == sc_int							\
@@ -485,6 +602,15 @@ sim_reg_stats(struct stat_sdb_t *sdb)
 					/* format */"0x%p %u %.2f",
 					/* print fn */NULL);
     }
+  if (bbv_fd)
+    {
+      stat_reg_int(sdb, "bbv.blocks", "total number of basic blocks seen",
+		   &bbv_nblocks, 0, NULL);
+      stat_reg_counter(sdb, "bbv.intervals",
+		       "total number of full-interval vectors written",
+		       &bbv_nintervals, 0, NULL);
+    }
+
   ld_reg_stats(sdb);
   mem_reg_stats(mem, sdb);
 }
@@ -548,7 +674,14 @@ sim_aux_stats(FILE *stream)		/* output stream */
 void
 sim_uninit(void)
 {
-  /* nada */
+  /* write the last, partial, basic block vector */
+  if (bbv_fd)
+    {
+      if (bbv_ntouched)
+	bbv_dump();
+      fclose(bbv_fd);
+      bbv_fd = NULL;
+    }
 }
 
 
@@ -707,6 +840,9 @@ sim_main(void)
 	  panic("attempted to execute a bogus opcode");
       }
 
+      if (fault != md_fault_none)
+	fatal("fault (%d) detected @ 0x%08p", fault, regs.regs_PC);
+
       if (MD_OP_FLAGS(op) & F_MEM)
 	{
 	  sim_num_refs++;
@@ -851,6 +987,12 @@ sim_main(void)
 	  stat_add_sample(taddr_prof, regs.regs_PC);
 	}
 
+      if (bbv_fd)
+	{
+	  /* add the inst to its basic block's count */
+	  bbv_profile(regs.regs_PC, flags);
+	}
+
       /* update any stats tracked by PC */
       for (i=0; i<pcstat_nelt; i++)
 	{
@@ -64,6 +64,10 @@
 /* set to non-zero when simulator should dump statistics */
 extern int sim_dump_stats;
 
+/* non-zero in a simulator that forked -snapshot children, it only waited
+   for them and must not write to the files they have taken over */
+extern int sim_snapshot_parent;
+
 /* exit when this becomes non-zero */
 extern int sim_exit_now;
 
@@ -138,4 +142,24 @@ void sim_uninit(void);
 void
 sim_print_stats(FILE *fd);		/* output stream */
 
+/* register FN to be called by sim_print_stats() before the stats are
+   printed, e.g., to bring stats kept by other threads up to date */
+void
+sim_stats_hook(void (*fn)(void));	/* stats hook function */
+
+/* fork one child simulator per -snapshot configuration file from the
+   current architected state, called by a simulator once it has fast
+   forwarded to the point of interest; each child re-reads its -config
+   file on top of the original options, re-runs sim_check_options() and
+   sim_reg_stats(), redirects its output to <prefix>.<n>.simout/progout,
+   and returns the (zero-based) snapshot number to continue simulating;
+   the parent waits for all children and exits, returns -1 if no
+   snapshots were requested */
+int sim_snapshot(void);
+
+/* give this process private copies of all regular files it has open,
+   standard input included, so file offsets are no longer shared with the
+   processes it was forked from */
+void sim_private_files(void);
+
 #endif /* SIM_H */
@@ -1026,6 +1026,87 @@ stat_find_stat(struct stat_sdb_t *sdb,	/* stat database */
   return stat;
 }
 
+/* get the values of all integer and floating point stats in SDB into VALS,
+   if ADD is zero, else add VALS to them, returns the number of values */
+static int
+stat_values(struct stat_sdb_t *sdb,	/* stat database */
+	    double *vals,		/* values */
+	    int add)			/* add VALS to the stats? */
+{
+  struct stat_stat_t *stat;
+  int i, n = 0;
+
+#define STAT_VALUE(VAR, TYPE)						\
+  do {									\
+    if (add)								\
+      (VAR) = (TYPE)((VAR) + vals[n]);					\
+    else if (vals)							\
+      vals[n] = (double)(VAR);						\
+    n++;								\
+  } while (0)
+
+  for (stat = sdb->stats; stat != NULL; stat = stat->next)
+    {
+      switch (stat->sc)
+	{
+	case sc_int:
+	  STAT_VALUE(*stat->variant.for_int.var, int);
+	  break;
+	case sc_uint:
+	  STAT_VALUE(*stat->variant.for_uint.var, unsigned int);
+	  break;
+#ifdef HOST_HAS_QWORD
+	case sc_qword:
+	  STAT_VALUE(*stat->variant.for_qword.var, qword_t);
+	  break;
+	case sc_sqword:
+	  STAT_VALUE(*stat->variant.for_sqword.var, sqword_t);
+	  break;
+#endif /* HOST_HAS_QWORD */
+	case sc_float:
+	  STAT_VALUE(*stat->variant.for_float.var, float);
+	  break;
+	case sc_double:
+	  STAT_VALUE(*stat->variant.for_double.var, double);
+	  break;
+	case sc_dist:
+	  for (i=0; i < stat->variant.for_dist.arr_sz; i++)
+	    STAT_VALUE(stat->variant.for_dist.arr[i], unsigned int);
+	  STAT_VALUE(stat->variant.for_dist.overflows, unsigned int);
+	  break;
+	case sc_sdist:
+	case sc_formula:
+	  break;
+	default:
+	  panic("bogus stat class");
+	}
+    }
+#undef STAT_VALUE
+
+  return n;
+}
+
+/* get the values of all integer and floating point stats, and the buckets
+   of all array distributions, in stat database SDB into VALS, in the order
+   the stats were registered, returns the number of values, VALS may be NULL
+   to just count them; sparse distributions and formulas are left out */
+int
+stat_get_values(struct stat_sdb_t *sdb,	/* stat database */
+		double *vals)		/* values, returned */
+{
+  return stat_values(sdb, vals, /* add */FALSE);
+}
+
+/* add VALS, in the order stat_get_values() returns them, to the stats in
+   stat database SDB, e.g., to merge the stats of another simulator
+   process running the same configuration */
+void
+stat_add_values(struct stat_sdb_t *sdb,	/* stat database */
+		double *vals)		/* values to add */
+{
+  stat_values(sdb, vals, /* add */TRUE);
+}
+
 #ifdef TESTIT
 
 void
@@ -328,5 +328,20 @@ stat_print_stats(struct stat_sdb_t *sdb,/* stat database */
 struct stat_stat_t *
 stat_find_stat(struct stat_sdb_t *sdb,	/* stat database */
 	       char *stat_name);	/* stat name */
+
+/* get the values of all integer and floating point stats, and the buckets
+   of all array distributions, in stat database SDB into VALS, in the order
+   the stats were registered, returns the number of values, VALS may be NULL
+   to just count them; sparse distributions and formulas are left out */
+int
+stat_get_values(struct stat_sdb_t *sdb,	/* stat database */
+		double *vals);		/* values, returned */
+
+/* add VALS, in the order stat_get_values() returns them, to the stats in
+   stat database SDB, e.g., to merge the stats of another simulator
+   process running the same configuration */
+void
+stat_add_values(struct stat_sdb_t *sdb,	/* stat database */
+		double *vals);		/* values to add */
 	       
 #endif /* STAT_H */
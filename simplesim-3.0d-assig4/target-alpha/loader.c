@@ -72,37 +72,37 @@
 #define TEXT_TAIL_PADDING 0 /* was: 128 */
 
 /* program text (code) segment base */
-md_addr_t ld_text_base = 0;
+HOST_TLS md_addr_t ld_text_base = 0;
 
 /* program text (code) size in bytes */
-unsigned int ld_text_size = 0;
+HOST_TLS unsigned int ld_text_size = 0;
 
 /* program initialized data segment base */
-md_addr_t ld_data_base = 0;
+HOST_TLS md_addr_t ld_data_base = 0;
 
 /* top of the data segment */
-md_addr_t ld_brk_point = 0;
+HOST_TLS md_addr_t ld_brk_point = 0;
 
 /* program initialized ".data" and uninitialized ".bss" size in bytes */
-unsigned int ld_data_size = 0;
+HOST_TLS unsigned int ld_data_size = 0;
 
 /* program stack segment base (highest address in stack) */
-md_addr_t ld_stack_base = 0;
+HOST_TLS md_addr_t ld_stack_base = 0;
 
 /* program initial stack size */
-unsigned int ld_stack_size = 0;
+HOST_TLS unsigned int ld_stack_size = 0;
 
 /* lowest address accessed on the stack */
-md_addr_t ld_stack_min = -1;
+HOST_TLS md_addr_t ld_stack_min = -1;
 
 /* program file name */
-char *ld_prog_fname = NULL;
+HOST_TLS char *ld_prog_fname = NULL;
 
 /* program entry point (initial PC) */
-md_addr_t ld_prog_entry = 0;
+HOST_TLS md_addr_t ld_prog_entry = 0;
 
 /* program environment base address address */
-md_addr_t ld_environ_base = 0;
+HOST_TLS md_addr_t ld_environ_base = 0;
 
 /* target executable endian-ness, non-zero if big endian */
 int ld_target_big_endian;
@@ -180,7 +180,19 @@ ld_load_prog(char *fname,		/* program to load */
 	fatal("bad initial checkpoint in EIO file");
 
       /* load checkpoint? */
-      if (sim_chkpt_fname != NULL)
+      if (sim_chkpt_fname != NULL && sim_chkpt_fname[0] == '#')
+	{
+	  counter_t chkpt_icnt;
+
+	  /* restore a checkpoint interleaved into the EIO trace itself */
+	  if (sscanf(sim_chkpt_fname+1, "%Ld", &chkpt_icnt) != 1)
+	    fatal("cannot parse EIO trace checkpoint `%s', use #<icnt>",
+		  sim_chkpt_fname);
+	  chkpt_icnt = eio_seek_chkpt(sim_eio_fd, chkpt_icnt, regs, mem);
+	  myfprintf(stderr, "sim: restored EIO trace checkpoint @ inst %n\n",
+		    chkpt_icnt);
+	}
+      else if (sim_chkpt_fname != NULL)
 	{
 	  counter_t restore_icnt;
 
@@ -189,15 +201,23 @@ ld_load_prog(char *fname,		/* program to load */
 	  fprintf(stderr, "sim: loading checkpoint file: %s\n",
 		  sim_chkpt_fname);
 
-	  if (!eio_valid(sim_chkpt_fname))
-	    fatal("file `%s' does not appear to be a checkpoint file",
-		  sim_chkpt_fname);
-
-	  /* open the checkpoint file */
-	  chkpt_fd = eio_open(sim_chkpt_fname);
-
-	  /* load the state image */
-	  restore_icnt = eio_read_chkpt(regs, mem, chkpt_fd);
+	  if (eio_bin_valid(sim_chkpt_fname))
+	    {
+	      /* load the binary state image */
+	      restore_icnt = eio_read_bin_chkpt(regs, mem, sim_chkpt_fname);
+	    }
+	  else
+	    {
+	      if (!eio_valid(sim_chkpt_fname))
+		fatal("file `%s' does not appear to be a checkpoint file",
+		      sim_chkpt_fname);
+
+	      /* open the checkpoint file */
+	      chkpt_fd = eio_open(sim_chkpt_fname);
+
+	      /* load the state image */
+	      restore_icnt = eio_read_chkpt(regs, mem, chkpt_fd);
+	    }
 
 	  /* fast forward the baseline EIO trace to checkpoint location */
 	  myfprintf(stderr, "sim: fast forwarding to instruction %n\n",
@@ -0,0 +1,70 @@
+#
+#	test-shm.s: Test memory shared by CMP cores (sim-outorder -cmp:shm).
+#
+#	Run one copy with no arguments on core 0 and one with an argument
+#	on core 1, with at least a page of shared memory, e.g.:
+#
+#	  sim-outorder -cmp:cores 2 -cmp:shm 4096 \
+#		-cmp:prog "test-shm 1" test-shm
+#
+#	Each copy bumps its own word of a shared cache block COUNT times,
+#	reading the other copy's word as it goes, then raises its flag,
+#	waits for the other copy's flag, checks that both words are COUNT,
+#	and prints "shm ok" (or "shm bad", exiting 1).  Built with
+#	-nostdlib, it makes its own system calls.
+#
+	.data
+ok:	.ascii		"shm ok\n"
+bad:	.ascii		"shm bad\n"
+
+	.text
+	.globl		__start
+__start:
+	lw	$16, 0($29)		# argc
+	lui	$8, 0x6000		# the shared memory, at 0x60000000
+	addiu	$9, $16, -1		# this copy's word, 0 or 1
+	sll	$9, $9, 2
+	addu	$17, $8, $9
+	xori	$18, $17, 4		# the other copy's word
+	ori	$11, $0, 20000		# COUNT
+	addu	$10, $0, $0
+
+bump:
+	lw	$12, 0($17)
+	addiu	$12, $12, 1
+	sw	$12, 0($17)
+	lw	$13, 0($18)
+	addiu	$10, $10, 1
+	bne	$10, $11, bump
+
+	addiu	$12, $0, 1		# raise this copy's flag, a block away
+	sw	$12, 64($17)
+	lui	$14, 0x10		# give up after 1M polls, e.g., when
+wait:					# the memory is not shared
+	lw	$13, 64($18)
+	addiu	$14, $14, -1
+	beq	$14, $0, fail
+	beq	$13, $0, wait
+
+	lw	$13, 0($18)
+	bne	$13, $11, fail
+	lw	$13, 0($17)
+	bne	$13, $11, fail
+
+	la	$5, ok
+	addiu	$6, $0, 7
+	addu	$16, $0, $0
+	b	done
+
+fail:
+	la	$5, bad
+	addiu	$6, $0, 8
+	addiu	$16, $0, 1
+
+done:
+	addiu	$4, $0, 1		# write(1, msg, len)
+	addiu	$2, $0, 4
+	syscall
+	addu	$4, $0, $16		# exit(status)
+	addiu	$2, $0, 1
+	syscall